@@ -0,0 +1,184 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+
+struct AllocatorCounters {
+	atomic_size_t allocations;
+	atomic_size_t bytes;
+	atomic_size_t current_bytes;
+	atomic_size_t peak_bytes;
+};
+
+// Prepended to every block of the counting allocator so that
+// counting_free() knows how much to give back.
+union CountingHeader {
+	size_t size;
+	long double align;
+};
+
+static void *default_alloc(void *, enum AllocatorSubsystem, size_t);
+static void default_free(void *, enum AllocatorSubsystem, void *);
+static void *counting_alloc(void *, enum AllocatorSubsystem, size_t);
+static void counting_free(void *, enum AllocatorSubsystem, void *);
+
+static const char *subsystem_names[ALLOCATOR__N] = {
+	[ALLOCATOR_TOKENS] = "tokens",
+	[ALLOCATOR_OUTPUT] = "output",
+	[ALLOCATOR_METADATA] = "metadata",
+	[ALLOCATOR_LOG] = "log",
+};
+
+static const struct Allocator default_allocator = {
+	.alloc = default_alloc,
+	.free = default_free,
+	.userdata = NULL,
+};
+
+static struct AllocatorCounters counters[ALLOCATOR__N];
+static const struct Allocator counting_allocator = {
+	.alloc = counting_alloc,
+	.free = counting_free,
+	.userdata = counters,
+};
+
+static const struct Allocator *allocator = &default_allocator;
+
+void *
+default_alloc(void *userdata, enum AllocatorSubsystem subsystem, size_t size)
+{
+	void *p = calloc(1, size);
+	if (p == NULL) {
+		err(1, "calloc");
+	}
+	return p;
+}
+
+void
+default_free(void *userdata, enum AllocatorSubsystem subsystem, void *p)
+{
+	free(p);
+}
+
+void *
+counting_alloc(void *userdata, enum AllocatorSubsystem subsystem, size_t size)
+{
+	struct AllocatorCounters *c = (struct AllocatorCounters *)userdata + subsystem;
+	union CountingHeader *header = default_alloc(NULL, subsystem, sizeof(union CountingHeader) + size);
+	header->size = size;
+
+	atomic_fetch_add_explicit(&c->allocations, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&c->bytes, size, memory_order_relaxed);
+	size_t current = atomic_fetch_add_explicit(&c->current_bytes, size, memory_order_relaxed) + size;
+	size_t peak = atomic_load_explicit(&c->peak_bytes, memory_order_relaxed);
+	while (current > peak && !atomic_compare_exchange_weak(&c->peak_bytes, &peak, current));
+
+	return header + 1;
+}
+
+void
+counting_free(void *userdata, enum AllocatorSubsystem subsystem, void *p)
+{
+	if (p == NULL) {
+		return;
+	}
+	struct AllocatorCounters *c = (struct AllocatorCounters *)userdata + subsystem;
+	union CountingHeader *header = (union CountingHeader *)p - 1;
+	atomic_fetch_sub_explicit(&c->current_bytes, header->size, memory_order_relaxed);
+	free(header);
+}
+
+void
+allocator_set(const struct Allocator *new_allocator)
+{
+	if (new_allocator == NULL) {
+		allocator = &default_allocator;
+	} else {
+		allocator = new_allocator;
+	}
+}
+
+const struct Allocator *
+allocator_counting()
+{
+	return &counting_allocator;
+}
+
+void
+allocator_stats(enum AllocatorSubsystem subsystem, struct AllocatorStats *stats)
+{
+	struct AllocatorCounters *c = &counters[subsystem];
+	stats->allocations = atomic_load_explicit(&c->allocations, memory_order_relaxed);
+	stats->bytes = atomic_load_explicit(&c->bytes, memory_order_relaxed);
+	stats->current_bytes = atomic_load_explicit(&c->current_bytes, memory_order_relaxed);
+	stats->peak_bytes = atomic_load_explicit(&c->peak_bytes, memory_order_relaxed);
+}
+
+const char *
+allocator_subsystem_tostring(enum AllocatorSubsystem subsystem)
+{
+	return subsystem_names[subsystem];
+}
+
+void *
+allocator_alloc(enum AllocatorSubsystem subsystem, size_t size)
+{
+	return allocator->alloc(allocator->userdata, subsystem, size);
+}
+
+void
+allocator_free(enum AllocatorSubsystem subsystem, void *p)
+{
+	if (p) {
+		allocator->free(allocator->userdata, subsystem, p);
+	}
+}
+
+char *
+allocator_strdup(enum AllocatorSubsystem subsystem, const char *s)
+{
+	return allocator_strndup(subsystem, s, strlen(s));
+}
+
+char *
+allocator_strndup(enum AllocatorSubsystem subsystem, const char *s, size_t len)
+{
+	len = strnlen(s, len);
+	char *p = allocator_alloc(subsystem, len + 1);
+	memcpy(p, s, len);
+	return p;
+}
@@ -0,0 +1,65 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+enum AllocatorSubsystem {
+	ALLOCATOR_TOKENS,
+	ALLOCATOR_OUTPUT,
+	ALLOCATOR_METADATA,
+	ALLOCATOR_LOG,
+	ALLOCATOR__N,
+};
+
+// Hooks for embedders that want to serve parser memory from their
+// own arenas.  alloc() must return zeroed memory or not return at all.
+// The allocator has to be installed before the first allocation since
+// every pointer is handed back to the free() hook that was active when
+// it is released.
+struct Allocator {
+	void *(*alloc)(void *, enum AllocatorSubsystem, size_t);
+	void (*free)(void *, enum AllocatorSubsystem, void *);
+	void *userdata;
+};
+
+struct AllocatorStats {
+	size_t allocations;
+	size_t bytes;
+	size_t current_bytes;
+	size_t peak_bytes;
+};
+
+void allocator_set(const struct Allocator *);
+const struct Allocator *allocator_counting(void);
+void allocator_stats(enum AllocatorSubsystem, struct AllocatorStats *);
+const char *allocator_subsystem_tostring(enum AllocatorSubsystem);
+
+void *allocator_alloc(enum AllocatorSubsystem, size_t);
+void allocator_free(enum AllocatorSubsystem, void *);
+char *allocator_strdup(enum AllocatorSubsystem, const char *);
+char *allocator_strndup(enum AllocatorSubsystem, const char *, size_t);
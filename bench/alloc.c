@@ -0,0 +1,194 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench/alloc.h"
+
+/*
+ * Count heap allocations done by libportfmt and libias by
+ * interposing malloc(3) and friends.  The real functions are looked
+ * up lazily with dlsym(3).  dlsym(3) itself might want to allocate
+ * memory while we are still resolving, so serve those requests from
+ * a small static arena that is never freed.
+ */
+
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void (*real_free)(void *);
+static void *(*real_malloc)(size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+
+static char bootstrap_arena[4096];
+static size_t bootstrap_used;
+static int resolving;
+static struct BenchAllocStats stats;
+
+static void *bootstrap_alloc(size_t);
+static int bootstrap_owns(void *);
+static void resolve(void);
+
+void *
+bootstrap_alloc(size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	if (bootstrap_used + size > sizeof(bootstrap_arena)) {
+		return NULL;
+	}
+	void *p = bootstrap_arena + bootstrap_used;
+	bootstrap_used += size;
+	return p;
+}
+
+int
+bootstrap_owns(void *p)
+{
+	return (char *)p >= bootstrap_arena &&
+		(char *)p < bootstrap_arena + sizeof(bootstrap_arena);
+}
+
+void
+resolve()
+{
+	if (real_malloc) {
+		return;
+	}
+	resolving = 1;
+	real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+	real_calloc = dlsym(RTLD_NEXT, "calloc");
+	real_free = dlsym(RTLD_NEXT, "free");
+	real_malloc = dlsym(RTLD_NEXT, "malloc");
+	real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+	real_realloc = dlsym(RTLD_NEXT, "realloc");
+	resolving = 0;
+	if (!real_aligned_alloc || !real_calloc || !real_free || !real_malloc ||
+	    !real_posix_memalign || !real_realloc) {
+		abort();
+	}
+}
+
+void *
+malloc(size_t size)
+{
+	if (resolving) {
+		return bootstrap_alloc(size);
+	}
+	resolve();
+	stats.allocations++;
+	stats.bytes += size;
+	return real_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	if (resolving) {
+		// The arena is static and thus already zeroed
+		return bootstrap_alloc(nmemb * size);
+	}
+	resolve();
+	stats.allocations++;
+	stats.bytes += nmemb * size;
+	return real_calloc(nmemb, size);
+}
+
+void *
+realloc(void *p, size_t size)
+{
+	if (resolving) {
+		return bootstrap_alloc(size);
+	}
+	resolve();
+	stats.allocations++;
+	stats.bytes += size;
+	if (bootstrap_owns(p)) {
+		void *newp = real_malloc(size);
+		if (newp) {
+			size_t avail = bootstrap_arena + sizeof(bootstrap_arena) - (char *)p;
+			memcpy(newp, p, size < avail ? size : avail);
+		}
+		return newp;
+	}
+	return real_realloc(p, size);
+}
+
+// The arena only guarantees 16 byte alignment so larger alignments
+// cannot be served from it while resolving
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+	if (resolving) {
+		return alignment <= 16 ? bootstrap_alloc(size) : NULL;
+	}
+	resolve();
+	stats.allocations++;
+	stats.bytes += size;
+	return real_aligned_alloc(alignment, size);
+}
+
+int
+posix_memalign(void **p, size_t alignment, size_t size)
+{
+	if (resolving) {
+		*p = alignment <= 16 ? bootstrap_alloc(size) : NULL;
+		return *p ? 0 : ENOMEM;
+	}
+	resolve();
+	stats.allocations++;
+	stats.bytes += size;
+	return real_posix_memalign(p, alignment, size);
+}
+
+void
+free(void *p)
+{
+	if (p == NULL || bootstrap_owns(p)) {
+		return;
+	}
+	resolve();
+	real_free(p);
+}
+
+void
+bench_alloc_reset()
+{
+	stats.allocations = 0;
+	stats.bytes = 0;
+}
+
+struct BenchAllocStats
+bench_alloc_stats()
+{
+	return stats;
+}
@@ -0,0 +1,655 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "bench/alloc.h"
+#include "bench/compare.h"
+#include "bench/stress.h"
+#include "parser.h"
+#include "parser/edits.h"
+
+enum BenchPhase {
+	BENCH_PHASE_READ,
+	BENCH_PHASE_READ_FINISH,
+	BENCH_PHASE_OUTPUT,
+	BENCH_PHASE_EDIT,
+	BENCH_PHASE_PASS,
+};
+
+struct BenchCase {
+	const char *name;
+	enum BenchPhase phase;
+	enum ParserBehavior behavior;
+	ParserEditFn edit;
+	void *userdata;
+};
+
+struct BenchPassArgs {
+	struct ParserEdit edit;
+	struct ParserEditOutput output;
+	int status;
+};
+
+struct BenchInput {
+	char *buf;
+	size_t len;
+};
+
+struct BenchCorpus {
+	char *name;
+	struct Array *inputs;
+	size_t bytes;
+	size_t tokens;
+};
+
+struct BenchResult {
+	double seconds;
+	size_t allocations;
+	size_t allocated_bytes;
+	long peak_rss_kb;
+	size_t tokens_in;
+	size_t tokens_out;
+};
+
+enum BenchMetric {
+	BENCH_METRIC_MB_PER_S,
+	BENCH_METRIC_TOKENS_PER_S,
+	BENCH_METRIC_ALLOCATIONS,
+	BENCH_METRIC_ALLOCATED_BYTES,
+	BENCH_METRIC_PEAK_RSS_KB,
+	BENCH_METRIC__N,
+};
+
+static void bench_case_compare(struct BenchCompare *, const struct BenchCase *, struct BenchCorpus *, size_t, struct BenchResult *, size_t);
+static void bench_case_run(const struct BenchCase *, struct BenchCorpus *, size_t, struct BenchResult *);
+static void bench_case_fork(const struct BenchCase *, struct BenchCorpus *, size_t, struct BenchResult *);
+static void bench_corpus_add(struct BenchCorpus *, char *, size_t);
+static void bench_corpus_count_tokens(struct BenchCorpus *);
+static void bench_corpus_free(struct BenchCorpus *);
+static struct BenchCorpus *bench_corpus_new(const char *);
+static struct Parser *bench_parser_new(const struct BenchCase *, struct BenchInput *, int);
+static struct BenchCase *bench_pass_cases(void);
+static int bench_pass_implicit(const struct BenchCase *);
+static void *bench_pass_userdata(const struct BenchCase *, struct BenchPassArgs *);
+static void bench_print_result(const struct BenchCase *, struct BenchCorpus *, size_t, struct BenchResult *, int);
+static double bench_result_metric(struct BenchCorpus *, size_t, struct BenchResult *, enum BenchMetric);
+static int compare_seconds(const void *, const void *);
+static double elapsed(struct timespec *, struct timespec *);
+static PARSER_EDIT(count_tokens);
+static char *slurp(const char *, size_t *);
+static void usage(void);
+
+#define PORTFMT_BEHAVIOR (PARSER_COLLAPSE_ADJACENT_VARIABLES | \
+	PARSER_DEDUP_TOKENS | PARSER_OUTPUT_REFORMAT | \
+	PARSER_ALLOW_FUZZY_MATCHING | PARSER_SANITIZE_COMMENTS)
+#define PORTCLIPPY_BEHAVIOR PARSER_OUTPUT_RAWLINES
+
+static int lint_order_status;
+static const struct BenchCase cases[] = {
+	{ "parser_read_from_buffer", BENCH_PHASE_READ, PORTFMT_BEHAVIOR, NULL, NULL },
+	{ "parser_read_finish", BENCH_PHASE_READ_FINISH, PORTFMT_BEHAVIOR, NULL, NULL },
+	{ "output.reformat", BENCH_PHASE_OUTPUT, PORTFMT_BEHAVIOR, NULL, NULL },
+	{ "output.diff", BENCH_PHASE_OUTPUT, PORTFMT_BEHAVIOR | PARSER_OUTPUT_DIFF, NULL, NULL },
+	{ "output.dump-tokens", BENCH_PHASE_OUTPUT, PORTFMT_BEHAVIOR | PARSER_OUTPUT_DUMP_TOKENS, NULL, NULL },
+	{ "lint.bsd-port", BENCH_PHASE_EDIT, PORTCLIPPY_BEHAVIOR, lint_bsd_port, NULL },
+	{ "lint.clones", BENCH_PHASE_EDIT, PORTCLIPPY_BEHAVIOR, lint_clones, NULL },
+	{ "lint.commented-portrevision", BENCH_PHASE_EDIT, PORTCLIPPY_BEHAVIOR, lint_commented_portrevision, NULL },
+	{ "lint.order", BENCH_PHASE_EDIT, PORTCLIPPY_BEHAVIOR, lint_order, &lint_order_status },
+};
+
+static const struct {
+	const char *name;
+	enum BenchCompareDirection direction;
+} metrics[BENCH_METRIC__N] = {
+	[BENCH_METRIC_MB_PER_S] = { "mb_per_s", BENCH_COMPARE_HIGHER_IS_BETTER },
+	[BENCH_METRIC_TOKENS_PER_S] = { "tokens_per_s", BENCH_COMPARE_HIGHER_IS_BETTER },
+	[BENCH_METRIC_ALLOCATIONS] = { "allocations", BENCH_COMPARE_LOWER_IS_BETTER },
+	[BENCH_METRIC_ALLOCATED_BYTES] = { "allocated_bytes", BENCH_COMPARE_LOWER_IS_BETTER },
+	[BENCH_METRIC_PEAK_RSS_KB] = { "peak_rss_kb", BENCH_COMPARE_LOWER_IS_BETTER },
+};
+
+static FILE *devnull;
+
+void
+usage()
+{
+	fprintf(stderr, "usage: portfmt-bench [-p] [-c baseline] [-n iterations] [-r runs] [-s stress-size]\n"
+		"                     [-t threshold] [file ...]\n");
+	exit(EX_USAGE);
+}
+
+int
+compare_seconds(const void *ap, const void *bp)
+{
+	const struct BenchResult *a = ap;
+	const struct BenchResult *b = bp;
+	return (a->seconds > b->seconds) - (a->seconds < b->seconds);
+}
+
+double
+elapsed(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+char *
+slurp(const char *path, size_t *len)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return NULL;
+	}
+	char *buf = xmalloc(st.st_size + 1);
+	size_t off = 0;
+	while (off < (size_t)st.st_size) {
+		ssize_t n = read(fd, buf + off, st.st_size - off);
+		if (n <= 0) {
+			free(buf);
+			close(fd);
+			return NULL;
+		}
+		off += n;
+	}
+	close(fd);
+	*len = off;
+	return buf;
+}
+
+PARSER_EDIT(count_tokens)
+{
+	size_t *tokens = userdata;
+	*tokens += array_len(ptokens);
+	return NULL;
+}
+
+struct BenchCorpus *
+bench_corpus_new(const char *name)
+{
+	struct BenchCorpus *corpus = xmalloc(sizeof(struct BenchCorpus));
+	corpus->name = xstrdup(name);
+	corpus->inputs = array_new();
+	return corpus;
+}
+
+void
+bench_corpus_add(struct BenchCorpus *corpus, char *buf, size_t len)
+{
+	struct BenchInput *input = xmalloc(sizeof(struct BenchInput));
+	input->buf = buf;
+	input->len = len;
+	array_append(corpus->inputs, input);
+	corpus->bytes += len;
+}
+
+void
+bench_corpus_count_tokens(struct BenchCorpus *corpus)
+{
+	corpus->tokens = 0;
+	ARRAY_FOREACH(corpus->inputs, struct BenchInput *, input) {
+		struct Parser *parser = bench_parser_new(&cases[0], input, 1);
+		if (parser_edit(parser, count_tokens, &corpus->tokens) != PARSER_ERROR_OK) {
+			errx(1, "%s: %s", corpus->name, parser_error_tostring(parser));
+		}
+		parser_free(parser);
+	}
+}
+
+void
+bench_corpus_free(struct BenchCorpus *corpus)
+{
+	ARRAY_FOREACH(corpus->inputs, struct BenchInput *, input) {
+		free(input->buf);
+		free(input);
+	}
+	array_free(corpus->inputs);
+	free(corpus->name);
+	free(corpus);
+}
+
+struct Parser *
+bench_parser_new(const struct BenchCase *c, struct BenchInput *input, int finish)
+{
+	struct ParserSettings settings;
+	parser_init_settings(&settings);
+	settings.behavior = c->behavior | PARSER_OUTPUT_NO_COLOR;
+	struct Parser *parser = parser_new(&settings);
+	if (parser_read_from_buffer(parser, input->buf, input->len) != PARSER_ERROR_OK) {
+		errx(1, "%s", parser_error_tostring(parser));
+	}
+	if (finish && parser_read_finish(parser) != PARSER_ERROR_OK) {
+		errx(1, "%s", parser_error_tostring(parser));
+	}
+	return parser;
+}
+
+struct BenchCase *
+bench_pass_cases()
+{
+	struct BenchCase *passes = xmalloc(parser_edits_len * sizeof(struct BenchCase));
+	for (size_t i = 0; i < parser_edits_len; i++) {
+		passes[i].name = parser_edits[i].name;
+		passes[i].phase = BENCH_PHASE_PASS;
+		passes[i].behavior = PARSER_DEFAULT;
+		if (str_startswith(passes[i].name, "kakoune.") ||
+		    str_startswith(passes[i].name, "lint.") ||
+		    str_startswith(passes[i].name, "output.")) {
+			passes[i].behavior |= PARSER_OUTPUT_RAWLINES;
+		}
+		passes[i].edit = parser_edits[i].fn;
+		passes[i].userdata = NULL;
+	}
+	return passes;
+}
+
+int
+bench_pass_implicit(const struct BenchCase *c)
+{
+	// Passes that parser_read_finish() might run on its own
+	return c->edit == refactor_collapse_adjacent_variables ||
+		c->edit == refactor_dedup_tokens ||
+		c->edit == refactor_remove_consecutive_empty_lines ||
+		c->edit == refactor_sanitize_append_modifier ||
+		c->edit == refactor_sanitize_cmake_args ||
+		c->edit == refactor_sanitize_comments;
+}
+
+void *
+bench_pass_userdata(const struct BenchCase *c, struct BenchPassArgs *args)
+{
+	// Mirror what portedit passes to each edit
+	memset(args, 0, sizeof(*args));
+	if (c->edit == edit_bump_revision) {
+		return &args->edit;
+	} else if (c->edit == edit_merge) {
+		const char *script = "PORTREVISION=\t1\nUSES+=\tgmake\n";
+		struct ParserSettings settings;
+		parser_init_settings(&settings);
+		args->edit.subparser = parser_new(&settings);
+		if (parser_read_from_buffer(args->edit.subparser, script, strlen(script)) != PARSER_ERROR_OK ||
+		    parser_read_finish(args->edit.subparser) != PARSER_ERROR_OK) {
+			errx(1, "%s", parser_error_tostring(args->edit.subparser));
+		}
+		return &args->edit;
+	} else if (c->edit == edit_set_version) {
+		args->edit.arg1 = "99.0";
+		return &args->edit;
+	} else if (c->edit == lint_order) {
+		return &args->status;
+	} else if (str_startswith(c->name, "output.")) {
+		return &args->output;
+	} else {
+		return NULL;
+	}
+}
+
+void
+bench_case_run(const struct BenchCase *c, struct BenchCorpus *corpus, size_t iterations, struct BenchResult *result)
+{
+	struct timespec start, end;
+	size_t allocations = 0;
+	size_t allocated_bytes = 0;
+
+	memset(result, 0, sizeof(*result));
+	for (size_t i = 0; i < iterations; i++) {
+		ARRAY_FOREACH(corpus->inputs, struct BenchInput *, input) {
+			struct Parser *parser = NULL;
+			enum ParserError error = PARSER_ERROR_OK;
+			struct BenchPassArgs args;
+			void *userdata = c->userdata;
+			int failed = 0;
+			size_t tokens_in = 0;
+			if (c->phase != BENCH_PHASE_READ) {
+				parser = bench_parser_new(c, input, c->phase != BENCH_PHASE_READ_FINISH);
+			}
+			if (c->phase == BENCH_PHASE_PASS) {
+				userdata = bench_pass_userdata(c, &args);
+				if (parser_edit(parser, count_tokens, &tokens_in) != PARSER_ERROR_OK) {
+					errx(1, "%s", parser_error_tostring(parser));
+				}
+				result->tokens_in += tokens_in;
+			}
+
+			bench_alloc_reset();
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			switch (c->phase) {
+			case BENCH_PHASE_READ: {
+				struct ParserSettings settings;
+				parser_init_settings(&settings);
+				settings.behavior = c->behavior | PARSER_OUTPUT_NO_COLOR;
+				parser = parser_new(&settings);
+				error = parser_read_from_buffer(parser, input->buf, input->len);
+				break;
+			} case BENCH_PHASE_READ_FINISH:
+				error = parser_read_finish(parser);
+				break;
+			case BENCH_PHASE_OUTPUT:
+				error = parser_output_write_to_file(parser, devnull);
+				break;
+			case BENCH_PHASE_EDIT:
+			case BENCH_PHASE_PASS:
+				error = parser_edit(parser, c->edit, userdata);
+				// Lint failures are results, not benchmark errors
+				if (error == PARSER_ERROR_EDIT_FAILED) {
+					error = PARSER_ERROR_OK;
+					failed = 1;
+				}
+				break;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			struct BenchAllocStats stats = bench_alloc_stats();
+
+			if (error != PARSER_ERROR_OK && error != PARSER_ERROR_DIFFERENCES_FOUND) {
+				errx(1, "%s: %s: %s", corpus->name, c->name, parser_error_tostring(parser));
+			}
+			result->seconds += elapsed(&start, &end);
+			allocations += stats.allocations;
+			allocated_bytes += stats.bytes;
+			if (c->phase == BENCH_PHASE_PASS) {
+				// The parser refuses further edits after a failed one
+				if (failed) {
+					result->tokens_out += tokens_in;
+				} else if (parser_edit(parser, count_tokens, &result->tokens_out) != PARSER_ERROR_OK) {
+					errx(1, "%s", parser_error_tostring(parser));
+				}
+				if (args.edit.subparser) {
+					parser_free(args.edit.subparser);
+				}
+			}
+			parser_free(parser);
+		}
+	}
+
+	result->allocations = allocations / iterations;
+	result->allocated_bytes = allocated_bytes / iterations;
+	result->tokens_in /= iterations;
+	result->tokens_out /= iterations;
+
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#ifdef __APPLE__
+		result->peak_rss_kb = ru.ru_maxrss / 1024;
+#else
+		result->peak_rss_kb = ru.ru_maxrss;
+#endif
+	}
+}
+
+void
+bench_case_fork(const struct BenchCase *c, struct BenchCorpus *corpus, size_t iterations, struct BenchResult *result)
+{
+	// Run every case in its own process so that the peak RSS
+	// reported is not inflated by the cases that ran before.
+	int fd[2];
+	if (pipe(fd) == -1) {
+		err(1, "pipe");
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == -1) {
+		err(1, "fork");
+	} else if (pid == 0) {
+		close(fd[0]);
+		bench_case_run(c, corpus, iterations, result);
+		if (write(fd[1], result, sizeof(*result)) != sizeof(*result)) {
+			_exit(1);
+		}
+		_exit(0);
+	}
+
+	close(fd[1]);
+	ssize_t n = read(fd[0], result, sizeof(*result));
+	close(fd[0]);
+	int status;
+	if (waitpid(pid, &status, 0) == -1) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || n != sizeof(*result)) {
+		errx(1, "%s: %s: benchmark failed", corpus->name, c->name);
+	}
+}
+
+void
+bench_case_compare(struct BenchCompare *cmp, const struct BenchCase *c, struct BenchCorpus *corpus, size_t iterations, struct BenchResult *results, size_t runs)
+{
+	double *samples = xmalloc(runs * sizeof(double));
+	for (enum BenchMetric metric = 0; metric < BENCH_METRIC__N; metric++) {
+		for (size_t run = 0; run < runs; run++) {
+			samples[run] = bench_result_metric(corpus, iterations, &results[run], metric);
+		}
+		bench_compare_metric(cmp, c->name, corpus->name, metrics[metric].name,
+			metrics[metric].direction, samples, runs);
+	}
+	free(samples);
+}
+
+double
+bench_result_metric(struct BenchCorpus *corpus, size_t iterations, struct BenchResult *result, enum BenchMetric metric)
+{
+	double seconds = result->seconds / iterations;
+	switch (metric) {
+	case BENCH_METRIC_MB_PER_S:
+		return seconds > 0 ? corpus->bytes / seconds / (1024 * 1024) : 0;
+	case BENCH_METRIC_TOKENS_PER_S:
+		return seconds > 0 ? corpus->tokens / seconds : 0;
+	case BENCH_METRIC_ALLOCATIONS:
+		return result->allocations;
+	case BENCH_METRIC_ALLOCATED_BYTES:
+		return result->allocated_bytes;
+	case BENCH_METRIC_PEAK_RSS_KB:
+		return result->peak_rss_kb;
+	case BENCH_METRIC__N:
+		break;
+	}
+	return 0;
+}
+
+void
+bench_print_result(const struct BenchCase *c, struct BenchCorpus *corpus, size_t iterations, struct BenchResult *result, int first)
+{
+	double seconds = result->seconds / iterations;
+	double mb_per_s = bench_result_metric(corpus, iterations, result, BENCH_METRIC_MB_PER_S);
+	double tokens_per_s = bench_result_metric(corpus, iterations, result, BENCH_METRIC_TOKENS_PER_S);
+	printf("%s\n    {\"case\": \"%s\", \"input\": \"%s\", \"files\": %zu, \"bytes\": %zu, "
+		"\"tokens\": %zu, \"iterations\": %zu, \"seconds\": %.9f, \"mb_per_s\": %.3f, "
+		"\"tokens_per_s\": %.1f, \"allocations\": %zu, \"allocated_bytes\": %zu, "
+		"\"peak_rss_kb\": %ld",
+		first ? "" : ",", c->name, corpus->name, array_len(corpus->inputs),
+		corpus->bytes, corpus->tokens, iterations, seconds, mb_per_s,
+		tokens_per_s, result->allocations, result->allocated_bytes,
+		result->peak_rss_kb);
+	if (c->phase == BENCH_PHASE_PASS) {
+		printf(", \"tokens_in\": %zu, \"tokens_out\": %zu, \"implicit\": %s",
+			result->tokens_in, result->tokens_out,
+			bench_pass_implicit(c) ? "true" : "false");
+	}
+	printf("}");
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t iterations = 5;
+	size_t runs = 0;
+	size_t stress_size = 1000;
+	size_t threshold = 5;
+	int passes = 0;
+	const char *baseline = NULL;
+	const char *errstr = NULL;
+
+	int ch;
+	while ((ch = getopt(argc, argv, "c:n:pr:s:t:")) != -1) {
+		switch (ch) {
+		case 'c':
+			baseline = optarg;
+			break;
+		case 'n':
+			iterations = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL) {
+				errx(1, "-n %s is %s", optarg, errstr);
+			}
+			break;
+		case 'p':
+			passes = 1;
+			break;
+		case 'r':
+			runs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL) {
+				errx(1, "-r %s is %s", optarg, errstr);
+			}
+			break;
+		case 's':
+			stress_size = strtonum(optarg, 0, INT_MAX, &errstr);
+			if (errstr != NULL) {
+				errx(1, "-s %s is %s", optarg, errstr);
+			}
+			break;
+		case 't':
+			threshold = strtonum(optarg, 0, 1000, &errstr);
+			if (errstr != NULL) {
+				errx(1, "-t %s is %s", optarg, errstr);
+			}
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	struct BenchCompare *cmp = NULL;
+	if (baseline) {
+		cmp = bench_compare_new(baseline, threshold / 100.0);
+		if (runs == 0) {
+			runs = 5;
+		}
+	} else if (runs == 0) {
+		runs = 1;
+	}
+
+	devnull = fopen("/dev/null", "w");
+	if (devnull == NULL) {
+		err(1, "fopen: /dev/null");
+	}
+
+	struct Array *corpora = array_new();
+	for (int i = 0; i < argc; i++) {
+		size_t len;
+		char *buf = slurp(argv[i], &len);
+		if (buf == NULL) {
+			err(1, "%s", argv[i]);
+		}
+		struct BenchCorpus *corpus = bench_corpus_new(argv[i]);
+		bench_corpus_add(corpus, buf, len);
+		array_append(corpora, corpus);
+	}
+	if (stress_size > 0) {
+		for (size_t i = 0; i < bench_stress_inputs_len; i++) {
+			struct BenchCorpus *corpus = bench_corpus_new(bench_stress_inputs[i].name);
+			char *buf = bench_stress_inputs[i].generate(stress_size);
+			bench_corpus_add(corpus, buf, strlen(buf));
+			array_append(corpora, corpus);
+		}
+	}
+	if (array_len(corpora) == 0) {
+		usage();
+	}
+
+	const struct BenchCase *selected = cases;
+	size_t selected_len = nitems(cases);
+	struct BenchCase *pass_cases = NULL;
+	if (passes) {
+		// kakoune.select-object-on-line wants to know where the
+		// cursor is
+		setenv("kak_cursor_line", "1", 1);
+		pass_cases = bench_pass_cases();
+		selected = pass_cases;
+		selected_len = parser_edits_len;
+	}
+
+	if (cmp == NULL) {
+		printf("{\n  \"iterations\": %zu,\n  \"runs\": %zu,\n  \"results\": [", iterations, runs);
+	}
+	struct BenchResult *results = xmalloc(runs * sizeof(struct BenchResult));
+	int first = 1;
+	ARRAY_FOREACH(corpora, struct BenchCorpus *, corpus) {
+		bench_corpus_count_tokens(corpus);
+		for (size_t i = 0; i < selected_len; i++) {
+			for (size_t run = 0; run < runs; run++) {
+				bench_case_fork(&selected[i], corpus, iterations, &results[run]);
+			}
+			if (cmp) {
+				bench_case_compare(cmp, &selected[i], corpus, iterations, results, runs);
+			} else {
+				// Report the run with the median time
+				qsort(results, runs, sizeof(struct BenchResult), compare_seconds);
+				bench_print_result(&selected[i], corpus, iterations, &results[runs / 2], first);
+				first = 0;
+			}
+		}
+		bench_corpus_free(corpus);
+	}
+
+	int status = 0;
+	if (cmp) {
+		status = bench_compare_report(cmp, stdout) ? 2 : 0;
+		bench_compare_free(cmp);
+	} else {
+		printf("\n  ]\n}\n");
+	}
+
+	free(results);
+	free(pass_cases);
+	array_free(corpora);
+	fclose(devnull);
+
+	return status;
+}
@@ -0,0 +1,362 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/param.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "bench/compare.h"
+
+/*
+ * Compare benchmark results against a baseline that was written by
+ * an earlier run of portfmt-bench or portscan-bench.  Both print one
+ * flat JSON object per result line, so that is all the parser below
+ * understands.
+ */
+
+struct BenchBaselineMetric {
+	char *name;
+	double value;
+};
+
+struct BenchBaselineEntry {
+	char *name;
+	char *input;
+	struct Array *metrics;
+};
+
+struct BenchCompareRow {
+	char *name;
+	char *input;
+	const char *metric;
+	int found;
+	double baseline;
+	double current;
+	double change;
+	double threshold;
+	int regressed;
+	int improved;
+};
+
+struct BenchCompare {
+	struct Array *baseline;
+	struct Array *rows;
+	double threshold;
+};
+
+static int compare_double(const void *, const void *);
+static struct BenchBaselineEntry *baseline_find(struct BenchCompare *, const char *, const char *);
+static struct BenchBaselineEntry *baseline_parse_line(const char *);
+static const char *parse_string(const char *, char **);
+static double median(double *, size_t);
+
+// A metric only regresses if it moved by more than this many times
+// its own median absolute deviation across the current runs.
+#define NOISE_FACTOR 3
+
+int
+compare_double(const void *ap, const void *bp)
+{
+	double a = *(const double *)ap;
+	double b = *(const double *)bp;
+	return (a > b) - (a < b);
+}
+
+double
+median(double *values, size_t len)
+{
+	qsort(values, len, sizeof(double), compare_double);
+	if (len % 2 == 0) {
+		return (values[len / 2 - 1] + values[len / 2]) / 2;
+	} else {
+		return values[len / 2];
+	}
+}
+
+const char *
+parse_string(const char *s, char **out)
+{
+	if (*s != '"') {
+		return NULL;
+	}
+	const char *start = ++s;
+	for (; *s && *s != '"'; s++) {
+		if (*s == '\\' && *(s + 1)) {
+			s++;
+		}
+	}
+	if (*s != '"') {
+		return NULL;
+	}
+	*out = xstrndup(start, s - start);
+	return s + 1;
+}
+
+struct BenchBaselineEntry *
+baseline_parse_line(const char *line)
+{
+	const char *s = strchr(line, '{');
+	if (s == NULL || strstr(s, "\"case\"") == NULL) {
+		return NULL;
+	}
+
+	struct BenchBaselineEntry *entry = xmalloc(sizeof(struct BenchBaselineEntry));
+	entry->metrics = array_new();
+	s++;
+	while (*s && *s != '}') {
+		if (*s == ' ' || *s == ',' || *s == '\t') {
+			s++;
+			continue;
+		}
+		char *key = NULL;
+		if ((s = parse_string(s, &key)) == NULL) {
+			break;
+		}
+		while (*s == ' ' || *s == ':') {
+			s++;
+		}
+		if (*s == '"') {
+			char *value = NULL;
+			s = parse_string(s, &value);
+			if (strcmp(key, "case") == 0) {
+				entry->name = value;
+			} else if (strcmp(key, "input") == 0) {
+				entry->input = value;
+			} else {
+				free(value);
+			}
+			free(key);
+			if (s == NULL) {
+				break;
+			}
+		} else {
+			char *end;
+			double value = strtod(s, &end);
+			if (end == s) {
+				// true, false, null
+				free(key);
+				s += strcspn(s, ",}");
+				continue;
+			}
+			struct BenchBaselineMetric *metric = xmalloc(sizeof(struct BenchBaselineMetric));
+			metric->name = key;
+			metric->value = value;
+			array_append(entry->metrics, metric);
+			s = end;
+		}
+	}
+
+	if (entry->name == NULL) {
+		ARRAY_FOREACH(entry->metrics, struct BenchBaselineMetric *, metric) {
+			free(metric->name);
+			free(metric);
+		}
+		array_free(entry->metrics);
+		free(entry->input);
+		free(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+struct BenchBaselineEntry *
+baseline_find(struct BenchCompare *cmp, const char *name, const char *input)
+{
+	ARRAY_FOREACH(cmp->baseline, struct BenchBaselineEntry *, entry) {
+		if (strcmp(entry->name, name) != 0) {
+			continue;
+		}
+		if ((input == NULL && entry->input == NULL) ||
+		    (input && entry->input && strcmp(entry->input, input) == 0)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+struct BenchCompare *
+bench_compare_new(const char *path, double threshold)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		err(1, "fopen: %s", path);
+	}
+
+	struct BenchCompare *cmp = xmalloc(sizeof(struct BenchCompare));
+	cmp->baseline = array_new();
+	cmp->rows = array_new();
+	cmp->threshold = threshold;
+
+	char *line = NULL;
+	size_t linecap = 0;
+	while (getline(&line, &linecap, fp) > 0) {
+		struct BenchBaselineEntry *entry = baseline_parse_line(line);
+		if (entry) {
+			array_append(cmp->baseline, entry);
+		}
+	}
+	free(line);
+	fclose(fp);
+
+	if (array_len(cmp->baseline) == 0) {
+		errx(1, "%s: no benchmark results found", path);
+	}
+
+	return cmp;
+}
+
+void
+bench_compare_free(struct BenchCompare *cmp)
+{
+	if (cmp == NULL) {
+		return;
+	}
+
+	ARRAY_FOREACH(cmp->baseline, struct BenchBaselineEntry *, entry) {
+		ARRAY_FOREACH(entry->metrics, struct BenchBaselineMetric *, metric) {
+			free(metric->name);
+			free(metric);
+		}
+		array_free(entry->metrics);
+		free(entry->name);
+		free(entry->input);
+		free(entry);
+	}
+	array_free(cmp->baseline);
+	ARRAY_FOREACH(cmp->rows, struct BenchCompareRow *, row) {
+		free(row->name);
+		free(row->input);
+		free(row);
+	}
+	array_free(cmp->rows);
+	free(cmp);
+}
+
+void
+bench_compare_metric(struct BenchCompare *cmp, const char *name, const char *input, const char *metric, enum BenchCompareDirection direction, double *samples, size_t len)
+{
+	struct BenchCompareRow *row = xmalloc(sizeof(struct BenchCompareRow));
+	row->name = xstrdup(name);
+	if (input) {
+		row->input = xstrdup(input);
+	}
+	row->metric = metric;
+	row->current = median(samples, len);
+
+	// Scale the threshold up when the runs disagree with each other
+	// so that a noisy machine does not fail the comparison.
+	double *deviations = xmalloc(len * sizeof(double));
+	for (size_t i = 0; i < len; i++) {
+		deviations[i] = fabs(samples[i] - row->current);
+	}
+	double noise = 0;
+	if (row->current != 0) {
+		noise = NOISE_FACTOR * median(deviations, len) / fabs(row->current);
+	}
+	free(deviations);
+	row->threshold = MAX(cmp->threshold, noise);
+
+	struct BenchBaselineEntry *entry = baseline_find(cmp, name, input);
+	if (entry) {
+		ARRAY_FOREACH(entry->metrics, struct BenchBaselineMetric *, m) {
+			if (strcmp(m->name, metric) == 0) {
+				row->found = 1;
+				row->baseline = m->value;
+				break;
+			}
+		}
+	}
+
+	if (row->found) {
+		if (row->baseline != 0) {
+			row->change = (row->current - row->baseline) / fabs(row->baseline);
+		} else if (row->current != 0) {
+			row->change = row->current > 0 ? INFINITY : -INFINITY;
+		}
+		if (direction == BENCH_COMPARE_HIGHER_IS_BETTER) {
+			row->regressed = row->change < -row->threshold;
+			row->improved = row->change > row->threshold;
+		} else {
+			row->regressed = row->change > row->threshold;
+			row->improved = row->change < -row->threshold;
+		}
+	}
+
+	array_append(cmp->rows, row);
+}
+
+int
+bench_compare_report(struct BenchCompare *cmp, FILE *fp)
+{
+	size_t regressions = 0;
+	size_t improvements = 0;
+	size_t missing = 0;
+
+	fprintf(fp, "%-40s %-24s %-16s %14s %14s %9s %9s  %s\n", "case", "input",
+		"metric", "baseline", "current", "change", "threshold", "status");
+	ARRAY_FOREACH(cmp->rows, struct BenchCompareRow *, row) {
+		const char *status = "ok";
+		if (!row->found) {
+			status = "new";
+			missing++;
+		} else if (row->regressed) {
+			status = "REGRESSED";
+			regressions++;
+		} else if (row->improved) {
+			status = "improved";
+			improvements++;
+		}
+		fprintf(fp, "%-40s %-24s %-16s ", row->name, row->input ? row->input : "-", row->metric);
+		if (row->found) {
+			fprintf(fp, "%14.3f ", row->baseline);
+		} else {
+			fprintf(fp, "%14s ", "-");
+		}
+		fprintf(fp, "%14.3f ", row->current);
+		if (row->found) {
+			fprintf(fp, "%+8.1f%% ", row->change * 100);
+		} else {
+			fprintf(fp, "%9s ", "-");
+		}
+		fprintf(fp, "%8.1f%%  %s\n", row->threshold * 100, status);
+	}
+	fprintf(fp, "%zu metrics: %zu regressed, %zu improved, %zu not in baseline\n",
+		array_len(cmp->rows), regressions, improvements, missing);
+
+	return regressions > 0;
+}
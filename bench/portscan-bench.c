@@ -0,0 +1,246 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/param.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libias/util.h>
+
+#include "bench/compare.h"
+#include "bench/portstree.h"
+
+struct PortscanBenchResult {
+	double seconds;
+	long peak_rss_kb;
+};
+
+static double elapsed(struct timespec *, struct timespec *);
+static void run_portscan(const char *, const char *, const char *, struct PortscanBenchResult *);
+static void usage(void);
+
+// One entry per portscan check flag.  NULL means portscan's
+// default set of checks.
+static const char *checks[] = {
+	NULL,
+	"--all",
+	"--categories",
+	"--clones",
+	"--comments",
+	"--expanded-values",
+	"--option-default-descriptions",
+	"--options",
+	"--unknown-targets",
+	"--unknown-variables",
+	"--variable-values",
+};
+
+void
+usage()
+{
+	fprintf(stderr, "usage: portscan-bench [-G] [-c baseline] [-n ports] [-P portscan] [-r runs] [-s seed]\n"
+		"                      [-t threshold] portsdir\n");
+	exit(EX_USAGE);
+}
+
+double
+elapsed(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void
+run_portscan(const char *portscan, const char *portsdir, const char *check, struct PortscanBenchResult *result)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid_t pid = fork();
+	if (pid == -1) {
+		err(1, "fork");
+	} else if (pid == 0) {
+		int fd = open("/dev/null", O_WRONLY);
+		if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1) {
+			_exit(127);
+		}
+		if (check) {
+			execl(portscan, portscan, "-p", portsdir, check, NULL);
+		} else {
+			execl(portscan, portscan, "-p", portsdir, NULL);
+		}
+		_exit(127);
+	}
+
+	int status;
+	struct rusage ru;
+	if (wait4(pid, &status, 0, &ru) == -1) {
+		err(1, "wait4");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s %s failed", portscan, check ? check : "");
+	}
+
+	result->seconds = elapsed(&start, &end);
+#ifdef __APPLE__
+	result->peak_rss_kb = ru.ru_maxrss / 1024;
+#else
+	result->peak_rss_kb = ru.ru_maxrss;
+#endif
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *portscan = "bin/portscan";
+	size_t nports = 2000;
+	size_t runs = 3;
+	unsigned long long seed = 1;
+	size_t threshold = 5;
+	int generate_only = 0;
+	const char *baseline = NULL;
+	const char *errstr = NULL;
+
+	int ch;
+	while ((ch = getopt(argc, argv, "c:Gn:P:r:s:t:")) != -1) {
+		switch (ch) {
+		case 'c':
+			baseline = optarg;
+			break;
+		case 'G':
+			generate_only = 1;
+			break;
+		case 'n':
+			nports = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL) {
+				errx(1, "-n %s is %s", optarg, errstr);
+			}
+			break;
+		case 'P':
+			portscan = optarg;
+			break;
+		case 'r':
+			runs = strtonum(optarg, 1, INT_MAX, &errstr);
+			if (errstr != NULL) {
+				errx(1, "-r %s is %s", optarg, errstr);
+			}
+			break;
+		case 's':
+			seed = strtonum(optarg, 0, LLONG_MAX, &errstr);
+			if (errstr != NULL) {
+				errx(1, "-s %s is %s", optarg, errstr);
+			}
+			break;
+		case 't':
+			threshold = strtonum(optarg, 0, 1000, &errstr);
+			if (errstr != NULL) {
+				errx(1, "-t %s is %s", optarg, errstr);
+			}
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1) {
+		usage();
+	}
+	const char *portsdir = argv[0];
+
+	struct BenchPortsTreeStats stats;
+	if (!bench_portstree_generate(portsdir, nports, seed, &stats)) {
+		err(1, "could not generate ports tree in %s", portsdir);
+	}
+	if (generate_only) {
+		return 0;
+	}
+
+	struct BenchCompare *cmp = NULL;
+	if (baseline) {
+		cmp = bench_compare_new(baseline, threshold / 100.0);
+	} else {
+		printf("{\n  \"ports\": %zu,\n  \"categories\": %zu,\n  \"slaves\": %zu,\n"
+			"  \"seed\": %llu,\n  \"runs\": %zu,\n  \"results\": [",
+			stats.ports, stats.categories, stats.slaves, seed, runs);
+	}
+	double *ports_per_s = xmalloc(runs * sizeof(double));
+	double *peak_rss = xmalloc(runs * sizeof(double));
+	for (size_t i = 0; i < nitems(checks); i++) {
+		double seconds = 0;
+		long peak_rss_kb = 0;
+		for (size_t run = 0; run < runs; run++) {
+			struct PortscanBenchResult result;
+			fflush(stdout);
+			run_portscan(portscan, portsdir, checks[i], &result);
+			seconds += result.seconds;
+			peak_rss_kb = MAX(peak_rss_kb, result.peak_rss_kb);
+			ports_per_s[run] = result.seconds > 0 ? stats.ports / result.seconds : 0;
+			peak_rss[run] = result.peak_rss_kb;
+		}
+		seconds /= runs;
+		if (cmp) {
+			char *name = str_printf("portscan%s%s", checks[i] ? " " : "", checks[i] ? checks[i] : "");
+			bench_compare_metric(cmp, name, NULL, "ports_per_s", BENCH_COMPARE_HIGHER_IS_BETTER, ports_per_s, runs);
+			bench_compare_metric(cmp, name, NULL, "peak_rss_kb", BENCH_COMPARE_LOWER_IS_BETTER, peak_rss, runs);
+			free(name);
+			continue;
+		}
+		printf("%s\n    {\"case\": \"portscan%s%s\", \"ports\": %zu, \"seconds\": %.6f, "
+			"\"ports_per_s\": %.1f, \"peak_rss_kb\": %ld}",
+			i == 0 ? "" : ",", checks[i] ? " " : "", checks[i] ? checks[i] : "",
+			stats.ports, seconds, seconds > 0 ? stats.ports / seconds : 0,
+			peak_rss_kb);
+	}
+	free(ports_per_s);
+	free(peak_rss);
+
+	int status = 0;
+	if (cmp) {
+		status = bench_compare_report(cmp, stdout) ? 2 : 0;
+		bench_compare_free(cmp);
+	} else {
+		printf("\n  ]\n}\n");
+	}
+
+	return status;
+}
@@ -0,0 +1,564 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "bench/portstree.h"
+
+/*
+ * Write a fake but deterministic ports tree that looks enough like
+ * the real one for portscan to exercise all of its checks.  The same
+ * port count and seed always produce the same tree regardless of
+ * the platform since we bring our own PRNG.
+ */
+
+struct Generator {
+	const char *root;
+	uint64_t state;
+	struct BenchPortsTreeStats *stats;
+	int error;
+};
+
+struct Port {
+	char *category;
+	char *name;
+};
+
+static uint64_t rng_next(struct Generator *);
+static size_t rng_range(struct Generator *, size_t);
+static int rng_percent(struct Generator *, size_t);
+static void add(struct Array *, const char *);
+static void add_list(struct Generator *, struct Array *, const char *, const char *[], size_t, size_t);
+static void write_file(struct Generator *, struct Array *, const char *);
+static void make_dir(struct Generator *, const char *);
+static void gen_options_desc(struct Generator *);
+static void gen_root(struct Generator *, struct Array *);
+static void gen_category(struct Generator *, const char *, struct Array *);
+static void gen_common(struct Generator *, const char *, const char *);
+static void gen_port(struct Generator *, struct Port *, const char *);
+static void gen_slave(struct Generator *, struct Port *, struct Port *);
+
+static const char *categories_[] = {
+	"accessibility", "archivers", "audio", "databases", "devel",
+	"editors", "games", "graphics", "lang", "mail", "math", "misc",
+	"multimedia", "net", "print", "security", "sysutils", "textproc",
+	"www", "x11",
+};
+
+static const char *syllables_[] = {
+	"ab", "ar", "bo", "cu", "da", "el", "fi", "go", "ha", "io", "ju",
+	"ka", "li", "mo", "nu", "or", "pa", "qu", "ro", "si", "tu", "vi",
+	"wa", "xe", "yo", "zu",
+};
+
+static const char *uses_[] = {
+	"autoreconf", "cmake", "compiler:c++11-lang", "cpe", "gettext",
+	"gmake", "gnome", "iconv", "libtool", "localbase", "meson",
+	"ninja", "perl5", "pkgconfig", "python:3.6+", "qt:5", "shebangfix",
+	"ssl", "tar:xz",
+};
+
+static const char *licenses_[] = {
+	"APACHE20", "BSD2CLAUSE", "BSD3CLAUSE", "GPLv2", "GPLv3", "LGPL21",
+	"MIT", "MPL20",
+};
+
+static const char *options_[] = {
+	"DOCS", "EXAMPLES", "NLS", "IPV6", "DEBUG", "TEST", "X11", "GTK3",
+	"QT5", "PULSEAUDIO", "ALSA", "JACK", "SNDIO", "OPENSSL", "GNUTLS",
+	"LDAP", "MYSQL", "PGSQL", "SQLITE", "PYTHON", "LUA", "PERL", "TCL",
+	"RUBY", "ZSTD", "LZ4", "BZIP2", "XZ", "PNG", "JPEG", "TIFF",
+	"WEBP", "FREETYPE", "FONTCONFIG", "CAIRO", "PANGO", "DBUS",
+	"AVAHI", "CUPS", "SASL", "KERBEROS", "PAM", "READLINE", "NCURSES",
+};
+
+static const char *option_helpers_[][2] = {
+	{ "BUILD_DEPENDS", "%s>0:devel/%s" },
+	{ "CONFIGURE_ENABLE", "%s" },
+	{ "CONFIGURE_ON", "--with-%s" },
+	{ "CONFIGURE_WITH", "%s" },
+	{ "EXTRA_PATCHES", "${FILESDIR}/extra-patch-%s" },
+	{ "LIB_DEPENDS", "lib%s.so:devel/%s" },
+	{ "PLIST_FILES", "bin/%s" },
+	{ "RUN_DEPENDS", "%s>0:devel/%s" },
+	{ "USES", "gettext" },
+};
+
+static const char *default_descs_[][2] = {
+	{ "DOCS", "Build and/or install documentation" },
+	{ "EXAMPLES", "Build and/or install examples" },
+	{ "NLS", "Native Language Support" },
+	{ "IPV6", "IPv6 protocol support" },
+	{ "DEBUG", "Build with debugging support" },
+	{ "TEST", "Build and/or run tests" },
+	{ "X11", "X11 (graphics) support" },
+	{ "GTK3", "GTK+ 3 graphical user interface" },
+	{ "QT5", "Qt 5 graphical user interface" },
+	{ "PULSEAUDIO", "PulseAudio sound server support" },
+	{ "ALSA", "ALSA audio architecture support" },
+	{ "OPENSSL", "SSL protocol support via OpenSSL" },
+	{ "GNUTLS", "SSL/TLS support via GnuTLS" },
+	{ "LDAP", "LDAP protocol support" },
+	{ "MYSQL", "MySQL database support" },
+	{ "PGSQL", "PostgreSQL database support" },
+	{ "SQLITE", "SQLite database support" },
+	{ "PYTHON", "Python bindings or support" },
+	{ "PERL", "Perl scripting language support" },
+	{ "DBUS", "D-Bus IPC system support" },
+	{ "CUPS", "CUPS printing system support" },
+	{ "PAM", "Pluggable authentication module support" },
+};
+
+uint64_t
+rng_next(struct Generator *g)
+{
+	// splitmix64
+	uint64_t z = (g->state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+size_t
+rng_range(struct Generator *g, size_t n)
+{
+	if (n == 0) {
+		return 0;
+	}
+	return rng_next(g) % n;
+}
+
+int
+rng_percent(struct Generator *g, size_t percent)
+{
+	return rng_range(g, 100) < percent;
+}
+
+void
+add(struct Array *lines, const char *line)
+{
+	array_append(lines, xstrdup(line));
+}
+
+void
+add_list(struct Generator *g, struct Array *lines, const char *var, const char *values[], size_t len, size_t n)
+{
+	if (n == 0) {
+		return;
+	}
+	struct Array *picked = array_new();
+	size_t start = rng_range(g, len);
+	for (size_t i = 0; i < n && i < len; i++) {
+		array_append(picked, values[(start + i) % len]);
+	}
+	array_sort(picked, str_compare, NULL);
+	char *joined = str_join(picked, " ");
+	array_append(lines, str_printf("%s=\t%s", var, joined));
+	free(joined);
+	array_free(picked);
+}
+
+void
+make_dir(struct Generator *g, const char *path)
+{
+	if (g->error) {
+		return;
+	}
+	char *fullpath = str_printf("%s/%s", g->root, path);
+	if (mkdir(fullpath, 0755) == -1 && errno != EEXIST) {
+		g->error = errno;
+	}
+	free(fullpath);
+}
+
+void
+write_file(struct Generator *g, struct Array *lines, const char *path)
+{
+	if (!g->error) {
+		char *fullpath = str_printf("%s/%s", g->root, path);
+		FILE *f = fopen(fullpath, "w");
+		if (f == NULL) {
+			g->error = errno;
+		} else {
+			ARRAY_FOREACH(lines, char *, line) {
+				fputs(line, f);
+				fputc('\n', f);
+			}
+			if (fclose(f) != 0) {
+				g->error = errno;
+			}
+		}
+		free(fullpath);
+	}
+
+	ARRAY_FOREACH(lines, char *, line) {
+		free(line);
+	}
+	array_truncate(lines);
+}
+
+void
+gen_options_desc(struct Generator *g)
+{
+	struct Array *lines = array_new();
+	add(lines, "# Standard descriptions for options");
+	add(lines, "");
+	for (size_t i = 0; i < nitems(default_descs_); i++) {
+		array_append(lines, str_printf("%s_DESC?=\t%s", default_descs_[i][0], default_descs_[i][1]));
+	}
+	make_dir(g, "Mk");
+	write_file(g, lines, "Mk/bsd.options.desc.mk");
+	array_free(lines);
+}
+
+void
+gen_root(struct Generator *g, struct Array *categories)
+{
+	struct Array *lines = array_new();
+	ARRAY_FOREACH(categories, const char *, category) {
+		array_append(lines, str_printf("SUBDIR += %s", category));
+	}
+	add(lines, "");
+	add(lines, "PORTSTOP=\tyes");
+	add(lines, "");
+	add(lines, ".include <bsd.port.subdir.mk>");
+	write_file(g, lines, "Makefile");
+	array_free(lines);
+}
+
+void
+gen_category(struct Generator *g, const char *category, struct Array *ports)
+{
+	struct Array *lines = array_new();
+	array_append(lines, str_printf("    COMMENT = Synthetic %s ports", category));
+	add(lines, "");
+	ARRAY_FOREACH(ports, const char *, port) {
+		array_append(lines, str_printf("    SUBDIR += %s", port));
+	}
+	add(lines, "");
+	add(lines, ".include <bsd.port.subdir.mk>");
+	char *path = str_printf("%s/Makefile", category);
+	write_file(g, lines, path);
+	free(path);
+	array_free(lines);
+}
+
+void
+gen_common(struct Generator *g, const char *category, const char *name)
+{
+	struct Array *lines = array_new();
+	array_append(lines, str_printf("# Shared by all %s ports", name));
+	add(lines, "");
+	array_append(lines, str_printf("MASTER_SITES=\thttps://example.org/%s/", name));
+	array_append(lines, str_printf("DISTNAME=\t%s-${DISTVERSION}", name));
+	add(lines, "");
+	add(lines, "MAINTAINER=\tports@FreeBSD.org");
+	add(lines, "");
+	array_append(lines, str_printf("LICENSE=\t%s", licenses_[rng_range(g, nitems(licenses_))]));
+	add(lines, "");
+	add(lines, "USES=\t\tgmake pkgconfig");
+	add(lines, "GNU_CONFIGURE=\tyes");
+	char *dir = str_printf("%s/%s", category, name);
+	char *path = str_printf("%s/Makefile.common", dir);
+	make_dir(g, dir);
+	write_file(g, lines, path);
+	free(path);
+	free(dir);
+	array_free(lines);
+	g->stats->commons++;
+}
+
+void
+gen_port(struct Generator *g, struct Port *port, const char *common)
+{
+	struct Array *lines = array_new();
+
+	array_append(lines, str_printf("PORTNAME=\t%s", port->name));
+	array_append(lines, str_printf("DISTVERSION=\t%zu.%zu.%zu", rng_range(g, 10), rng_range(g, 30), rng_range(g, 100)));
+	if (rng_percent(g, 30)) {
+		array_append(lines, str_printf("PORTREVISION=\t%zu", 1 + rng_range(g, 5)));
+	} else if (rng_percent(g, 2)) {
+		array_append(lines, str_printf("#PORTREVISION=\t%zu", 1 + rng_range(g, 5)));
+	}
+	if (rng_percent(g, 5)) {
+		add(lines, "PORTEPOCH=\t1");
+	}
+	array_append(lines, str_printf("CATEGORIES=\t%s", port->category));
+	if (!common) {
+		add(lines, "MASTER_SITES=\thttps://example.org/releases/");
+	}
+	add(lines, "");
+	if (!common) {
+		add(lines, "MAINTAINER=\tports@FreeBSD.org");
+	}
+	array_append(lines, str_printf("COMMENT=\tSynthetic port number %s", port->name));
+	add(lines, "");
+	if (!common) {
+		array_append(lines, str_printf("LICENSE=\t%s", licenses_[rng_range(g, nitems(licenses_))]));
+		if (rng_percent(g, 40)) {
+			add(lines, "LICENSE_FILE=\t${WRKSRC}/LICENSE");
+		}
+		add(lines, "");
+	}
+
+	size_t deps = rng_range(g, 6);
+	if (deps > 0) {
+		add(lines, "LIB_DEPENDS=\t\\");
+		for (size_t i = 0; i < deps; i++) {
+			array_append(lines, str_printf("\t\tlib%s%zu.so:devel/%s%zu%s", syllables_[i % nitems(syllables_)], i,
+				syllables_[i % nitems(syllables_)], i, i + 1 < deps ? " \\" : ""));
+		}
+		add(lines, "");
+	}
+
+	add_list(g, lines, common ? "USES+" : "USES", uses_, nitems(uses_), rng_range(g, 5));
+	if (rng_percent(g, 20)) {
+		add(lines, "USE_GITHUB=\tyes");
+		array_append(lines, str_printf("GH_ACCOUNT=\t%s", port->name));
+	}
+	if (rng_percent(g, 3)) {
+		// Misspelled variable for the unknown variables check
+		array_append(lines, str_printf("CONFIGURE_ARG=\t--enable-%s", port->name));
+	}
+	if (rng_percent(g, 3)) {
+		// Duplicate assignment for the clones check
+		add(lines, "MAKE_JOBS_UNSAFE=\tyes");
+		add(lines, "MAKE_JOBS_UNSAFE=\tyes");
+	}
+	add(lines, "");
+
+	// Most ports have no options, a few have lots
+	size_t noptions = 0;
+	if (rng_percent(g, 40)) {
+		noptions = 1 + rng_range(g, 4);
+		if (rng_percent(g, 10)) {
+			noptions += rng_range(g, 30);
+		}
+	}
+	struct Array *options = array_new();
+	size_t start = rng_range(g, nitems(options_));
+	for (size_t i = 0; i < noptions && i < nitems(options_); i++) {
+		array_append(options, options_[(start + i) % nitems(options_)]);
+	}
+	array_sort(options, str_compare, NULL);
+	if (array_len(options) > 0) {
+		char *joined = str_join(options, " ");
+		array_append(lines, str_printf("OPTIONS_DEFINE=\t%s", joined));
+		free(joined);
+		array_append(lines, str_printf("OPTIONS_DEFAULT=\t%s", (char *)array_get(options, 0)));
+		if (array_len(options) > 8 && rng_percent(g, 50)) {
+			add(lines, "OPTIONS_GROUP=\tEXTRA");
+			add(lines, "OPTIONS_GROUP_EXTRA=\tEXTRA1 EXTRA2");
+			add(lines, "EXTRA1_DESC=\tFirst extra feature");
+			add(lines, "EXTRA2_DESC=\tSecond extra feature");
+		}
+		ARRAY_FOREACH(options, const char *, opt) {
+			if (rng_percent(g, 10)) {
+				// Near-identical copy of the default description
+				for (size_t i = 0; i < nitems(default_descs_); i++) {
+					if (strcmp(default_descs_[i][0], opt) == 0) {
+						array_append(lines, str_printf("%s_DESC=\t%s.", opt, default_descs_[i][1]));
+						break;
+					}
+				}
+			}
+		}
+		add(lines, "");
+		ARRAY_FOREACH(options, const char *, opt) {
+			size_t nhelpers = 1 + rng_range(g, 3);
+			size_t first = rng_range(g, nitems(option_helpers_));
+			for (size_t i = 0; i < nhelpers; i++) {
+				size_t helper = (first + i) % nitems(option_helpers_);
+				char *value = str_printf(option_helpers_[helper][1], port->name, port->name);
+				array_append(lines, str_printf("%s_%s=\t%s", opt, option_helpers_[helper][0], value));
+				free(value);
+			}
+		}
+		add(lines, "");
+	}
+
+	if (array_len(options) > 0 && rng_percent(g, 30)) {
+		add(lines, ".include <bsd.port.options.mk>");
+		add(lines, "");
+		array_append(lines, str_printf(".if ${PORT_OPTIONS:M%s}", (char *)array_get(options, 0)));
+		array_append(lines, str_printf("CONFIGURE_ARGS+=\t--with-%s", port->name));
+		if (rng_percent(g, 30)) {
+			add(lines, ".  if ${ARCH} == amd64");
+			add(lines, "CFLAGS+=\t-DAMD64");
+			add(lines, ".  endif");
+		}
+		add(lines, ".endif");
+		add(lines, "");
+	}
+	array_free(options);
+
+	if (rng_percent(g, 25)) {
+		add(lines, "post-patch:");
+		add(lines, "\t@${REINPLACE_CMD} -e 's|/usr/local|${PREFIX}|g' ${WRKSRC}/Makefile");
+		add(lines, "");
+	}
+	if (rng_percent(g, 2)) {
+		// Unknown target
+		add(lines, "post-instal:");
+		array_append(lines, str_printf("\t${STRIP_CMD} ${STAGEDIR}${PREFIX}/bin/%s", port->name));
+		add(lines, "");
+	}
+
+	if (common) {
+		array_append(lines, str_printf(".include \"${.CURDIR}/../%s/Makefile.common\"", common));
+	}
+	add(lines, ".include <bsd.port.mk>");
+
+	char *dir = str_printf("%s/%s", port->category, port->name);
+	char *path = str_printf("%s/Makefile", dir);
+	make_dir(g, dir);
+	write_file(g, lines, path);
+	free(path);
+	free(dir);
+	array_free(lines);
+}
+
+void
+gen_slave(struct Generator *g, struct Port *master, struct Port *slave)
+{
+	struct Array *lines = array_new();
+	array_append(lines, str_printf("PKGNAMESUFFIX=\t-%s", slave->name + strlen(master->name) + 1));
+	add(lines, "");
+	array_append(lines, str_printf("COMMENT=\tSlave of %s/%s", master->category, master->name));
+	add(lines, "");
+	array_append(lines, str_printf("MASTERDIR=\t${.CURDIR}/../%s", master->name));
+	add(lines, "");
+	add(lines, ".include \"${MASTERDIR}/Makefile\"");
+	char *dir = str_printf("%s/%s", slave->category, slave->name);
+	char *path = str_printf("%s/Makefile", dir);
+	make_dir(g, dir);
+	write_file(g, lines, path);
+	free(path);
+	free(dir);
+	array_free(lines);
+	g->stats->slaves++;
+}
+
+int
+bench_portstree_generate(const char *root, size_t nports, unsigned long long seed, struct BenchPortsTreeStats *stats)
+{
+	struct BenchPortsTreeStats dummy;
+	if (stats == NULL) {
+		stats = &dummy;
+	}
+	memset(stats, 0, sizeof(*stats));
+	struct Generator g = { root, seed, stats, 0 };
+
+	if (mkdir(root, 0755) == -1) {
+		return 0;
+	}
+
+	struct Array *categories = array_new();
+	size_t ncategories = MIN(nitems(categories_), nports / 20 + 1);
+	for (size_t i = 0; i < ncategories; i++) {
+		array_append(categories, categories_[i]);
+		make_dir(&g, categories_[i]);
+	}
+	stats->categories = ncategories;
+
+	struct Array *ports_per_category[nitems(categories_)];
+	for (size_t i = 0; i < ncategories; i++) {
+		ports_per_category[i] = array_new();
+	}
+
+	struct Array *names = array_new();
+	for (size_t i = 0; i < nports;) {
+		size_t category = rng_range(&g, ncategories);
+		struct Port master;
+		master.category = array_get(categories, category);
+		master.name = str_printf("%s%s%zu", syllables_[rng_range(&g, nitems(syllables_))],
+			syllables_[rng_range(&g, nitems(syllables_))], i);
+		int common = rng_percent(&g, 5);
+		if (common) {
+			gen_common(&g, master.category, master.name);
+		}
+		gen_port(&g, &master, common ? master.name : NULL);
+		array_append(ports_per_category[category], master.name);
+		array_append(names, master.name);
+		i++;
+		if (common) {
+			// Ports sharing the Makefile.common with master
+			size_t nsiblings = 1 + rng_range(&g, 3);
+			for (size_t j = 0; j < nsiblings && i < nports; j++, i++) {
+				struct Port sibling;
+				sibling.category = master.category;
+				sibling.name = str_printf("%s-plugin%zu", master.name, j);
+				gen_port(&g, &sibling, master.name);
+				array_append(ports_per_category[category], sibling.name);
+				array_append(names, sibling.name);
+			}
+		} else if (i < nports && rng_percent(&g, 5)) {
+			size_t nslaves = 1 + rng_range(&g, 3);
+			for (size_t j = 0; j < nslaves && i < nports; j++, i++) {
+				struct Port slave;
+				slave.category = master.category;
+				slave.name = str_printf("%s-slave%zu", master.name, j);
+				gen_slave(&g, &master, &slave);
+				array_append(ports_per_category[category], slave.name);
+				array_append(names, slave.name);
+			}
+		}
+	}
+	stats->ports = array_len(names);
+
+	for (size_t i = 0; i < ncategories; i++) {
+		array_sort(ports_per_category[i], str_compare, NULL);
+		gen_category(&g, array_get(categories, i), ports_per_category[i]);
+		array_free(ports_per_category[i]);
+	}
+	gen_root(&g, categories);
+	gen_options_desc(&g);
+
+	ARRAY_FOREACH(names, char *, name) {
+		free(name);
+	}
+	array_free(names);
+	array_free(categories);
+
+	if (g.error) {
+		errno = g.error;
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,188 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "bench/stress.h"
+
+static void add_line(struct Array *, const char *);
+static void add_header(struct Array *);
+static void add_footer(struct Array *);
+static char *finish(struct Array *);
+static char *generate_cargo_crates(size_t);
+static char *generate_conditionals(size_t);
+static char *generate_continuations(size_t);
+static char *generate_options(size_t);
+
+const struct BenchStressInput bench_stress_inputs[] = {
+	{ "stress/cargo-crates", generate_cargo_crates },
+	{ "stress/conditionals", generate_conditionals },
+	{ "stress/continuations", generate_continuations },
+	{ "stress/options", generate_options },
+};
+const size_t bench_stress_inputs_len = nitems(bench_stress_inputs);
+
+void
+add_line(struct Array *lines, const char *line)
+{
+	array_append(lines, xstrdup(line));
+}
+
+void
+add_header(struct Array *lines)
+{
+	add_line(lines, "PORTNAME=\tstress");
+	add_line(lines, "DISTVERSION=\t1.0.0");
+	add_line(lines, "CATEGORIES=\tdevel");
+	add_line(lines, "");
+	add_line(lines, "MAINTAINER=\tports@FreeBSD.org");
+	add_line(lines, "COMMENT=\tGenerated benchmark input");
+	add_line(lines, "");
+	add_line(lines, "LICENSE=\tBSD2CLAUSE");
+	add_line(lines, "");
+}
+
+void
+add_footer(struct Array *lines)
+{
+	add_line(lines, "");
+	add_line(lines, ".include <bsd.port.mk>");
+	add_line(lines, "");
+}
+
+char *
+finish(struct Array *lines)
+{
+	char *buf = str_join(lines, "\n");
+	ARRAY_FOREACH(lines, char *, line) {
+		free(line);
+	}
+	array_free(lines);
+	return buf;
+}
+
+char *
+generate_cargo_crates(size_t n)
+{
+	struct Array *lines = array_new();
+	add_header(lines);
+	add_line(lines, "USES=\t\tcargo");
+	add_line(lines, "");
+	add_line(lines, "CARGO_CRATES=\t\\");
+	for (size_t i = 0; i < n; i++) {
+		array_append(lines, str_printf("\t\tcrate%zu-%zu.%zu.%zu%s", i, i % 7, (i * 13) % 31, i % 3,
+			i + 1 < n ? " \\" : ""));
+	}
+	add_footer(lines);
+	return finish(lines);
+}
+
+char *
+generate_conditionals(size_t n)
+{
+	struct Array *lines = array_new();
+	add_header(lines);
+	add_line(lines, "OPTIONS_DEFINE=\tDOCS");
+	add_line(lines, "");
+	add_line(lines, ".include <bsd.port.options.mk>");
+	add_line(lines, "");
+	const size_t depth = 32;
+	for (size_t block = 0; block < n / depth + 1; block++) {
+		for (size_t i = 0; i < depth; i++) {
+			array_append(lines, str_printf(".%*sif ${ARCH} == arch%zu || ${PORT_OPTIONS:MDOCS}", (int)i, "", i));
+			array_append(lines, str_printf("CONFIGURE_ARGS+=\t--with-level%zu-%zu", block, i));
+		}
+		for (size_t i = depth; i > 0; i--) {
+			array_append(lines, str_printf(".%*selse", (int)(i - 1), ""));
+			array_append(lines, str_printf("CONFIGURE_ARGS+=\t--without-level%zu-%zu", block, i - 1));
+			array_append(lines, str_printf(".%*sendif", (int)(i - 1), ""));
+		}
+	}
+	add_footer(lines);
+	return finish(lines);
+}
+
+char *
+generate_continuations(size_t n)
+{
+	struct Array *lines = array_new();
+	add_header(lines);
+	const char *vars[] = { "CONFIGURE_ARGS", "MAKE_ENV", "PLIST_FILES", "RUN_DEPENDS" };
+	for (size_t v = 0; v < nitems(vars); v++) {
+		array_append(lines, str_printf("%s=\t\\", vars[v]));
+		for (size_t i = 0; i < n; i++) {
+			array_append(lines, str_printf("\t\tvalue%zu-%zu %s", v, i, i + 1 < n ? "\\" : ""));
+		}
+	}
+	add_footer(lines);
+	return finish(lines);
+}
+
+char *
+generate_options(size_t n)
+{
+	struct Array *lines = array_new();
+	add_header(lines);
+	struct Array *names = array_new();
+	// Even the biggest ports stay well below a few hundred options
+	for (size_t i = 0; i < n / 4; i++) {
+		array_append(names, str_printf("OPT%zu", i));
+	}
+	char *joined = str_join(names, " ");
+	array_append(lines, str_printf("OPTIONS_DEFINE=\t%s", joined));
+	free(joined);
+	add_line(lines, "OPTIONS_DEFAULT=\tOPT0 OPT1");
+	add_line(lines, "OPTIONS_GROUP=\tGROUP");
+	add_line(lines, "OPTIONS_GROUP_GROUP=\tGOPT0 GOPT1 GOPT2");
+	add_line(lines, "");
+	ARRAY_FOREACH(names, char *, name) {
+		array_append(lines, str_printf("%s_DESC=\tDescription of option %s", name, name));
+	}
+	add_line(lines, "GOPT0_DESC=\tGroup option 0");
+	add_line(lines, "GOPT1_DESC=\tGroup option 1");
+	add_line(lines, "GOPT2_DESC=\tGroup option 2");
+	add_line(lines, "");
+	ARRAY_FOREACH(names, char *, name) {
+		array_append(lines, str_printf("%s_CONFIGURE_ENABLE=\t%s", name, name));
+		array_append(lines, str_printf("%s_LIB_DEPENDS=\tlib%s.so:devel/%s", name, name, name));
+		array_append(lines, str_printf("%s_USES=\tgnome", name));
+		array_append(lines, str_printf("%s_VARS=\tFOO+=%s", name, name));
+	}
+	add_footer(lines);
+	ARRAY_FOREACH(names, char *, name) {
+		free(name);
+	}
+	array_free(names);
+	return finish(lines);
+}
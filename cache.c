@@ -0,0 +1,120 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libias/map.h>
+#include <libias/util.h>
+
+#include "cache.h"
+#include "hashfn.h"
+#include "stats.h"
+
+#define CACHE_SHARDS 64
+// Keys include metadata fingerprints, so a scan of a full ports tree
+// keeps adding new ones.  A shard is simply emptied when it grows past
+// this, which bounds the cache to about 256k entries.
+#define CACHE_SHARD_MAX 4096
+
+struct CacheShard {
+	pthread_mutex_t mutex;
+	struct Map *map;
+};
+
+struct Cache {
+	struct CacheShard shards[CACHE_SHARDS];
+};
+
+static struct CacheShard *cache_shard(struct Cache *, const char *);
+
+struct CacheShard *
+cache_shard(struct Cache *cache, const char *key)
+{
+	return &cache->shards[hash_str(HASH_INIT, key) % CACHE_SHARDS];
+}
+
+struct Cache *
+cache_new()
+{
+	struct Cache *cache = xmalloc(sizeof(struct Cache));
+	for (size_t i = 0; i < CACHE_SHARDS; i++) {
+		pthread_mutex_init(&cache->shards[i].mutex, NULL);
+		cache->shards[i].map = map_new(str_compare, NULL, free, NULL);
+	}
+	return cache;
+}
+
+void
+cache_free(struct Cache *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < CACHE_SHARDS; i++) {
+		pthread_mutex_destroy(&cache->shards[i].mutex);
+		map_free(cache->shards[i].map);
+	}
+	free(cache);
+}
+
+int
+cache_get(struct Cache *cache, const char *key, int *value)
+{
+	struct CacheShard *shard = cache_shard(cache, key);
+	pthread_mutex_lock(&shard->mutex);
+	int found = map_contains(shard->map, key);
+	if (found) {
+		*value = (intptr_t)map_get(shard->map, key);
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	if (found) {
+		STATS_INC(STATS_CACHE_HITS);
+	} else {
+		STATS_INC(STATS_CACHE_MISSES);
+	}
+	return found;
+}
+
+void
+cache_put(struct Cache *cache, const char *key, int value)
+{
+	struct CacheShard *shard = cache_shard(cache, key);
+	pthread_mutex_lock(&shard->mutex);
+	map_remove(shard->map, key);
+	if (map_len(shard->map) >= CACHE_SHARD_MAX) {
+		map_truncate(shard->map);
+	}
+	map_add(shard->map, xstrdup(key), (void *)(intptr_t)value);
+	pthread_mutex_unlock(&shard->mutex);
+}
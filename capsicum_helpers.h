@@ -48,6 +48,7 @@ enum CapsicumHelperFlags {
 	CAPH_CREATE = 1 << 5,
 	CAPH_READDIR = 1 << 6,
 	CAPH_SYMLINK = 1 << 7,
+	CAPH_RENAME = 1 << 8,
 };
 
 static __inline int
@@ -73,6 +74,8 @@ caph_limit_stream(int fd, int flags)
 		cap_rights_set(&rights, CAP_FSTATFS, CAP_LOOKUP, CAP_READ);
 	if ((flags & CAPH_SYMLINK) != 0)
 		cap_rights_set(&rights, CAP_SYMLINKAT | CAP_UNLINKAT);
+	if ((flags & CAPH_RENAME) != 0)
+		cap_rights_set(&rights, CAP_RENAMEAT_SOURCE, CAP_RENAMEAT_TARGET);
 
 	if (cap_rights_limit(fd, &rights) < 0 && errno != ENOSYS) {
 		if (errno == EBADF && (flags & CAPH_IGNORE_EBADF) != 0)
@@ -154,6 +154,12 @@ conditional_free(struct Conditional *cond)
 	free(cond);
 }
 
+size_t
+conditional_memory_usage(struct Conditional *cond)
+{
+	return sizeof(struct Conditional);
+}
+
 char *
 conditional_tostring(struct Conditional *cond)
 {
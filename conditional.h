@@ -61,5 +61,6 @@ enum ConditionalType {
 struct Conditional *conditional_new(char *);
 struct Conditional *conditional_clone(struct Conditional *);
 void conditional_free(struct Conditional *);
+size_t conditional_memory_usage(struct Conditional *);
 char *conditional_tostring(struct Conditional *);
 enum ConditionalType conditional_type(struct Conditional *);
@@ -0,0 +1,842 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/map.h>
+#include <libias/set.h>
+#include <libias/util.h>
+
+#include "conditional.h"
+#include "evaluator.h"
+#include "expander.h"
+#include "rules.h"
+#include "token.h"
+
+/*
+ * Compiles the expressions of all .if/.elif chains once and then
+ * evaluates them for a given configuration to get a view of the
+ * tokens where all decidable conditionals have been resolved.
+ * Chains where a condition cannot be decided before a branch is
+ * taken are kept as is but nested chains inside them are still
+ * pruned.
+ */
+
+enum EvaluatorResult {
+	EVAL_UNDECIDABLE = -1,
+	EVAL_FALSE = 0,
+	EVAL_TRUE = 1,
+};
+
+enum ExprType {
+	EXPR_AND,
+	EXPR_COMPARE,
+	EXPR_DEFINED,
+	EXPR_EMPTY,
+	EXPR_MAKE,
+	EXPR_NOT,
+	EXPR_OR,
+	EXPR_UNDECIDABLE,
+	EXPR_VALUE,
+};
+
+enum ExprCompare {
+	EXPR_COMPARE_EQ,
+	EXPR_COMPARE_NE,
+	EXPR_COMPARE_LT,
+	EXPR_COMPARE_LE,
+	EXPR_COMPARE_GT,
+	EXPR_COMPARE_GE,
+};
+
+struct Expr {
+	enum ExprType type;
+	enum ExprCompare op;
+	char *lhs;
+	char *rhs;
+	struct Expr *left;
+	struct Expr *right;
+};
+
+struct ExprParser {
+	const char *p;
+	enum ExprType function;
+	int error;
+};
+
+struct EvaluatorBranch {
+	size_t start;
+	size_t body;
+	struct Expr *expr;
+};
+
+struct EvaluatorChain {
+	struct Array *branches;
+	size_t end_start;
+	size_t end;
+};
+
+struct Evaluator {
+	struct Array *tokens;
+	struct EvaluatorChain **chains;
+	struct Array *chainlist;
+	int malformed;
+};
+
+struct EvaluatorConfig {
+	struct Map *variables;
+	struct Set *options;
+	struct Set *targets;
+};
+
+struct EvaluatorContext {
+	struct Evaluator *evaluator;
+	struct EvaluatorConfig *config;
+	struct Expander *expander;
+	struct Array *out;
+	struct Array *dropped;
+};
+
+static struct Expr *compile(const char *, enum ConditionalType);
+static void drop(struct EvaluatorContext *, size_t, size_t);
+static void emit(struct EvaluatorContext *, size_t, size_t);
+static enum EvaluatorResult eval(struct EvaluatorContext *, struct Expr *);
+static enum EvaluatorResult eval_compare(struct EvaluatorContext *, struct Expr *);
+static char *expand(struct EvaluatorContext *, const char *);
+static struct Expr *expr_new(enum ExprType, char *, struct Expr *, struct Expr *);
+static void expr_free(struct Expr *);
+static int parse_number(const char *, double *);
+static struct Expr *parse_and(struct ExprParser *);
+static struct Expr *parse_or(struct ExprParser *);
+static struct Expr *parse_primary(struct ExprParser *);
+static char *parse_term(struct ExprParser *, int *);
+static struct Expr *parse_unary(struct ExprParser *);
+static void prune_chain(struct EvaluatorContext *, struct EvaluatorChain *);
+static void prune_range(struct EvaluatorContext *, size_t, size_t);
+static const char *skip_expression(const char *);
+static void skip_space(struct ExprParser *);
+
+struct Expr *
+expr_new(enum ExprType type, char *lhs, struct Expr *left, struct Expr *right)
+{
+	struct Expr *expr = xmalloc(sizeof(struct Expr));
+	expr->type = type;
+	expr->lhs = lhs;
+	expr->left = left;
+	expr->right = right;
+	return expr;
+}
+
+void
+expr_free(struct Expr *expr)
+{
+	if (expr == NULL) {
+		return;
+	}
+	free(expr->lhs);
+	free(expr->rhs);
+	expr_free(expr->left);
+	expr_free(expr->right);
+	free(expr);
+}
+
+const char *
+skip_expression(const char *p)
+{
+	char close = p[1] == '{' ? '}' : ')';
+	for (p += 2; *p && *p != close;) {
+		if (*p == '$' && (p[1] == '{' || p[1] == '(')) {
+			p = skip_expression(p);
+		} else if (*p == '\\' && p[1]) {
+			p += 2;
+		} else {
+			p++;
+		}
+	}
+	if (*p) {
+		p++;
+	}
+	return p;
+}
+
+void
+skip_space(struct ExprParser *parser)
+{
+	while (isspace((unsigned char)*parser->p)) {
+		parser->p++;
+	}
+}
+
+char *
+parse_term(struct ExprParser *parser, int *bare)
+{
+	skip_space(parser);
+	const char *start = parser->p;
+	const char *p = start;
+	*bare = *p != '"';
+	if (!*bare) {
+		start = ++p;
+		while (*p && *p != '"') {
+			if (*p == '$' && (p[1] == '{' || p[1] == '(')) {
+				p = skip_expression(p);
+			} else if (*p == '\\' && p[1]) {
+				p += 2;
+			} else {
+				p++;
+			}
+		}
+		if (*p != '"') {
+			parser->error = 1;
+			return NULL;
+		}
+		parser->p = p + 1;
+		return xstrndup(start, p - start);
+	}
+
+	while (*p && !isspace((unsigned char)*p) && !strchr("!=<>()&|\"", *p)) {
+		if (*p == '$' && (p[1] == '{' || p[1] == '(')) {
+			p = skip_expression(p);
+		} else {
+			p++;
+		}
+	}
+	if (p == start) {
+		parser->error = 1;
+		return NULL;
+	}
+	parser->p = p;
+	return xstrndup(start, p - start);
+}
+
+struct Expr *
+parse_primary(struct ExprParser *parser)
+{
+	skip_space(parser);
+	if (*parser->p == '(') {
+		parser->p++;
+		struct Expr *expr = parse_or(parser);
+		skip_space(parser);
+		if (*parser->p != ')') {
+			parser->error = 1;
+		} else {
+			parser->p++;
+		}
+		return expr;
+	}
+
+	static const struct {
+		const char *name;
+		enum ExprType type;
+	} functions[] = {
+		{ "commands", EXPR_UNDECIDABLE },
+		{ "defined", EXPR_DEFINED },
+		{ "empty", EXPR_EMPTY },
+		{ "exists", EXPR_UNDECIDABLE },
+		{ "make", EXPR_MAKE },
+		{ "target", EXPR_UNDECIDABLE },
+	};
+	for (size_t i = 0; i < nitems(functions); i++) {
+		size_t len = strlen(functions[i].name);
+		if (strncmp(parser->p, functions[i].name, len) != 0 || parser->p[len] != '(') {
+			continue;
+		}
+		const char *start = parser->p + len + 1;
+		const char *p = start;
+		int depth = 0;
+		while (*p && (depth > 0 || *p != ')')) {
+			if (*p == '$' && (p[1] == '{' || p[1] == '(')) {
+				p = skip_expression(p);
+				continue;
+			} else if (*p == '(') {
+				depth++;
+			} else if (*p == ')') {
+				depth--;
+			}
+			p++;
+		}
+		if (*p != ')') {
+			parser->error = 1;
+			return NULL;
+		}
+		parser->p = p + 1;
+		return expr_new(functions[i].type, xstrndup(start, p - start), NULL, NULL);
+	}
+
+	int bare;
+	char *lhs = parse_term(parser, &bare);
+	if (lhs == NULL) {
+		return NULL;
+	}
+
+	skip_space(parser);
+	static const struct {
+		const char *op;
+		enum ExprCompare compare;
+	} ops[] = {
+		{ "==", EXPR_COMPARE_EQ },
+		{ "!=", EXPR_COMPARE_NE },
+		{ "<=", EXPR_COMPARE_LE },
+		{ ">=", EXPR_COMPARE_GE },
+		{ "<", EXPR_COMPARE_LT },
+		{ ">", EXPR_COMPARE_GT },
+	};
+	for (size_t i = 0; i < nitems(ops); i++) {
+		if (!str_startswith(parser->p, ops[i].op)) {
+			continue;
+		}
+		parser->p += strlen(ops[i].op);
+		int rhsbare;
+		char *rhs = parse_term(parser, &rhsbare);
+		if (rhs == NULL) {
+			free(lhs);
+			return NULL;
+		}
+		struct Expr *expr = expr_new(EXPR_COMPARE, lhs, NULL, NULL);
+		expr->op = ops[i].compare;
+		expr->rhs = rhs;
+		return expr;
+	}
+
+	// Plain words are passed to the default function of the
+	// directive, i.e., defined() for .if and make() for .ifmake
+	double number;
+	if (bare && strchr(lhs, '$') == NULL && !parse_number(lhs, &number)) {
+		return expr_new(parser->function, lhs, NULL, NULL);
+	}
+	return expr_new(EXPR_VALUE, lhs, NULL, NULL);
+}
+
+struct Expr *
+parse_unary(struct ExprParser *parser)
+{
+	skip_space(parser);
+	if (*parser->p == '!') {
+		parser->p++;
+		struct Expr *expr = parse_unary(parser);
+		if (expr == NULL) {
+			return NULL;
+		}
+		return expr_new(EXPR_NOT, NULL, expr, NULL);
+	}
+	return parse_primary(parser);
+}
+
+struct Expr *
+parse_and(struct ExprParser *parser)
+{
+	struct Expr *left = parse_unary(parser);
+	while (left) {
+		skip_space(parser);
+		if (!str_startswith(parser->p, "&&")) {
+			break;
+		}
+		parser->p += 2;
+		struct Expr *right = parse_unary(parser);
+		if (right == NULL) {
+			expr_free(left);
+			return NULL;
+		}
+		left = expr_new(EXPR_AND, NULL, left, right);
+	}
+	return left;
+}
+
+struct Expr *
+parse_or(struct ExprParser *parser)
+{
+	struct Expr *left = parse_and(parser);
+	while (left) {
+		skip_space(parser);
+		if (!str_startswith(parser->p, "||")) {
+			break;
+		}
+		parser->p += 2;
+		struct Expr *right = parse_and(parser);
+		if (right == NULL) {
+			expr_free(left);
+			return NULL;
+		}
+		left = expr_new(EXPR_OR, NULL, left, right);
+	}
+	return left;
+}
+
+struct Expr *
+compile(const char *s, enum ConditionalType type)
+{
+	struct ExprParser parser = { s, EXPR_DEFINED, 0 };
+	int negate = 0;
+	switch (type) {
+	case COND_ELIFNDEF:
+	case COND_IFNDEF:
+		negate = 1;
+		break;
+	case COND_IFNMAKE:
+		negate = 1;
+		/* FALLTHROUGH */
+	case COND_ELIFMAKE:
+	case COND_IFMAKE:
+		parser.function = EXPR_MAKE;
+		break;
+	default:
+		break;
+	}
+
+	struct Expr *expr = parse_or(&parser);
+	skip_space(&parser);
+	if (expr == NULL || parser.error || *parser.p) {
+		// Conservatively treat anything we do not understand as
+		// undecidable so that the chain is kept as is
+		expr_free(expr);
+		return expr_new(EXPR_UNDECIDABLE, NULL, NULL, NULL);
+	} else if (negate) {
+		return expr_new(EXPR_NOT, NULL, expr, NULL);
+	} else {
+		return expr;
+	}
+}
+
+int
+parse_number(const char *s, double *number)
+{
+	char *end;
+	while (isspace((unsigned char)*s)) {
+		s++;
+	}
+	if (*s == 0) {
+		return 0;
+	}
+	*number = strtod(s, &end);
+	while (isspace((unsigned char)*end)) {
+		end++;
+	}
+	return *end == 0;
+}
+
+char *
+expand(struct EvaluatorContext *ctx, const char *s)
+{
+	char *reason = NULL;
+	char *value = expander_string(ctx->expander, s, &reason);
+	free(reason);
+	return value;
+}
+
+enum EvaluatorResult
+eval_compare(struct EvaluatorContext *ctx, struct Expr *expr)
+{
+	char *lhs = expand(ctx, expr->lhs);
+	char *rhs = expand(ctx, expr->rhs);
+	enum EvaluatorResult result = EVAL_UNDECIDABLE;
+	double a, b;
+	if (lhs == NULL || rhs == NULL) {
+		result = EVAL_UNDECIDABLE;
+	} else if (parse_number(lhs, &a) && parse_number(rhs, &b)) {
+		switch (expr->op) {
+		case EXPR_COMPARE_EQ:
+			result = a == b;
+			break;
+		case EXPR_COMPARE_NE:
+			result = a != b;
+			break;
+		case EXPR_COMPARE_LT:
+			result = a < b;
+			break;
+		case EXPR_COMPARE_LE:
+			result = a <= b;
+			break;
+		case EXPR_COMPARE_GT:
+			result = a > b;
+			break;
+		case EXPR_COMPARE_GE:
+			result = a >= b;
+			break;
+		}
+	} else if (expr->op == EXPR_COMPARE_EQ) {
+		result = strcmp(lhs, rhs) == 0;
+	} else if (expr->op == EXPR_COMPARE_NE) {
+		result = strcmp(lhs, rhs) != 0;
+	}
+	free(lhs);
+	free(rhs);
+	return result;
+}
+
+enum EvaluatorResult
+eval(struct EvaluatorContext *ctx, struct Expr *expr)
+{
+	switch (expr->type) {
+	case EXPR_AND: {
+		enum EvaluatorResult left = eval(ctx, expr->left);
+		if (left == EVAL_FALSE) {
+			return EVAL_FALSE;
+		}
+		enum EvaluatorResult right = eval(ctx, expr->right);
+		if (right == EVAL_FALSE) {
+			return EVAL_FALSE;
+		} else if (left == EVAL_TRUE && right == EVAL_TRUE) {
+			return EVAL_TRUE;
+		}
+		return EVAL_UNDECIDABLE;
+	} case EXPR_OR: {
+		enum EvaluatorResult left = eval(ctx, expr->left);
+		if (left == EVAL_TRUE) {
+			return EVAL_TRUE;
+		}
+		enum EvaluatorResult right = eval(ctx, expr->right);
+		if (right == EVAL_TRUE) {
+			return EVAL_TRUE;
+		} else if (left == EVAL_FALSE && right == EVAL_FALSE) {
+			return EVAL_FALSE;
+		}
+		return EVAL_UNDECIDABLE;
+	} case EXPR_NOT: {
+		enum EvaluatorResult result = eval(ctx, expr->left);
+		if (result == EVAL_UNDECIDABLE) {
+			return EVAL_UNDECIDABLE;
+		}
+		return !result;
+	} case EXPR_COMPARE:
+		return eval_compare(ctx, expr);
+	case EXPR_DEFINED: {
+		char *name = expand(ctx, expr->lhs);
+		if (name == NULL) {
+			return EVAL_UNDECIDABLE;
+		}
+		enum EvaluatorResult result = expander_defined(ctx->expander, name);
+		free(name);
+		return result;
+	} case EXPR_EMPTY: {
+		char *s = str_printf("${%s}", expr->lhs);
+		char *value = expand(ctx, s);
+		free(s);
+		if (value == NULL) {
+			return EVAL_UNDECIDABLE;
+		}
+		enum EvaluatorResult result = value[strspn(value, " \t\n")] == 0;
+		free(value);
+		return result;
+	} case EXPR_MAKE: {
+		char *pattern = expand(ctx, expr->lhs);
+		if (pattern == NULL) {
+			return EVAL_UNDECIDABLE;
+		}
+		enum EvaluatorResult result = EVAL_FALSE;
+		SET_FOREACH(ctx->config->targets, const char *, target) {
+			if (fnmatch(pattern, target, 0) == 0) {
+				result = EVAL_TRUE;
+				break;
+			}
+		}
+		free(pattern);
+		return result;
+	} case EXPR_VALUE: {
+		char *value = expand(ctx, expr->lhs);
+		if (value == NULL) {
+			return EVAL_UNDECIDABLE;
+		}
+		enum EvaluatorResult result;
+		double number;
+		if (parse_number(value, &number)) {
+			result = number != 0;
+		} else {
+			result = value[strspn(value, " \t\n")] != 0;
+		}
+		free(value);
+		return result;
+	} case EXPR_UNDECIDABLE:
+		return EVAL_UNDECIDABLE;
+	}
+
+	return EVAL_UNDECIDABLE;
+}
+
+void
+emit(struct EvaluatorContext *ctx, size_t start, size_t end)
+{
+	for (size_t i = start; i < end; i++) {
+		struct Token *t = array_get(ctx->evaluator->tokens, i);
+		array_append(ctx->out, t);
+		expander_feed(ctx->expander, t);
+	}
+}
+
+void
+drop(struct EvaluatorContext *ctx, size_t start, size_t end)
+{
+	if (ctx->dropped == NULL) {
+		return;
+	}
+	for (size_t i = start; i < end; i++) {
+		array_append(ctx->dropped, array_get(ctx->evaluator->tokens, i));
+	}
+}
+
+void
+prune_chain(struct EvaluatorContext *ctx, struct EvaluatorChain *chain)
+{
+	struct EvaluatorBranch *taken = NULL;
+	int undecidable = 0;
+	ARRAY_FOREACH(chain->branches, struct EvaluatorBranch *, branch) {
+		enum EvaluatorResult result = EVAL_TRUE;
+		if (branch->expr) {
+			result = eval(ctx, branch->expr);
+		}
+		if (result == EVAL_TRUE) {
+			taken = branch;
+			break;
+		} else if (result == EVAL_UNDECIDABLE) {
+			undecidable = 1;
+			break;
+		}
+	}
+
+	ARRAY_FOREACH(chain->branches, struct EvaluatorBranch *, branch) {
+		size_t end = chain->end_start;
+		if (branch_index + 1 < array_len(chain->branches)) {
+			struct EvaluatorBranch *next = array_get(chain->branches, branch_index + 1);
+			end = next->start;
+		}
+		if (undecidable) {
+			emit(ctx, branch->start, branch->body);
+			prune_range(ctx, branch->body, end);
+		} else if (branch == taken) {
+			drop(ctx, branch->start, branch->body);
+			prune_range(ctx, branch->body, end);
+		} else {
+			drop(ctx, branch->start, end);
+		}
+	}
+
+	if (undecidable) {
+		emit(ctx, chain->end_start, chain->end);
+	} else {
+		drop(ctx, chain->end_start, chain->end);
+	}
+}
+
+void
+prune_range(struct EvaluatorContext *ctx, size_t start, size_t end)
+{
+	for (size_t i = start; i < end;) {
+		struct EvaluatorChain *chain = ctx->evaluator->chains[i];
+		if (chain) {
+			prune_chain(ctx, chain);
+			i = chain->end;
+		} else {
+			emit(ctx, i, i + 1);
+			i++;
+		}
+	}
+}
+
+struct EvaluatorConfig *
+evaluator_config_new()
+{
+	struct EvaluatorConfig *config = xmalloc(sizeof(struct EvaluatorConfig));
+	config->variables = map_new(str_compare, NULL, free, free);
+	config->options = set_new(str_compare, NULL, free);
+	config->targets = set_new(str_compare, NULL, free);
+	return config;
+}
+
+void
+evaluator_config_free(struct EvaluatorConfig *config)
+{
+	if (config == NULL) {
+		return;
+	}
+	map_free(config->variables);
+	set_free(config->options);
+	set_free(config->targets);
+	free(config);
+}
+
+void
+evaluator_config_add_option(struct EvaluatorConfig *config, const char *option)
+{
+	if (!set_contains(config->options, option)) {
+		set_add(config->options, xstrdup(option));
+	}
+}
+
+void
+evaluator_config_add_target(struct EvaluatorConfig *config, const char *target)
+{
+	if (!set_contains(config->targets, target)) {
+		set_add(config->targets, xstrdup(target));
+	}
+}
+
+void
+evaluator_config_set(struct EvaluatorConfig *config, const char *name, const char *value)
+{
+	map_remove(config->variables, name);
+	map_add(config->variables, xstrdup(name), xstrdup(value));
+}
+
+struct Evaluator *
+evaluator_new(struct Array *tokens)
+{
+	struct Evaluator *evaluator = xmalloc(sizeof(struct Evaluator));
+	evaluator->tokens = tokens;
+	evaluator->chains = xrecallocarray(NULL, 0, array_len(tokens) + 1, sizeof(struct EvaluatorChain *));
+	evaluator->chainlist = array_new();
+
+	struct Array *stack = array_new();
+	struct Array *words = array_new();
+	size_t start = 0;
+	ARRAY_FOREACH(tokens, struct Token *, t) {
+		switch (token_type(t)) {
+		case CONDITIONAL_START:
+			start = t_index;
+			array_truncate(words);
+			break;
+		case CONDITIONAL_TOKEN:
+			// Skip over the directive itself
+			if (t_index > start + 1 && !is_comment(t)) {
+				array_append(words, token_data(t));
+			}
+			break;
+		case CONDITIONAL_END: {
+			enum ConditionalType type = conditional_type(token_conditional(t));
+			struct EvaluatorChain *chain = array_len(stack) > 0 ? array_get(stack, array_len(stack) - 1) : NULL;
+			struct EvaluatorBranch *branch = NULL;
+			switch (type) {
+			case COND_IF:
+			case COND_IFDEF:
+			case COND_IFMAKE:
+			case COND_IFNDEF:
+			case COND_IFNMAKE:
+				chain = xmalloc(sizeof(struct EvaluatorChain));
+				chain->branches = array_new();
+				array_append(evaluator->chainlist, chain);
+				array_append(stack, chain);
+				evaluator->chains[start] = chain;
+				/* FALLTHROUGH */
+			case COND_ELIF:
+			case COND_ELIFDEF:
+			case COND_ELIFMAKE:
+			case COND_ELIFNDEF:
+			case COND_ELSE:
+				if (chain == NULL) {
+					evaluator->malformed = 1;
+					break;
+				}
+				branch = xmalloc(sizeof(struct EvaluatorBranch));
+				branch->start = start;
+				branch->body = t_index + 1;
+				if (type != COND_ELSE) {
+					char *expr = str_join(words, " ");
+					branch->expr = compile(expr, type);
+					free(expr);
+				}
+				array_append(chain->branches, branch);
+				break;
+			case COND_ENDIF:
+				if (chain == NULL) {
+					evaluator->malformed = 1;
+					break;
+				}
+				chain->end_start = start;
+				chain->end = t_index + 1;
+				array_pop(stack);
+				break;
+			default:
+				break;
+			}
+			break;
+		} default:
+			break;
+		}
+	}
+	if (array_len(stack) > 0) {
+		evaluator->malformed = 1;
+	}
+	array_free(stack);
+	array_free(words);
+
+	return evaluator;
+}
+
+void
+evaluator_free(struct Evaluator *evaluator)
+{
+	if (evaluator == NULL) {
+		return;
+	}
+	ARRAY_FOREACH(evaluator->chainlist, struct EvaluatorChain *, chain) {
+		ARRAY_FOREACH(chain->branches, struct EvaluatorBranch *, branch) {
+			expr_free(branch->expr);
+			free(branch);
+		}
+		array_free(chain->branches);
+		free(chain);
+	}
+	array_free(evaluator->chainlist);
+	free(evaluator->chains);
+	free(evaluator);
+}
+
+struct Array *
+evaluator_prune(struct Evaluator *evaluator, struct EvaluatorConfig *config, struct Array *dropped)
+{
+	struct EvaluatorContext ctx = {
+		.evaluator = evaluator,
+		.config = config,
+		.expander = expander_new(NULL),
+		.out = array_new(),
+		.dropped = dropped,
+	};
+
+	// Options that are not part of the configuration are off
+	struct Array *options = set_values(config->options);
+	char *port_options = str_join(options, " ");
+	array_free(options);
+	expander_set(ctx.expander, "PORT_OPTIONS", port_options);
+	free(port_options);
+	MAP_FOREACH(config->variables, const char *, name, const char *, value) {
+		expander_set(ctx.expander, name, value);
+	}
+
+	if (evaluator->malformed) {
+		emit(&ctx, 0, array_len(evaluator->tokens));
+	} else {
+		prune_range(&ctx, 0, array_len(evaluator->tokens));
+	}
+
+	expander_free(ctx.expander);
+	return ctx.out;
+}
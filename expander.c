@@ -0,0 +1,944 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/map.h>
+#include <libias/util.h>
+
+#include "conditional.h"
+#include "expander.h"
+#include "rules.h"
+#include "token.h"
+#include "variable.h"
+
+/*
+ * A best effort evaluator for make variables.  The token stream is
+ * replayed once in order to resolve assignments with =, :=, +=, ?=
+ * and != semantics.  References are expanded lazily afterwards and
+ * the result for every variable is memoized.  Alternatively tokens
+ * can be fed one by one with expander_feed() to query the state at
+ * any point in the Makefile.
+ *
+ * Anything that needs more than the Makefile itself to be decided,
+ * i.e., variables that are only set by the framework, assignments
+ * inside conditionals, shell commands, or unsupported modifiers, is
+ * reported back to the caller as a reason instead of a value.
+ */
+
+struct ExpanderBuffer {
+	char *buf;
+	size_t len;
+	size_t cap;
+};
+
+struct ExpanderVariable {
+	char *name;
+	char *value;
+	char *unknown;
+	int defined;
+	int unset;
+	int fixed;
+	int expanding;
+	int memoized;
+	char *memo;
+	char *memo_unknown;
+};
+
+struct Expander {
+	struct Array *tokens;
+	struct Map *variables;
+	struct Array *names;
+	struct Array *values;
+	int depth;
+	int undef;
+	int replayed;
+	int memoize;
+};
+
+static void buffer_append(struct ExpanderBuffer *, const char *, size_t);
+static char *buffer_finish(struct ExpanderBuffer *);
+static char *expand(struct Expander *, const char *, char **);
+static char *expand_expression(struct Expander *, const char *, char **);
+static char *expand_range(struct Expander *, const char *, const char *, char **);
+static char *expand_variable(struct Expander *, struct ExpanderVariable *, char **);
+static void expander_assign(struct Expander *, struct Variable *, const char *, int);
+static struct ExpanderVariable *expander_lookup(struct Expander *, const char *);
+static void expander_replay(struct Expander *);
+static void expander_undef(struct Expander *, const char *, int);
+static void expander_variable_free(struct ExpanderVariable *);
+static void expander_variable_set(struct ExpanderVariable *, char *);
+static void expander_variable_unknown(struct ExpanderVariable *, char *);
+static const char *find_delimiter(const char *, char);
+static char *join_words(struct Array *);
+static char *modifier_match(const char *, const char *, int);
+static char *modifier_path(const char *, char);
+static char *modifier_quote(const char *);
+static char *modifier_regex(const char *, const char *, const char *, const char *, char **);
+static char *modifier_subst(const char *, const char *, const char *, const char *);
+static const char *skip_expression(const char *);
+static struct Array *split_words(const char *, int);
+static char *subst_word(const char *, const char *, const char *, int *);
+static void append_replacement(struct ExpanderBuffer *, const char *, const char *, regmatch_t *);
+static char *unescape_delimiter(char *, char);
+
+void
+buffer_append(struct ExpanderBuffer *buf, const char *s, size_t len)
+{
+	if (buf->len + len + 1 > buf->cap) {
+		size_t cap = buf->cap ? buf->cap : 64;
+		while (buf->len + len + 1 > cap) {
+			cap *= 2;
+		}
+		buf->buf = xrecallocarray(buf->buf, buf->cap, cap, 1);
+		buf->cap = cap;
+	}
+	memcpy(buf->buf + buf->len, s, len);
+	buf->len += len;
+	buf->buf[buf->len] = 0;
+}
+
+char *
+buffer_finish(struct ExpanderBuffer *buf)
+{
+	if (buf->buf == NULL) {
+		return xstrdup("");
+	}
+	return buf->buf;
+}
+
+const char *
+skip_expression(const char *p)
+{
+	char close = p[1] == '{' ? '}' : ')';
+	for (p += 2; *p && *p != close;) {
+		if (*p == '$' && (p[1] == '{' || p[1] == '(')) {
+			if ((p = skip_expression(p)) == NULL) {
+				return NULL;
+			}
+		} else if (*p == '\\' && p[1]) {
+			p += 2;
+		} else {
+			p++;
+		}
+	}
+	if (*p == 0) {
+		return NULL;
+	}
+	return p + 1;
+}
+
+const char *
+find_delimiter(const char *p, char delimiter)
+{
+	while (*p && *p != delimiter) {
+		if (*p == '$' && (p[1] == '{' || p[1] == '(')) {
+			if ((p = skip_expression(p)) == NULL) {
+				return NULL;
+			}
+		} else if (*p == '\\' && p[1]) {
+			p += 2;
+		} else {
+			p++;
+		}
+	}
+	return p;
+}
+
+char *
+unescape_delimiter(char *s, char delimiter)
+{
+	char *out = s;
+	for (char *p = s; *p; p++) {
+		if (*p == '\\' && *(p + 1) == delimiter) {
+			p++;
+		}
+		*out++ = *p;
+	}
+	*out = 0;
+	return s;
+}
+
+struct Array *
+split_words(const char *value, int whole)
+{
+	struct Array *words = array_new();
+	if (whole) {
+		array_append(words, xstrdup(value));
+		return words;
+	}
+	for (const char *p = value; *p;) {
+		p += strspn(p, " \t\n");
+		size_t len = strcspn(p, " \t\n");
+		if (len > 0) {
+			array_append(words, xstrndup(p, len));
+		}
+		p += len;
+	}
+	return words;
+}
+
+char *
+join_words(struct Array *words)
+{
+	char *s = str_join(words, " ");
+	ARRAY_FOREACH(words, char *, word) {
+		free(word);
+	}
+	array_free(words);
+	return s;
+}
+
+char *
+modifier_match(const char *value, const char *pattern, int negate)
+{
+	struct Array *words = split_words(value, 0);
+	struct Array *matches = array_new();
+	ARRAY_FOREACH(words, char *, word) {
+		if ((fnmatch(pattern, word, 0) == 0) != negate) {
+			array_append(matches, word);
+		} else {
+			free(word);
+		}
+	}
+	array_free(words);
+	return join_words(matches);
+}
+
+char *
+modifier_path(const char *value, char modifier)
+{
+	struct Array *words = split_words(value, 0);
+	ARRAY_FOREACH(words, char *, word) {
+		char *slash = strrchr(word, '/');
+		char *dot = strrchr(slash ? slash : word, '.');
+		char *part = NULL;
+		switch (modifier) {
+		case 'E':
+			part = xstrdup(dot ? dot + 1 : "");
+			break;
+		case 'H':
+			part = slash ? xstrndup(word, slash - word) : xstrdup(".");
+			break;
+		case 'R':
+			part = dot ? xstrndup(word, dot - word) : xstrdup(word);
+			break;
+		case 'T':
+			part = xstrdup(slash ? slash + 1 : word);
+			break;
+		}
+		free(word);
+		array_set(words, word_index, part);
+	}
+	return join_words(words);
+}
+
+char *
+modifier_quote(const char *value)
+{
+	struct ExpanderBuffer buf = {};
+	for (const char *p = value; *p; p++) {
+		if (strchr("\t\n \"#$&'()*;<>?[\\]`{|}~", *p)) {
+			buffer_append(&buf, "\\", 1);
+		}
+		buffer_append(&buf, p, 1);
+	}
+	return buffer_finish(&buf);
+}
+
+void
+append_replacement(struct ExpanderBuffer *buf, const char *rhs, const char *subject, regmatch_t *match)
+{
+	for (const char *p = rhs; *p; p++) {
+		if (*p == '\\' && *(p + 1) == '&') {
+			buffer_append(buf, "&", 1);
+			p++;
+		} else if (*p == '&') {
+			buffer_append(buf, subject + match[0].rm_so, match[0].rm_eo - match[0].rm_so);
+		} else if (match && *p == '\\' && isdigit((unsigned char)*(p + 1))) {
+			int i = *(p + 1) - '0';
+			if (match[i].rm_so != -1) {
+				buffer_append(buf, subject + match[i].rm_so, match[i].rm_eo - match[i].rm_so);
+			}
+			p++;
+		} else {
+			buffer_append(buf, p, 1);
+		}
+	}
+}
+
+char *
+subst_word(const char *word, const char *lhs, const char *rhs, int *global)
+{
+	// *global is 1 for :S///g and is reset to -1 after the first
+	// replacement for :S///1
+	int anchor_start = lhs[0] == '^';
+	if (anchor_start) {
+		lhs++;
+	}
+	size_t lhslen = strlen(lhs);
+	int anchor_end = lhslen > 0 && lhs[lhslen - 1] == '$';
+	if (anchor_end) {
+		lhslen--;
+	}
+	size_t wordlen = strlen(word);
+
+	struct ExpanderBuffer buf = {};
+	regmatch_t match[1];
+	const char *p = word;
+	if (anchor_start || anchor_end) {
+		size_t start = anchor_end && !anchor_start ? wordlen - lhslen : 0;
+		if (lhslen > wordlen || (anchor_start && anchor_end && lhslen != wordlen) ||
+		    strncmp(word + start, lhs, lhslen) != 0) {
+			return NULL;
+		}
+		match[0].rm_so = start;
+		match[0].rm_eo = start + lhslen;
+		buffer_append(&buf, word, start);
+		append_replacement(&buf, rhs, word, match);
+		buffer_append(&buf, word + start + lhslen, wordlen - start - lhslen);
+		return buffer_finish(&buf);
+	}
+
+	int matched = 0;
+	const char *found;
+	while (lhslen > 0 && (found = strstr(p, lhs)) != NULL) {
+		matched = 1;
+		match[0].rm_so = found - word;
+		match[0].rm_eo = found - word + lhslen;
+		buffer_append(&buf, p, found - p);
+		append_replacement(&buf, rhs, word, match);
+		p = found + lhslen;
+		if (!*global) {
+			break;
+		}
+	}
+	if (!matched) {
+		return NULL;
+	}
+	buffer_append(&buf, p, strlen(p));
+	return buffer_finish(&buf);
+}
+
+char *
+modifier_subst(const char *value, const char *lhs, const char *rhs, const char *flags)
+{
+	int global = strchr(flags, 'g') != NULL;
+	int once = strchr(flags, '1') != NULL;
+	struct Array *words = split_words(value, strchr(flags, 'W') != NULL);
+	int done = 0;
+	ARRAY_FOREACH(words, char *, word) {
+		if (done) {
+			continue;
+		}
+		char *replaced = subst_word(word, lhs, rhs, &global);
+		if (replaced) {
+			free(word);
+			array_set(words, word_index, replaced);
+			done = once;
+		}
+	}
+	return join_words(words);
+}
+
+char *
+modifier_regex(const char *value, const char *pattern, const char *rhs, const char *flags, char **reason)
+{
+	regex_t re;
+	if (regcomp(&re, pattern, REG_EXTENDED) != 0) {
+		*reason = str_printf("invalid regular expression in :C/%s/", pattern);
+		return NULL;
+	}
+	int global = strchr(flags, 'g') != NULL;
+	int once = strchr(flags, '1') != NULL;
+	struct Array *words = split_words(value, strchr(flags, 'W') != NULL);
+	int done = 0;
+	ARRAY_FOREACH(words, char *, word) {
+		if (done) {
+			continue;
+		}
+		struct ExpanderBuffer buf = {};
+		regmatch_t match[10];
+		const char *p = word;
+		int matched = 0;
+		while (*p && regexec(&re, p, nitems(match), match, p == word ? 0 : REG_NOTBOL) == 0) {
+			matched = 1;
+			buffer_append(&buf, p, match[0].rm_so);
+			append_replacement(&buf, rhs, p, match);
+			if (match[0].rm_eo == 0) {
+				// Empty match, make progress
+				buffer_append(&buf, p, 1);
+				p++;
+			} else {
+				p += match[0].rm_eo;
+			}
+			if (!global) {
+				break;
+			}
+		}
+		if (matched) {
+			buffer_append(&buf, p, strlen(p));
+			free(word);
+			array_set(words, word_index, buffer_finish(&buf));
+			done = once;
+		}
+	}
+	regfree(&re);
+	return join_words(words);
+}
+
+char *
+expand_range(struct Expander *e, const char *start, const char *end, char **reason)
+{
+	char *s = xstrndup(start, end - start);
+	char *value = expand(e, s, reason);
+	free(s);
+	return value;
+}
+
+char *
+expand_expression(struct Expander *e, const char *expr, char **reason)
+{
+	const char *p = find_delimiter(expr, ':');
+	if (p == NULL) {
+		*reason = str_printf("unterminated variable expression in ${%s}", expr);
+		return NULL;
+	}
+	char *name = expand_range(e, expr, p, reason);
+	if (name == NULL) {
+		return NULL;
+	}
+	char *value;
+	int defined;
+	if (*name == 0) {
+		// The empty variable is never defined, ${:Ufoo} is a
+		// common way to spell a literal
+		free(name);
+		value = xstrdup("");
+		defined = 0;
+	} else {
+		struct ExpanderVariable *var = NULL;
+		if (e->variables) {
+			var = map_get(e->variables, name);
+		}
+		if (var == NULL) {
+			*reason = str_printf("%s is not set in the Makefile", name);
+			free(name);
+			return NULL;
+		}
+		free(name);
+		if ((value = expand_variable(e, var, reason)) == NULL) {
+			return NULL;
+		}
+		defined = var->defined;
+	}
+
+	while (*p == ':') {
+		p++;
+		char *newvalue = NULL;
+		const char *end = NULL;
+		switch (*p) {
+		case 'M':
+		case 'N': {
+			if ((end = find_delimiter(p + 1, ':')) == NULL) {
+				goto malformed;
+			}
+			char *pattern = expand_range(e, p + 1, end, reason);
+			if (pattern == NULL) {
+				goto fail;
+			}
+			newvalue = modifier_match(value, pattern, *p == 'N');
+			free(pattern);
+			break;
+		} case 'S':
+		case 'C': {
+			char delimiter = *(p + 1);
+			if (delimiter == 0 || delimiter == ':') {
+				goto malformed;
+			}
+			const char *lhs_end = find_delimiter(p + 2, delimiter);
+			if (lhs_end == NULL || *lhs_end != delimiter) {
+				goto malformed;
+			}
+			const char *rhs_end = find_delimiter(lhs_end + 1, delimiter);
+			if (rhs_end == NULL || *rhs_end != delimiter) {
+				goto malformed;
+			}
+			end = rhs_end + 1 + strcspn(rhs_end + 1, ":");
+			char *flags = xstrndup(rhs_end + 1, end - rhs_end - 1);
+			if (strspn(flags, "g1W") != strlen(flags)) {
+				free(flags);
+				goto unsupported;
+			}
+			char *lhs = expand_range(e, p + 2, lhs_end, reason);
+			if (lhs == NULL) {
+				free(flags);
+				goto fail;
+			}
+			char *rhs = expand_range(e, lhs_end + 1, rhs_end, reason);
+			if (rhs == NULL) {
+				free(flags);
+				free(lhs);
+				goto fail;
+			}
+			unescape_delimiter(lhs, delimiter);
+			unescape_delimiter(rhs, delimiter);
+			if (*p == 'S') {
+				newvalue = modifier_subst(value, lhs, rhs, flags);
+			} else {
+				newvalue = modifier_regex(value, lhs, rhs, flags, reason);
+			}
+			free(flags);
+			free(lhs);
+			free(rhs);
+			if (newvalue == NULL) {
+				goto fail;
+			}
+			break;
+		} case 't':
+			end = p + 2;
+			if ((*(p + 1) != 'l' && *(p + 1) != 'u') || (*end != ':' && *end != 0)) {
+				goto unsupported;
+			}
+			newvalue = str_map(value, strlen(value), *(p + 1) == 'l' ? tolower : toupper);
+			break;
+		case 'E':
+		case 'H':
+		case 'Q':
+		case 'R':
+		case 'T':
+			end = p + 1;
+			if (*end != ':' && *end != 0) {
+				goto unsupported;
+			}
+			if (*p == 'Q') {
+				newvalue = modifier_quote(value);
+			} else {
+				newvalue = modifier_path(value, *p);
+			}
+			break;
+		case 'U':
+		case 'D':
+			if ((end = find_delimiter(p + 1, ':')) == NULL) {
+				goto malformed;
+			}
+			if ((*p == 'U' && !defined) || (*p == 'D' && defined)) {
+				if ((newvalue = expand_range(e, p + 1, end, reason)) == NULL) {
+					goto fail;
+				}
+			} else if (*p == 'D') {
+				newvalue = xstrdup("");
+			} else {
+				newvalue = xstrdup(value);
+			}
+			if (*p == 'U') {
+				defined = 1;
+			}
+			break;
+		default:
+			goto unsupported;
+		}
+		free(value);
+		value = newvalue;
+		p = end;
+	}
+
+	if (*p != 0) {
+		goto malformed;
+	}
+	if (!defined) {
+		free(value);
+		return xstrdup("");
+	}
+	return value;
+
+unsupported:
+	*reason = str_printf("unsupported modifier :%.*s in ${%s}", (int)strcspn(p, ":"), p, expr);
+	free(value);
+	return NULL;
+malformed:
+	*reason = str_printf("malformed modifier in ${%s}", expr);
+fail:
+	free(value);
+	return NULL;
+}
+
+char *
+expand(struct Expander *e, const char *s, char **reason)
+{
+	struct ExpanderBuffer buf = {};
+	for (const char *p = s; *p;) {
+		if (*p != '$') {
+			size_t len = strcspn(p, "$");
+			buffer_append(&buf, p, len);
+			p += len;
+		} else if (*(p + 1) == '$') {
+			buffer_append(&buf, "$", 1);
+			p += 2;
+		} else if (*(p + 1) == 0) {
+			buffer_append(&buf, "$", 1);
+			p++;
+		} else {
+			char *expr;
+			if (*(p + 1) == '{' || *(p + 1) == '(') {
+				const char *end = skip_expression(p);
+				if (end == NULL) {
+					*reason = str_printf("unterminated variable expression in %s", s);
+					free(buf.buf);
+					return NULL;
+				}
+				expr = xstrndup(p + 2, end - p - 3);
+				p = end;
+			} else {
+				// $@, $<, etc. or single letter variables
+				expr = xstrndup(p + 1, 1);
+				p += 2;
+			}
+			char *value = expand_expression(e, expr, reason);
+			free(expr);
+			if (value == NULL) {
+				free(buf.buf);
+				return NULL;
+			}
+			buffer_append(&buf, value, strlen(value));
+			free(value);
+		}
+	}
+	return buffer_finish(&buf);
+}
+
+char *
+expand_variable(struct Expander *e, struct ExpanderVariable *var, char **reason)
+{
+	if (var->unknown) {
+		*reason = xstrdup(var->unknown);
+		return NULL;
+	} else if (!var->defined) {
+		return xstrdup("");
+	} else if (var->memoized) {
+		if (var->memo) {
+			return xstrdup(var->memo);
+		}
+		*reason = xstrdup(var->memo_unknown);
+		return NULL;
+	} else if (var->expanding) {
+		*reason = str_printf("%s references itself", var->name);
+		return NULL;
+	}
+
+	var->expanding = 1;
+	char *value = expand(e, var->value, reason);
+	var->expanding = 0;
+
+	// While the Makefile is replayed the variable might still
+	// change, so only remember the final values.
+	if (e->memoize) {
+		var->memoized = 1;
+		if (value) {
+			var->memo = xstrdup(value);
+		} else {
+			var->memo_unknown = xstrdup(*reason);
+		}
+	}
+
+	return value;
+}
+
+void
+expander_variable_free(struct ExpanderVariable *var)
+{
+	free(var->name);
+	free(var->value);
+	free(var->unknown);
+	free(var->memo);
+	free(var->memo_unknown);
+	free(var);
+}
+
+void
+expander_variable_set(struct ExpanderVariable *var, char *value)
+{
+	free(var->value);
+	free(var->unknown);
+	var->value = value;
+	var->unknown = NULL;
+	var->defined = 1;
+	var->unset = 0;
+}
+
+void
+expander_variable_unknown(struct ExpanderVariable *var, char *reason)
+{
+	free(var->value);
+	free(var->unknown);
+	var->value = NULL;
+	var->unknown = reason;
+	var->defined = 0;
+	var->unset = 0;
+}
+
+struct ExpanderVariable *
+expander_lookup(struct Expander *e, const char *name)
+{
+	struct ExpanderVariable *var = map_get(e->variables, name);
+	if (var == NULL) {
+		var = xmalloc(sizeof(struct ExpanderVariable));
+		var->name = xstrdup(name);
+		// Until the Makefile assigns it the variable might still
+		// have a value from the framework or the environment.
+		var->unknown = str_printf("%s is not set in the Makefile", name);
+		var->unset = 1;
+		map_add(e->variables, var->name, var);
+		array_append(e->names, var->name);
+	}
+	return var;
+}
+
+void
+expander_assign(struct Expander *e, struct Variable *v, const char *value, int conditional)
+{
+	const char *name = variable_name(v);
+	struct ExpanderVariable *var = expander_lookup(e, name);
+
+	if (var->fixed) {
+		// Like variables set on the command line
+		return;
+	} else if (conditional) {
+		if (var->unknown == NULL || var->unset) {
+			expander_variable_unknown(var, str_printf("%s is assigned inside a conditional", name));
+		}
+		return;
+	}
+
+	switch (variable_modifier(v)) {
+	case MODIFIER_ASSIGN:
+		expander_variable_set(var, xstrdup(value));
+		break;
+	case MODIFIER_EXPAND: {
+		char *reason = NULL;
+		char *expanded = expand(e, value, &reason);
+		if (expanded == NULL) {
+			expander_variable_unknown(var, reason);
+			break;
+		}
+		// The value is final, make sure it is not expanded again
+		struct ExpanderBuffer buf = {};
+		for (const char *p = expanded; *p; p++) {
+			buffer_append(&buf, p, 1);
+			if (*p == '$') {
+				buffer_append(&buf, "$", 1);
+			}
+		}
+		free(expanded);
+		expander_variable_set(var, buffer_finish(&buf));
+		break;
+	} case MODIFIER_OPTIONAL:
+		if (var->unset) {
+			expander_variable_unknown(var, str_printf("%s may be set outside the Makefile", name));
+		} else if (!var->defined && var->unknown == NULL) {
+			expander_variable_set(var, xstrdup(value));
+		}
+		break;
+	case MODIFIER_APPEND:
+		if (var->unset) {
+			expander_variable_unknown(var, str_printf("%s may be set outside the Makefile", name));
+		} else if (var->unknown) {
+			break;
+		} else if (var->defined && *var->value && *value) {
+			expander_variable_set(var, str_printf("%s %s", var->value, value));
+		} else if (!var->defined || *value) {
+			expander_variable_set(var, xstrdup(value));
+		}
+		break;
+	case MODIFIER_SHELL:
+		expander_variable_unknown(var, str_printf("%s is assigned with != which runs a shell command", name));
+		break;
+	}
+}
+
+void
+expander_undef(struct Expander *e, const char *name, int conditional)
+{
+	struct ExpanderVariable *var = expander_lookup(e, name);
+	if (var->fixed) {
+		return;
+	} else if (conditional) {
+		if (var->unknown == NULL || var->unset) {
+			expander_variable_unknown(var, str_printf("%s is undefined inside a conditional", name));
+		}
+	} else {
+		expander_variable_unknown(var, NULL);
+	}
+}
+
+void
+expander_replay(struct Expander *e)
+{
+	if (e->replayed) {
+		return;
+	}
+	e->replayed = 1;
+
+	if (e->tokens) {
+		ARRAY_FOREACH(e->tokens, struct Token *, t) {
+			expander_feed(e, t);
+		}
+		e->memoize = 1;
+	}
+}
+
+struct Expander *
+expander_new(struct Array *tokens)
+{
+	struct Expander *e = xmalloc(sizeof(struct Expander));
+	e->tokens = tokens;
+	e->variables = map_new(str_compare, NULL, NULL, expander_variable_free);
+	e->names = array_new();
+	e->values = array_new();
+	return e;
+}
+
+void
+expander_free(struct Expander *e)
+{
+	if (e == NULL) {
+		return;
+	}
+	map_free(e->variables);
+	array_free(e->names);
+	array_free(e->values);
+	free(e);
+}
+
+void
+expander_feed(struct Expander *e, struct Token *t)
+{
+	switch (token_type(t)) {
+	case CONDITIONAL_START:
+		switch (conditional_type(token_conditional(t))) {
+		case COND_FOR:
+		case COND_IF:
+		case COND_IFDEF:
+		case COND_IFMAKE:
+		case COND_IFNDEF:
+		case COND_IFNMAKE:
+			e->depth++;
+			break;
+		case COND_ENDFOR:
+		case COND_ENDIF:
+			if (e->depth > 0) {
+				e->depth--;
+			}
+			break;
+		case COND_UNDEF:
+			e->undef = 1;
+			break;
+		default:
+			break;
+		}
+		break;
+	case CONDITIONAL_TOKEN:
+		// Skip over the .undef itself
+		if (e->undef == 1) {
+			e->undef = 2;
+		} else if (e->undef == 2) {
+			expander_undef(e, token_data(t), e->depth > 0);
+		}
+		break;
+	case CONDITIONAL_END:
+		e->undef = 0;
+		break;
+	case VARIABLE_START:
+		array_truncate(e->values);
+		break;
+	case VARIABLE_TOKEN:
+		if (!is_comment(t)) {
+			array_append(e->values, token_data(t));
+		}
+		break;
+	case VARIABLE_END: {
+		char *value = str_join(e->values, " ");
+		expander_assign(e, token_variable(t), value, e->depth > 0);
+		free(value);
+		break;
+	} default:
+		break;
+	}
+}
+
+int
+expander_defined(struct Expander *e, const char *name)
+{
+	expander_replay(e);
+	struct ExpanderVariable *var = map_get(e->variables, name);
+	if (var == NULL || var->unknown) {
+		return -1;
+	}
+	return var->defined;
+}
+
+void
+expander_set(struct Expander *e, const char *name, const char *value)
+{
+	struct ExpanderVariable *var = expander_lookup(e, name);
+	expander_variable_set(var, xstrdup(value));
+	var->fixed = 1;
+}
+
+char *
+expander_string(struct Expander *e, const char *s, char **reason)
+{
+	expander_replay(e);
+	return expand(e, s, reason);
+}
+
+char *
+expander_variable(struct Expander *e, const char *name, char **reason)
+{
+	expander_replay(e);
+	struct ExpanderVariable *var = map_get(e->variables, name);
+	if (var == NULL) {
+		*reason = str_printf("%s is not set in the Makefile", name);
+		return NULL;
+	}
+	return expand_variable(e, var, reason);
+}
+
+struct Array *
+expander_variables(struct Expander *e)
+{
+	expander_replay(e);
+	return e->names;
+}
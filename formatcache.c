@@ -0,0 +1,159 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libias/util.h>
+
+#include "formatcache.h"
+#include "hashfn.h"
+#include "parser.h"
+#include "stats.h"
+
+// Bump this whenever the output of portfmt changes for some input so
+// that files are checked again.
+#define FORMAT_CACHE_VERSION 1
+
+// Flags that only select where and how the output is written
+#define FORMAT_CACHE_IGNORED_BEHAVIOR \
+	(PARSER_OUTPUT_DIFF | PARSER_OUTPUT_INPLACE | PARSER_OUTPUT_NO_COLOR)
+
+struct FormatCache {
+	int dirfd;
+};
+
+// An entry is a file named after the key that holds the content
+// length and a second hash to catch key collisions.
+struct FormatCacheEntry {
+	uint64_t len;
+	uint64_t check;
+};
+
+static uint64_t hash_key(struct ParserSettings *, const char *, size_t);
+
+uint64_t
+hash_key(struct ParserSettings *settings, const char *buf, size_t len)
+{
+	uint64_t settings_key[] = {
+		FORMAT_CACHE_VERSION,
+		PORTFMT_SUBPACKAGES,
+		settings->behavior & ~FORMAT_CACHE_IGNORED_BEHAVIOR,
+		settings->target_command_format_threshold,
+		settings->target_command_format_wrapcol,
+		settings->wrapcol,
+	};
+	uint64_t h = hash_bytes(HASH_INIT, settings_key, sizeof(settings_key));
+	return hash_bytes(h, buf, len);
+}
+
+struct FormatCache *
+format_cache_open(const char *path)
+{
+	if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+		return NULL;
+	}
+	char *formatted = str_printf("%s/formatted", path);
+	if (mkdir(formatted, 0755) == -1 && errno != EEXIST) {
+		free(formatted);
+		return NULL;
+	}
+	int dirfd = open(formatted, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+	free(formatted);
+	if (dirfd == -1) {
+		return NULL;
+	}
+
+	struct FormatCache *cache = xmalloc(sizeof(struct FormatCache));
+	cache->dirfd = dirfd;
+	return cache;
+}
+
+void
+format_cache_close(struct FormatCache *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+	close(cache->dirfd);
+	free(cache);
+}
+
+int
+format_cache_contains(struct FormatCache *cache, struct ParserSettings *settings, const char *buf, size_t len)
+{
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash_key(settings, buf, len));
+
+	int found = 0;
+	int fd = openat(cache->dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd != -1) {
+		struct FormatCacheEntry entry;
+		found = read(fd, &entry, sizeof(entry)) == sizeof(entry) &&
+			entry.len == len && entry.check == hash_check(buf, len);
+		close(fd);
+	}
+
+	if (found) {
+		STATS_INC(STATS_FORMAT_CACHE_HITS);
+	} else {
+		STATS_INC(STATS_FORMAT_CACHE_MISSES);
+	}
+	return found;
+}
+
+// Records that buf is formatted according to settings.  Like the
+// token cache this is best effort and errors are ignored.
+void
+format_cache_add(struct FormatCache *cache, struct ParserSettings *settings, const char *buf, size_t len)
+{
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash_key(settings, buf, len));
+	char *tmpname = str_printf(".%s.%ld", name, (long)getpid());
+
+	struct FormatCacheEntry entry = { len, hash_check(buf, len) };
+	int fd = openat(cache->dirfd, tmpname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd != -1) {
+		ssize_t written = write(fd, &entry, sizeof(entry));
+		if (close(fd) == -1 || written != sizeof(entry) ||
+		    renameat(cache->dirfd, tmpname, cache->dirfd, name) == -1) {
+			unlinkat(cache->dirfd, tmpname, 0);
+		}
+	}
+
+	free(tmpname);
+}
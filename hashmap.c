@@ -0,0 +1,318 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "hashfn.h"
+#include "hashmap.h"
+
+#define HASHMAP_MIN_CAPACITY 16
+
+struct HashMapSlot {
+	const void *key;
+	const void *value;
+	size_t hash;
+};
+
+struct HashMap {
+	HashMapHashFn hash;
+	HashMapCompareFn cmp;
+	void *userdata;
+	void (*keyfree)(void *);
+	void (*valuefree)(void *);
+	struct HashMapSlot *slots;
+	size_t cap;
+	size_t len;
+};
+
+static int hashmap_compare(struct HashMap *, const void *, const void *);
+static void hashmap_free_entry(struct HashMap *, struct HashMapSlot *);
+static void hashmap_grow(struct HashMap *);
+static struct HashMapSlot *hashmap_search(struct HashMap *, const void *, size_t);
+static int hashmap_sort_compare(const void *, const void *, void *);
+
+struct HashMap *
+hashmap_new(HashMapHashFn hash, HashMapCompareFn cmp, void *userdata, void *keyfree, void *valuefree)
+{
+	struct HashMap *map = xmalloc(sizeof(struct HashMap));
+	map->hash = hash;
+	map->cmp = cmp;
+	map->userdata = userdata;
+	map->keyfree = keyfree;
+	map->valuefree = valuefree;
+	return map;
+}
+
+void
+hashmap_free(struct HashMap *map)
+{
+	if (map == NULL) {
+		return;
+	}
+
+	hashmap_truncate(map);
+	free(map->slots);
+	free(map);
+}
+
+int
+hashmap_compare(struct HashMap *map, const void *a, const void *b)
+{
+	if (map->cmp) {
+		return map->cmp(&a, &b, map->userdata);
+	} else if (a < b) {
+		return -1;
+	} else if (a > b) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+void
+hashmap_free_entry(struct HashMap *map, struct HashMapSlot *slot)
+{
+	if (map->keyfree) {
+		map->keyfree((void *)slot->key);
+	}
+	if (map->valuefree && slot->value != slot->key) {
+		map->valuefree((void *)slot->value);
+	}
+}
+
+// Returns the slot of key or the empty slot where it would go
+struct HashMapSlot *
+hashmap_search(struct HashMap *map, const void *key, size_t hash)
+{
+	size_t mask = map->cap - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+		struct HashMapSlot *slot = &map->slots[i];
+		if (slot->key == NULL ||
+		    (slot->hash == hash && hashmap_compare(map, slot->key, key) == 0)) {
+			return slot;
+		}
+	}
+}
+
+void
+hashmap_grow(struct HashMap *map)
+{
+	struct HashMapSlot *slots = map->slots;
+	size_t cap = map->cap;
+	if (map->cap == 0) {
+		map->cap = HASHMAP_MIN_CAPACITY;
+	} else {
+		map->cap *= 2;
+	}
+	map->slots = xmalloc(map->cap * sizeof(struct HashMapSlot));
+	for (size_t i = 0; i < cap; i++) {
+		if (slots[i].key) {
+			*hashmap_search(map, slots[i].key, slots[i].hash) = slots[i];
+		}
+	}
+	free(slots);
+}
+
+// Like map_add() an existing entry is kept and the new key and value
+// are freed instead.
+void
+hashmap_add(struct HashMap *map, const void *key, const void *value)
+{
+	// Keep the load factor below 3/4 so that probe sequences stay short
+	if (4 * (map->len + 1) > 3 * map->cap) {
+		hashmap_grow(map);
+	}
+
+	size_t hash = map->hash(key, map->userdata);
+	struct HashMapSlot *slot = hashmap_search(map, key, hash);
+	if (slot->key) {
+		if (map->keyfree && slot->key != key) {
+			map->keyfree((void *)key);
+		}
+		if (map->valuefree && slot->value != value && value != key) {
+			map->valuefree((void *)value);
+		}
+		return;
+	}
+	slot->key = key;
+	slot->value = value;
+	slot->hash = hash;
+	map->len++;
+}
+
+void
+hashmap_remove(struct HashMap *map, const void *key)
+{
+	if (map->len == 0) {
+		return;
+	}
+
+	struct HashMapSlot *slot = hashmap_search(map, key, map->hash(key, map->userdata));
+	if (slot->key == NULL) {
+		return;
+	}
+	hashmap_free_entry(map, slot);
+	map->len--;
+
+	// Shift back the entries after it that would otherwise no
+	// longer be reachable from their home slot
+	size_t mask = map->cap - 1;
+	size_t hole = slot - map->slots;
+	for (size_t i = (hole + 1) & mask; map->slots[i].key; i = (i + 1) & mask) {
+		size_t home = map->slots[i].hash & mask;
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			map->slots[hole] = map->slots[i];
+			hole = i;
+		}
+	}
+	map->slots[hole].key = NULL;
+	map->slots[hole].value = NULL;
+}
+
+void *
+hashmap_get(struct HashMap *map, const void *key)
+{
+	if (map->len == 0) {
+		return NULL;
+	}
+
+	struct HashMapSlot *slot = hashmap_search(map, key, map->hash(key, map->userdata));
+	return (void *)slot->value;
+}
+
+int
+hashmap_contains(struct HashMap *map, const void *key)
+{
+	if (map->len == 0) {
+		return 0;
+	}
+
+	return hashmap_search(map, key, map->hash(key, map->userdata))->key != NULL;
+}
+
+size_t
+hashmap_len(struct HashMap *map)
+{
+	return map->len;
+}
+
+// Removes all entries.  Large tables are released so that reusing a
+// map for many small batches stays cheap.
+void
+hashmap_truncate(struct HashMap *map)
+{
+	if (map->len > 0) {
+		for (size_t i = 0; i < map->cap; i++) {
+			if (map->slots[i].key) {
+				hashmap_free_entry(map, &map->slots[i]);
+			}
+		}
+		map->len = 0;
+	}
+	if (map->cap > HASHMAP_MIN_CAPACITY) {
+		free(map->slots);
+		map->slots = NULL;
+		map->cap = 0;
+	} else if (map->slots) {
+		memset(map->slots, 0, map->cap * sizeof(struct HashMapSlot));
+	}
+}
+
+// Keys in table order
+struct Array *
+hashmap_keys(struct HashMap *map)
+{
+	struct Array *keys = array_new();
+	for (size_t i = 0; i < map->cap; i++) {
+		if (map->slots[i].key) {
+			array_append(keys, map->slots[i].key);
+		}
+	}
+	return keys;
+}
+
+int
+hashmap_sort_compare(const void *ap, const void *bp, void *userdata)
+{
+	struct HashMap *map = userdata;
+	return hashmap_compare(map, *(const void **)ap, *(const void **)bp);
+}
+
+// Keys in the order a struct Map with the same compare function
+// would return them
+struct Array *
+hashmap_sorted_keys(struct HashMap *map)
+{
+	struct Array *keys = hashmap_keys(map);
+	array_sort(keys, hashmap_sort_compare, map);
+	return keys;
+}
+
+struct HashMapIterator
+hashmap_iterator(struct HashMap *map)
+{
+	struct HashMapIterator iter = { .map = map, .i = 0 };
+	return iter;
+}
+
+int
+hashmap_iterator_next(struct HashMapIterator *iter, void **key, void **value)
+{
+	struct HashMap *map = iter->map;
+	for (; iter->i < map->cap; iter->i++) {
+		struct HashMapSlot *slot = &map->slots[iter->i];
+		if (slot->key) {
+			*key = (void *)slot->key;
+			*value = (void *)slot->value;
+			iter->i++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+size_t
+hashmap_ptr_hash(const void *p, void *userdata)
+{
+	// Fibonacci hashing, the low bits of pointers are mostly zero
+	uint64_t h = (uintptr_t)p * 11400714819323198485ULL;
+	return h ^ (h >> 32);
+}
+
+size_t
+hashmap_str_hash(const void *s, void *userdata)
+{
+	return hash_str(HASH_INIT, s);
+}
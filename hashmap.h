@@ -0,0 +1,66 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#pragma once
+
+// Open addressing hash map for hot membership tests where the
+// O(log n) comparisons of libias' sorted maps add up.  The interface
+// mirrors struct Map: keys are compared with the same kind of compare
+// function, which is also used by hashmap_sorted_keys() for callers
+// that need a stable order.  NULL keys are not supported and the map
+// must not be modified while iterating over it.
+struct Array;
+struct HashMap;
+
+typedef size_t (*HashMapHashFn)(const void *, void *);
+typedef int (*HashMapCompareFn)(const void *, const void *, void *);
+
+struct HashMapIterator {
+	struct HashMap *map;
+	size_t i;
+};
+
+#define HASHMAP_FOREACH(MAP, KEYTYPE, KEYVAR, VALTYPE, VALVAR) \
+	for (struct HashMapIterator __##KEYVAR##_iter = hashmap_iterator(MAP), *__##KEYVAR##_p = &__##KEYVAR##_iter; __##KEYVAR##_p; __##KEYVAR##_p = NULL) \
+	for (VALTYPE VALVAR = NULL, *__##VALVAR##_p = (void *)1; __##VALVAR##_p; __##VALVAR##_p = NULL) \
+	for (KEYTYPE KEYVAR; hashmap_iterator_next(&__##KEYVAR##_iter, (void **)&KEYVAR, (void **)&VALVAR);)
+
+struct HashMap *hashmap_new(HashMapHashFn, HashMapCompareFn, void *, void *, void *);
+void hashmap_free(struct HashMap *);
+void hashmap_add(struct HashMap *, const void *, const void *);
+void hashmap_remove(struct HashMap *, const void *);
+void *hashmap_get(struct HashMap *, const void *);
+int hashmap_contains(struct HashMap *, const void *);
+size_t hashmap_len(struct HashMap *);
+void hashmap_truncate(struct HashMap *);
+struct Array *hashmap_keys(struct HashMap *);
+struct Array *hashmap_sorted_keys(struct HashMap *);
+struct HashMapIterator hashmap_iterator(struct HashMap *);
+int hashmap_iterator_next(struct HashMapIterator *, void **, void **);
+
+size_t hashmap_ptr_hash(const void *, void *);
+size_t hashmap_str_hash(const void *, void *);
@@ -0,0 +1,125 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "hashmap.h"
+#include "hashset.h"
+
+struct HashSet {
+	struct HashMap *map;
+};
+
+struct HashSet *
+hashset_new(HashSetHashFn hash, HashSetCompareFn cmp, void *userdata, void *valuefree)
+{
+	struct HashSet *set = xmalloc(sizeof(struct HashSet));
+	set->map = hashmap_new(hash, cmp, userdata, valuefree, NULL);
+	return set;
+}
+
+void
+hashset_free(struct HashSet *set)
+{
+	if (set == NULL) {
+		return;
+	}
+
+	hashmap_free(set->map);
+	free(set);
+}
+
+void
+hashset_add(struct HashSet *set, const void *value)
+{
+	hashmap_add(set->map, value, value);
+}
+
+void
+hashset_remove(struct HashSet *set, const void *value)
+{
+	hashmap_remove(set->map, value);
+}
+
+void *
+hashset_get(struct HashSet *set, const void *value)
+{
+	return hashmap_get(set->map, value);
+}
+
+int
+hashset_contains(struct HashSet *set, const void *value)
+{
+	return hashmap_contains(set->map, value);
+}
+
+size_t
+hashset_len(struct HashSet *set)
+{
+	return hashmap_len(set->map);
+}
+
+void
+hashset_truncate(struct HashSet *set)
+{
+	hashmap_truncate(set->map);
+}
+
+struct Array *
+hashset_values(struct HashSet *set)
+{
+	return hashmap_keys(set->map);
+}
+
+struct Array *
+hashset_sorted_values(struct HashSet *set)
+{
+	return hashmap_sorted_keys(set->map);
+}
+
+struct HashSetIterator
+hashset_iterator(struct HashSet *set)
+{
+	struct HashSetIterator iter = { .map = set->map, .i = 0 };
+	return iter;
+}
+
+int
+hashset_iterator_next(struct HashSetIterator *iter, void **value)
+{
+	struct HashMapIterator mapiter = { .map = iter->map, .i = iter->i };
+	void *unused;
+	int retval = hashmap_iterator_next(&mapiter, value, &unused);
+	iter->i = mapiter.i;
+	return retval;
+}
@@ -0,0 +1,58 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#pragma once
+
+// Hash set on top of struct HashMap, see hashmap.h
+struct Array;
+struct HashMap;
+struct HashSet;
+
+typedef size_t (*HashSetHashFn)(const void *, void *);
+typedef int (*HashSetCompareFn)(const void *, const void *, void *);
+
+struct HashSetIterator {
+	struct HashMap *map;
+	size_t i;
+};
+
+#define HASHSET_FOREACH(SET, TYPE, VAR) \
+	for (struct HashSetIterator __##VAR##_iter = hashset_iterator(SET), *__##VAR##_p = &__##VAR##_iter; __##VAR##_p; __##VAR##_p = NULL) \
+	for (TYPE VAR; hashset_iterator_next(&__##VAR##_iter, (void **)&VAR);)
+
+struct HashSet *hashset_new(HashSetHashFn, HashSetCompareFn, void *, void *);
+void hashset_free(struct HashSet *);
+void hashset_add(struct HashSet *, const void *);
+void hashset_remove(struct HashSet *, const void *);
+void *hashset_get(struct HashSet *, const void *);
+int hashset_contains(struct HashSet *, const void *);
+size_t hashset_len(struct HashSet *);
+void hashset_truncate(struct HashSet *);
+struct Array *hashset_values(struct HashSet *);
+struct Array *hashset_sorted_values(struct HashSet *);
+struct HashSetIterator hashset_iterator(struct HashSet *);
+int hashset_iterator_next(struct HashSetIterator *, void **);
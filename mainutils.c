@@ -35,6 +35,7 @@
 # include <err.h>
 #endif
 #include <fcntl.h>
+#include <getopt.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -45,8 +46,21 @@
 #include <libias/util.h>
 
 #include "capsicum_helpers.h"
+#include "formatcache.h"
 #include "mainutils.h"
 #include "parser.h"
+#include "stats.h"
+#include "token.h"
+#include "tokencache.h"
+
+int memory_usage_enabled = 0;
+static struct FormatCache *format_cache = NULL;
+static struct TokenCache *token_cache = NULL;
+
+static struct option longopts[] = {
+	{ "stats", optional_argument, NULL, 0 },
+	{ NULL, 0, NULL, 0 },
+};
 
 int
 can_use_colors(FILE *fp)
@@ -75,18 +89,60 @@ enter_sandbox()
 	}
 #endif
 #if HAVE_PLEDGE
-	if (pledge("stdio", NULL) == -1) {
+	const char *promises = "stdio";
+	if (format_cache || token_cache) {
+		promises = "stdio rpath wpath cpath";
+	}
+	if (pledge(promises, NULL) == -1) {
 		err(1, "pledge");
 	}
 #endif
 }
 
+void
+print_memory_usage(struct Parser *parser, FILE *fp)
+{
+	struct ParserMemoryStats stats;
+	parser_memory_usage(parser, &stats);
+
+	struct {
+		const char *name;
+		struct ParserMemoryUsage *usage;
+	} usages[] = {
+		{ "tokens", &stats.tokens },
+		{ "token_data", &stats.token_data },
+		{ "variables", &stats.variables },
+		{ "targets", &stats.targets },
+		{ "conditionals", &stats.conditionals },
+		{ "rawlines", &stats.rawlines },
+		{ "result", &stats.result },
+		{ "metadata", &stats.metadata },
+		{ "edited", &stats.edited },
+		{ "tokengc", &stats.tokengc },
+	};
+	fprintf(fp, "{\n");
+	for (size_t i = 0; i < nitems(usages); i++) {
+		fprintf(fp, "  \"%s\": { \"count\": %zu, \"bytes\": %zu },\n",
+			usages[i].name, usages[i].usage->count, usages[i].usage->bytes);
+	}
+	fprintf(fp, "  \"total\": %zu\n}\n", stats.total);
+}
+
 int
 read_common_args(int *argc, char ***argv, struct ParserSettings *settings, const char *optstr, struct Array *expressions)
 {
 	int ch;
-	while ((ch = getopt(*argc, *argv, optstr)) != -1) {
+	while ((ch = getopt_long(*argc, *argv, optstr, longopts, NULL)) != -1) {
 		switch (ch) {
+		case 0:
+			if (optarg == NULL) {
+				stats_enable();
+			} else if (strcmp(optarg, "allocations") == 0) {
+				stats_enable_allocations();
+			} else {
+				return 0;
+			}
+			break;
 		case 'D':
 			settings->behavior |= PARSER_OUTPUT_DIFF;
 			if (optarg) {
@@ -110,6 +166,9 @@ read_common_args(int *argc, char ***argv, struct ParserSettings *settings, const
 		case 'i':
 			settings->behavior |= PARSER_OUTPUT_INPLACE;
 			break;
+		case 'M':
+			memory_usage_enabled = 1;
+			break;
 		case 't':
 			settings->behavior |= PARSER_FORMAT_TARGET_COMMANDS;
 			break;
@@ -242,3 +301,68 @@ open_file(enum MainutilsOpenFileBehavior behavior, int *argc, char ***argv, FILE
 
 	return 1;
 }
+
+// Opens the token cache in PORTFMT_CACHE_DIR if it is set.  Call it
+// after open_file(), which closes all other descriptors in capability
+// mode, and before enter_sandbox().
+struct TokenCache *
+open_token_cache()
+{
+	if (token_cache) {
+		return token_cache;
+	}
+
+	const char *path = getenv("PORTFMT_CACHE_DIR");
+	if (path == NULL || *path == 0) {
+		return NULL;
+	}
+
+	token_cache = token_cache_open(path);
+	if (token_cache == NULL) {
+		warn("PORTFMT_CACHE_DIR: %s", path);
+	}
+	return token_cache;
+}
+
+// Like open_token_cache() but for portfmt's cache of files that are
+// known to be formatted already.
+struct FormatCache *
+open_format_cache()
+{
+	if (format_cache) {
+		return format_cache;
+	}
+
+	const char *path = getenv("PORTFMT_CACHE_DIR");
+	if (path == NULL || *path == 0) {
+		return NULL;
+	}
+
+	format_cache = format_cache_open(path);
+	if (format_cache == NULL) {
+		warn("PORTFMT_CACHE_DIR: %s", path);
+	}
+	return format_cache;
+}
+
+// Reads the rest of fp into a buffer.  Exits on errors.
+char *
+slurp_file(FILE *fp, size_t *len)
+{
+	size_t cap = 8192;
+	char *buf = xmalloc(cap);
+	*len = 0;
+	size_t n;
+	while ((n = fread(buf + *len, 1, cap - *len, fp)) > 0) {
+		*len += n;
+		if (*len == cap) {
+			buf = xrecallocarray(buf, cap, 2 * cap, 1);
+			cap *= 2;
+		}
+	}
+	if (ferror(fp)) {
+		err(1, "fread");
+	}
+	STATS_ADD(STATS_BYTES_READ, *len);
+	return buf;
+}
@@ -28,7 +28,10 @@
 #pragma once
 
 struct Array;
+struct FormatCache;
+struct Parser;
 struct ParserSettings;
+struct TokenCache;
 
 enum MainutilsOpenFileBehavior {
 	MAINUTILS_OPEN_FILE_DEFAULT = 0,
@@ -36,7 +39,13 @@ enum MainutilsOpenFileBehavior {
 	MAINUTILS_OPEN_FILE_KEEP_STDIN = 1 << 1,
 };
 
+extern int memory_usage_enabled;
+
 int can_use_colors(FILE *);
 void enter_sandbox(void);
 int open_file(enum MainutilsOpenFileBehavior, int *, char ***, FILE **, FILE **, char **filename);
+struct FormatCache *open_format_cache(void);
+struct TokenCache *open_token_cache(void);
+void print_memory_usage(struct Parser *, FILE *);
 int read_common_args(int *, char ***, struct ParserSettings *, const char *, struct Array *);
+char *slurp_file(FILE *, size_t *);
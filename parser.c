@@ -54,13 +54,18 @@
 #include <libias/set.h>
 #include <libias/util.h>
 
+#include "allocator.h"
 #include "conditional.h"
+#include "hashmap.h"
+#include "hashset.h"
 #include "parser.h"
 #include "parser/edits.h"
 #include "regexp.h"
 #include "rules.h"
+#include "stats.h"
 #include "target.h"
 #include "token.h"
+#include "tokencache.h"
 #include "variable.h"
 
 struct Parser {
@@ -75,32 +80,79 @@ struct Parser {
 	char *condname;
 	char *targetname;
 	char *varname;
+	struct TokenStream *token_stream;
 
-	struct Set *edited;
-	struct Mempool *tokengc;
+	struct HashSet *tokengc;
 	struct Array *tokens;
 	struct Array *result;
+	struct ParserMemoryUsage result_peak;
 	struct Array *rawlines;
 	void *metadata[PARSER_METADATA_USES + 1];
 	int metadata_valid[PARSER_METADATA_USES + 1];
+	// Bitmask of metadata kinds whose variables were touched by the
+	// current edit.  They are invalidated once the outermost
+	// parser_edit() returns.
+	unsigned int metadata_stale;
+	int edit_depth;
 
 	int read_finished;
 };
 
 #define INBUF_SIZE 131072
 
+// libias containers are opaque, so their overhead is estimated from
+// the number of elements: a pointer per array slot.  Sets and maps
+// keep their entries in a sorted array, so an entry is a pointer per
+// key or value plus about half of that again for unused capacity.
+#define MEMORY_USAGE_ARRAY_SLOT sizeof(void *)
+#define MEMORY_USAGE_SET_ENTRY (3 * sizeof(void *) / 2)
+// A hash set slot is a key, value and hash at a load factor of up to
+// 3/4.
+#define MEMORY_USAGE_HASHSET_SLOT (4 * sizeof(void *))
+
+#define METADATA_MASK(meta) (1U << (meta))
+#define METADATA_OPTIONS_MASK \
+	(METADATA_MASK(PARSER_METADATA_OPTION_DESCRIPTIONS) | \
+	 METADATA_MASK(PARSER_METADATA_OPTION_GROUPS) | \
+	 METADATA_MASK(PARSER_METADATA_OPTIONS))
+#define METADATA_ALL_MASK (METADATA_MASK(PARSER_METADATA_USES + 1) - 1)
+
+// Variables read by parser_meta_values() for each kind of metadata
+static const struct {
+	enum ParserMetadata meta;
+	const char *var;
+} metadata_values_[] = {
+	{ PARSER_METADATA_CABAL_EXECUTABLES, "EXECUTABLES" },
+	{ PARSER_METADATA_FLAVORS, "FLAVORS" },
+	{ PARSER_METADATA_LICENSES, "LICENSE" },
+	{ PARSER_METADATA_SHEBANG_LANGS, "SHEBANG_LANG" },
+	{ PARSER_METADATA_POST_PLIST_TARGETS, "POST_PLIST" },
+#if PORTFMT_SUBPACKAGES
+	{ PARSER_METADATA_SUBPACKAGES, "SUBPACKAGES" },
+#endif
+	{ PARSER_METADATA_USES, "USES" },
+};
+
 static size_t consume_comment(const char *);
 static size_t consume_conditional(const char *);
 static size_t consume_target(const char *);
 static size_t consume_token(struct Parser *, const char *, size_t, char, char, int);
 static size_t consume_var(const char *);
 static int is_empty_line(const char *);
+static int is_option_helper(const char *, const char *);
 static void parser_append_token(struct Parser *, enum TokenType, const char *);
 static void parser_find_goalcols(struct Parser *);
+static void parser_lookup_variable_collect(struct Parser *, const char *, int, void *);
 static void parser_meta_values(struct Parser *, const char *, struct Set *);
 static void parser_metadata_alloc(struct Parser *);
+static unsigned int parser_metadata_dependents(const char *);
+static void parser_metadata_invalidate(struct Parser *, unsigned int);
+static void parser_metadata_invalidate_edited(struct Parser *, struct Array *, struct Array *);
+static void parser_metadata_mark_stale(struct Parser *, struct Token *);
 static void parser_metadata_free(struct Parser *);
+static void parser_metadata_free_value(void *);
 static void parser_metadata_port_options(struct Parser *);
+static void parser_memory_usage_token(struct Token *, struct ParserMemoryStats *);
 static void parser_output_dump_tokens(struct Parser *);
 static void parser_output_prepare(struct Parser *);
 static void parser_output_print_rawlines(struct Parser *, struct Range *);
@@ -110,8 +162,10 @@ static struct Array *parser_output_reformatted_helper(struct Parser *, struct Ar
 static void parser_output_reformatted(struct Parser *);
 static void parser_output_diff(struct Parser *);
 static void parser_propagate_goalcol(struct Parser *, size_t, size_t, int);
+static enum ParserError parser_read_from_file_cached(struct Parser *, FILE *);
 static void parser_read_internal(struct Parser *);
 static void parser_read_line(struct Parser *, char *);
+static int parser_read_token_stream(struct Parser *, struct TokenStream *);
 static void parser_tokenize(struct Parser *, const char *, enum TokenType, size_t);
 static void print_newline_array(struct Parser *, struct Array *);
 static void print_token_array(struct Parser *, struct Array *);
@@ -119,6 +173,19 @@ static char *range_tostring(struct Range *);
 
 #include "parser/constants.h"
 
+// Returns 1 if name looks like <opt>_<var> or <opt>_<var>_OFF
+int
+is_option_helper(const char *name, const char *var)
+{
+	size_t len = strlen(name);
+	size_t varlen = strlen(var);
+	if (str_endswith(name, "_OFF")) {
+		len -= strlen("_OFF");
+	}
+	return len > varlen + 1 && name[len - varlen - 1] == '_' &&
+		strncmp(name + len - varlen, var, varlen) == 0;
+}
+
 size_t
 consume_comment(const char *buf)
 {
@@ -309,6 +376,8 @@ parser_init_settings(struct ParserSettings *settings)
 {
 	settings->filename = NULL;
 	settings->behavior = PARSER_DEFAULT;
+	settings->cache = NULL;
+	settings->token_cache = NULL;
 	settings->diff_context = 3;
 	settings->target_command_format_threshold = 8;
 	settings->target_command_format_wrapcol = 65;
@@ -322,8 +391,7 @@ parser_new(struct ParserSettings *settings)
 
 	struct Parser *parser = xmalloc(sizeof(struct Parser));
 
-	parser->edited = set_new(NULL, NULL, NULL);
-	parser->tokengc = mempool_new_unique();
+	parser->tokengc = hashset_new(hashmap_ptr_hash, NULL, NULL, token_free);
 	parser->rawlines = array_new();
 	parser->result = array_new();
 	parser->tokens = array_new();
@@ -361,7 +429,7 @@ parser_free(struct Parser *parser)
 	}
 
 	ARRAY_FOREACH(parser->result, void *, x) {
-		free(x);
+		allocator_free(ALLOCATOR_OUTPUT, x);
 	}
 	array_free(parser->result);
 
@@ -370,8 +438,7 @@ parser_free(struct Parser *parser)
 	}
 	array_free(parser->rawlines);
 
-	mempool_free(parser->tokengc);
-	set_free(parser->edited);
+	hashset_free(parser->tokengc);
 	parser_metadata_free(parser);
 	array_free(parser->tokens);
 
@@ -484,13 +551,18 @@ parser_append_token(struct Parser *parser, enum TokenType type, const char *data
 	}
 	parser_mark_for_gc(parser, t);
 	array_append(parser->tokens, t);
+	if (parser->token_stream) {
+		token_stream_append(parser->token_stream, type, &parser->lines, data,
+				    parser->varname, parser->condname, parser->targetname);
+	}
 }
 
 void
 parser_enqueue_output(struct Parser *parser, const char *s)
 {
 	assert(s != NULL);
-	array_append(parser->result, xstrdup(s));
+	STATS_INC(STATS_OUTPUT_FRAGMENTS);
+	array_append(parser->result, allocator_strdup(ALLOCATOR_OUTPUT, s));
 }
 
 void
@@ -930,7 +1002,7 @@ parser_output_print_target_command(struct Parser *parser, struct Array *tokens)
 	if (!(parser->settings.behavior & PARSER_FORMAT_TARGET_COMMANDS) ||
 	    complexity > parser->settings.target_command_format_threshold) {
 		struct Token *t = array_get(tokens, 0);
-		if (!set_contains(parser->edited, t)) {
+		if (!(token_flags(t) & TOKEN_EDITED)) {
 			parser_output_print_rawlines(parser, token_lines(t));
 			return;
 		}
@@ -1110,12 +1182,12 @@ parser_output_reformatted_helper(struct Parser *parser, struct Array *arr /* uno
 	/* Leave variables unformatted that have $\ in them. */
 	if ((array_len(arr) == 1 && strstr(token_data(t0), "$\001") != NULL) ||
 	    (leave_unformatted(parser, token_variable(t0)) &&
-	     !set_contains(parser->edited, t0))) {
+	     !(token_flags(t0) & TOKEN_EDITED))) {
 		parser_output_print_rawlines(parser, token_lines(t0));
 		goto cleanup;
 	}
 
-	if (!set_contains(parser->edited, t0) &&
+	if (!(token_flags(t0) & TOKEN_EDITED) &&
 	    (parser->settings.behavior & PARSER_OUTPUT_EDITED)) {
 		parser_output_print_rawlines(parser, token_lines(t0));
 		goto cleanup;
@@ -1285,7 +1357,7 @@ parser_output_reformatted(struct Parser *parser)
 	struct Token *prev = NULL;
 	for (size_t i = 0; i < array_len(parser->tokens); i++) {
 		struct Token *o = array_get(parser->tokens, i);
-		int edited = set_contains(parser->edited, o);
+		int edited = token_flags(o) & TOKEN_EDITED;
 		switch (token_type(o)) {
 		case CONDITIONAL_END:
 			if (edited) {
@@ -1403,7 +1475,7 @@ parser_output_diff(struct Parser *parser)
 
 	for (size_t i = 0; i < array_len(parser->result); i++) {
 		char *line = array_get(parser->result, i);
-		free(line);
+		allocator_free(ALLOCATOR_OUTPUT, line);
 	}
 	array_truncate(parser->result);
 
@@ -1423,9 +1495,11 @@ parser_output_diff(struct Parser *parser)
 		}
 		char *buf = str_printf("%s--- %s\n%s+++ %s%s\n",
 			color_delete, filename, color_add, filename, color_reset);
-		array_append(parser->result, buf);
+		array_append(parser->result, allocator_strdup(ALLOCATOR_OUTPUT, buf));
+		free(buf);
 		buf = diff_to_patch(&p, NULL, NULL, parser->settings.diff_context, !nocolor);
-		array_append(parser->result, buf);
+		array_append(parser->result, allocator_strdup(ALLOCATOR_OUTPUT, buf));
+		free(buf);
 		parser->error = PARSER_ERROR_DIFFERENCES_FOUND;
 	}
 
@@ -1629,10 +1703,16 @@ parser_read_from_file(struct Parser *parser, FILE *fp)
 		return parser->error;
 	}
 
+	if (parser->settings.token_cache && !parser->read_finished &&
+	    array_len(parser->rawlines) == 0 && array_len(parser->tokens) == 0) {
+		return parser_read_from_file_cached(parser, fp);
+	}
+
 	ssize_t linelen;
 	size_t linecap = 0;
 	char *line = NULL;
 	while ((linelen = getline(&line, &linecap, fp)) > 0) {
+		STATS_ADD(STATS_BYTES_READ, linelen);
 		if (linelen > 0 && line[linelen - 1] == '\n') {
 			line[linelen - 1] = 0;
 		}
@@ -1648,6 +1728,104 @@ parser_read_from_file(struct Parser *parser, FILE *fp)
 	return PARSER_ERROR_OK;
 }
 
+// Like the getline() loop in parser_read_from_file() but with the
+// tokens taken from the token cache if the file is in it.  Otherwise
+// the tokenizer's calls to token_new() are recorded and stored in the
+// cache.  Only fresh parsers use it since a token stream only depends
+// on the file content when the tokenizer starts from scratch.
+enum ParserError
+parser_read_from_file_cached(struct Parser *parser, FILE *fp)
+{
+	size_t len = 0;
+	size_t cap = 8192;
+	char *buf = xmalloc(cap);
+	size_t n;
+	while ((n = fread(buf + len, 1, cap - len, fp)) > 0) {
+		len += n;
+		if (len == cap) {
+			buf = xrecallocarray(buf, cap, 2 * cap, 1);
+			cap *= 2;
+		}
+	}
+	STATS_ADD(STATS_BYTES_READ, len);
+
+	struct TokenStream *stream = token_cache_get(parser->settings.token_cache, buf, len);
+	int cached = stream && parser_read_token_stream(parser, stream);
+	token_stream_free(stream);
+	if (!cached) {
+		parser->token_stream = token_stream_new();
+	}
+
+	for (size_t pos = 0; pos < len;) {
+		const char *nl = memchr(buf + pos, '\n', len - pos);
+		size_t linelen = nl ? (size_t)(nl - buf) - pos : len - pos;
+		char *line = xstrndup(buf + pos, linelen);
+		pos += linelen + 1;
+		if (cached) {
+			array_append(parser->rawlines, line);
+			continue;
+		}
+		parser_read_line(parser, line);
+		free(line);
+		if (parser->error != PARSER_ERROR_OK) {
+			break;
+		}
+	}
+
+	if (!cached) {
+		if (parser->error == PARSER_ERROR_OK && !parser->continued) {
+			stream = parser->token_stream;
+			stream->lines = parser->lines;
+			stream->in_target = parser->in_target;
+			stream->condname = token_stream_intern(stream, parser->condname);
+			stream->targetname = token_stream_intern(stream, parser->targetname);
+			token_cache_put(parser->settings.token_cache, buf, len, stream);
+		}
+		token_stream_free(parser->token_stream);
+		parser->token_stream = NULL;
+	}
+	free(buf);
+
+	return parser->error;
+}
+
+// Recreates the tokens and the tokenizer state that were recorded in
+// the stream.  Nothing is changed if any token cannot be created.
+int
+parser_read_token_stream(struct Parser *parser, struct TokenStream *stream)
+{
+	struct Array *tokens = array_new();
+	ARRAY_FOREACH(stream->entries, struct TokenStreamEntry *, e) {
+		struct Token *t = token_new(e->type, &e->lines, e->data, e->varname,
+					    e->condname, e->targetname);
+		if (t == NULL) {
+			ARRAY_FOREACH(tokens, struct Token *, t) {
+				token_free(t);
+			}
+			array_free(tokens);
+			return 0;
+		}
+		array_append(tokens, t);
+	}
+
+	ARRAY_FOREACH(tokens, struct Token *, t) {
+		parser_mark_for_gc(parser, t);
+		array_append(parser->tokens, t);
+	}
+	array_free(tokens);
+
+	parser->lines = stream->lines;
+	parser->in_target = stream->in_target;
+	if (stream->condname) {
+		parser->condname = xstrdup(stream->condname);
+	}
+	if (stream->targetname) {
+		parser->targetname = xstrdup(stream->targetname);
+	}
+
+	return 1;
+}
+
 void
 parser_read_internal(struct Parser *parser)
 {
@@ -1854,18 +2032,27 @@ parser_output_write_to_file(struct Parser *parser, FILE *fp)
 			iov[j].iov_base = s;
 			iov[j].iov_len = strlen(s);
 		}
-		if (writev(fd, iov, j) < 0) {
+		ssize_t written = writev(fd, iov, j);
+		if (written < 0) {
 			parser->error = PARSER_ERROR_IO;
 			free(parser->error_msg);
 			parser->error_msg = str_printf("writev: %s", strerror(errno));
 			free(iov);
 			return parser->error;
 		}
+		STATS_ADD(STATS_BYTES_WRITTEN, written);
 	}
 
 	/* Collect garbage */
+	size_t result_bytes = 0;
 	for (size_t i = 0; i < array_len(parser->result); i++) {
-		free(array_get(parser->result, i));
+		char *s = array_get(parser->result, i);
+		result_bytes += strlen(s) + 1;
+		allocator_free(ALLOCATOR_OUTPUT, s);
+	}
+	if (result_bytes > parser->result_peak.bytes) {
+		parser->result_peak.count = array_len(parser->result);
+		parser->result_peak.bytes = result_bytes;
 	}
 	array_truncate(parser->result);
 	free(iov);
@@ -1880,6 +2067,7 @@ parser_read_from_buffer(struct Parser *parser, const char *input, size_t len)
 		return parser->error;
 	}
 
+	STATS_ADD(STATS_BYTES_READ, len);
 	char *buf, *bufp, *line;
 	buf = bufp = xstrndup(input, len);
 	while ((line = strsep(&bufp, "\n")) != NULL) {
@@ -1896,13 +2084,125 @@ parser_read_from_buffer(struct Parser *parser, const char *input, size_t len)
 void
 parser_mark_for_gc(struct Parser *parser, struct Token *t)
 {
-	mempool_add(parser->tokengc, t, token_free);
+	if (!hashset_contains(parser->tokengc, t)) {
+		hashset_add(parser->tokengc, t);
+	}
 }
 
 void
 parser_mark_edited(struct Parser *parser, struct Token *t)
 {
-	set_add(parser->edited, t);
+	token_set_flags(t, token_flags(t) | TOKEN_EDITED);
+	parser_metadata_mark_stale(parser, t);
+}
+
+void
+parser_memory_usage_token(struct Token *t, struct ParserMemoryStats *stats)
+{
+	stats->tokens.count++;
+	stats->tokens.bytes += token_memory_usage(t);
+	if (token_data(t)) {
+		stats->token_data.count++;
+		stats->token_data.bytes += strlen(token_data(t)) + 1;
+	}
+	if (token_variable(t)) {
+		stats->variables.count++;
+		stats->variables.bytes += variable_memory_usage(token_variable(t));
+	}
+	if (token_target(t)) {
+		stats->targets.count++;
+		stats->targets.bytes += target_memory_usage(token_target(t));
+	}
+	if (token_conditional(t)) {
+		stats->conditionals.count++;
+		stats->conditionals.bytes += conditional_memory_usage(token_conditional(t));
+	}
+}
+
+void
+parser_memory_usage(struct Parser *parser, struct ParserMemoryStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	ARRAY_FOREACH(parser->tokens, struct Token *, t) {
+		parser_memory_usage_token(t, stats);
+	}
+	stats->tokens.bytes += array_len(parser->tokens) * MEMORY_USAGE_ARRAY_SLOT;
+
+	ARRAY_FOREACH(parser->rawlines, const char *, line) {
+		stats->rawlines.count++;
+		stats->rawlines.bytes += MEMORY_USAGE_ARRAY_SLOT + strlen(line) + 1;
+	}
+
+	// The output is released after it has been written, so report
+	// the largest one we held on to.
+	ARRAY_FOREACH(parser->result, const char *, s) {
+		stats->result.count++;
+		stats->result.bytes += MEMORY_USAGE_ARRAY_SLOT + strlen(s) + 1;
+	}
+	if (parser->result_peak.bytes + parser->result_peak.count * MEMORY_USAGE_ARRAY_SLOT > stats->result.bytes) {
+		stats->result.count = parser->result_peak.count;
+		stats->result.bytes = parser->result_peak.bytes + parser->result_peak.count * MEMORY_USAGE_ARRAY_SLOT;
+	}
+
+	for (enum ParserMetadata meta = 0; meta <= PARSER_METADATA_USES; meta++) {
+		switch (meta) {
+		case PARSER_METADATA_MASTERDIR:
+			if (parser->metadata[meta]) {
+				stats->metadata.count++;
+				stats->metadata.bytes += strlen(parser->metadata[meta]) + 1;
+			}
+			break;
+		case PARSER_METADATA_OPTION_DESCRIPTIONS:
+			MAP_FOREACH(parser->metadata[meta], const char *, key, const char *, value) {
+				stats->metadata.count++;
+				stats->metadata.bytes += 2 * MEMORY_USAGE_SET_ENTRY + strlen(key) + 1 + strlen(value) + 1;
+			}
+			break;
+		default:
+			SET_FOREACH(parser->metadata[meta], const char *, value) {
+				stats->metadata.count++;
+				stats->metadata.bytes += MEMORY_USAGE_SET_ENTRY + strlen(value) + 1;
+			}
+			break;
+		}
+	}
+
+	// The edited flag lives in the tokens themselves
+	HASHSET_FOREACH(parser->tokengc, struct Token *, t) {
+		if (token_flags(t) & TOKEN_EDITED) {
+			stats->edited.count++;
+		}
+	}
+
+	// Every token is owned by the GC.  Only count the ones that are
+	// no longer part of the token stream, i.e., garbage that will be
+	// released by parser_free().
+	struct HashSet *live = hashset_new(hashmap_ptr_hash, NULL, NULL, NULL);
+	ARRAY_FOREACH(parser->tokens, struct Token *, t) {
+		hashset_add(live, t);
+	}
+	struct ParserMemoryStats garbage;
+	memset(&garbage, 0, sizeof(garbage));
+	HASHSET_FOREACH(parser->tokengc, struct Token *, t) {
+		if (!hashset_contains(live, t)) {
+			parser_memory_usage_token(t, &garbage);
+		}
+	}
+	hashset_free(live);
+	stats->tokengc.count = garbage.tokens.count;
+	stats->tokengc.bytes = hashset_len(parser->tokengc) * MEMORY_USAGE_HASHSET_SLOT +
+		garbage.tokens.bytes + garbage.token_data.bytes + garbage.variables.bytes +
+		garbage.targets.bytes + garbage.conditionals.bytes;
+
+	struct ParserMemoryUsage *usages[] = {
+		&stats->tokens, &stats->token_data, &stats->variables,
+		&stats->targets, &stats->conditionals, &stats->rawlines,
+		&stats->result, &stats->metadata, &stats->edited, &stats->tokengc,
+	};
+	for (size_t i = 0; i < nitems(usages); i++) {
+		stats->total += usages[i]->bytes;
+	}
 }
 
 enum ParserError
@@ -1916,13 +2216,28 @@ parser_edit(struct Parser *parser, ParserEditFn f, void *userdata)
 		return parser->error;
 	}
 
+	STATS_INC(STATS_EDIT_PASSES);
 	enum ParserError error = PARSER_ERROR_OK;
 	char *error_msg = NULL;
+	struct Array *oldtokens = parser->tokens;
+	parser->edit_depth++;
 	struct Array *tokens = f(parser, parser->tokens, &error, &error_msg, userdata);
+	parser->edit_depth--;
 	if (tokens && tokens != parser->tokens) {
+		if (parser->tokens == oldtokens) {
+			parser_metadata_invalidate_edited(parser, oldtokens, tokens);
+		} else {
+			// A nested edit already replaced and freed the
+			// tokens we started with
+			parser->metadata_stale = METADATA_ALL_MASK;
+		}
 		array_free(parser->tokens);
 		parser->tokens = tokens;
 	}
+	if (parser->edit_depth == 0) {
+		parser_metadata_invalidate(parser, parser->metadata_stale);
+		parser->metadata_stale = 0;
+	}
 
 	if (error != PARSER_ERROR_OK) {
 		parser->error = error;
@@ -1942,15 +2257,22 @@ struct ParserSettings parser_settings(struct Parser *parser)
 	return parser->settings;
 }
 
+struct MetaValues {
+	struct Set *set;
+	const char *var;
+	char *append;
+	char *assign;
+};
+
 static void
-parser_meta_values_helper(struct Set *set, const char *var, char *value)
+parser_meta_values_helper(struct Set *set, const char *var, const char *value)
 {
 	if (strcmp(var, "USES") == 0) {
 		char *buf = strchr(value, ':');
 		if (buf != NULL) {
-			char *val = xstrndup(value, buf - value);
+			char *val = allocator_strndup(ALLOCATOR_METADATA, value, buf - value);
 			if (set_contains(set, val)) {
-				free(val);
+				allocator_free(ALLOCATOR_METADATA, val);
 			} else {
 				set_add(set, val);
 			}
@@ -1959,69 +2281,56 @@ parser_meta_values_helper(struct Set *set, const char *var, char *value)
 	}
 
 	if (!set_contains(set, value)) {
-		set_add(set, xstrdup(value));
+		set_add(set, allocator_strdup(ALLOCATOR_METADATA, value));
+	}
+}
+
+static void
+parser_meta_values_add(struct Parser *parser, const char *value, int comment, void *userdata)
+{
+	struct MetaValues *params = userdata;
+	if (!comment) {
+		parser_meta_values_helper(params->set, params->var, value);
+	}
+}
+
+// Adds the values of <opt>_VARS entries like VAR=value or VAR+=value
+static void
+parser_meta_values_add_from_vars(struct Parser *parser, const char *value, int comment, void *userdata)
+{
+	struct MetaValues *params = userdata;
+	if (comment) {
+		return;
+	}
+	if (str_startswith(value, params->append)) {
+		value += strlen(params->append);
+	} else if (str_startswith(value, params->assign)) {
+		value += strlen(params->assign);
+	} else {
+		return;
 	}
+	parser_meta_values_helper(params->set, params->var, value);
 }
 
 void
 parser_meta_values(struct Parser *parser, const char *var, struct Set *set)
 {
-	struct Array *tmp = NULL;
-	if (parser_lookup_variable(parser, var, PARSER_LOOKUP_DEFAULT, &tmp, NULL)) {
-		for (size_t i = 0; i < array_len(tmp); i++) {
-			parser_meta_values_helper(set, var, array_get(tmp, i));
-		}
-		array_free(tmp);
-	}
+	struct MetaValues params = {
+		.set = set,
+		.var = var,
+		.append = str_printf("%s+=", var),
+		.assign = str_printf("%s=", var),
+	};
+	parser_variable_foreach(parser, var, PARSER_LOOKUP_DEFAULT, parser_meta_values_add, &params);
 
 	struct Set *options = parser_metadata(parser, PARSER_METADATA_OPTIONS);
 	SET_FOREACH(options, const char *, opt) {
 		char *buf = str_printf("%s_VARS", opt);
-		if (parser_lookup_variable(parser, buf, PARSER_LOOKUP_DEFAULT, &tmp, NULL)) {
-			for (size_t i = 0; i < array_len(tmp); i++) {
-				char *value = array_get(tmp, i);
-				char *buf = str_printf("%s+=", var);
-				if (str_startswith(value, buf)) {
-					value += strlen(buf);
-				} else {
-					free(buf);
-					buf = str_printf("%s=", var);
-					if (str_startswith(value, buf)) {
-						value += strlen(buf);
-					} else {
-						free(buf);
-						continue;
-					}
-				}
-				free(buf);
-				parser_meta_values_helper(set, var, value);
-			}
-			array_free(tmp);
-		}
+		parser_variable_foreach(parser, buf, PARSER_LOOKUP_DEFAULT, parser_meta_values_add_from_vars, &params);
 		free(buf);
 
 		buf = str_printf("%s_VARS_OFF", opt);
-		if (parser_lookup_variable(parser, buf, PARSER_LOOKUP_DEFAULT, &tmp, NULL)) {
-			for (size_t i = 0; i < array_len(tmp); i++) {
-				char *value = array_get(tmp, i);
-				char *buf = str_printf("%s+=", var);
-				if (str_startswith(value, buf)) {
-					value += strlen(buf);
-				} else {
-					free(buf);
-					buf = str_printf("%s=", var);
-					if (str_startswith(value, buf)) {
-						value += strlen(buf);
-					} else {
-						free(buf);
-						continue;
-					}
-				}
-				free(buf);
-				parser_meta_values_helper(set, var, value);
-			}
-			array_free(tmp);
-		}
+		parser_variable_foreach(parser, buf, PARSER_LOOKUP_DEFAULT, parser_meta_values_add_from_vars, &params);
 		free(buf);
 
 #if PORTFMT_SUBPACKAGES
@@ -2030,66 +2339,52 @@ parser_meta_values(struct Parser *parser, const char *var, struct Set *set)
 		if (strcmp(var, "USES") == 0) {
 #endif
 			buf = str_printf("%s_%s", opt, var);
-			if (parser_lookup_variable(parser, buf, PARSER_LOOKUP_DEFAULT, &tmp, NULL)) {
-				for (size_t i = 0; i < array_len(tmp); i++) {
-					parser_meta_values_helper(set, var, array_get(tmp, i));
-				}
-				array_free(tmp);
-			}
+			parser_variable_foreach(parser, buf, PARSER_LOOKUP_DEFAULT, parser_meta_values_add, &params);
 			free(buf);
 
 			buf = str_printf("%s_%s_OFF", opt, var);
-			if (parser_lookup_variable(parser, buf, PARSER_LOOKUP_DEFAULT, &tmp, NULL)) {
-				for (size_t i = 0; i < array_len(tmp); i++) {
-					parser_meta_values_helper(set, var, array_get(tmp, i));
-				}
-				array_free(tmp);
-			}
+			parser_variable_foreach(parser, buf, PARSER_LOOKUP_DEFAULT, parser_meta_values_add, &params);
 			free(buf);
 		}
 	}
+
+	free(params.append);
+	free(params.assign);
 }
 
 static void
-parser_port_options_add_from_group(struct Parser *parser, const char *groupname)
+parser_port_options_add(struct Parser *parser, const char *opt, int comment, void *userdata)
 {
-	struct Array *optmulti = NULL;
-	if (parser_lookup_variable(parser, groupname, PARSER_LOOKUP_DEFAULT, &optmulti, NULL)) {
-		for (size_t i = 0; i < array_len(optmulti); i++) {
-			char *optgroupname = array_get(optmulti, i);
-			if (!set_contains(parser->metadata[PARSER_METADATA_OPTION_GROUPS], optgroupname)) {
-				set_add(parser->metadata[PARSER_METADATA_OPTION_GROUPS], xstrdup(optgroupname));
-			}
-			char *optgroupvar = str_printf("%s_%s", groupname, optgroupname);
-			struct Array *opts = NULL;
-			if (parser_lookup_variable(parser, optgroupvar, PARSER_LOOKUP_DEFAULT, &opts, NULL)) {
-				for (size_t i = 0; i < array_len(opts); i++) {
-					char *opt = array_get(opts, i);
-					if (!set_contains(parser->metadata[PARSER_METADATA_OPTIONS], opt)) {
-						set_add(parser->metadata[PARSER_METADATA_OPTIONS], xstrdup(opt));
-					}
-				}
-				array_free(opts);
-			}
-			free(optgroupvar);
-		}
-		array_free(optmulti);
+	if (!comment && !set_contains(parser->metadata[PARSER_METADATA_OPTIONS], opt)) {
+		set_add(parser->metadata[PARSER_METADATA_OPTIONS], allocator_strdup(ALLOCATOR_METADATA, opt));
 	}
 }
 
 static void
-parser_port_options_add_from_var(struct Parser *parser, const char *var)
+parser_port_options_add_group(struct Parser *parser, const char *optgroupname, int comment, void *userdata)
 {
-	struct Array *optdefine = NULL;
-	if (parser_lookup_variable(parser, var, PARSER_LOOKUP_DEFAULT, &optdefine, NULL)) {
-		for (size_t i = 0; i < array_len(optdefine); i++) {
-			char *opt = array_get(optdefine, i);
-			if (!set_contains(parser->metadata[PARSER_METADATA_OPTIONS], opt)) {
-				set_add(parser->metadata[PARSER_METADATA_OPTIONS], xstrdup(opt));
-			}
-		}
-		array_free(optdefine);
+	const char *groupname = userdata;
+	if (comment) {
+		return;
+	}
+	if (!set_contains(parser->metadata[PARSER_METADATA_OPTION_GROUPS], optgroupname)) {
+		set_add(parser->metadata[PARSER_METADATA_OPTION_GROUPS], allocator_strdup(ALLOCATOR_METADATA, optgroupname));
 	}
+	char *optgroupvar = str_printf("%s_%s", groupname, optgroupname);
+	parser_variable_foreach(parser, optgroupvar, PARSER_LOOKUP_DEFAULT, parser_port_options_add, NULL);
+	free(optgroupvar);
+}
+
+static void
+parser_port_options_add_from_group(struct Parser *parser, const char *groupname)
+{
+	parser_variable_foreach(parser, groupname, PARSER_LOOKUP_DEFAULT, parser_port_options_add_group, (void *)groupname);
+}
+
+static void
+parser_port_options_add_from_var(struct Parser *parser, const char *var)
+{
+	parser_variable_foreach(parser, var, PARSER_LOOKUP_DEFAULT, parser_port_options_add, NULL);
 }
 
 void
@@ -2134,13 +2429,13 @@ parser_metadata_port_options(struct Parser *parser)
 			if (!map_contains(parser->metadata[PARSER_METADATA_OPTION_DESCRIPTIONS], var)) {
 				char *desc;
 				if (parser_lookup_variable_str(parser, var, PARSER_LOOKUP_FIRST, &desc, NULL)) {
-					map_add(parser->metadata[PARSER_METADATA_OPTION_DESCRIPTIONS], var, desc);
-				} else {
-					free(var);
+					map_add(parser->metadata[PARSER_METADATA_OPTION_DESCRIPTIONS],
+						allocator_strdup(ALLOCATOR_METADATA, var),
+						allocator_strdup(ALLOCATOR_METADATA, desc));
+					free(desc);
 				}
-			} else {
-				free(var);
 			}
+			free(var);
 		}
 	}
 }
@@ -2151,13 +2446,13 @@ parser_metadata_alloc(struct Parser *parser)
 	for (enum ParserMetadata meta = 0; meta <= PARSER_METADATA_USES; meta++) {
 		switch (meta) {
 		case PARSER_METADATA_OPTION_DESCRIPTIONS:
-			parser->metadata[meta] = map_new(str_compare, NULL, free, free);
+			parser->metadata[meta] = map_new(str_compare, NULL, parser_metadata_free_value, parser_metadata_free_value);
 			break;
 		case PARSER_METADATA_MASTERDIR:
 			parser->metadata[meta] = NULL;
 			break;
 		default:
-			parser->metadata[meta] = set_new(str_compare, NULL, free);
+			parser->metadata[meta] = set_new(str_compare, NULL, parser_metadata_free_value);
 			break;
 		}
 	}
@@ -2169,7 +2464,7 @@ parser_metadata_free(struct Parser *parser)
 	for (enum ParserMetadata i = 0; i <= PARSER_METADATA_USES; i++) {
 		switch (i) {
 		case PARSER_METADATA_MASTERDIR:
-			free(parser->metadata[i]);
+			allocator_free(ALLOCATOR_METADATA, parser->metadata[i]);
 			break;
 		case PARSER_METADATA_OPTION_DESCRIPTIONS:
 			map_free(parser->metadata[i]);
@@ -2182,9 +2477,115 @@ parser_metadata_free(struct Parser *parser)
 	}
 }
 
+void
+parser_metadata_free_value(void *p)
+{
+	allocator_free(ALLOCATOR_METADATA, p);
+}
+
+// Returns the kinds of metadata that depend on the variable name
+unsigned int
+parser_metadata_dependents(const char *name)
+{
+	unsigned int mask = 0;
+	if (str_startswith(name, "OPTIONS_") || str_endswith(name, "_DESC")) {
+		mask |= METADATA_OPTIONS_MASK;
+	}
+	if (strcmp(name, "MASTERDIR") == 0) {
+		mask |= METADATA_MASK(PARSER_METADATA_MASTERDIR);
+	}
+	if (strcmp(name, "PORTNAME") == 0) {
+		mask |= METADATA_MASK(PARSER_METADATA_CABAL_EXECUTABLES);
+	}
+	int optvars = is_option_helper(name, "VARS");
+	for (size_t i = 0; i < nitems(metadata_values_); i++) {
+		if (optvars || strcmp(name, metadata_values_[i].var) == 0 ||
+		    is_option_helper(name, metadata_values_[i].var)) {
+			mask |= METADATA_MASK(metadata_values_[i].meta);
+		}
+	}
+
+	// Metadata derived from other metadata
+	if (mask & METADATA_OPTIONS_MASK) {
+		for (size_t i = 0; i < nitems(metadata_values_); i++) {
+			mask |= METADATA_MASK(metadata_values_[i].meta);
+		}
+	}
+	if (mask & METADATA_MASK(PARSER_METADATA_USES)) {
+		mask |= METADATA_MASK(PARSER_METADATA_CABAL_EXECUTABLES);
+		mask |= METADATA_MASK(PARSER_METADATA_FLAVORS);
+	}
+
+	return mask;
+}
+
+// Drops the metadata in mask so that it is recomputed on next access.
+// The sets and maps are emptied in place since callers might still
+// hold on to them.
+void
+parser_metadata_invalidate(struct Parser *parser, unsigned int mask)
+{
+	for (enum ParserMetadata meta = 0; meta <= PARSER_METADATA_USES; meta++) {
+		if (!(mask & METADATA_MASK(meta))) {
+			continue;
+		}
+		STATS_INC(STATS_METADATA_INVALIDATIONS);
+		parser->metadata_valid[meta] = 0;
+		switch (meta) {
+		case PARSER_METADATA_MASTERDIR:
+			allocator_free(ALLOCATOR_METADATA, parser->metadata[meta]);
+			parser->metadata[meta] = NULL;
+			break;
+		case PARSER_METADATA_OPTION_DESCRIPTIONS:
+			map_truncate(parser->metadata[meta]);
+			break;
+		default:
+			set_truncate(parser->metadata[meta]);
+			break;
+		}
+	}
+}
+
+// Marks the metadata that depends on the variables of all tokens that
+// were added or removed by an edit as stale.
+void
+parser_metadata_invalidate_edited(struct Parser *parser, struct Array *oldtokens, struct Array *newtokens)
+{
+	ARRAY_FOREACH(oldtokens, struct Token *, t) {
+		token_set_flags(t, token_flags(t) | TOKEN_VISITED);
+	}
+	ARRAY_FOREACH(newtokens, struct Token *, t) {
+		if (token_flags(t) & TOKEN_VISITED) {
+			token_set_flags(t, token_flags(t) & ~TOKEN_VISITED);
+		} else {
+			parser_metadata_mark_stale(parser, t);
+		}
+	}
+	ARRAY_FOREACH(oldtokens, struct Token *, t) {
+		if (token_flags(t) & TOKEN_VISITED) {
+			token_set_flags(t, token_flags(t) & ~TOKEN_VISITED);
+			parser_metadata_mark_stale(parser, t);
+		}
+	}
+}
+
+void
+parser_metadata_mark_stale(struct Parser *parser, struct Token *t)
+{
+	struct Variable *var = token_variable(t);
+	if (var) {
+		parser->metadata_stale |= parser_metadata_dependents(variable_name(var));
+	}
+}
+
 void *
 parser_metadata(struct Parser *parser, enum ParserMetadata meta)
 {
+	if (parser->edit_depth == 0 && parser->metadata_stale) {
+		parser_metadata_invalidate(parser, parser->metadata_stale);
+		parser->metadata_stale = 0;
+	}
+
 	if (!parser->metadata_valid[meta]) {
 		switch (meta) {
 		case PARSER_METADATA_CABAL_EXECUTABLES: {
@@ -2194,11 +2595,10 @@ parser_metadata(struct Parser *parser, enum ParserMetadata meta)
 				if (set_len(parser->metadata[PARSER_METADATA_CABAL_EXECUTABLES]) == 0) {
 					char *portname;
 					if (parser_lookup_variable_str(parser, "PORTNAME", PARSER_LOOKUP_FIRST, &portname, NULL)) {
-						if (set_contains(parser->metadata[PARSER_METADATA_CABAL_EXECUTABLES], portname)) {
-							free(portname);
-						} else {
-							set_add(parser->metadata[PARSER_METADATA_CABAL_EXECUTABLES], portname);
+						if (!set_contains(parser->metadata[PARSER_METADATA_CABAL_EXECUTABLES], portname)) {
+							set_add(parser->metadata[PARSER_METADATA_CABAL_EXECUTABLES], allocator_strdup(ALLOCATOR_METADATA, portname));
 						}
+						free(portname);
 					}
 				}
 			}
@@ -2210,7 +2610,7 @@ parser_metadata(struct Parser *parser, enum ParserMetadata meta)
 			for (size_t i = 0; i < nitems(static_flavors_); i++) {
 				if (set_contains(uses, (void*)static_flavors_[i].uses) &&
 				    !set_contains(parser->metadata[PARSER_METADATA_FLAVORS], (void*)static_flavors_[i].flavor)) {
-					set_add(parser->metadata[PARSER_METADATA_FLAVORS], xstrdup(static_flavors_[i].flavor));
+					set_add(parser->metadata[PARSER_METADATA_FLAVORS], allocator_strdup(ALLOCATOR_METADATA, static_flavors_[i].flavor));
 				}
 			}
 			break;
@@ -2220,8 +2620,11 @@ parser_metadata(struct Parser *parser, enum ParserMetadata meta)
 		case PARSER_METADATA_MASTERDIR: {
 			struct Array *tokens = NULL;
 			if (parser_lookup_variable(parser, "MASTERDIR", PARSER_LOOKUP_FIRST, &tokens, NULL)) {
-				free(parser->metadata[meta]);
-				parser->metadata[meta] = str_join(tokens, " ");
+				char *masterdir = str_join(tokens, " ");
+				array_free(tokens);
+				allocator_free(ALLOCATOR_METADATA, parser->metadata[meta]);
+				parser->metadata[meta] = allocator_strdup(ALLOCATOR_METADATA, masterdir);
+				free(masterdir);
 			}
 			break;
 		} case PARSER_METADATA_SHEBANG_LANGS:
@@ -2239,7 +2642,7 @@ parser_metadata(struct Parser *parser, enum ParserMetadata meta)
 		case PARSER_METADATA_SUBPACKAGES:
 			if (!set_contains(parser->metadata[PARSER_METADATA_SUBPACKAGES], "main")) {
 				// There is always a main subpackage
-				set_add(parser->metadata[PARSER_METADATA_SUBPACKAGES], xstrdup("main"));
+				set_add(parser->metadata[PARSER_METADATA_SUBPACKAGES], allocator_strdup(ALLOCATOR_METADATA, "main"));
 			}
 			parser_meta_values(parser, "SUBPACKAGES", parser->metadata[PARSER_METADATA_SUBPACKAGES]);
 			break;
@@ -2306,12 +2709,15 @@ found:
 	return target;
 }
 
+// Calls f with the data of every token of the variable and whether it
+// is a comment.  With PARSER_LOOKUP_FIRST only the tokens of the first
+// assignment are visited.  Returns the variable of the last visited
+// assignment or NULL if there was none.  f may be NULL.
 struct Variable *
-parser_lookup_variable(struct Parser *parser, const char *name, enum ParserLookupVariableBehavior behavior, struct Array **retval, struct Array **comment)
+parser_variable_foreach(struct Parser *parser, const char *name, enum ParserLookupVariableBehavior behavior, ParserVariableForeachFn f, void *userdata)
 {
+	STATS_INC(STATS_LOOKUP_VARIABLE_CALLS);
 	struct Variable *var = NULL;
-	struct Array *tokens = array_new();
-	struct Array *comments = array_new();
 	int skip = 0;
 	for (size_t i = 0; i < array_len(parser->tokens); i++) {
 		struct Token *t = array_get(parser->tokens, i);
@@ -2320,25 +2726,17 @@ parser_lookup_variable(struct Parser *parser, const char *name, enum ParserLooku
 			continue;
 		}
 		switch (token_type(t)) {
-		case VARIABLE_START:
-			if (behavior & PARSER_LOOKUP_FIRST) {
-				array_truncate(tokens);
-			}
-			break;
 		case VARIABLE_TOKEN:
-			if (strcmp(variable_name(token_variable(t)), name) == 0) {
-				if (is_comment(t)) {
-					array_append(comments, token_data(t));
-				} else {
-					array_append(tokens, token_data(t));
-				}
+			if (f && strcmp(variable_name(token_variable(t)), name) == 0) {
+				f(parser, token_data(t), is_comment(t), userdata);
 			}
 			break;
 		case VARIABLE_END:
 			if (strcmp(variable_name(token_variable(t)), name) == 0) {
 				var = token_variable(t);
 				if (behavior & PARSER_LOOKUP_FIRST) {
-					goto found;
+					STATS_ADD(STATS_LOOKUP_VARIABLE_TOKENS_SCANNED, i + 1);
+					return var;
 				}
 			}
 			break;
@@ -2346,33 +2744,54 @@ parser_lookup_variable(struct Parser *parser, const char *name, enum ParserLooku
 			break;
 		}
 	}
+	STATS_ADD(STATS_LOOKUP_VARIABLE_TOKENS_SCANNED, array_len(parser->tokens));
 
-	if (var) {
-		goto found;
-	}
+	return var;
+}
 
-	array_free(comments);
-	array_free(tokens);
+struct Variable *
+parser_variable_exists(struct Parser *parser, const char *name, enum ParserLookupVariableBehavior behavior)
+{
+	return parser_variable_foreach(parser, name, behavior, NULL, NULL);
+}
 
-	if (comment) {
-		*comment = NULL;
+void
+parser_lookup_variable_collect(struct Parser *parser, const char *data, int comment, void *userdata)
+{
+	struct Array **arrays = userdata;
+	if (arrays[comment ? 1 : 0]) {
+		array_append(arrays[comment ? 1 : 0], (char *)data);
 	}
+}
+
+struct Variable *
+parser_lookup_variable(struct Parser *parser, const char *name, enum ParserLookupVariableBehavior behavior, struct Array **retval, struct Array **comment)
+{
+	struct Array *arrays[2] = { NULL, NULL };
 	if (retval) {
-		*retval = NULL;
+		arrays[0] = array_new();
 	}
-
-	return NULL;
-
-found:
 	if (comment) {
-		*comment = comments;
-	} else {
-		array_free(comments);
+		arrays[1] = array_new();
+	}
+	ParserVariableForeachFn f = NULL;
+	if (retval || comment) {
+		f = parser_lookup_variable_collect;
 	}
+
+	struct Variable *var = parser_variable_foreach(parser, name, behavior, f, arrays);
+	if (var == NULL) {
+		array_free(arrays[0]);
+		array_free(arrays[1]);
+		arrays[0] = NULL;
+		arrays[1] = NULL;
+	}
+
 	if (retval) {
-		*retval = tokens;
-	} else {
-		array_free(tokens);
+		*retval = arrays[0];
+	}
+	if (comment) {
+		*comment = arrays[1];
 	}
 
 	return var;
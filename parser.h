@@ -93,9 +93,34 @@ enum ParserMetadata {
 	PARSER_METADATA_USES,
 };
 
+struct ParserMemoryUsage {
+	size_t count;
+	size_t bytes;
+};
+
+struct ParserMemoryStats {
+	struct ParserMemoryUsage tokens;
+	struct ParserMemoryUsage token_data;
+	struct ParserMemoryUsage variables;
+	struct ParserMemoryUsage targets;
+	struct ParserMemoryUsage conditionals;
+	struct ParserMemoryUsage rawlines;
+	struct ParserMemoryUsage result;
+	struct ParserMemoryUsage metadata;
+	struct ParserMemoryUsage edited;
+	struct ParserMemoryUsage tokengc;
+	size_t total;
+};
+
 struct ParserSettings {
 	char *filename;
 	enum ParserBehavior behavior;
+	// Optional cache for variable classification results shared
+	// between parsers, i.e., between all ports in portscan
+	struct Cache *cache;
+	// Optional on-disk cache of token streams that
+	// parser_read_from_file() consults for fresh parsers
+	struct TokenCache *token_cache;
 	int target_command_format_threshold;
 	size_t diff_context;
 	size_t target_command_format_wrapcol;
@@ -103,11 +128,14 @@ struct ParserSettings {
 };
 
 struct Array;
+struct Cache;
 struct Parser;
 struct Set;
 struct Token;
+struct TokenCache;
 
 typedef struct Array *(*ParserEditFn)(struct Parser *, struct Array *, enum ParserError *, char **, void *);
+typedef void (*ParserVariableForeachFn)(struct Parser *, const char *, int, void *);
 
 #define PARSER_EDIT(name) \
 	struct Array *name(struct Parser *parser, struct Array *ptokens, enum ParserError *error, char **error_msg, void *userdata)
@@ -125,8 +153,11 @@ void parser_enqueue_output(struct Parser *, const char *);
 struct Target *parser_lookup_target(struct Parser *, const char *, struct Array **);
 struct Variable *parser_lookup_variable(struct Parser *, const char *, enum ParserLookupVariableBehavior, struct Array **, struct Array **);
 struct Variable *parser_lookup_variable_str(struct Parser *, const char *, enum ParserLookupVariableBehavior, char **, char **);
+struct Variable *parser_variable_exists(struct Parser *, const char *, enum ParserLookupVariableBehavior);
+struct Variable *parser_variable_foreach(struct Parser *, const char *, enum ParserLookupVariableBehavior, ParserVariableForeachFn, void *);
 void parser_mark_for_gc(struct Parser *, struct Token *);
 void parser_mark_edited(struct Parser *, struct Token *);
+void parser_memory_usage(struct Parser *, struct ParserMemoryStats *);
 void *parser_metadata(struct Parser *, enum ParserMetadata);
 enum ParserError parser_merge(struct Parser *, struct Parser *, enum ParserMergeBehavior);
 struct ParserSettings parser_settings(struct Parser *);
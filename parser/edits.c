@@ -0,0 +1,61 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include <libias/util.h>
+
+#include "parser.h"
+#include "parser/edits.h"
+
+const struct ParserEdits parser_edits[] = {
+	{ "edit.bump-revision", edit_bump_revision },
+	{ "edit.merge", edit_merge },
+	{ "edit.prune-conditionals", edit_prune_conditionals },
+	{ "edit.set-version", edit_set_version },
+	{ "kakoune.select-object-on-line", kakoune_select_object_on_line },
+	{ "lint.bsd-port", lint_bsd_port },
+	{ "lint.clones", lint_clones },
+	{ "lint.commented-portrevision", lint_commented_portrevision },
+	{ "lint.order", lint_order },
+	{ "output.dependencies", output_dependencies },
+	{ "output.expanded-value", output_expanded_value },
+	{ "output.unknown-targets", output_unknown_targets },
+	{ "output.unknown-variables", output_unknown_variables },
+	{ "output.variable-value", output_variable_value },
+	{ "refactor.collapse-adjacent-variables", refactor_collapse_adjacent_variables },
+	{ "refactor.dedup-tokens", refactor_dedup_tokens },
+	{ "refactor.remove-consecutive-empty-lines", refactor_remove_consecutive_empty_lines },
+	{ "refactor.sanitize-append-modifier", refactor_sanitize_append_modifier },
+	{ "refactor.sanitize-cmake-args", refactor_sanitize_cmake_args },
+	{ "refactor.sanitize-comments", refactor_sanitize_comments },
+	{ "refactor.sanitize-eol-comments", refactor_sanitize_eol_comments },
+};
+const size_t parser_edits_len = nitems(parser_edits);
@@ -38,6 +38,11 @@ struct ParserEdit {
 	enum ParserMergeBehavior merge_behavior;
 };
 
+struct ParserEdits {
+	const char *name;
+	ParserEditFn fn;
+};
+
 struct ParserEditOutput {
 	int (*keyfilter)(struct Parser *, const char *, void *);
 	void *keyuserdata;
@@ -50,12 +55,15 @@ struct ParserEditOutput {
 
 PARSER_EDIT(edit_bump_revision);
 PARSER_EDIT(edit_merge);
+PARSER_EDIT(edit_prune_conditionals);
 PARSER_EDIT(edit_set_version);
 PARSER_EDIT(kakoune_select_object_on_line);
 PARSER_EDIT(lint_bsd_port);
 PARSER_EDIT(lint_clones);
 PARSER_EDIT(lint_commented_portrevision);
 PARSER_EDIT(lint_order);
+PARSER_EDIT(output_dependencies);
+PARSER_EDIT(output_expanded_value);
 PARSER_EDIT(output_unknown_targets);
 PARSER_EDIT(output_unknown_variables);
 PARSER_EDIT(output_variable_value);
@@ -66,3 +74,6 @@ PARSER_EDIT(refactor_sanitize_append_modifier);
 PARSER_EDIT(refactor_sanitize_cmake_args);
 PARSER_EDIT(refactor_sanitize_comments);
 PARSER_EDIT(refactor_sanitize_eol_comments);
+
+extern const struct ParserEdits parser_edits[];
+extern const size_t parser_edits_len;
@@ -55,7 +55,7 @@ get_merge_script(struct Parser *parser, const char *variable, enum ParserError *
 
 	struct Variable *var;
 	if (strcmp(variable, "PORTEPOCH") == 0) {
-		if ((var = parser_lookup_variable(parser, "PORTREVISION", PARSER_LOOKUP_FIRST, NULL, NULL)) &&
+		if ((var = parser_variable_exists(parser, "PORTREVISION", PARSER_LOOKUP_FIRST)) &&
 		    variable_modifier(var) == MODIFIER_OPTIONAL) {
 			array_append(script, "PORTREVISION=0\n");
 		} else {
@@ -77,7 +77,7 @@ get_merge_script(struct Parser *parser, const char *variable, enum ParserError *
 			*error_msg = xstrdup(errstr);
 			return NULL;
 		}
-		if (parser_lookup_variable(parser, "MASTERDIR", PARSER_LOOKUP_FIRST, NULL, NULL) == NULL) {
+		if (parser_variable_exists(parser, "MASTERDIR", PARSER_LOOKUP_FIRST) == NULL) {
 			// In slave ports we do not delete the variable first since
 			// they have a non-uniform structure and edit_merge will probably
 			// insert it into a non-optimal position.
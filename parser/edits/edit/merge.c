@@ -553,7 +553,7 @@ PARSER_EDIT(edit_merge)
 				if (params->merge_behavior & PARSER_MERGE_IGNORE_VARIABLES_IN_CONDITIONALS) {
 					behavior |= PARSER_LOOKUP_IGNORE_VARIABLES_IN_CONDITIIONALS;
 				}
-				if (!parser_lookup_variable(parser, variable_name(var), behavior, NULL, NULL)) {
+				if (!parser_variable_exists(parser, variable_name(var), behavior)) {
 					*error = parser_edit(parser, insert_variable, var);
 					if (*error != PARSER_ERROR_OK) {
 						goto cleanup;
@@ -154,7 +154,7 @@ PARSER_EDIT(edit_set_version)
 	const char *newversion = newversion_buf;
 
 	const char *ver = "DISTVERSION";
-	if (parser_lookup_variable(parser, "PORTVERSION", PARSER_LOOKUP_FIRST, NULL, NULL)) {
+	if (parser_variable_exists(parser, "PORTVERSION", PARSER_LOOKUP_FIRST)) {
 		ver = "PORTVERSION";
 	}
 
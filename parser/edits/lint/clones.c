@@ -33,34 +33,35 @@
 #include <stdio.h>
 
 #include <libias/array.h>
-#include <libias/set.h>
 #include <libias/util.h>
 
 #include "conditional.h"
+#include "hashmap.h"
+#include "hashset.h"
 #include "parser.h"
 #include "parser/edits.h"
 #include "token.h"
 #include "variable.h"
 
 static void
-add_clones(struct Set *clones, struct Set *seen, struct Set *seen_in_cond)
+add_clones(struct HashSet *clones, struct HashSet *seen, struct HashSet *seen_in_cond)
 {
-	SET_FOREACH(seen_in_cond, char *, name) {
-		if (set_contains(seen, name) && !set_contains(clones, name)) {
-			set_add(clones, xstrdup(name));
+	HASHSET_FOREACH(seen_in_cond, char *, name) {
+		if (hashset_contains(seen, name) && !hashset_contains(clones, name)) {
+			hashset_add(clones, xstrdup(name));
 		}
 	}
-	set_truncate(seen_in_cond);
+	hashset_truncate(seen_in_cond);
 }
 
 PARSER_EDIT(lint_clones)
 {
-	struct Set **clones_ret = userdata;
+	struct HashSet **clones_ret = userdata;
 	int no_color = parser_settings(parser).behavior & PARSER_OUTPUT_NO_COLOR;
 
-	struct Set *seen = set_new(str_compare, NULL, NULL);
-	struct Set *seen_in_cond = set_new(str_compare, NULL, NULL);
-	struct Set *clones = set_new(str_compare, NULL, free);
+	struct HashSet *seen = hashset_new(hashmap_str_hash, str_compare, NULL, NULL);
+	struct HashSet *seen_in_cond = hashset_new(hashmap_str_hash, str_compare, NULL, NULL);
+	struct HashSet *clones = hashset_new(hashmap_str_hash, str_compare, NULL, free);
 	int in_conditional = 0;
 	ARRAY_FOREACH(ptokens, struct Token *, t) {
 		switch (token_type(t)) {
@@ -89,13 +90,13 @@ PARSER_EDIT(lint_clones)
 			if (variable_modifier(v) == MODIFIER_ASSIGN) {
 				char *name = variable_name(v);
 				if (in_conditional > 0) {
-					set_add(seen_in_cond, name);
-				} else if (set_contains(seen, name)) {
-					if (!set_contains(clones, name)) {
-						set_add(clones, xstrdup(name));
+					hashset_add(seen_in_cond, name);
+				} else if (hashset_contains(seen, name)) {
+					if (!hashset_contains(clones, name)) {
+						hashset_add(clones, xstrdup(name));
 					}
 				} else {
-					set_add(seen, name);
+					hashset_add(seen, name);
 				}
 			}
 			break;
@@ -104,7 +105,7 @@ PARSER_EDIT(lint_clones)
 		}
 	}
 
-	if (clones_ret == NULL && set_len(clones) > 0) {
+	if (clones_ret == NULL && hashset_len(clones) > 0) {
 		if (!no_color) {
 			parser_enqueue_output(parser, ANSI_COLOR_CYAN);
 		}
@@ -112,16 +113,18 @@ PARSER_EDIT(lint_clones)
 		if (!no_color) {
 			parser_enqueue_output(parser, ANSI_COLOR_RESET);
 		}
-		SET_FOREACH (clones, const char *, name) {
+		struct Array *names = hashset_sorted_values(clones);
+		ARRAY_FOREACH(names, const char *, name) {
 			parser_enqueue_output(parser, name);
 			parser_enqueue_output(parser, "\n");
 		}
+		array_free(names);
 	}
 
-	set_free(seen);
-	set_free(seen_in_cond);
+	hashset_free(seen);
+	hashset_free(seen_in_cond);
 	if (clones_ret == NULL) {
-		set_free(clones);
+		hashset_free(clones);
 	} else {
 		*clones_ret = clones;
 	}
@@ -0,0 +1,268 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <regex.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/map.h>
+#include <libias/set.h>
+#include <libias/util.h>
+
+#include "parser.h"
+#include "parser/edits.h"
+#include "rules.h"
+#include "token.h"
+#include "variable.h"
+
+// Only USES that always pull in the same port are listed here.
+// Versioned ones like python or perl5 depend on the framework's
+// defaults and cannot be resolved from the Makefile.
+static const struct {
+	const char *uses;
+	const char *origin;
+} uses_dependencies_[] = {
+	{ "autoreconf", "devel/autoconf" },
+	{ "autoreconf", "devel/automake" },
+	{ "bison", "devel/bison" },
+	{ "cargo", "lang/rust" },
+	{ "cmake", "devel/cmake-core" },
+	{ "desktop-file-utils", "devel/desktop-file-utils" },
+	{ "gettext", "devel/gettext-runtime" },
+	{ "gettext", "devel/gettext-tools" },
+	{ "gettext-runtime", "devel/gettext-runtime" },
+	{ "gettext-tools", "devel/gettext-tools" },
+	{ "gmake", "devel/gmake" },
+	{ "go", "lang/go" },
+	{ "jpeg", "graphics/jpeg-turbo" },
+	{ "libarchive", "archivers/libarchive" },
+	{ "libtool", "devel/libtool" },
+	{ "makeinfo", "print/texinfo" },
+	{ "meson", "devel/meson" },
+	{ "ninja", "devel/ninja" },
+	{ "pkgconfig", "devel/pkgconf" },
+	{ "shared-mime-info", "misc/shared-mime-info" },
+	{ "sqlite", "databases/sqlite3" },
+	{ "zip", "archivers/unzip" },
+};
+
+static const char *depends_[] = {
+	"BUILD_DEPENDS",
+	"EXTRACT_DEPENDS",
+	"FETCH_DEPENDS",
+	"LIB_DEPENDS",
+	"PATCH_DEPENDS",
+	"PKG_DEPENDS",
+	"RUN_DEPENDS",
+	"TEST_DEPENDS",
+};
+
+static const char *
+skip_expression(const char *p)
+{
+	char close = p[1] == '{' ? '}' : ')';
+	for (p += 2; *p && *p != close;) {
+		if (*p == '$' && (p[1] == '{' || p[1] == '(')) {
+			p = skip_expression(p);
+		} else {
+			p++;
+		}
+	}
+	if (*p) {
+		p++;
+	}
+	return p;
+}
+
+static const char *
+find_colon(const char *p)
+{
+	while (*p && *p != ':') {
+		if (*p == '$' && (p[1] == '{' || p[1] == '(')) {
+			p = skip_expression(p);
+		} else {
+			p++;
+		}
+	}
+	return p;
+}
+
+static int
+has_suffix(const char *name, const char *suffix)
+{
+	size_t len = strlen(name);
+	size_t suffixlen = strlen(suffix);
+	if (len < suffixlen || strcmp(name + len - suffixlen, suffix) != 0) {
+		return 0;
+	}
+	// Either the variable itself or an option or flavor helper
+	// like DOCS_BUILD_DEPENDS
+	return len == suffixlen || name[len - suffixlen - 1] == '_';
+}
+
+static int
+is_depends_variable(const char *name)
+{
+	for (size_t i = 0; i < nitems(depends_); i++) {
+		char *off = str_printf("%s_OFF", depends_[i]);
+		int found = has_suffix(name, depends_[i]) || has_suffix(name, off);
+		free(off);
+		if (found) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int
+is_uses_variable(const char *name)
+{
+	return has_suffix(name, "USES") || has_suffix(name, "USES_OFF");
+}
+
+// Returns the origin of a pattern:origin[:target] dependency or
+// NULL if it cannot be determined without evaluating the Makefile.
+static char *
+dependency_origin(const char *dependency)
+{
+	const char *origin = find_colon(dependency);
+	if (*origin != ':') {
+		return NULL;
+	}
+	origin++;
+	if (str_startswith(origin, "${PORTSDIR}/")) {
+		origin += strlen("${PORTSDIR}/");
+	}
+	size_t len = strcspn(origin, ":@");
+	char *buf = xstrndup(origin, len);
+	char *slash = strchr(buf, '/');
+	if (strchr(buf, '$') || slash == NULL || slash == buf ||
+	    *(slash + 1) == 0 || strchr(slash + 1, '/')) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+static void
+add_dependency(struct Parser *parser, struct ParserEditOutput *param, struct Set *seen, const char *name, char *origin)
+{
+	char *key = str_printf("%s %s", name, origin);
+	if (set_contains(seen, key) ||
+	    (param->filter && !param->filter(parser, origin, param->filteruserdata))) {
+		free(key);
+	} else {
+		set_add(seen, key);
+		param->found = 1;
+		if (param->callback) {
+			param->callback(name, origin, NULL, param->callbackuserdata);
+		}
+	}
+	free(origin);
+}
+
+static void
+add_dependencies(struct Parser *parser, struct ParserEditOutput *param, struct Map *values, struct Set *seen, const char *name, struct Array *words, int depth)
+{
+	ARRAY_FOREACH(words, const char *, word) {
+		// Follow BUILD_DEPENDS=${MY_DEPENDS} indirections that
+		// are defined in the Makefile itself
+		if (depth < 8 && str_startswith(word, "${") && skip_expression(word) == word + strlen(word) &&
+		    strchr(word, ':') == NULL) {
+			char *var = xstrndup(word + 2, strlen(word) - 3);
+			struct Array *indirect = map_get(values, var);
+			free(var);
+			if (indirect) {
+				add_dependencies(parser, param, values, seen, name, indirect, depth + 1);
+				continue;
+			}
+		}
+		if (is_uses_variable(name)) {
+			char *uses = xstrndup(word, strcspn(word, ":"));
+			for (size_t i = 0; i < nitems(uses_dependencies_); i++) {
+				if (strcmp(uses, uses_dependencies_[i].uses) == 0) {
+					add_dependency(parser, param, seen, name, xstrdup(uses_dependencies_[i].origin));
+				}
+			}
+			free(uses);
+		} else {
+			char *origin = dependency_origin(word);
+			if (origin) {
+				add_dependency(parser, param, seen, name, origin);
+			}
+		}
+	}
+}
+
+PARSER_EDIT(output_dependencies)
+{
+	struct ParserEditOutput *param = userdata;
+	if (param == NULL) {
+		*error = PARSER_ERROR_INVALID_ARGUMENT;
+		*error_msg = str_printf("missing parameter");
+		return NULL;
+	}
+
+	param->found = 0;
+
+	// Collect the words of all variables first so that references
+	// to helper variables can be resolved in a second pass.
+	struct Map *values = map_new(str_compare, NULL, NULL, array_free);
+	struct Array *names = array_new();
+	ARRAY_FOREACH(ptokens, struct Token *, t) {
+		if (token_type(t) != VARIABLE_TOKEN || is_comment(t)) {
+			continue;
+		}
+		char *name = variable_name(token_variable(t));
+		struct Array *words = map_get(values, name);
+		if (words == NULL) {
+			words = array_new();
+			map_add(values, name, words);
+			array_append(names, name);
+		}
+		array_append(words, token_data(t));
+	}
+
+	struct Set *seen = set_new(str_compare, NULL, free);
+	ARRAY_FOREACH(names, const char *, name) {
+		if ((!is_depends_variable(name) && !is_uses_variable(name)) ||
+		    (param->keyfilter && !param->keyfilter(parser, name, param->keyuserdata))) {
+			continue;
+		}
+		add_dependencies(parser, param, values, seen, name, map_get(values, name), 0);
+	}
+	set_free(seen);
+	array_free(names);
+	map_free(values);
+
+	return NULL;
+}
@@ -0,0 +1,80 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <regex.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "expander.h"
+#include "parser.h"
+#include "parser/edits.h"
+
+PARSER_EDIT(output_expanded_value)
+{
+	struct ParserEditOutput *param = userdata;
+	if (param == NULL) {
+		*error = PARSER_ERROR_INVALID_ARGUMENT;
+		*error_msg = str_printf("missing parameter");
+		return NULL;
+	}
+
+	param->found = 0;
+
+	struct Expander *expander = expander_new(ptokens);
+	ARRAY_FOREACH(expander_variables(expander), const char *, name) {
+		if (param->keyfilter && !param->keyfilter(parser, name, param->keyuserdata)) {
+			continue;
+		}
+		char *reason = NULL;
+		char *value = expander_variable(expander, name, &reason);
+		if (value == NULL) {
+			// Undecidable without evaluating the framework or
+			// the environment, report why instead of a value
+			param->found = 1;
+			if (param->callback) {
+				param->callback(name, NULL, reason, param->callbackuserdata);
+			}
+		} else if (param->filter == NULL || param->filter(parser, value, param->filteruserdata)) {
+			param->found = 1;
+			if (param->callback) {
+				param->callback(name, value, NULL, param->callbackuserdata);
+			}
+		}
+		free(value);
+		free(reason);
+	}
+	expander_free(expander);
+
+	return NULL;
+}
@@ -88,6 +88,48 @@ var_compare(const void *ap, const void *bp, void *userdata)
 	}
 }
 
+struct OptHelper {
+	struct ParserEditOutput *param;
+	struct Set *vars;
+	const char *var;
+	int optuse;
+};
+
+static void
+check_opthelper_token(struct Parser *parser, const char *token, int comment, void *userdata)
+{
+	struct OptHelper *params = userdata;
+	if (comment) {
+		return;
+	}
+
+	char *suffix = strchr(token, '+');
+	if (!suffix) {
+		suffix = strchr(token, '=');
+		if (!suffix) {
+			return;
+		}
+	} else if (*(suffix + 1) != '=') {
+		return;
+	}
+	char *name = str_map(token, suffix - token, toupper);
+	if (params->optuse) {
+		char *tmp = name;
+		name = str_printf("USE_%s", tmp);
+		free(tmp);
+	}
+	struct UnknownVariable varskey = { .name = name, .hint = (char *)params->var };
+	if (variable_order_block(parser, name, NULL) == BLOCK_UNKNOWN &&
+	    !set_contains(params->vars, &varskey) &&
+	    (params->param->keyfilter == NULL || params->param->keyfilter(parser, name, params->param->keyuserdata))) {
+		set_add(params->vars, var_new(name, params->var));
+		if (params->param->callback) {
+			params->param->callback(name, name, params->var, params->param->callbackuserdata);
+		}
+	}
+	free(name);
+}
+
 static void
 check_opthelper(struct Parser *parser, struct ParserEditOutput *param, struct Set *vars, const char *option, int optuse, int optoff)
 {
@@ -103,41 +145,9 @@ check_opthelper(struct Parser *parser, struct ParserEditOutput *param, struct Se
 	} else {
 		var = str_printf("%s_VARS%s", option, suffix);
 	}
-	struct Array *optvars;
-	if (!parser_lookup_variable(parser, var, PARSER_LOOKUP_DEFAULT, &optvars, NULL)) {
-		free(var);
-		return;
-	}
-
-	ARRAY_FOREACH(optvars, const char *, token) {
-		char *suffix = strchr(token, '+');
-		if (!suffix) {
-			suffix = strchr(token, '=');
-			if (!suffix) {
-				continue;
-			}
-		} else if (*(suffix + 1) != '=') {
-			continue;
-		}
-		char *name = str_map(token, suffix - token, toupper);
-		if (optuse) {
-			char *tmp = name;
-			name = str_printf("USE_%s", tmp);
-			free(tmp);
-		}
-		struct UnknownVariable varskey = { .name = name, .hint = var };
-		if (variable_order_block(parser, name, NULL) == BLOCK_UNKNOWN &&
-		    !set_contains(vars, &varskey) &&
-		    (param->keyfilter == NULL || param->keyfilter(parser, name, param->keyuserdata))) {
-			set_add(vars, var_new(name, var));
-			if (param->callback) {
-				param->callback(name, name, var, param->callbackuserdata);
-			}
-		}
-		free(name);
-	}
+	struct OptHelper params = { param, vars, var, optuse };
+	parser_variable_foreach(parser, var, PARSER_LOOKUP_DEFAULT, check_opthelper_token, &params);
 	free(var);
-	array_free(optvars);
 }
 
 PARSER_EDIT(output_unknown_variables)
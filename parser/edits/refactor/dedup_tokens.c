@@ -34,9 +34,10 @@
 #include <string.h>
 
 #include <libias/array.h>
-#include <libias/set.h>
 #include <libias/util.h>
 
+#include "hashmap.h"
+#include "hashset.h"
 #include "parser.h"
 #include "parser/edits.h"
 #include "rules.h"
@@ -58,14 +59,14 @@ PARSER_EDIT(refactor_dedup_tokens)
 	}
 
 	struct Array *tokens = array_new();
-	struct Set *seen = set_new(str_compare, NULL, NULL);
-	struct Set *uses = set_new(str_compare, NULL, free);
+	struct HashSet *seen = hashset_new(hashmap_str_hash, str_compare, NULL, NULL);
+	struct HashSet *uses = hashset_new(hashmap_str_hash, str_compare, NULL, free);
 	enum DedupAction action = DEFAULT;
 	ARRAY_FOREACH(ptokens, struct Token *, t) {
 		switch (token_type(t)) {
 		case VARIABLE_START:
-			set_truncate(seen);
-			set_truncate(uses);
+			hashset_truncate(seen);
+			hashset_truncate(uses);
 			action = DEFAULT;
 			if (skip_dedup(parser, token_variable(t))) {
 				action = SKIP;
@@ -93,7 +94,7 @@ PARSER_EDIT(refactor_dedup_tokens)
 				}
 				if (action == APPEND) {
 					array_append(tokens, t);
-					set_add(seen, token_data(t));
+					hashset_add(seen, token_data(t));
 				} else if (action == USES) {
 					char *buf = xstrdup(token_data(t));
 					char *args = strchr(buf, ':');
@@ -105,17 +106,17 @@ PARSER_EDIT(refactor_dedup_tokens)
 					// semantically equivalent to just USES=compiler:c++11-lang
 					// since compiler_ARGS has already been set once before.
 					// As such compiler:c++14-lang can be dropped entirely.
-					if (set_contains(uses, buf)) {
+					if (hashset_contains(uses, buf)) {
 						parser_mark_for_gc(parser, t);
 						free(buf);
 					} else {
 						array_append(tokens, t);
-						set_add(uses, buf);
-						set_add(seen, token_data(t));
+						hashset_add(uses, buf);
+						hashset_add(seen, token_data(t));
 					}
-				} else if (!set_contains(seen, token_data(t))) {
+				} else if (!hashset_contains(seen, token_data(t))) {
 					array_append(tokens, t);
-					set_add(seen, token_data(t));
+					hashset_add(seen, token_data(t));
 				} else {
 					parser_mark_for_gc(parser, t);
 				}
@@ -127,8 +128,8 @@ PARSER_EDIT(refactor_dedup_tokens)
 		}
 	}
 
-	set_free(seen);
-	set_free(uses);
+	hashset_free(seen);
+	hashset_free(uses);
 	return tokens;
 }
 
@@ -42,13 +42,14 @@
 #include "mainutils.h"
 #include "parser.h"
 #include "parser/edits.h"
+#include "stats.h"
 
 static void usage(void);
 
 void
 usage()
 {
-	fprintf(stderr, "usage: portclippy [Makefile]\n");
+	fprintf(stderr, "usage: portclippy [-M] [--stats[=allocations]] [Makefile]\n");
 	exit(EX_USAGE);
 }
 
@@ -60,8 +61,9 @@ main(int argc, char *argv[])
 	parser_init_settings(&settings);
 	settings.behavior = PARSER_OUTPUT_RAWLINES;
 
-	argc--;
-	argv++;
+	if (!read_common_args(&argc, &argv, &settings, "M", NULL)) {
+		usage();
+	}
 
 	FILE *fp_in = stdin;
 	FILE *fp_out = stdout;
@@ -75,6 +77,7 @@ main(int argc, char *argv[])
 	if (!can_use_colors(fp_out)) {
 		settings.behavior |= PARSER_OUTPUT_NO_COLOR;
 	}
+	settings.token_cache = open_token_cache();
 	enter_sandbox();
 
 	struct Parser *parser = parser_new(&settings);
@@ -104,6 +107,9 @@ main(int argc, char *argv[])
 	if (error != PARSER_ERROR_OK) {
 		errx(1, "%s", parser_error_tostring(parser));
 	}
+	if (memory_usage_enabled) {
+		print_memory_usage(parser, stderr);
+	}
 	parser_free(parser);
 
 	fclose(fp_out);
@@ -111,5 +117,10 @@ main(int argc, char *argv[])
 		fclose(fp_in);
 	}
 
+	if (stats_enabled) {
+		stats_print(stderr);
+		stats_free();
+	}
+
 	return status;
 }
@@ -44,10 +44,12 @@
 #include <libias/set.h>
 #include <libias/util.h>
 
+#include "evaluator.h"
 #include "mainutils.h"
 #include "parser.h"
 #include "parser/edits.h"
 #include "regexp.h"
+#include "stats.h"
 
 static int apply(struct ParserSettings *, int, char *[]);
 static int bump_epoch(struct ParserSettings *, int, char *[]);
@@ -88,31 +90,6 @@ static struct PorteditCommand cmds[] = {
 	{ "set-version", set_version },
 };
 
-struct ParserEdits {
-	const char *name;
-	ParserEditFn fn;
-};
-static struct ParserEdits parser_edits[] = {
-	{ "edit.bump-revision", edit_bump_revision },
-	{ "edit.merge", edit_merge },
-	{ "edit.set-version", edit_set_version },
-	{ "kakoune.select-object-on-line", kakoune_select_object_on_line },
-	{ "lint.bsd-port", lint_bsd_port },
-	{ "lint.clones", lint_clones },
-	{ "lint.commented-portrevision", lint_commented_portrevision },
-	{ "lint.order", lint_order },
-	{ "output.unknown-targets", output_unknown_targets },
-	{ "output.unknown-variables", output_unknown_variables },
-	{ "output.variable-value", output_variable_value },
-	{ "refactor.collapse-adjacent-variables", refactor_collapse_adjacent_variables },
-	{ "refactor.dedup-tokens", refactor_dedup_tokens },
-	{ "refactor.remove-consecutive-empty-lines", refactor_remove_consecutive_empty_lines },
-	{ "refactor.sanitize-append-modifier", refactor_sanitize_append_modifier },
-	{ "refactor.sanitize-cmake-args", refactor_sanitize_cmake_args },
-	{ "refactor.sanitize-comments", refactor_sanitize_comments },
-	{ "refactor.sanitize-eol-comments", refactor_sanitize_eol_comments },
-};
-
 static void
 enqueue_output(const char *key, const char *value, const char *hint, void *userdata)
 {
@@ -137,7 +114,7 @@ apply(struct ParserSettings *settings, int argc, char *argv[])
 			if (argc != 2) {
 				apply_usage();
 			}
-			for (size_t i = 0; i < nitems(parser_edits); i++) {
+			for (size_t i = 0; i < parser_edits_len; i++) {
 				printf("%s\n", parser_edits[i].name);
 			}
 			return 0;
@@ -151,7 +128,7 @@ apply(struct ParserSettings *settings, int argc, char *argv[])
 	argc--;
 
 	ParserEditFn editfn = NULL;
-	for (size_t i = 0; i < nitems(parser_edits); i++) {
+	for (size_t i = 0; i < parser_edits_len; i++) {
 		if (strcasecmp(parser_edits[i].name, apply_edit) == 0) {
 			editfn = parser_edits[i].fn;
 			break;
@@ -299,17 +276,74 @@ get_variable_filter(struct Parser *parser, const char *key, void *userdata)
 	return regexp_exec(regexp, key) == 0;
 }
 
+struct GetVariableExpanded {
+	struct Parser *parser;
+	int undecidable;
+};
+
+static void
+get_variable_expanded(const char *key, const char *value, const char *hint, void *userdata)
+{
+	struct GetVariableExpanded *this = userdata;
+	if (value == NULL) {
+		warnx("cannot expand %s: %s", key, hint);
+		this->undecidable = 1;
+		return;
+	}
+	parser_enqueue_output(this->parser, value);
+	parser_enqueue_output(this->parser, "\n");
+}
+
 int
 get_variable(struct ParserSettings *settings, int argc, char *argv[])
 {
 	settings->behavior |= PARSER_OUTPUT_RAWLINES;
 
-	if (argc < 3) { 
+	if (argc < 2) {
+		get_variable_usage();
+	}
+	argv++;
+	argc--;
+
+	struct EvaluatorConfig *config = NULL;
+	int expand = 0;
+	int ch;
+	while ((ch = getopt(argc, argv, "c:o:x")) != -1) {
+		switch (ch) {
+		case 'c': {
+			char *value = strchr(optarg, '=');
+			if (value == NULL || value == optarg) {
+				get_variable_usage();
+			}
+			char *name = xstrndup(optarg, value - optarg);
+			if (config == NULL) {
+				config = evaluator_config_new();
+			}
+			evaluator_config_set(config, name, value + 1);
+			free(name);
+			break;
+		} case 'o':
+			if (config == NULL) {
+				config = evaluator_config_new();
+			}
+			evaluator_config_add_option(config, optarg);
+			break;
+		case 'x':
+			expand = 1;
+			break;
+		default:
+			get_variable_usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) {
 		get_variable_usage();
 	}
-	const char *var = argv[2];
-	argv += 3;
-	argc -= 3;
+	const char *var = argv[0];
+	argv++;
+	argc--;
 
 	FILE *fp_in = stdin;
 	FILE *fp_out = stdout;
@@ -322,8 +356,23 @@ get_variable(struct ParserSettings *settings, int argc, char *argv[])
 	if (regexp == NULL) {
 		errx(1, "invalid regexp");
 	}
+	struct GetVariableExpanded expanded = { parser, 0 };
 	struct ParserEditOutput param = { get_variable_filter, regexp, NULL, NULL, enqueue_output, parser, 0 };
-	int error = parser_edit(parser, output_variable_value, &param);
+	int error;
+	if (config) {
+		error = parser_edit(parser, edit_prune_conditionals, config);
+		if (error != PARSER_ERROR_OK) {
+			errx(1, "%s", parser_error_tostring(parser));
+		}
+		evaluator_config_free(config);
+	}
+	if (expand) {
+		param.callback = get_variable_expanded;
+		param.callbackuserdata = &expanded;
+		error = parser_edit(parser, output_expanded_value, &param);
+	} else {
+		error = parser_edit(parser, output_variable_value, &param);
+	}
 	if (error != PARSER_ERROR_OK) {
 		errx(1, "%s", parser_error_tostring(parser));
 	}
@@ -340,7 +389,7 @@ get_variable(struct ParserSettings *settings, int argc, char *argv[])
 		fclose(fp_in);
 	}
 
-	if (param.found) {
+	if (param.found && !expanded.undecidable) {
 		return 0;
 	}
 	return 1;
@@ -616,7 +665,7 @@ bump_revision_usage()
 void
 get_variable_usage()
 {
-	fprintf(stderr, "usage: portedit get <variable-regexp> [Makefile]\n");
+	fprintf(stderr, "usage: portedit get [-x] [-c var=value] [-o option] <variable-regexp> [Makefile]\n");
 	exit(EX_USAGE);
 }
 
@@ -658,7 +707,7 @@ unknown_vars_usage()
 void
 usage()
 {
-	fprintf(stderr, "usage: portedit <command> [<args>]\n\n");
+	fprintf(stderr, "usage: portedit [--stats[=allocations]] <command> [<args>]\n\n");
 	fprintf(stderr, "Supported commands:\n");
 	fprintf(stderr, "\t%-16s%s\n", "apply", "Call an edit plugin");
 	fprintf(stderr, "\t%-16s%s\n", "bump-epoch", "Bump and sanitize PORTEPOCH");
@@ -689,6 +738,7 @@ read_file(struct ParserSettings *settings, enum MainutilsOpenFileBehavior behavi
 		settings->behavior |= PARSER_OUTPUT_NO_COLOR;
 	}
 
+	settings->token_cache = open_token_cache();
 	enter_sandbox();
 
 	struct Parser *parser = parser_new(settings);
@@ -709,6 +759,15 @@ read_file(struct ParserSettings *settings, enum MainutilsOpenFileBehavior behavi
 int
 main(int argc, char *argv[])
 {
+	if (argc > 1 && strcmp(argv[1], "--stats") == 0) {
+		stats_enable();
+		argc--;
+		argv++;
+	} else if (argc > 1 && strcmp(argv[1], "--stats=allocations") == 0) {
+		stats_enable_allocations();
+		argc--;
+		argv++;
+	}
 	if (argc < 2) {
 		usage();
 	}
@@ -721,7 +780,12 @@ main(int argc, char *argv[])
 
 	for (size_t i = 0; i < nitems(cmds); i++) {
 		if (strcmp(command, cmds[i].name) == 0) {
-			return cmds[i].main(&settings, argc, argv);
+			int status = cmds[i].main(&settings, argc, argv);
+			if (stats_enabled) {
+				stats_print(stderr);
+				stats_free();
+			}
+			return status;
 		}
 	}
 
@@ -37,15 +37,17 @@
 #include <sysexits.h>
 #include <unistd.h>
 
+#include "formatcache.h"
 #include "mainutils.h"
 #include "parser.h"
+#include "stats.h"
 
 static void usage(void);
 
 void
 usage()
 {
-	fprintf(stderr, "usage: portfmt [-D[context]] [-dituU] [-w wrapcol] [Makefile]\n");
+	fprintf(stderr, "usage: portfmt [-D[context]] [-diMtuU] [-w wrapcol] [--stats[=allocations]] [Makefile]\n");
 	exit(EX_USAGE);
 }
 
@@ -59,7 +61,7 @@ main(int argc, char *argv[])
 		PARSER_DEDUP_TOKENS | PARSER_OUTPUT_REFORMAT |
 		PARSER_ALLOW_FUZZY_MATCHING | PARSER_SANITIZE_COMMENTS;
 
-	if (!read_common_args(&argc, &argv, &settings, "D::dituUw:", NULL)) {
+	if (!read_common_args(&argc, &argv, &settings, "D::diMtuUw:", NULL)) {
 		usage();
 	}
 
@@ -80,12 +82,37 @@ main(int argc, char *argv[])
 		settings.behavior |= PARSER_OUTPUT_NO_COLOR;
 	}
 
+	settings.token_cache = open_token_cache();
+	struct FormatCache *format_cache = NULL;
+	if ((settings.behavior & (PARSER_OUTPUT_DIFF | PARSER_OUTPUT_INPLACE)) &&
+	    !(settings.behavior & PARSER_OUTPUT_DUMP_TOKENS)) {
+		format_cache = open_format_cache();
+	}
 	enter_sandbox();
 
+	// Files that are known to be formatted already are skipped
+	// without parsing them.  Otherwise parse the content that was
+	// used for the lookup.
+	int status = 0;
+	char *content = NULL;
+	size_t content_len = 0;
+	FILE *fp_content = NULL;
+	if (format_cache) {
+		content = slurp_file(fp_in, &content_len);
+		if (format_cache_contains(format_cache, &settings, content, content_len)) {
+			free(settings.filename);
+			goto done;
+		}
+		if (content_len > 0 &&
+		    (fp_content = fmemopen(content, content_len, "r")) == NULL) {
+			err(1, "fmemopen");
+		}
+	}
+
 	struct Parser *parser = parser_new(&settings);
 	free(settings.filename);
 	settings.filename = NULL;
-	enum ParserError error = parser_read_from_file(parser, fp_in);
+	enum ParserError error = parser_read_from_file(parser, fp_content ? fp_content : fp_in);
 	if (error != PARSER_ERROR_OK) {
 		errx(1, "%s", parser_error_tostring(parser));
 	}
@@ -94,19 +121,45 @@ main(int argc, char *argv[])
 		errx(1, "%s", parser_error_tostring(parser));
 	}
 
-	int status = 0;
 	error = parser_output_write_to_file(parser, fp_out);
 	if (error == PARSER_ERROR_DIFFERENCES_FOUND) {
 		status = 2;
 	} else if (error != PARSER_ERROR_OK) {
 		errx(1, "%s", parser_error_tostring(parser));
+	} else if (format_cache && !(settings.behavior & PARSER_OUTPUT_INPLACE)) {
+		format_cache_add(format_cache, &settings, content, content_len);
+	} else if (format_cache) {
+		// Only remember files that were left unchanged
+		if (fseek(fp_in, 0, SEEK_SET) < 0) {
+			err(1, "fseek");
+		}
+		size_t len;
+		char *formatted = slurp_file(fp_in, &len);
+		if (len == content_len && memcmp(formatted, content, len) == 0) {
+			format_cache_add(format_cache, &settings, content, content_len);
+		}
+		free(formatted);
+	}
+	if (memory_usage_enabled) {
+		print_memory_usage(parser, stderr);
 	}
 	parser_free(parser);
 
+	if (fp_content) {
+		fclose(fp_content);
+	}
+
+done:
+	free(content);
 	fclose(fp_out);
 	if (fp_out != fp_in) {
 		fclose(fp_in);
 	}
 
+	if (stats_enabled) {
+		stats_print(stderr);
+		stats_free();
+	}
+
 	return status;
 }
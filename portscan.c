@@ -41,8 +41,10 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <libgen.h>
 #include <pthread.h>
 #include <regex.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -55,14 +57,25 @@
 #include <libias/set.h>
 #include <libias/util.h>
 
+#include "cache.h"
 #include "capsicum_helpers.h"
 #include "conditional.h"
+#include "hashmap.h"
+#include "hashset.h"
 #include "mainutils.h"
 #include "parser.h"
 #include "parser/edits.h"
+#include "portscan/depgraph.h"
+#include "portscan/hash.h"
 #include "portscan/log.h"
+#include "portscan/profile.h"
 #include "portscan/status.h"
+#include "portscan/stream.h"
+#include "portscan/trace.h"
+#include "portscan/varindex.h"
+#include "portscan/watch.h"
 #include "regexp.h"
+#include "stats.h"
 #include "token.h"
 #include "variable.h"
 
@@ -77,6 +90,10 @@ enum ScanFlags {
 	SCAN_VARIABLE_VALUES = 1 << 6,
 	SCAN_PARTIAL = 1 << 7,
 	SCAN_COMMENTS = 1 << 8,
+	SCAN_EXPANDED_VALUES = 1 << 9,
+	SCAN_DEPGRAPH = 1 << 10,
+	SCAN_VARINDEX = 1 << 11,
+	SCAN_WATCH = 1 << 12,
 };
 
 enum ScanLongopts {
@@ -84,15 +101,34 @@ enum ScanLongopts {
 	SCAN_LONGOPT_CATEGORIES,
 	SCAN_LONGOPT_CLONES,
 	SCAN_LONGOPT_COMMENTS,
+	SCAN_LONGOPT_DEPGRAPH,
+	SCAN_LONGOPT_DEPS,
+	SCAN_LONGOPT_EXPANDED_VALUES,
+	SCAN_LONGOPT_FORMAT,
+	SCAN_LONGOPT_LOOKUP,
 	SCAN_LONGOPT_OPTION_DEFAULT_DESCRIPTIONS,
 	SCAN_LONGOPT_OPTIONS,
+	SCAN_LONGOPT_PROFILE,
 	SCAN_LONGOPT_PROGRESS,
+	SCAN_LONGOPT_RDEPS,
+	SCAN_LONGOPT_SHARD,
+	SCAN_LONGOPT_STATS,
+	SCAN_LONGOPT_STATUS_FILE,
+	SCAN_LONGOPT_TRACE,
 	SCAN_LONGOPT_UNKNOWN_TARGETS,
 	SCAN_LONGOPT_UNKNOWN_VARIABLES,
 	SCAN_LONGOPT_VARIABLE_VALUES,
+	SCAN_LONGOPT_VARINDEX,
+	SCAN_LONGOPT_WATCH,
 	SCAN_LONGOPT__N
 };
 
+enum ScanFormat {
+	SCAN_FORMAT_TEXT,
+	SCAN_FORMAT_NDJSON,
+	SCAN_FORMAT_NDJSON_ORDERED,
+};
+
 struct ScanLongoptsState {
 	int flag;
 	const char *optarg;
@@ -100,27 +136,52 @@ struct ScanLongoptsState {
 
 struct ScanResult {
 	char *origin;
-	struct Set *comments;
-	struct Set *errors;
-	struct Set *unknown_variables;
-	struct Set *unknown_targets;
-	struct Set *clones;
-	struct Set *option_default_descriptions;
-	struct Set *option_groups;
-	struct Set *options;
-	struct Set *variable_values;
+	struct HashSet *comments;
+	struct HashSet *errors;
+	struct HashSet *expanded_values;
+	struct HashSet *unknown_variables;
+	struct HashSet *unknown_targets;
+	struct HashSet *clones;
+	struct HashSet *option_default_descriptions;
+	struct HashSet *option_groups;
+	struct HashSet *options;
+	struct HashSet *variable_values;
+	struct Array *depends;
+	struct Array *variables;
+	char *inputs;
+	char *master;
+	uint64_t hash;
 	enum ScanFlags flags;
 };
 
+struct ScanIndexes {
+	struct PortscanDepgraph *depgraph;
+	struct PortscanDepgraphBuilder *depgraph_builder;
+	struct PortscanVarindex *varindex;
+	struct PortscanVarindexBuilder *varindex_builder;
+	struct PortscanWatch *watch;
+};
+
+// Variable, target, and option names repeat a lot between ports so
+// whether a name matches is only checked once for all workers.
+struct ScanQuery {
+	struct Regexp *regexp;
+	struct Cache *names;
+};
+
 struct ScanPortArgs {
 	enum ScanFlags flags;
 	int portsdir;
 	const char *path;
-	struct Regexp *keyquery;
-	struct Regexp *query;
+	struct ScanQuery *keyquery;
+	struct ScanQuery *query;
+	struct Cache *cache;
+	struct TokenCache *token_cache;
 	ssize_t editdist;
 	struct Map *default_option_descriptions;
+	struct PortscanProfile *profile;
 	struct ScanResult *result;
+	struct Array *inputs;
 };
 
 struct CategoryReaderData {
@@ -128,7 +189,10 @@ struct CategoryReaderData {
 	struct Array *categories;
 	size_t start;
 	size_t end;
+	size_t worker;
 	enum ScanFlags flags;
+	struct PortscanProfile *profile;
+	struct PortscanTraceThread *trace;
 };
 
 struct CategoryReaderResult {
@@ -145,46 +209,87 @@ struct PortReaderData {
 	struct Array *origins;
 	size_t start;
 	size_t end;
-	struct Regexp *keyquery;
-	struct Regexp *query;
+	size_t worker;
+	struct ScanQuery *keyquery;
+	struct ScanQuery *query;
+	struct Cache *cache;
+	struct TokenCache *token_cache;
 	ssize_t editdist;
 	enum ScanFlags flags;
 	struct Map *default_option_descriptions;
+	struct ScanIndexes *indexes;
+	struct PortscanStream *stream;
+	struct PortscanProfile *profile;
+	struct PortscanTraceThread *trace;
 };
 
 static void lookup_subdirs(int, const char *, const char *, enum ScanFlags, struct Array *, struct Array *, struct Array *, struct Array *, struct Array *, struct Array *);
 static void scan_port(struct ScanPortArgs *);
 static void *lookup_origins_worker(void *);
-static enum ParserError process_include(struct Parser *, struct Set *, const char *, int, const char *);
+static enum ParserError process_include(struct Parser *, struct HashSet *, struct Array *, const char *, int, const char *);
 static PARSER_EDIT(extract_includes);
+static PARSER_EDIT(extract_variables);
 static PARSER_EDIT(get_default_option_descriptions);
 static DIR *diropenat(int, const char *);
 static FILE *fileopenat(int, const char *);
 static void *scan_ports_worker(void *);
-static struct Array *lookup_origins(int, enum ScanFlags, struct PortscanLog *);
-static void scan_ports(int, struct Array *, enum ScanFlags, struct Regexp *, struct Regexp *, ssize_t, struct PortscanLog *);
+static struct Array *lookup_origins(int, enum ScanFlags, struct PortscanLog *, struct Array *, struct PortscanTrace *);
+static int merge_main(int, char *[]);
+static int open_index_dir(const char *, char **);
+static int query_depgraph(const char *, const char *, const char *);
+static int query_matches_name(struct ScanQuery *, const char *);
+static int query_varindex(const char *, const char *, const char *);
+static char *resolve_masterdir(const char *, const char *);
+static void scan_ports(int, struct Array *, enum ScanFlags, struct Regexp *, struct Regexp *, ssize_t, struct PortscanLog *, struct Array *, size_t, struct PortscanTrace *, struct ScanIndexes *, struct PortscanStream *, struct TokenCache *);
+static void scan_result_log(struct ScanResult *, struct PortscanLog *);
 static void usage(void);
+static void watch_ports(struct PortscanWatch *, int, int, struct Array *, enum ScanFlags, struct Regexp *, struct Regexp *, ssize_t, struct PortscanLog *, struct PortscanLog *, struct PortscanLogDir *, FILE *, struct TokenCache *);
+
+// Checks that need to parse the port's Makefile
+static const enum ScanFlags scan_port_flags = SCAN_CLONES |
+	SCAN_COMMENTS |
+	SCAN_DEPGRAPH |
+	SCAN_EXPANDED_VALUES |
+	SCAN_OPTION_DEFAULT_DESCRIPTIONS |
+	SCAN_OPTIONS |
+	SCAN_UNKNOWN_TARGETS |
+	SCAN_UNKNOWN_VARIABLES |
+	SCAN_VARIABLE_VALUES |
+	SCAN_VARINDEX;
 
 static struct option longopts[SCAN_LONGOPT__N] = {
 	[SCAN_LONGOPT_ALL] = { "all", no_argument, NULL, 1 },
 	[SCAN_LONGOPT_CATEGORIES] = { "categories", no_argument, NULL, 1 },
 	[SCAN_LONGOPT_CLONES] = { "clones", no_argument, NULL, 1 },
 	[SCAN_LONGOPT_COMMENTS] = { "comments", no_argument, NULL, 1 },
+	[SCAN_LONGOPT_DEPGRAPH] = { "depgraph", required_argument, NULL, 1 },
+	[SCAN_LONGOPT_DEPS] = { "deps", required_argument, NULL, 1 },
+	[SCAN_LONGOPT_EXPANDED_VALUES] = { "expanded-values", optional_argument, NULL, 1 },
+	[SCAN_LONGOPT_FORMAT] = { "format", required_argument, NULL, 1 },
+	[SCAN_LONGOPT_LOOKUP] = { "lookup", required_argument, NULL, 1 },
 	[SCAN_LONGOPT_OPTION_DEFAULT_DESCRIPTIONS] = { "option-default-descriptions", optional_argument, NULL, 1 },
 	[SCAN_LONGOPT_OPTIONS] = { "options", no_argument, NULL, 1 },
+	[SCAN_LONGOPT_PROFILE] = { "profile", optional_argument, NULL, 1 },
 	[SCAN_LONGOPT_PROGRESS] = { "progress", optional_argument, NULL, 1 },
+	[SCAN_LONGOPT_RDEPS] = { "rdeps", required_argument, NULL, 1 },
+	[SCAN_LONGOPT_SHARD] = { "shard", required_argument, NULL, 1 },
+	[SCAN_LONGOPT_STATS] = { "stats", optional_argument, NULL, 1 },
+	[SCAN_LONGOPT_STATUS_FILE] = { "status-file", required_argument, NULL, 1 },
+	[SCAN_LONGOPT_TRACE] = { "trace", required_argument, NULL, 1 },
 	[SCAN_LONGOPT_UNKNOWN_TARGETS] = { "unknown-targets", no_argument, NULL, 1 },
 	[SCAN_LONGOPT_UNKNOWN_VARIABLES] = { "unknown-variables", no_argument, NULL, 1 },
 	[SCAN_LONGOPT_VARIABLE_VALUES] = { "variable-values", optional_argument, NULL, 1 },
+	[SCAN_LONGOPT_VARINDEX] = { "varindex", required_argument, NULL, 1 },
+	[SCAN_LONGOPT_WATCH] = { "watch", optional_argument, NULL, 1 },
 };
 
 static void
-add_error(struct Set *errors, char *msg)
+add_error(struct HashSet *errors, char *msg)
 {
-	if (set_contains(errors, msg)) {
+	if (hashset_contains(errors, msg)) {
 		free(msg);
 	} else {
-		set_add(errors, msg);
+		hashset_add(errors, msg);
 	}
 }
 
@@ -322,7 +427,7 @@ cleanup:
 }
 
 enum ParserError
-process_include(struct Parser *parser, struct Set *errors, const char *curdir, int portsdir, const char *filename)
+process_include(struct Parser *parser, struct HashSet *errors, struct Array *inputs, const char *curdir, int portsdir, const char *filename)
 {
 	char *path;
 	if (str_startswith(filename, "${MASTERDIR}/")) {
@@ -351,6 +456,9 @@ process_include(struct Parser *parser, struct Set *errors, const char *curdir, i
 	} else {
 		path = str_printf("%s/%s", curdir, filename);
 	}
+	if (inputs) {
+		array_append(inputs, xstrdup(path));
+	}
 	FILE *f = fileopenat(portsdir, path);
 	if (f == NULL) {
 		add_error(errors, str_printf("cannot open include: %s: %s", path, strerror(errno)));
@@ -403,25 +511,49 @@ PARSER_EDIT(extract_includes)
 	return NULL;
 }
 
+PARSER_EDIT(extract_variables)
+{
+	struct Array *entries = userdata;
+
+	ARRAY_FOREACH(ptokens, struct Token *, t) {
+		if (token_type(t) != VARIABLE_TOKEN || token_data(t) == NULL) {
+			continue;
+		}
+		struct Range *lines = token_lines(t);
+		struct PortscanVarindexEntry *entry = xmalloc(sizeof(struct PortscanVarindexEntry));
+		entry->name = xstrdup(variable_name(token_variable(t)));
+		entry->value = xstrdup(token_data(t));
+		entry->start = lines->start;
+		entry->end = lines->end;
+		array_append(entries, entry);
+	}
+
+	return NULL;
+}
+
+static int
+variable_name_filter(struct Parser *parser, const char *value, void *userdata)
+{
+	return query_matches_name(userdata, value);
+}
+
 static int
 variable_value_filter(struct Parser *parser, const char *value, void *userdata)
 {
-	struct Regexp *query = userdata;
-	return !query || regexp_exec(query, value) == 0;
+	struct ScanQuery *query = userdata;
+	return !query->regexp || regexp_exec(query->regexp, value) == 0;
 }
 
 static int
 unknown_targets_filter(struct Parser *parser, const char *value, void *userdata)
 {
-	struct Regexp *query = userdata;
-	return !query || regexp_exec(query, value) == 0;
+	return query_matches_name(userdata, value);
 }
 
 static int
 unknown_variables_filter(struct Parser *parser, const char *value, void *userdata)
 {
-	struct Regexp *query = userdata;
-	return !query || regexp_exec(query, value) == 0;
+	return query_matches_name(userdata, value);
 }
 
 static int
@@ -459,8 +591,8 @@ edit_distance(const char *a, const char *b)
 static void
 collect_output_unknowns(const char *key, const char *value, const char *hint, void *userdata)
 {
-	if (!set_contains(userdata, key)) {
-		set_add(userdata, xstrdup(key));
+	if (!hashset_contains(userdata, key)) {
+		hashset_add(userdata, xstrdup(key));
 	}
 }
 
@@ -468,38 +600,115 @@ static void
 collect_output_variable_values(const char *key, const char *value, const char *hint, void *userdata)
 {
 	char *buf = str_printf("%-30s\t%s", key, value);
-	if (set_contains(userdata, buf)) {
+	if (hashset_contains(userdata, buf)) {
 		free(buf);
 	} else {
-		set_add(userdata, buf);
+		hashset_add(userdata, buf);
+	}
+}
+
+static void
+collect_output_expanded_values(const char *key, const char *value, const char *hint, void *userdata)
+{
+	char *buf;
+	if (value) {
+		buf = str_printf("%-30s\t%s", key, value);
+	} else {
+		buf = str_printf("%-30s\t(cannot expand: %s)", key, hint);
+	}
+	if (hashset_contains(userdata, buf)) {
+		free(buf);
+	} else {
+		hashset_add(userdata, buf);
+	}
+}
+
+static void
+collect_output_dependencies(const char *key, const char *value, const char *hint, void *userdata)
+{
+	struct PortscanDepgraphEdge *edge = xmalloc(sizeof(struct PortscanDepgraphEdge));
+	edge->origin = xstrdup(value);
+	edge->kinds = portscan_depgraph_kind_from_variable(key);
+	array_append(userdata, edge);
+}
+
+char *
+resolve_masterdir(const char *origin, const char *masterdir)
+{
+	char *path;
+	if (str_startswith(masterdir, "${.CURDIR}/")) {
+		path = str_printf("%s/%s", origin, masterdir + strlen("${.CURDIR}/"));
+	} else if (str_startswith(masterdir, "${PORTSDIR}/")) {
+		path = xstrdup(masterdir + strlen("${PORTSDIR}/"));
+	} else {
+		return NULL;
+	}
+
+	struct Array *components = array_new();
+	char *buf = path;
+	char *component;
+	while ((component = strsep(&buf, "/")) != NULL) {
+		if (*component == 0 || strcmp(component, ".") == 0) {
+			continue;
+		} else if (strcmp(component, "..") == 0) {
+			array_pop(components);
+		} else {
+			array_append(components, component);
+		}
+	}
+
+	char *master = NULL;
+	if (array_len(components) == 2) {
+		master = str_join(components, "/");
+		if (strchr(master, '$')) {
+			free(master);
+			master = NULL;
+		}
 	}
+	array_free(components);
+	free(path);
+
+	return master;
 }
 
 void
 scan_port(struct ScanPortArgs *args)
 {
 	struct ScanResult *retval = args->result;
-	retval->comments = set_new(str_compare, NULL, free);
-	retval->errors = set_new(str_compare, NULL, free);
-	retval->option_default_descriptions = set_new(str_compare, NULL, free);
-	retval->option_groups = set_new(str_compare, NULL, free);
-	retval->options = set_new(str_compare, NULL, free);
-	retval->unknown_variables = set_new(str_compare, NULL, free);
-	retval->unknown_targets = set_new(str_compare, NULL, free);
-	retval->variable_values = set_new(str_compare, NULL, free);
+	retval->comments = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	retval->errors = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	retval->expanded_values = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	retval->option_default_descriptions = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	retval->option_groups = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	retval->options = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	retval->unknown_variables = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	retval->unknown_targets = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	retval->variable_values = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	if (retval->flags & SCAN_DEPGRAPH) {
+		retval->depends = array_new();
+	}
+	if (retval->flags & SCAN_VARINDEX) {
+		retval->variables = array_new();
+	}
 
 	struct ParserSettings settings;
 	parser_init_settings(&settings);
 	settings.behavior = PARSER_OUTPUT_RAWLINES;
+	settings.cache = args->cache;
+	settings.token_cache = args->token_cache;
 
+	portscan_profile_begin(args->profile, PORTSCAN_PROFILE_OPEN);
 	FILE *in = fileopenat(args->portsdir, args->path);
+	portscan_profile_end(args->profile, PORTSCAN_PROFILE_OPEN);
 	if (in == NULL) {
 		add_error(retval->errors, str_printf("fileopenat: %s", strerror(errno)));
 		return;
 	}
 
 	struct Parser *parser = parser_new(&settings);
+	portscan_profile_begin(args->profile, PORTSCAN_PROFILE_READ);
 	enum ParserError error = parser_read_from_file(parser, in);
+	portscan_profile_end(args->profile, PORTSCAN_PROFILE_READ);
 	if (error != PARSER_ERROR_OK) {
 		add_error(retval->errors, parser_error_tostring(parser));
 		goto cleanup;
@@ -513,23 +722,31 @@ scan_port(struct ScanPortArgs *args)
 		}
 	}
 
+	portscan_profile_begin(args->profile, PORTSCAN_PROFILE_INCLUDES);
+	portscan_trace_begin("includes", NULL);
 	struct Array *includes = NULL;
 	error = parser_edit(parser, extract_includes, &includes);
 	if (error != PARSER_ERROR_OK) {
+		portscan_trace_end();
 		add_error(retval->errors, parser_error_tostring(parser));
 		goto cleanup;
 	}
 	ARRAY_FOREACH(includes, char *, include) {
-		error = process_include(parser, retval->errors, retval->origin, args->portsdir, include);
+		error = process_include(parser, retval->errors, args->inputs, retval->origin, args->portsdir, include);
 		if (error != PARSER_ERROR_OK) {
+			portscan_trace_end();
 			array_free(includes);
 			add_error(retval->errors, parser_error_tostring(parser));
 			goto cleanup;
 		}
 	}
 	array_free(includes);
+	portscan_trace_end();
+	portscan_profile_end(args->profile, PORTSCAN_PROFILE_INCLUDES);
 
+	portscan_profile_begin(args->profile, PORTSCAN_PROFILE_READ_FINISH);
 	error = parser_read_finish(parser);
+	portscan_profile_end(args->profile, PORTSCAN_PROFILE_READ_FINISH);
 	if (error != PARSER_ERROR_OK) {
 		add_error(retval->errors, parser_error_tostring(parser));
 		goto cleanup;
@@ -537,7 +754,9 @@ scan_port(struct ScanPortArgs *args)
 
 	if (retval->flags & SCAN_UNKNOWN_VARIABLES) {
 		struct ParserEditOutput param = { unknown_variables_filter, args->query, NULL, NULL, collect_output_unknowns, retval->unknown_variables, 0 };
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_UNKNOWN_VARIABLES);
 		error = parser_edit(parser, output_unknown_variables, &param);
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_UNKNOWN_VARIABLES);
 		if (error != PARSER_ERROR_OK) {
 			char *err = parser_error_tostring(parser);
 			add_error(retval->errors, str_printf("output.unknown-variables: %s", err));
@@ -548,7 +767,9 @@ scan_port(struct ScanPortArgs *args)
 
 	if (retval->flags & SCAN_UNKNOWN_TARGETS) {
 		struct ParserEditOutput param = { unknown_targets_filter, args->query, NULL, NULL, collect_output_unknowns, retval->unknown_targets, 0 };
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_UNKNOWN_TARGETS);
 		error = parser_edit(parser, output_unknown_targets, &param);
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_UNKNOWN_TARGETS);
 		if (error != PARSER_ERROR_OK) {
 			char *err = parser_error_tostring(parser);
 			add_error(retval->errors, str_printf("output.unknown-targets: %s", err));
@@ -559,7 +780,9 @@ scan_port(struct ScanPortArgs *args)
 
 	if (retval->flags & SCAN_CLONES) {
 		// XXX: Limit by query?
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_CLONES);
 		error = parser_edit(parser, lint_clones, &retval->clones);
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_CLONES);
 		if (error != PARSER_ERROR_OK) {
 			char *err = parser_error_tostring(parser);
 			add_error(retval->errors, str_printf("lint.clones: %s", err));
@@ -568,41 +791,47 @@ scan_port(struct ScanPortArgs *args)
 	}
 
 	if (retval->flags & SCAN_OPTION_DEFAULT_DESCRIPTIONS) {
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_OPTION_DEFAULT_DESCRIPTIONS);
 		struct Map *descs = parser_metadata(parser, PARSER_METADATA_OPTION_DESCRIPTIONS);
 		MAP_FOREACH(descs, char *, var, char *, desc) {
 			char *default_desc = map_get(args->default_option_descriptions, var);
 			if (!default_desc) {
 				continue;
 			}
-			if (!set_contains(retval->option_default_descriptions, var)) {
+			if (!hashset_contains(retval->option_default_descriptions, var)) {
 				ssize_t editdist = edit_distance(default_desc, desc);
 				if (strcasecmp(default_desc, desc) == 0 || (editdist > 0 && editdist <= args->editdist)) {
-					set_add(retval->option_default_descriptions, xstrdup(var));
+					hashset_add(retval->option_default_descriptions, xstrdup(var));
 				}
 			}
 		}
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_OPTION_DEFAULT_DESCRIPTIONS);
 	}
 
 	if (retval->flags & SCAN_OPTIONS) {
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_OPTIONS);
 		struct Set *groups = parser_metadata(parser, PARSER_METADATA_OPTION_GROUPS);
 		SET_FOREACH(groups, char *, group) {
-			if (!set_contains(retval->option_groups, group) &&
-			    (args->query == NULL || regexp_exec(args->query, group) == 0)) {
-				set_add(retval->option_groups, xstrdup(group));
+			if (!hashset_contains(retval->option_groups, group) &&
+			    query_matches_name(args->query, group)) {
+				hashset_add(retval->option_groups, xstrdup(group));
 			}
 		}
 		struct Set *options = parser_metadata(parser, PARSER_METADATA_OPTIONS);
 		SET_FOREACH(options, char *, option) {
-			if (!set_contains(retval->options, option) &&
-			    (args->query == NULL || regexp_exec(args->query, option) == 0)) {
-				set_add(retval->options, xstrdup(option));
+			if (!hashset_contains(retval->options, option) &&
+			    query_matches_name(args->query, option)) {
+				hashset_add(retval->options, xstrdup(option));
 			}
 		}
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_OPTIONS);
 	}
 
 	if (retval->flags & SCAN_VARIABLE_VALUES) {
-		struct ParserEditOutput param = { variable_value_filter, args->keyquery, variable_value_filter, args->query, collect_output_variable_values, retval->variable_values, 0 };
+		struct ParserEditOutput param = { variable_name_filter, args->keyquery, variable_value_filter, args->query, collect_output_variable_values, retval->variable_values, 0 };
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_VARIABLE_VALUES);
 		error = parser_edit(parser, output_variable_value, &param);
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_VARIABLE_VALUES);
 		if (error != PARSER_ERROR_OK) {
 			char *err = parser_error_tostring(parser);
 			add_error(retval->errors, str_printf("output.variable-value: %s", err));
@@ -611,9 +840,24 @@ scan_port(struct ScanPortArgs *args)
 		}
 	}
 
+	if (retval->flags & SCAN_EXPANDED_VALUES) {
+		struct ParserEditOutput param = { variable_name_filter, args->keyquery, variable_value_filter, args->query, collect_output_expanded_values, retval->expanded_values, 0 };
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_EXPANDED_VALUES);
+		error = parser_edit(parser, output_expanded_value, &param);
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_EXPANDED_VALUES);
+		if (error != PARSER_ERROR_OK) {
+			char *err = parser_error_tostring(parser);
+			add_error(retval->errors, str_printf("output.expanded-value: %s", err));
+			free(err);
+			goto cleanup;
+		}
+	}
+
 	if (retval->flags & SCAN_COMMENTS) {
 		struct Set *commented_portrevision = NULL;
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_COMMENTS);
 		error = parser_edit(parser, lint_commented_portrevision, &commented_portrevision);
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_COMMENTS);
 		if (error != PARSER_ERROR_OK) {
 			char *err = parser_error_tostring(parser);
 			add_error(retval->errors, str_printf("lint.commented-portrevision: %s", err));
@@ -622,15 +866,42 @@ scan_port(struct ScanPortArgs *args)
 		}
 		SET_FOREACH(commented_portrevision, char *, comment) {
 			char *msg = str_printf("commented revision or epoch: %s", comment);
-			if (set_contains(retval->comments, msg)) {
+			if (hashset_contains(retval->comments, msg)) {
 				free(msg);
 			} else {
-				set_add(retval->comments, msg);
+				hashset_add(retval->comments, msg);
 			}
 		}
 		set_free(commented_portrevision);
 	}
 
+	if (retval->flags & SCAN_DEPGRAPH) {
+		struct ParserEditOutput param = { NULL, NULL, NULL, NULL, collect_output_dependencies, retval->depends, 0 };
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_DEPENDENCIES);
+		error = parser_edit(parser, output_dependencies, &param);
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_DEPENDENCIES);
+		if (error != PARSER_ERROR_OK) {
+			char *err = parser_error_tostring(parser);
+			add_error(retval->errors, str_printf("output.dependencies: %s", err));
+			free(err);
+			goto cleanup;
+		}
+		const char *masterdir = parser_metadata(parser, PARSER_METADATA_MASTERDIR);
+		if (masterdir) {
+			retval->master = resolve_masterdir(retval->origin, masterdir);
+		}
+	}
+
+	if (retval->flags & SCAN_VARINDEX) {
+		portscan_profile_begin(args->profile, PORTSCAN_PROFILE_VARIABLES);
+		error = parser_edit(parser, extract_variables, retval->variables);
+		portscan_profile_end(args->profile, PORTSCAN_PROFILE_VARIABLES);
+		if (error != PARSER_ERROR_OK) {
+			add_error(retval->errors, parser_error_tostring(parser));
+			goto cleanup;
+		}
+	}
+
 cleanup:
 	parser_free(parser);
 	fclose(in);
@@ -641,6 +912,8 @@ scan_ports_worker(void *userdata)
 {
 	struct PortReaderData *data = userdata;
 	struct Array *retval = array_new();
+	portscan_status_attach(data->worker);
+	portscan_trace_attach(data->trace);
 
 	if (data->start == data->end) {
 		free(data);
@@ -649,28 +922,113 @@ scan_ports_worker(void *userdata)
 
 	assert(data->start < data->end);
 
-	for (size_t i = data->start; i < data->end; i++) {
+	// Streamed origins are claimed one by one so that ordered
+	// output does not wait on a whole slice of another worker
+	size_t next = data->start;
+	for (;;) {
+		size_t i;
+		if (data->stream) {
+			i = portscan_stream_claim(data->stream);
+		} else {
+			i = next++;
+		}
+		if (i >= data->end) {
+			break;
+		}
 		portscan_status_print();
 		char *origin = array_get(data->origins, i);
+		portscan_status_set_origin(origin);
 		char *path = str_printf("%s/Makefile", origin);
 		struct ScanResult *result = xmalloc(sizeof(struct ScanResult));
 		result->origin = xstrdup(origin);
 		result->flags = data->flags;
+
+		// Reuse the entries from the previous indexes when
+		// none of the port's inputs changed since then
+		uint64_t hash;
+		uint64_t current;
+		const char *inputs;
+		const char *master;
+		if ((data->flags & SCAN_DEPGRAPH) && data->indexes->depgraph &&
+		    portscan_depgraph_port(data->indexes->depgraph, origin, &hash, &inputs, &master) &&
+		    portscan_hash_inputs(data->portsdir, inputs, &current) &&
+		    current == hash) {
+			result->flags &= ~SCAN_DEPGRAPH;
+			result->depends = portscan_depgraph_deps(data->indexes->depgraph, origin);
+			result->inputs = xstrdup(inputs);
+			result->hash = hash;
+			if (master) {
+				result->master = xstrdup(master);
+			}
+		}
+		if ((data->flags & SCAN_VARINDEX) && data->indexes->varindex &&
+		    portscan_varindex_port(data->indexes->varindex, origin, &hash, &inputs) &&
+		    ((result->inputs && result->hash == hash && strcmp(result->inputs, inputs) == 0) ||
+		     (portscan_hash_inputs(data->portsdir, inputs, &current) && current == hash))) {
+			result->flags &= ~SCAN_VARINDEX;
+			result->variables = portscan_varindex_port_entries(data->indexes->varindex, origin);
+			if (result->inputs == NULL) {
+				result->inputs = xstrdup(inputs);
+				result->hash = hash;
+			}
+		}
+
+		struct Array *input_paths = NULL;
+		if (result->flags & (SCAN_DEPGRAPH | SCAN_VARINDEX | SCAN_WATCH)) {
+			input_paths = array_new();
+			array_append(input_paths, xstrdup(path));
+		}
 		struct ScanPortArgs scan_port_args = {
 			.flags = data->flags,
 			.portsdir = data->portsdir,
 			.path = path,
 			.keyquery = data->keyquery,
 			.query = data->query,
+			.cache = data->cache,
+			.token_cache = data->token_cache,
 			.editdist = data->editdist,
 			.result = result,
 			.default_option_descriptions = data->default_option_descriptions,
+			.profile = data->profile,
+			.inputs = input_paths,
 		};
-		scan_port(&scan_port_args);
+		portscan_profile_begin_origin(data->profile);
+		portscan_trace_begin("port", origin);
+		if (result->flags & scan_port_flags) {
+			scan_port(&scan_port_args);
+		}
+		if (input_paths) {
+			free(result->inputs);
+			result->inputs = str_join(input_paths, " ");
+			if ((data->flags & (SCAN_DEPGRAPH | SCAN_VARINDEX)) &&
+			    !portscan_hash_inputs(data->portsdir, result->inputs, &result->hash)) {
+				// Never reused since the hash will not match
+				result->hash = 0;
+			}
+			ARRAY_FOREACH(input_paths, char *, input) {
+				free(input);
+			}
+			array_free(input_paths);
+		}
+		if (data->stream) {
+			// Like in scan_ports() ports with errors are
+			// left out of the index
+			if (result->errors && hashset_len(result->errors) > 0) {
+				free(result->inputs);
+				result->inputs = NULL;
+			}
+			struct PortscanLog *log = portscan_log_new();
+			scan_result_log(result, log);
+			portscan_stream_write(data->stream, i, log);
+			portscan_log_free(log);
+		}
+		portscan_trace_end();
+		portscan_profile_end_origin(data->profile, origin);
 		portscan_status_inc();
 		free(path);
 		array_append(retval, result);
 	}
+	portscan_status_set_origin(NULL);
 
 	free(data);
 	return retval;
@@ -687,15 +1045,23 @@ lookup_origins_worker(void *userdata)
 	result->unhooked = array_new();
 	result->unsorted = array_new();
 	result->origins = array_new();
+	portscan_status_attach(data->worker);
+	portscan_trace_attach(data->trace);
 
 	for (size_t i = data->start; i < data->end; i++) {
 		portscan_status_print();
 		char *category = array_get(data->categories, i);
+		portscan_status_set_origin(category);
 		char *path = str_printf("%s/Makefile", category);
+		portscan_profile_begin(data->profile, PORTSCAN_PROFILE_CATEGORIES);
+		portscan_trace_begin("category", category);
 		lookup_subdirs(data->portsdir, category, path, data->flags, result->origins, result->nonexistent, result->unhooked, result->unsorted, result->error_origins, result->error_msgs);
+		portscan_trace_end();
+		portscan_profile_end(data->profile, PORTSCAN_PROFILE_CATEGORIES);
 		portscan_status_inc();
 		free(path);
 	}
+	portscan_status_set_origin(NULL);
 
 	free(data);
 
@@ -703,7 +1069,7 @@ lookup_origins_worker(void *userdata)
 }
 
 struct Array *
-lookup_origins(int portsdir, enum ScanFlags flags, struct PortscanLog *log)
+lookup_origins(int portsdir, enum ScanFlags flags, struct PortscanLog *log, struct Array *profiles, struct PortscanTrace *trace)
 {
 	struct Array *retval = array_new();
 
@@ -712,11 +1078,11 @@ lookup_origins(int portsdir, enum ScanFlags flags, struct PortscanLog *log)
 	struct Array *error_msgs = array_new();
 	lookup_subdirs(portsdir, "", "Makefile", SCAN_NOTHING, categories, NULL, NULL, NULL, error_origins, error_msgs);
 
-	portscan_status_reset(PORTSCAN_STATUS_CATEGORIES, array_len(categories));
 	ssize_t n_threads = sysconf(_SC_NPROCESSORS_ONLN);
 	if (n_threads < 0) {
 		err(1, "sysconf");
 	}
+	portscan_status_reset(PORTSCAN_STATUS_CATEGORIES, array_len(categories), n_threads);
 	pthread_t *tid = reallocarray(NULL, n_threads, sizeof(pthread_t));
 	if (tid == NULL) {
 		err(1, "reallocarray");
@@ -730,7 +1096,19 @@ lookup_origins(int portsdir, enum ScanFlags flags, struct PortscanLog *log)
 		data->categories = categories;
 		data->start = start;
 		data->end = end;
+		data->worker = i;
 		data->flags = flags;
+		if (profiles) {
+			char *name = str_printf("categories[%zd]", i);
+			data->profile = portscan_profile_new(name, 0);
+			array_append(profiles, data->profile);
+			free(name);
+		}
+		if (trace) {
+			char *name = str_printf("categories[%zd]", i);
+			data->trace = portscan_trace_thread(trace, name);
+			free(name);
+		}
 		if (pthread_create(&tid[i], NULL, lookup_origins_worker, data) != 0) {
 			err(1, "pthread_create");
 		}
@@ -851,20 +1229,23 @@ PARSER_EDIT(get_default_option_descriptions)
 }
 
 void
-scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Regexp *keyquery, struct Regexp *query, ssize_t editdist, struct PortscanLog *retval)
+scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Regexp *keyquery, struct Regexp *query, ssize_t editdist, struct PortscanLog *retval, struct Array *profiles, size_t slowest, struct PortscanTrace *trace, struct ScanIndexes *indexes, struct PortscanStream *stream, struct TokenCache *token_cache)
 {
-	if (!(flags & (SCAN_CLONES |
-		       SCAN_COMMENTS |
-		       SCAN_OPTION_DEFAULT_DESCRIPTIONS |
-		       SCAN_OPTIONS |
-		       SCAN_UNKNOWN_TARGETS |
-		       SCAN_UNKNOWN_VARIABLES |
-		       SCAN_VARIABLE_VALUES))) {
+	if (!(flags & scan_port_flags)) {
 		return;
 	}
 
+	struct PortscanProfile *profile = NULL;
+	if (profiles) {
+		profile = portscan_profile_new("main", 0);
+		array_append(profiles, profile);
+	}
+
+	portscan_profile_begin(profile, PORTSCAN_PROFILE_OPTIONS_DESC);
+	portscan_trace_begin("bsd.options.desc.mk", NULL);
 	FILE *in = fileopenat(portsdir, "Mk/bsd.options.desc.mk");
 	if (in == NULL) {
+		portscan_trace_end();
 		portscan_log_add_entry(retval, PORTSCAN_LOG_ENTRY_ERROR, "Mk/bsd.options.desc.mk",
 			str_printf("fileopenat: %s", strerror(errno)));
 		return;
@@ -872,9 +1253,11 @@ scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Reg
 
 	struct ParserSettings settings;
 	parser_init_settings(&settings);
+	settings.token_cache = token_cache;
 	struct Parser *parser = parser_new(&settings);
 	enum ParserError error = parser_read_from_file(parser, in);
 	if (error != PARSER_ERROR_OK) {
+		portscan_trace_end();
 		portscan_log_add_entry(retval, PORTSCAN_LOG_ENTRY_ERROR, "Mk/bsd.options.desc.mk", parser_error_tostring(parser));
 		parser_free(parser);
 		fclose(in);
@@ -882,6 +1265,7 @@ scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Reg
 	}
 	error = parser_read_finish(parser);
 	if (error != PARSER_ERROR_OK) {
+		portscan_trace_end();
 		portscan_log_add_entry(retval, PORTSCAN_LOG_ENTRY_ERROR, "Mk/bsd.options.desc.mk", parser_error_tostring(parser));
 		parser_free(parser);
 		fclose(in);
@@ -890,6 +1274,7 @@ scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Reg
 
 	struct Map *default_option_descriptions = NULL;
 	if (parser_edit(parser, get_default_option_descriptions, &default_option_descriptions) != PARSER_ERROR_OK) {
+		portscan_trace_end();
 		portscan_log_add_entry(retval, PORTSCAN_LOG_ENTRY_ERROR, "Mk/bsd.options.desc.mk", parser_error_tostring(parser));
 		parser_free(parser);
 		fclose(in);
@@ -901,6 +1286,12 @@ scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Reg
 	parser = NULL;
 	fclose(in);
 	in = NULL;
+	portscan_trace_end();
+	portscan_profile_end(profile, PORTSCAN_PROFILE_OPTIONS_DESC);
+
+	struct ScanQuery keyquery_names = { keyquery, cache_new() };
+	struct ScanQuery query_names = { query, cache_new() };
+	struct Cache *cache = cache_new();
 
 	ssize_t n_threads = sysconf(_SC_NPROCESSORS_ONLN);
 	if (n_threads < 0) {
@@ -911,6 +1302,7 @@ scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Reg
 		err(1, "reallocarray");
 	}
 
+	portscan_status_reset(PORTSCAN_STATUS_PORTS, array_len(origins), n_threads);
 	size_t start = 0;
 	size_t step = array_len(origins) / n_threads + 1;
 	size_t end = MIN(start + step, array_len(origins));
@@ -918,13 +1310,34 @@ scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Reg
 		struct PortReaderData *data = xmalloc(sizeof(struct PortReaderData));
 		data->portsdir = portsdir;
 		data->origins = origins;
-		data->start = start;
-		data->end = end;
-		data->keyquery = keyquery;
-		data->query = query;
+		if (stream) {
+			data->start = 0;
+			data->end = array_len(origins);
+		} else {
+			data->start = start;
+			data->end = end;
+		}
+		data->worker = i;
+		data->keyquery = &keyquery_names;
+		data->query = &query_names;
+		data->cache = cache;
+		data->token_cache = token_cache;
 		data->editdist = editdist;
 		data->flags = flags;
 		data->default_option_descriptions = default_option_descriptions;
+		data->indexes = indexes;
+		data->stream = stream;
+		if (profiles) {
+			char *name = str_printf("ports[%zd]", i);
+			data->profile = portscan_profile_new(name, slowest);
+			array_append(profiles, data->profile);
+			free(name);
+		}
+		if (trace) {
+			char *name = str_printf("ports[%zd]", i);
+			data->trace = portscan_trace_thread(trace, name);
+			free(name);
+		}
 		if (pthread_create(&tid[i], NULL, scan_ports_worker, data) != 0) {
 			err(1, "pthread_create");
 		}
@@ -944,41 +1357,430 @@ scan_ports(int portsdir, struct Array *origins, enum ScanFlags flags, struct Reg
 		}
 		array_free(result);
 	}
+	portscan_status_reset(PORTSCAN_STATUS_RESULT, array_len(results), 0);
+	portscan_profile_begin(profile, PORTSCAN_PROFILE_RESULT);
+	portscan_trace_begin("merge", NULL);
 	ARRAY_FOREACH(results, struct ScanResult *, r) {
 		portscan_status_print();
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_ERROR, r->origin, r->errors);
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_UNKNOWN_VAR, r->origin, r->unknown_variables);
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_UNKNOWN_TARGET, r->origin, r->unknown_targets);
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_DUPLICATE_VAR, r->origin, r->clones);
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_OPTION_DEFAULT_DESCRIPTION, r->origin, r->option_default_descriptions);
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_OPTION_GROUP, r->origin, r->option_groups);
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_OPTION, r->origin, r->options);
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_VARIABLE_VALUE, r->origin, r->variable_values);
-		portscan_log_add_entries(retval, PORTSCAN_LOG_ENTRY_COMMENT, r->origin, r->comments);
+		// Ports with errors are left out of the index so that
+		// they are scanned again next time.
+		if (r->inputs && (r->errors == NULL || hashset_len(r->errors) == 0)) {
+			if (indexes->depgraph_builder) {
+				portscan_depgraph_builder_add_port(indexes->depgraph_builder, r->origin, r->hash, r->inputs, r->master);
+				ARRAY_FOREACH(r->depends, struct PortscanDepgraphEdge *, edge) {
+					if (edge->kinds) {
+						portscan_depgraph_builder_add_edge(indexes->depgraph_builder, r->origin, edge->origin, edge->kinds);
+					}
+				}
+			}
+			if (indexes->varindex_builder) {
+				portscan_varindex_builder_add_port(indexes->varindex_builder, r->origin, r->hash, r->inputs);
+				ARRAY_FOREACH(r->variables, struct PortscanVarindexEntry *, entry) {
+					portscan_varindex_builder_add_entry(indexes->varindex_builder, r->origin, entry->name, entry->value, entry->start, entry->end);
+				}
+			}
+		}
+		// Ports with errors are still watched so that fixing
+		// them triggers a rescan
+		if (r->inputs && indexes->watch) {
+			portscan_watch_add_port(indexes->watch, r->origin, r->inputs);
+		}
+		portscan_depgraph_edges_free(r->depends);
+		portscan_varindex_entries_free(r->variables);
+		free(r->inputs);
+		free(r->master);
+		scan_result_log(r, retval);
 		free(r->origin);
 		free(r);
+		portscan_status_inc();
 	}
 	array_free(results);
+	portscan_trace_end();
+	portscan_profile_end(profile, PORTSCAN_PROFILE_RESULT);
 
+	cache_free(keyquery_names.names);
+	cache_free(query_names.names);
+	cache_free(cache);
 	map_free(default_option_descriptions);
 	free(tid);
 }
 
+// Moves the check results of r into log
+void
+scan_result_log(struct ScanResult *r, struct PortscanLog *log)
+{
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_ERROR, r->origin, r->errors);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_UNKNOWN_VAR, r->origin, r->unknown_variables);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_UNKNOWN_TARGET, r->origin, r->unknown_targets);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_DUPLICATE_VAR, r->origin, r->clones);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_OPTION_DEFAULT_DESCRIPTION, r->origin, r->option_default_descriptions);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_OPTION_GROUP, r->origin, r->option_groups);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_OPTION, r->origin, r->options);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_VARIABLE_VALUE, r->origin, r->variable_values);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_EXPANDED_VALUE, r->origin, r->expanded_values);
+	portscan_log_add_entries(log, PORTSCAN_LOG_ENTRY_COMMENT, r->origin, r->comments);
+	r->errors = NULL;
+	r->unknown_variables = NULL;
+	r->unknown_targets = NULL;
+	r->clones = NULL;
+	r->option_default_descriptions = NULL;
+	r->option_groups = NULL;
+	r->options = NULL;
+	r->variable_values = NULL;
+	r->expanded_values = NULL;
+	r->comments = NULL;
+}
+
+int
+query_depgraph(const char *path, const char *deps_origin, const char *rdeps_origin)
+{
+	struct PortscanDepgraph *graph = portscan_depgraph_open(AT_FDCWD, path);
+	if (graph == NULL) {
+		err(1, "portscan_depgraph_open: %s", path);
+	}
+
+#if HAVE_CAPSICUM
+	if (caph_enter() < 0) {
+		err(1, "caph_enter");
+	}
+#endif
+
+	int status = 0;
+	const char *origins[] = { deps_origin, rdeps_origin };
+	for (size_t i = 0; i < nitems(origins); i++) {
+		if (origins[i] == NULL) {
+			continue;
+		}
+		struct Array *edges;
+		if (origins[i] == deps_origin) {
+			edges = portscan_depgraph_deps(graph, origins[i]);
+		} else {
+			edges = portscan_depgraph_rdeps(graph, origins[i]);
+		}
+		if (edges == NULL) {
+			warnx("%s is not in %s", origins[i], path);
+			status = 1;
+			continue;
+		}
+		ARRAY_FOREACH(edges, struct PortscanDepgraphEdge *, edge) {
+			char *kinds = portscan_depgraph_kind_tostring(edge->kinds | edge->inherited);
+			printf("%s\t%s\n", edge->origin, kinds);
+			free(kinds);
+		}
+		portscan_depgraph_edges_free(edges);
+	}
+
+	portscan_depgraph_close(graph);
+	return status;
+}
+
+int
+query_matches_name(struct ScanQuery *query, const char *name)
+{
+	if (query->regexp == NULL) {
+		return 1;
+	}
+
+	int matches;
+	if (!cache_get(query->names, name, &matches)) {
+		matches = regexp_exec(query->regexp, name) == 0;
+		cache_put(query->names, name, matches);
+	}
+	return matches;
+}
+
+int
+query_varindex(const char *path, const char *name_query, const char *value_query)
+{
+	struct PortscanVarindex *index = portscan_varindex_open(AT_FDCWD, path);
+	if (index == NULL) {
+		err(1, "portscan_varindex_open: %s", path);
+	}
+
+#if HAVE_CAPSICUM
+	if (caph_enter() < 0) {
+		err(1, "caph_enter");
+	}
+#endif
+
+	struct Regexp *name_regexp = regexp_new_from_str(name_query, REG_EXTENDED);
+	if (name_regexp == NULL) {
+		errx(1, "invalid regexp");
+	}
+	struct Regexp *value_regexp = NULL;
+	if (value_query) {
+		value_regexp = regexp_new_from_str(value_query, REG_EXTENDED);
+		if (value_regexp == NULL) {
+			errx(1, "invalid regexp");
+		}
+	}
+
+	struct Array *entries = portscan_varindex_query(index, name_regexp, value_regexp);
+	ARRAY_FOREACH(entries, struct PortscanVarindexEntry *, entry) {
+		if (entry->start + 1 >= entry->end) {
+			printf("%s:%zu\t%s\t%s\n", entry->origin, entry->start, entry->name, entry->value);
+		} else {
+			printf("%s:%zu-%zu\t%s\t%s\n", entry->origin, entry->start, entry->end - 1, entry->name, entry->value);
+		}
+	}
+	int status = array_len(entries) == 0;
+	portscan_varindex_entries_free(entries);
+
+	regexp_free(name_regexp);
+	regexp_free(value_regexp);
+	portscan_varindex_close(index);
+	return status;
+}
+
+int
+open_index_dir(const char *path, char **file)
+{
+	char *buf = xstrdup(path);
+	int dir = open(dirname(buf), O_DIRECTORY);
+	free(buf);
+	if (dir == -1) {
+		err(1, "open: %s", path);
+	}
+	buf = xstrdup(path);
+	*file = xstrdup(basename(buf));
+	free(buf);
+	return dir;
+}
+
+// Keeps the results of the initial scan up to date by rescanning the
+// ports affected by changes to the ports tree.  Category checks are
+// kept in categories and everything else in ports.  Does not return.
+void
+watch_ports(struct PortscanWatch *watch, int debounce, int portsdir, struct Array *origins, enum ScanFlags flags, struct Regexp *keyquery, struct Regexp *query, ssize_t editdist, struct PortscanLog *categories, struct PortscanLog *ports, struct PortscanLogDir *logdir, FILE *out, struct TokenCache *token_cache)
+{
+	struct ScanIndexes indexes = { .watch = watch };
+	flags &= ~(SCAN_DEPGRAPH | SCAN_VARINDEX);
+
+	struct Set *known = set_new(str_compare, NULL, free);
+	ARRAY_FOREACH(origins, const char *, origin) {
+		set_add(known, xstrdup(origin));
+	}
+
+	struct PortscanLog *prev = portscan_log_new();
+	for (;;) {
+		struct PortscanLog *result = portscan_log_new();
+		portscan_log_merge(result, categories);
+		portscan_log_merge(result, ports);
+		if (logdir) {
+			struct PortscanLog *latest = portscan_log_read_all(logdir, PORTSCAN_LOG_LATEST);
+			if (!portscan_log_compare(latest, result) &&
+			    !portscan_log_serialize_to_dir(result, logdir)) {
+				err(1, "portscan_log_serialize_to_dir");
+			}
+			portscan_log_free(latest);
+		} else if (!portscan_log_serialize_changes(prev, result, out)) {
+			err(1, "portscan_log_serialize_changes");
+		}
+		portscan_log_free(prev);
+		prev = result;
+
+		struct Set *changed = set_new(str_compare, NULL, free);
+		int changes = portscan_watch_wait(watch, debounce, changed);
+		if (changes == -1) {
+			err(1, "portscan_watch_wait");
+		}
+
+		// Ports that were added to a category are scanned and
+		// the results of removed ports are dropped
+		if ((changes & PORTSCAN_WATCH_CATEGORIES) && !(flags & SCAN_PARTIAL)) {
+			portscan_log_free(categories);
+			categories = portscan_log_new();
+			struct Array *current = lookup_origins(portsdir, flags, categories, NULL, NULL);
+			struct Set *current_set = set_new(str_compare, NULL, NULL);
+			ARRAY_FOREACH(current, char *, origin) {
+				set_add(current_set, origin);
+				if (!set_contains(known, origin)) {
+					set_add(known, xstrdup(origin));
+					if (!set_contains(changed, origin)) {
+						set_add(changed, xstrdup(origin));
+					}
+				}
+			}
+			struct Array *removed = array_new();
+			SET_FOREACH(known, const char *, origin) {
+				if (!set_contains(current_set, origin)) {
+					array_append(removed, origin);
+				}
+			}
+			ARRAY_FOREACH(removed, const char *, origin) {
+				portscan_watch_remove_port(watch, origin);
+				if (!set_contains(changed, origin)) {
+					set_add(changed, xstrdup(origin));
+				}
+				set_remove(known, origin);
+			}
+			array_free(removed);
+			set_free(current_set);
+			ARRAY_FOREACH(current, char *, origin) {
+				free(origin);
+			}
+			array_free(current);
+		}
+		if (changes & PORTSCAN_WATCH_ALL) {
+			SET_FOREACH(known, const char *, origin) {
+				if (!set_contains(changed, origin)) {
+					set_add(changed, xstrdup(origin));
+				}
+			}
+		}
+
+		if (set_len(changed) > 0) {
+			struct Array *rescan = array_new();
+			SET_FOREACH(changed, const char *, origin) {
+				if (set_contains(known, origin)) {
+					array_append(rescan, origin);
+				}
+			}
+			// Errors from reading the default option
+			// descriptions are reported again if they persist
+			set_add(changed, xstrdup("Mk/bsd.options.desc.mk"));
+			portscan_log_free(portscan_log_extract(ports, changed));
+			scan_ports(portsdir, rescan, flags, keyquery, query, editdist, ports, NULL, 0, NULL, &indexes, NULL, token_cache);
+			array_free(rescan);
+		}
+		set_free(changed);
+	}
+}
+
 void
 usage()
 {
 	fprintf(stderr, "usage: portscan [-l <logdir>] [-p <portsdir>] [-q <regexp>] [--<check> ...] [<origin1> ...]\n");
+	fprintf(stderr, "       portscan merge [-l <logdir>] [-p <portsdir>] <log> ...\n");
 	exit(EX_USAGE);
 }
 
+// Combines the logs of a scan that was split with --shard into the
+// log a single portscan run would have produced.
+int
+merge_main(int argc, char *argv[])
+{
+	const char *portsdir_path = getenv("PORTSDIR");
+	const char *logdir_path = NULL;
+	int ch;
+	while ((ch = getopt(argc, argv, "l:p:")) != -1) {
+		switch (ch) {
+		case 'l':
+			logdir_path = optarg;
+			break;
+		case 'p':
+			portsdir_path = optarg;
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc == 0) {
+		usage();
+	}
+
+	if (portsdir_path == NULL) {
+		portsdir_path = "/usr/ports";
+	}
+
+#if HAVE_CAPSICUM
+	if (caph_limit_stdio() < 0) {
+		err(1, "caph_limit_stdio");
+	}
+
+	closefrom(STDERR_FILENO + 1);
+	close(STDIN_FILENO);
+#endif
+
+	FILE **inputs = xrecallocarray(NULL, 0, argc, sizeof(FILE *));
+	for (int i = 0; i < argc; i++) {
+		inputs[i] = fopen(argv[i], "r");
+		if (inputs[i] == NULL) {
+			err(1, "fopen: %s", argv[i]);
+		}
+	}
+
+	struct PortscanLogDir *logdir = NULL;
+	if (logdir_path != NULL) {
+		// Only needed for the commit in the log's filename
+		int portsdir = open(portsdir_path, O_DIRECTORY);
+		if (portsdir == -1) {
+			err(1, "open: %s", portsdir_path);
+		}
+		logdir = portscan_log_dir_open(logdir_path, portsdir);
+		if (logdir == NULL) {
+			err(1, "portscan_log_dir_open: %s", logdir_path);
+		}
+		close(portsdir);
+	}
+
+#if HAVE_CAPSICUM
+	for (int i = 0; i < argc; i++) {
+		if (caph_limit_stream(fileno(inputs[i]), CAPH_READ) < 0) {
+			err(1, "caph_limit_stream: %s", argv[i]);
+		}
+	}
+	if (caph_enter() < 0) {
+		err(1, "caph_enter");
+	}
+#endif
+
+	struct PortscanLog *result = portscan_log_new();
+	if (!portscan_log_merge_files(result, inputs, argc)) {
+		errx(1, "input logs are not sorted");
+	}
+	for (int i = 0; i < argc; i++) {
+		fclose(inputs[i]);
+	}
+	free(inputs);
+
+	int status = 0;
+	if (portscan_log_len(result) > 0) {
+		if (logdir != NULL) {
+			struct PortscanLog *prev_result = portscan_log_read_all(logdir, PORTSCAN_LOG_LATEST);
+			if (portscan_log_compare(prev_result, result)) {
+				warnx("no changes compared to previous result");
+				status = 2;
+			} else if (!portscan_log_serialize_to_dir(result, logdir)) {
+				err(1, "portscan_log_serialize_to_dir");
+			}
+			portscan_log_free(prev_result);
+		} else if (!portscan_log_serialize_to_file(result, stdout)) {
+			err(1, "portscan_log_serialize");
+		}
+	}
+
+	portscan_log_dir_close(logdir);
+	portscan_log_free(result);
+
+	return status;
+}
+
 int
 main(int argc, char *argv[])
 {
+	if (argc > 1 && strcmp(argv[1], "merge") == 0) {
+		return merge_main(argc - 1, argv + 1);
+	}
+
 	const char *portsdir_path = getenv("PORTSDIR");
 	const char *logdir_path = NULL;
 	const char *keyquery = NULL;
 	const char *query = NULL;
 	unsigned int progressinterval = 0;
+	struct Array *profiles = NULL;
+	size_t profile_slowest = 10;
+	const char *trace_path = NULL;
+	const char *status_path = NULL;
+	const char *depgraph_path = NULL;
+	const char *deps_origin = NULL;
+	const char *rdeps_origin = NULL;
+	const char *varindex_path = NULL;
+	const char *lookup_query = NULL;
+	enum ScanFormat format = SCAN_FORMAT_TEXT;
 
 	struct ScanLongoptsState opts[SCAN_LONGOPT__N] = {};
 	for (enum ScanLongopts i = 0; i < SCAN_LONGOPT__N; i++) {
@@ -1054,15 +1856,68 @@ main(int argc, char *argv[])
 		case SCAN_LONGOPT_COMMENTS:
 			flags |= SCAN_COMMENTS;
 			break;
+		case SCAN_LONGOPT_DEPGRAPH:
+			flags |= SCAN_DEPGRAPH;
+			depgraph_path = opts[i].optarg;
+			break;
+		case SCAN_LONGOPT_DEPS:
+			deps_origin = opts[i].optarg;
+			break;
+		case SCAN_LONGOPT_EXPANDED_VALUES:
+			flags |= SCAN_EXPANDED_VALUES;
+			if (opts[i].optarg) {
+				keyquery = opts[i].optarg;
+			}
+			break;
+		case SCAN_LONGOPT_FORMAT:
+			if (opts[i].optarg == NULL) {
+				usage();
+			} else if (strcmp(opts[i].optarg, "text") == 0) {
+				format = SCAN_FORMAT_TEXT;
+			} else if (strcmp(opts[i].optarg, "ndjson") == 0) {
+				format = SCAN_FORMAT_NDJSON;
+			} else if (strcmp(opts[i].optarg, "ndjson-ordered") == 0) {
+				format = SCAN_FORMAT_NDJSON_ORDERED;
+			} else {
+				warnx("unknown format: %s", opts[i].optarg);
+				usage();
+			}
+			break;
+		case SCAN_LONGOPT_LOOKUP:
+			lookup_query = opts[i].optarg;
+			break;
 		case SCAN_LONGOPT_OPTION_DEFAULT_DESCRIPTIONS:
 			flags |= SCAN_OPTION_DEFAULT_DESCRIPTIONS;
 			break;
 		case SCAN_LONGOPT_OPTIONS:
 			flags |= SCAN_OPTIONS;
 			break;
+		case SCAN_LONGOPT_PROFILE:
+			profiles = array_new();
+			break;
 		case SCAN_LONGOPT_PROGRESS:
 			progressinterval = 5;
 			break;
+		case SCAN_LONGOPT_RDEPS:
+			rdeps_origin = opts[i].optarg;
+			break;
+		case SCAN_LONGOPT_SHARD:
+			break;
+		case SCAN_LONGOPT_STATS:
+			if (opts[i].optarg == NULL) {
+				stats_enable();
+			} else if (strcmp(opts[i].optarg, "allocations") == 0) {
+				stats_enable_allocations();
+			} else {
+				usage();
+			}
+			break;
+		case SCAN_LONGOPT_STATUS_FILE:
+			status_path = opts[i].optarg;
+			break;
+		case SCAN_LONGOPT_TRACE:
+			trace_path = opts[i].optarg;
+			break;
 		case SCAN_LONGOPT_UNKNOWN_TARGETS:
 			flags |= SCAN_UNKNOWN_TARGETS;
 			break;
@@ -1071,15 +1926,50 @@ main(int argc, char *argv[])
 			break;
 		case SCAN_LONGOPT_VARIABLE_VALUES:
 			flags |= SCAN_VARIABLE_VALUES;
-			keyquery = opts[i].optarg;
+			if (opts[i].optarg) {
+				keyquery = opts[i].optarg;
+			}
+			break;
+		case SCAN_LONGOPT_VARINDEX:
+			flags |= SCAN_VARINDEX;
+			varindex_path = opts[i].optarg;
+			break;
+		case SCAN_LONGOPT_WATCH:
+			flags |= SCAN_WATCH;
 			break;
 		case SCAN_LONGOPT__N:
 			break;
 		}
 	}
 
-	if (flags == SCAN_NOTHING) {
-		flags = SCAN_CATEGORIES | SCAN_CLONES | SCAN_COMMENTS |
+	if (depgraph_path == NULL) {
+		if (deps_origin || rdeps_origin) {
+			warnx("--deps and --rdeps need --depgraph");
+			usage();
+		}
+		flags &= ~SCAN_DEPGRAPH;
+	}
+	if (varindex_path == NULL) {
+		if (lookup_query) {
+			warnx("--lookup needs --varindex");
+			usage();
+		}
+		flags &= ~SCAN_VARINDEX;
+	}
+	if (!opts[SCAN_LONGOPT_WATCH].flag) {
+		flags &= ~SCAN_WATCH;
+	}
+	if (opts[SCAN_LONGOPT_SHARD].flag && (flags & SCAN_WATCH)) {
+		warnx("--shard cannot be used with --watch");
+		usage();
+	}
+	if (format != SCAN_FORMAT_TEXT && (logdir_path || (flags & SCAN_WATCH))) {
+		warnx("--format=%s cannot be used with -l or --watch", opts[SCAN_LONGOPT_FORMAT].optarg);
+		usage();
+	}
+
+	if ((flags & ~SCAN_WATCH) == SCAN_NOTHING) {
+		flags |= SCAN_CATEGORIES | SCAN_CLONES | SCAN_COMMENTS |
 			SCAN_OPTION_DEFAULT_DESCRIPTIONS | SCAN_UNKNOWN_TARGETS |
 			SCAN_UNKNOWN_VARIABLES;
 	}
@@ -1097,6 +1987,13 @@ main(int argc, char *argv[])
 	close(STDIN_FILENO);
 #endif
 
+	if (deps_origin || rdeps_origin) {
+		return query_depgraph(depgraph_path, deps_origin, rdeps_origin);
+	}
+	if (lookup_query) {
+		return query_varindex(varindex_path, lookup_query, query);
+	}
+
 	int portsdir = open(portsdir_path, O_DIRECTORY);
 	if (portsdir == -1) {
 		err(1, "open: %s", portsdir_path);
@@ -1113,12 +2010,67 @@ main(int argc, char *argv[])
 		out = NULL;
 	}
 
+	FILE *trace_out = NULL;
+	if (trace_path != NULL) {
+		trace_out = fopen(trace_path, "w");
+		if (trace_out == NULL) {
+			err(1, "fopen: %s", trace_path);
+		}
+	}
+
+	if (status_path != NULL && !portscan_status_open_file(status_path)) {
+		err(1, "open: %s", status_path);
+	}
+
+	struct TokenCache *token_cache = open_token_cache();
+
+	struct ScanIndexes indexes = {};
+	int depgraph_dir = -1;
+	char *depgraph_file = NULL;
+	if (flags & SCAN_DEPGRAPH) {
+		depgraph_dir = open_index_dir(depgraph_path, &depgraph_file);
+		indexes.depgraph = portscan_depgraph_open(depgraph_dir, depgraph_file);
+		if (indexes.depgraph == NULL && errno != ENOENT) {
+			warn("rebuilding %s", depgraph_path);
+		}
+		indexes.depgraph_builder = portscan_depgraph_builder_new();
+	}
+	int varindex_dir = -1;
+	char *varindex_file = NULL;
+	if (flags & SCAN_VARINDEX) {
+		varindex_dir = open_index_dir(varindex_path, &varindex_file);
+		indexes.varindex = portscan_varindex_open(varindex_dir, varindex_file);
+		if (indexes.varindex == NULL && errno != ENOENT) {
+			warn("rebuilding %s", varindex_path);
+		}
+		indexes.varindex_builder = portscan_varindex_builder_new();
+	}
+	struct PortscanWatch *watch = NULL;
+	if (flags & SCAN_WATCH) {
+		watch = portscan_watch_new(portsdir_path);
+		if (watch == NULL) {
+			err(1, "portscan_watch_new: %s", portsdir_path);
+		}
+		indexes.watch = watch;
+	}
+
 #if HAVE_CAPSICUM
 	if (caph_limit_stream(portsdir, CAPH_LOOKUP | CAPH_READ | CAPH_READDIR) < 0) {
 		err(1, "caph_limit_stream");
 	}
+	if (trace_out && caph_limit_stream(fileno(trace_out), CAPH_WRITE) < 0) {
+		err(1, "caph_limit_stream: %s", trace_path);
+	}
+	if (depgraph_dir != -1 && caph_limit_stream(depgraph_dir, CAPH_CREATE | CAPH_FTRUNCATE | CAPH_RENAME) < 0) {
+		err(1, "caph_limit_stream: %s", depgraph_path);
+	}
+	if (varindex_dir != -1 && caph_limit_stream(varindex_dir, CAPH_CREATE | CAPH_FTRUNCATE | CAPH_RENAME) < 0) {
+		err(1, "caph_limit_stream: %s", varindex_path);
+	}
 
-	if (caph_enter() < 0) {
+	// New directories are watched by path which is not possible
+	// in capability mode
+	if (watch == NULL && caph_enter() < 0) {
 		err(1, "caph_enter");
 	}
 #endif
@@ -1132,6 +2084,20 @@ main(int argc, char *argv[])
 	}
 	portscan_status_init(progressinterval);
 
+	if (opts[SCAN_LONGOPT_PROFILE].optarg) {
+		const char *error;
+		profile_slowest = strtonum(opts[SCAN_LONGOPT_PROFILE].optarg, 0, INT_MAX, &error);
+		if (error) {
+			errx(1, "--profile=%s is %s (must be >=0)", opts[SCAN_LONGOPT_PROFILE].optarg, error);
+		}
+	}
+
+	struct PortscanTrace *trace = NULL;
+	if (trace_out) {
+		trace = portscan_trace_new();
+		portscan_trace_attach(portscan_trace_thread(trace, "main"));
+	}
+
 	struct Regexp *keyquery_regexp = NULL;
 	if (keyquery) {
 		keyquery_regexp = regexp_new_from_str(keyquery, REG_EXTENDED);
@@ -1147,6 +2113,37 @@ main(int argc, char *argv[])
 		}
 	}
 
+	// Origins are assigned to shards by hash so that every shard
+	// gets a similar mix of ports no matter how the tree changes.
+	// Only the first shard reports category results.
+	long long shard = 0;
+	long long shards = 0;
+	if (opts[SCAN_LONGOPT_SHARD].optarg) {
+		const char *arg = opts[SCAN_LONGOPT_SHARD].optarg;
+		const char *sep = strchr(arg, '/');
+		const char *error = "invalid";
+		if (sep) {
+			char *buf = xstrndup(arg, sep - arg);
+			shards = strtonum(sep + 1, 1, INT_MAX, &error);
+			if (error == NULL) {
+				shard = strtonum(buf, 1, shards, &error);
+			}
+			free(buf);
+		}
+		if (error) {
+			errx(1, "--shard=%s is %s (must be i/N with 1 <= i <= N)", arg, error);
+		}
+	}
+
+	int debounce = 500;
+	if (opts[SCAN_LONGOPT_WATCH].optarg) {
+		const char *error;
+		debounce = strtonum(opts[SCAN_LONGOPT_WATCH].optarg, 0, INT_MAX, &error);
+		if (error) {
+			errx(1, "--watch=%s is %s (must be >=0)", opts[SCAN_LONGOPT_WATCH].optarg, error);
+		}
+	}
+
 	ssize_t editdist = 3;
 	if (opts[SCAN_LONGOPT_OPTION_DEFAULT_DESCRIPTIONS].optarg) {
 		const char *error;
@@ -1157,9 +2154,17 @@ main(int argc, char *argv[])
 	}
 
 	struct PortscanLog *result = portscan_log_new();
+	// Category results are kept apart in --watch mode so that
+	// they can be replaced independently of the ports
+	struct PortscanLog *category_result = result;
+	if (watch || shard > 1) {
+		category_result = portscan_log_new();
+	}
 	struct Array *origins = NULL;
 	if (argc == 0) {
-		origins = lookup_origins(portsdir, flags, result);
+		portscan_trace_begin("lookup-origins", NULL);
+		origins = lookup_origins(portsdir, flags, category_result, profiles, trace);
+		portscan_trace_end();
 	} else {
 		flags |= SCAN_PARTIAL;
 		origins = array_new();
@@ -1167,43 +2172,150 @@ main(int argc, char *argv[])
 			array_append(origins, xstrdup(argv[i]));
 		}
 	}
+	if (shards > 1) {
+		struct Array *owned = array_new();
+		ARRAY_FOREACH(origins, char *, origin) {
+			if (portscan_hash_origin(origin) % shards == (uint64_t)(shard - 1)) {
+				array_append(owned, origin);
+			} else {
+				free(origin);
+			}
+		}
+		array_free(origins);
+		origins = owned;
+	}
+	if (category_result != result && !watch) {
+		portscan_log_free(category_result);
+		category_result = NULL;
+	}
+
+	// Category results are complete at this point and are written
+	// before the ports are streamed
+	struct PortscanStream *stream = NULL;
+	if (format != SCAN_FORMAT_TEXT) {
+		if (!portscan_log_serialize_to_ndjson(result, out)) {
+			err(1, "portscan_log_serialize_to_ndjson");
+		}
+		portscan_log_free(result);
+		result = portscan_log_new();
+		stream = portscan_stream_new(out, array_len(origins), format == SCAN_FORMAT_NDJSON_ORDERED);
+	}
 
 	int status = 0;
-	portscan_status_reset(PORTSCAN_STATUS_PORTS, array_len(origins));
-	scan_ports(portsdir, origins, flags, keyquery_regexp, query_regexp, editdist, result);
+	portscan_trace_begin("scan-ports", NULL);
+	scan_ports(portsdir, origins, flags, keyquery_regexp, query_regexp, editdist, result, profiles, profile_slowest, trace, &indexes, stream, token_cache);
+	portscan_trace_end();
+	// Ports that were not part of a partial scan stay in the
+	// indexes unchanged
+	if (indexes.depgraph_builder) {
+		portscan_trace_begin("depgraph", NULL);
+		if (indexes.depgraph && (flags & SCAN_PARTIAL)) {
+			struct Array *ports = portscan_depgraph_ports(indexes.depgraph);
+			ARRAY_FOREACH(ports, const char *, origin) {
+				if (!portscan_depgraph_builder_has_port(indexes.depgraph_builder, origin)) {
+					portscan_depgraph_builder_copy_port(indexes.depgraph_builder, indexes.depgraph, origin);
+				}
+			}
+			array_free(ports);
+		}
+		if (!portscan_depgraph_builder_write(indexes.depgraph_builder, depgraph_dir, depgraph_file)) {
+			err(1, "portscan_depgraph_builder_write: %s", depgraph_path);
+		}
+		portscan_trace_end();
+	}
+	if (indexes.varindex_builder) {
+		portscan_trace_begin("varindex", NULL);
+		if (indexes.varindex && (flags & SCAN_PARTIAL)) {
+			struct Array *ports = portscan_varindex_ports(indexes.varindex);
+			ARRAY_FOREACH(ports, const char *, origin) {
+				if (!portscan_varindex_builder_has_port(indexes.varindex_builder, origin)) {
+					portscan_varindex_builder_copy_port(indexes.varindex_builder, indexes.varindex, origin);
+				}
+			}
+			array_free(ports);
+		}
+		if (!portscan_varindex_builder_write(indexes.varindex_builder, varindex_dir, varindex_file)) {
+			err(1, "portscan_varindex_builder_write: %s", varindex_path);
+		}
+		portscan_trace_end();
+	}
+	if (watch) {
+		watch_ports(watch, debounce, portsdir, origins, flags, keyquery_regexp, query_regexp, editdist, category_result, result, logdir, out, token_cache);
+	}
+	portscan_trace_begin("serialize", NULL);
 	if (portscan_log_len(result) > 0) {
 		if (logdir != NULL) {
 			struct PortscanLog *prev_result = portscan_log_read_all(logdir, PORTSCAN_LOG_LATEST);
 			if (portscan_log_compare(prev_result, result)) {
 				warnx("no changes compared to previous result");
 				status = 2;
+				portscan_trace_end();
 				goto cleanup;
 			}
 			if (!portscan_log_serialize_to_dir(result, logdir)) {
 				err(1, "portscan_log_serialize_to_dir");
 			}
+		} else if (stream) {
+			if (!portscan_log_serialize_to_ndjson(result, out)) {
+				err(1, "portscan_log_serialize_to_ndjson");
+			}
 		} else {
 			if (!portscan_log_serialize_to_file(result, out)) {
 				err(1, "portscan_log_serialize");
 			}
 		}
 	}
+	portscan_trace_end();
 
-	if (progressinterval) {
-		portscan_status_reset(PORTSCAN_STATUS_FINISHED, 0);
+	if (progressinterval || status_path) {
+		portscan_status_finish();
 		portscan_status_print();
 	}
 
 cleanup:
+	portscan_depgraph_builder_free(indexes.depgraph_builder);
+	portscan_depgraph_close(indexes.depgraph);
+	free(depgraph_file);
+	if (depgraph_dir != -1) {
+		close(depgraph_dir);
+	}
+	portscan_varindex_builder_free(indexes.varindex_builder);
+	portscan_varindex_close(indexes.varindex);
+	free(varindex_file);
+	if (varindex_dir != -1) {
+		close(varindex_dir);
+	}
 	regexp_free(keyquery_regexp);
 	regexp_free(query_regexp);
 	portscan_log_dir_close(logdir);
 	portscan_log_free(result);
+	portscan_stream_free(stream);
 
 	ARRAY_FOREACH(origins, char *, origin) {
 		free(origin);
 	}
 	array_free(origins);
 
+	if (profiles) {
+		portscan_profile_print(profiles, profile_slowest, stderr);
+		ARRAY_FOREACH(profiles, struct PortscanProfile *, profile) {
+			portscan_profile_free(profile);
+		}
+		array_free(profiles);
+	}
+
+	if (trace) {
+		if (!portscan_trace_write(trace, trace_out)) {
+			err(1, "portscan_trace_write: %s", trace_path);
+		}
+		fclose(trace_out);
+		portscan_trace_free(trace);
+	}
+
+	if (stats_enabled) {
+		stats_print(stderr);
+		stats_free();
+	}
+
 	return status;
 }
@@ -0,0 +1,590 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/map.h>
+#include <libias/util.h>
+
+#include "portscan/depgraph.h"
+#include "portscan/mmapfile.h"
+
+// Layout of the index, see portscan/mmapfile.h
+//
+// header
+// nodes[nodes]		sorted by origin
+// fwd_index[nodes + 1]	offsets into fwd_edges for every node
+// fwd_edges[edges]	index of the dependency
+// fwd_kinds[edges]	own kinds | inherited kinds << 16
+// rev_index[nodes + 1]
+// rev_edges[edges]	index of the dependent port
+// rev_kinds[edges]
+// strings[strings_len]	NUL terminated strings
+#define DEPGRAPH_MAGIC "PORTDEPG"
+#define DEPGRAPH_VERSION 1
+#define DEPGRAPH_NONE PORTSCAN_MMAPFILE_NONE
+
+struct PortscanDepgraphHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t nodes;
+	uint32_t edges;
+	uint32_t strings_len;
+};
+
+struct PortscanDepgraphNode {
+	uint64_t hash;
+	uint32_t origin;
+	uint32_t inputs;
+	uint32_t master;
+	uint32_t pad;
+};
+
+struct PortscanDepgraph {
+	struct PortscanMmapFile file;
+	const struct PortscanDepgraphHeader *header;
+	const struct PortscanDepgraphNode *nodes;
+	const uint32_t *fwd_index;
+	const uint32_t *fwd_edges;
+	const uint32_t *fwd_kinds;
+	const uint32_t *rev_index;
+	const uint32_t *rev_edges;
+	const uint32_t *rev_kinds;
+	const char *strings;
+};
+
+struct PortscanDepgraphBuilder {
+	struct Map *ports;
+};
+
+struct PortscanDepgraphBuilderPort {
+	char *origin;
+	uint64_t hash;
+	char *inputs;
+	char *master;
+	int scanned;
+	uint32_t index;
+	struct Map *edges;
+};
+
+static const struct {
+	enum PortscanDepgraphKind kind;
+	const char *name;
+	const char *variable;
+} kinds_[] = {
+	{ PORTSCAN_DEPGRAPH_BUILD, "build", "BUILD_DEPENDS" },
+	{ PORTSCAN_DEPGRAPH_EXTRACT, "extract", "EXTRACT_DEPENDS" },
+	{ PORTSCAN_DEPGRAPH_FETCH, "fetch", "FETCH_DEPENDS" },
+	{ PORTSCAN_DEPGRAPH_LIB, "lib", "LIB_DEPENDS" },
+	{ PORTSCAN_DEPGRAPH_PATCH, "patch", "PATCH_DEPENDS" },
+	{ PORTSCAN_DEPGRAPH_PKG, "pkg", "PKG_DEPENDS" },
+	{ PORTSCAN_DEPGRAPH_RUN, "run", "RUN_DEPENDS" },
+	{ PORTSCAN_DEPGRAPH_TEST, "test", "TEST_DEPENDS" },
+	{ PORTSCAN_DEPGRAPH_USES, "uses", "USES" },
+};
+
+static void add_string(char *, size_t *, uint32_t *, const char *);
+static struct PortscanDepgraphBuilderPort *builder_port(struct PortscanDepgraphBuilder *, const char *);
+static void builder_port_free(struct PortscanDepgraphBuilderPort *);
+static struct PortscanDepgraphEdge *builder_port_edge(struct PortscanDepgraphBuilderPort *, const char *);
+static void edge_free(struct PortscanDepgraphEdge *);
+static struct Array *edges(struct PortscanDepgraph *, const char *, const uint32_t *, const uint32_t *, const uint32_t *);
+static ssize_t lookup(struct PortscanDepgraph *, const char *);
+static int validate(struct PortscanDepgraph *);
+
+struct PortscanDepgraphBuilder *
+portscan_depgraph_builder_new()
+{
+	struct PortscanDepgraphBuilder *builder = xmalloc(sizeof(struct PortscanDepgraphBuilder));
+	builder->ports = map_new(str_compare, NULL, NULL, builder_port_free);
+	return builder;
+}
+
+void
+portscan_depgraph_builder_free(struct PortscanDepgraphBuilder *builder)
+{
+	if (builder == NULL) {
+		return;
+	}
+	map_free(builder->ports);
+	free(builder);
+}
+
+void
+builder_port_free(struct PortscanDepgraphBuilderPort *port)
+{
+	if (port == NULL) {
+		return;
+	}
+	map_free(port->edges);
+	free(port->origin);
+	free(port->inputs);
+	free(port->master);
+	free(port);
+}
+
+struct PortscanDepgraphBuilderPort *
+builder_port(struct PortscanDepgraphBuilder *builder, const char *origin)
+{
+	struct PortscanDepgraphBuilderPort *port = map_get(builder->ports, origin);
+	if (port == NULL) {
+		port = xmalloc(sizeof(struct PortscanDepgraphBuilderPort));
+		port->origin = xstrdup(origin);
+		port->edges = map_new(str_compare, NULL, NULL, edge_free);
+		map_add(builder->ports, port->origin, port);
+	}
+	return port;
+}
+
+struct PortscanDepgraphEdge *
+builder_port_edge(struct PortscanDepgraphBuilderPort *port, const char *dependency)
+{
+	struct PortscanDepgraphEdge *edge = map_get(port->edges, dependency);
+	if (edge == NULL) {
+		edge = xmalloc(sizeof(struct PortscanDepgraphEdge));
+		edge->origin = xstrdup(dependency);
+		map_add(port->edges, edge->origin, edge);
+	}
+	return edge;
+}
+
+void
+portscan_depgraph_builder_add_port(struct PortscanDepgraphBuilder *builder, const char *origin, uint64_t hash, const char *inputs, const char *master)
+{
+	struct PortscanDepgraphBuilderPort *port = builder_port(builder, origin);
+	port->scanned = 1;
+	port->hash = hash;
+	free(port->inputs);
+	port->inputs = xstrdup(inputs ? inputs : "");
+	free(port->master);
+	port->master = NULL;
+	if (master && strcmp(master, origin) != 0) {
+		port->master = xstrdup(master);
+	}
+}
+
+void
+portscan_depgraph_builder_add_edge(struct PortscanDepgraphBuilder *builder, const char *origin, const char *dependency, enum PortscanDepgraphKind kinds)
+{
+	struct PortscanDepgraphEdge *edge = builder_port_edge(builder_port(builder, origin), dependency);
+	edge->kinds |= kinds;
+}
+
+void
+portscan_depgraph_builder_copy_port(struct PortscanDepgraphBuilder *builder, struct PortscanDepgraph *graph, const char *origin)
+{
+	uint64_t hash;
+	const char *inputs;
+	const char *master;
+	if (!portscan_depgraph_port(graph, origin, &hash, &inputs, &master)) {
+		return;
+	}
+	portscan_depgraph_builder_add_port(builder, origin, hash, inputs, master);
+	struct Array *deps = portscan_depgraph_deps(graph, origin);
+	ARRAY_FOREACH(deps, struct PortscanDepgraphEdge *, edge) {
+		if (edge->kinds) {
+			portscan_depgraph_builder_add_edge(builder, origin, edge->origin, edge->kinds);
+		}
+	}
+	portscan_depgraph_edges_free(deps);
+}
+
+int
+portscan_depgraph_builder_has_port(struct PortscanDepgraphBuilder *builder, const char *origin)
+{
+	struct PortscanDepgraphBuilderPort *port = map_get(builder->ports, origin);
+	return port && port->scanned;
+}
+
+void
+add_string(char *strings, size_t *offset, uint32_t *retval, const char *s)
+{
+	if (s == NULL) {
+		*retval = DEPGRAPH_NONE;
+		return;
+	}
+	size_t len = strlen(s) + 1;
+	memcpy(strings + *offset, s, len);
+	*retval = *offset;
+	*offset += len;
+}
+
+int
+portscan_depgraph_builder_write(struct PortscanDepgraphBuilder *builder, int dir, const char *path)
+{
+	// Slave ports inherit the dependencies of their master.  Keep
+	// them apart from the port's own so that an unchanged slave can
+	// be reused even when its master was modified.  Masters of
+	// masters exist, so follow the chain a few levels.
+	struct Array *ports = map_values(builder->ports);
+	ARRAY_FOREACH(ports, struct PortscanDepgraphBuilderPort *, port) {
+		struct PortscanDepgraphBuilderPort *master = port;
+		for (size_t depth = 0; depth < 4 && master->master; depth++) {
+			master = map_get(builder->ports, master->master);
+			if (master == NULL || master == port) {
+				break;
+			}
+			MAP_FOREACH(master->edges, const char *, dep, struct PortscanDepgraphEdge *, edge) {
+				if (edge->kinds) {
+					builder_port_edge(port, dep)->inherited |= edge->kinds;
+				}
+			}
+		}
+	}
+	array_free(ports);
+
+	// Every dependency is a node even when it has not been scanned
+	ports = map_values(builder->ports);
+	ARRAY_FOREACH(ports, struct PortscanDepgraphBuilderPort *, port) {
+		MAP_FOREACH(port->edges, const char *, dep, struct PortscanDepgraphEdge *, edge) {
+			builder_port(builder, dep);
+		}
+	}
+	array_free(ports);
+
+	ports = map_values(builder->ports);
+	size_t nodes_len = array_len(ports);
+	size_t edges_len = 0;
+	size_t strings_len = 0;
+	ARRAY_FOREACH(ports, struct PortscanDepgraphBuilderPort *, port) {
+		port->index = port_index;
+		edges_len += map_len(port->edges);
+		strings_len += strlen(port->origin) + 1;
+		if (port->scanned) {
+			strings_len += strlen(port->inputs) + 1;
+			if (port->master) {
+				strings_len += strlen(port->master) + 1;
+			}
+		}
+	}
+	if (nodes_len >= UINT32_MAX || edges_len >= UINT32_MAX || strings_len >= UINT32_MAX) {
+		array_free(ports);
+		errno = EFBIG;
+		return 0;
+	}
+
+	struct PortscanDepgraphNode *nodes = xrecallocarray(NULL, 0, nodes_len + 1, sizeof(struct PortscanDepgraphNode));
+	uint32_t *fwd_index = xrecallocarray(NULL, 0, nodes_len + 1, sizeof(uint32_t));
+	uint32_t *fwd_edges = xrecallocarray(NULL, 0, edges_len + 1, sizeof(uint32_t));
+	uint32_t *fwd_kinds = xrecallocarray(NULL, 0, edges_len + 1, sizeof(uint32_t));
+	uint32_t *rev_index = xrecallocarray(NULL, 0, nodes_len + 1, sizeof(uint32_t));
+	uint32_t *rev_edges = xrecallocarray(NULL, 0, edges_len + 1, sizeof(uint32_t));
+	uint32_t *rev_kinds = xrecallocarray(NULL, 0, edges_len + 1, sizeof(uint32_t));
+	char *strings = xmalloc(strings_len + 1);
+
+	size_t edge = 0;
+	size_t offset = 0;
+	ARRAY_FOREACH(ports, struct PortscanDepgraphBuilderPort *, port) {
+		struct PortscanDepgraphNode *node = &nodes[port_index];
+		node->hash = port->hash;
+		add_string(strings, &offset, &node->origin, port->origin);
+		if (port->scanned) {
+			add_string(strings, &offset, &node->inputs, port->inputs);
+			add_string(strings, &offset, &node->master, port->master);
+		} else {
+			node->inputs = DEPGRAPH_NONE;
+			node->master = DEPGRAPH_NONE;
+		}
+
+		// The map keeps the edges sorted by origin
+		fwd_index[port_index] = edge;
+		MAP_FOREACH(port->edges, const char *, dep, struct PortscanDepgraphEdge *, e) {
+			struct PortscanDepgraphBuilderPort *target = map_get(builder->ports, dep);
+			fwd_edges[edge] = target->index;
+			fwd_kinds[edge] = (e->kinds & 0xffff) | (e->inherited & 0xffff) << 16;
+			rev_index[target->index + 1]++;
+			edge++;
+		}
+	}
+	fwd_index[nodes_len] = edge;
+	array_free(ports);
+
+	// Counting sort of the reverse edges.  Dependent ports end up
+	// sorted by origin too since the nodes are.
+	for (size_t i = 1; i <= nodes_len; i++) {
+		rev_index[i] += rev_index[i - 1];
+	}
+	uint32_t *fill = xrecallocarray(NULL, 0, nodes_len + 1, sizeof(uint32_t));
+	memcpy(fill, rev_index, (nodes_len + 1) * sizeof(uint32_t));
+	for (size_t i = 0; i < nodes_len; i++) {
+		for (size_t j = fwd_index[i]; j < fwd_index[i + 1]; j++) {
+			uint32_t slot = fill[fwd_edges[j]]++;
+			rev_edges[slot] = i;
+			rev_kinds[slot] = fwd_kinds[j];
+		}
+	}
+	free(fill);
+
+	struct PortscanDepgraphHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DEPGRAPH_MAGIC, sizeof(header.magic));
+	header.version = DEPGRAPH_VERSION;
+	header.nodes = nodes_len;
+	header.edges = edges_len;
+	header.strings_len = strings_len;
+
+	struct PortscanMmapFileSection sections[] = {
+		{ &header, sizeof(header) },
+		{ nodes, nodes_len * sizeof(*nodes) },
+		{ fwd_index, (nodes_len + 1) * sizeof(uint32_t) },
+		{ fwd_edges, edges_len * sizeof(uint32_t) },
+		{ fwd_kinds, edges_len * sizeof(uint32_t) },
+		{ rev_index, (nodes_len + 1) * sizeof(uint32_t) },
+		{ rev_edges, edges_len * sizeof(uint32_t) },
+		{ rev_kinds, edges_len * sizeof(uint32_t) },
+		{ strings, strings_len },
+	};
+	int retval = portscan_mmapfile_write(dir, path, sections, nitems(sections));
+
+	free(nodes);
+	free(fwd_index);
+	free(fwd_edges);
+	free(fwd_kinds);
+	free(rev_index);
+	free(rev_edges);
+	free(rev_kinds);
+	free(strings);
+
+	return retval;
+}
+
+int
+validate(struct PortscanDepgraph *graph)
+{
+	const struct PortscanDepgraphHeader *header = graph->file.buf;
+
+	size_t nodes = header->nodes;
+	size_t edges = header->edges;
+	size_t len = sizeof(*header) +
+		nodes * sizeof(struct PortscanDepgraphNode) +
+		2 * (nodes + 1) * sizeof(uint32_t) +
+		4 * edges * sizeof(uint32_t) +
+		header->strings_len;
+	if (len != graph->file.len) {
+		return 0;
+	}
+
+	const char *p = graph->file.buf;
+	p += sizeof(*header);
+	graph->header = header;
+	graph->nodes = (const struct PortscanDepgraphNode *)p;
+	p += nodes * sizeof(struct PortscanDepgraphNode);
+	graph->fwd_index = (const uint32_t *)p;
+	p += (nodes + 1) * sizeof(uint32_t);
+	graph->fwd_edges = (const uint32_t *)p;
+	p += edges * sizeof(uint32_t);
+	graph->fwd_kinds = (const uint32_t *)p;
+	p += edges * sizeof(uint32_t);
+	graph->rev_index = (const uint32_t *)p;
+	p += (nodes + 1) * sizeof(uint32_t);
+	graph->rev_edges = (const uint32_t *)p;
+	p += edges * sizeof(uint32_t);
+	graph->rev_kinds = (const uint32_t *)p;
+	p += edges * sizeof(uint32_t);
+	graph->strings = p;
+
+	if (header->strings_len > 0 && graph->strings[header->strings_len - 1] != 0) {
+		return 0;
+	}
+	for (size_t i = 0; i < nodes; i++) {
+		const struct PortscanDepgraphNode *node = &graph->nodes[i];
+		if (node->origin >= header->strings_len ||
+		    (node->inputs != DEPGRAPH_NONE && node->inputs >= header->strings_len) ||
+		    (node->master != DEPGRAPH_NONE && node->master >= header->strings_len) ||
+		    graph->fwd_index[i] > graph->fwd_index[i + 1] ||
+		    graph->rev_index[i] > graph->rev_index[i + 1]) {
+			return 0;
+		}
+	}
+	if (graph->fwd_index[0] != 0 || graph->fwd_index[nodes] != edges ||
+	    graph->rev_index[0] != 0 || graph->rev_index[nodes] != edges) {
+		return 0;
+	}
+	for (size_t i = 0; i < edges; i++) {
+		if (graph->fwd_edges[i] >= nodes || graph->rev_edges[i] >= nodes) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+struct PortscanDepgraph *
+portscan_depgraph_open(int dir, const char *path)
+{
+	struct PortscanDepgraph *graph = xmalloc(sizeof(struct PortscanDepgraph));
+	if (!portscan_mmapfile_open(&graph->file, dir, path, DEPGRAPH_MAGIC, DEPGRAPH_VERSION, sizeof(struct PortscanDepgraphHeader))) {
+		free(graph);
+		return NULL;
+	}
+	if (!validate(graph)) {
+		portscan_mmapfile_close(&graph->file);
+		free(graph);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return graph;
+}
+
+void
+portscan_depgraph_close(struct PortscanDepgraph *graph)
+{
+	if (graph == NULL) {
+		return;
+	}
+	portscan_mmapfile_close(&graph->file);
+	free(graph);
+}
+
+ssize_t
+lookup(struct PortscanDepgraph *graph, const char *origin)
+{
+	return portscan_mmapfile_lookup(graph->strings, graph->nodes, graph->header->nodes,
+		sizeof(struct PortscanDepgraphNode), offsetof(struct PortscanDepgraphNode, origin), origin);
+}
+
+struct Array *
+portscan_depgraph_ports(struct PortscanDepgraph *graph)
+{
+	struct Array *ports = array_new();
+	for (size_t i = 0; i < graph->header->nodes; i++) {
+		if (graph->nodes[i].inputs != DEPGRAPH_NONE) {
+			array_append(ports, portscan_mmapfile_string(graph->strings, graph->nodes[i].origin));
+		}
+	}
+	return ports;
+}
+
+int
+portscan_depgraph_port(struct PortscanDepgraph *graph, const char *origin, uint64_t *hash, const char **inputs, const char **master)
+{
+	ssize_t i = lookup(graph, origin);
+	if (i < 0 || graph->nodes[i].inputs == DEPGRAPH_NONE) {
+		return 0;
+	}
+	if (hash) {
+		*hash = graph->nodes[i].hash;
+	}
+	if (inputs) {
+		*inputs = portscan_mmapfile_string(graph->strings, graph->nodes[i].inputs);
+	}
+	if (master) {
+		*master = portscan_mmapfile_string(graph->strings, graph->nodes[i].master);
+	}
+	return 1;
+}
+
+struct Array *
+edges(struct PortscanDepgraph *graph, const char *origin, const uint32_t *index, const uint32_t *targets, const uint32_t *kinds)
+{
+	ssize_t i = lookup(graph, origin);
+	if (i < 0) {
+		return NULL;
+	}
+	struct Array *result = array_new();
+	for (size_t j = index[i]; j < index[i + 1]; j++) {
+		struct PortscanDepgraphEdge *edge = xmalloc(sizeof(struct PortscanDepgraphEdge));
+		edge->origin = xstrdup(portscan_mmapfile_string(graph->strings, graph->nodes[targets[j]].origin));
+		edge->kinds = kinds[j] & 0xffff;
+		edge->inherited = kinds[j] >> 16;
+		array_append(result, edge);
+	}
+	return result;
+}
+
+struct Array *
+portscan_depgraph_deps(struct PortscanDepgraph *graph, const char *origin)
+{
+	return edges(graph, origin, graph->fwd_index, graph->fwd_edges, graph->fwd_kinds);
+}
+
+struct Array *
+portscan_depgraph_rdeps(struct PortscanDepgraph *graph, const char *origin)
+{
+	return edges(graph, origin, graph->rev_index, graph->rev_edges, graph->rev_kinds);
+}
+
+void
+edge_free(struct PortscanDepgraphEdge *edge)
+{
+	if (edge) {
+		free(edge->origin);
+		free(edge);
+	}
+}
+
+void
+portscan_depgraph_edges_free(struct Array *edges)
+{
+	if (edges == NULL) {
+		return;
+	}
+	ARRAY_FOREACH(edges, struct PortscanDepgraphEdge *, edge) {
+		edge_free(edge);
+	}
+	array_free(edges);
+}
+
+enum PortscanDepgraphKind
+portscan_depgraph_kind_from_variable(const char *name)
+{
+	size_t len = strlen(name);
+	if (len > 4 && strcmp(name + len - 4, "_OFF") == 0) {
+		len -= 4;
+	}
+	for (size_t i = 0; i < nitems(kinds_); i++) {
+		size_t varlen = strlen(kinds_[i].variable);
+		if (len >= varlen && strncmp(name + len - varlen, kinds_[i].variable, varlen) == 0) {
+			return kinds_[i].kind;
+		}
+	}
+	return 0;
+}
+
+char *
+portscan_depgraph_kind_tostring(enum PortscanDepgraphKind kinds)
+{
+	struct Array *names = array_new();
+	for (size_t i = 0; i < nitems(kinds_); i++) {
+		if (kinds & kinds_[i].kind) {
+			array_append(names, kinds_[i].name);
+		}
+	}
+	char *buf = str_join(names, ",");
+	array_free(names);
+	return buf;
+}
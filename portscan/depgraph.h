@@ -0,0 +1,70 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+struct Array;
+struct PortscanDepgraph;
+struct PortscanDepgraphBuilder;
+
+enum PortscanDepgraphKind {
+	PORTSCAN_DEPGRAPH_BUILD = 1 << 0,
+	PORTSCAN_DEPGRAPH_EXTRACT = 1 << 1,
+	PORTSCAN_DEPGRAPH_FETCH = 1 << 2,
+	PORTSCAN_DEPGRAPH_LIB = 1 << 3,
+	PORTSCAN_DEPGRAPH_PATCH = 1 << 4,
+	PORTSCAN_DEPGRAPH_PKG = 1 << 5,
+	PORTSCAN_DEPGRAPH_RUN = 1 << 6,
+	PORTSCAN_DEPGRAPH_TEST = 1 << 7,
+	PORTSCAN_DEPGRAPH_USES = 1 << 8,
+};
+
+struct PortscanDepgraphEdge {
+	char *origin;
+	enum PortscanDepgraphKind kinds;
+	enum PortscanDepgraphKind inherited;
+};
+
+struct PortscanDepgraphBuilder *portscan_depgraph_builder_new(void);
+void portscan_depgraph_builder_free(struct PortscanDepgraphBuilder *);
+void portscan_depgraph_builder_add_port(struct PortscanDepgraphBuilder *, const char *, uint64_t, const char *, const char *);
+void portscan_depgraph_builder_add_edge(struct PortscanDepgraphBuilder *, const char *, const char *, enum PortscanDepgraphKind);
+void portscan_depgraph_builder_copy_port(struct PortscanDepgraphBuilder *, struct PortscanDepgraph *, const char *);
+int portscan_depgraph_builder_has_port(struct PortscanDepgraphBuilder *, const char *);
+int portscan_depgraph_builder_write(struct PortscanDepgraphBuilder *, int, const char *);
+
+struct PortscanDepgraph *portscan_depgraph_open(int, const char *);
+void portscan_depgraph_close(struct PortscanDepgraph *);
+struct Array *portscan_depgraph_ports(struct PortscanDepgraph *);
+int portscan_depgraph_port(struct PortscanDepgraph *, const char *, uint64_t *, const char **, const char **);
+struct Array *portscan_depgraph_deps(struct PortscanDepgraph *, const char *);
+struct Array *portscan_depgraph_rdeps(struct PortscanDepgraph *, const char *);
+
+void portscan_depgraph_edges_free(struct Array *);
+enum PortscanDepgraphKind portscan_depgraph_kind_from_variable(const char *);
+char *portscan_depgraph_kind_tostring(enum PortscanDepgraphKind);
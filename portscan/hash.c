@@ -0,0 +1,87 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libias/util.h>
+
+#include "hashfn.h"
+#include "portscan/hash.h"
+
+// Inputs are the space separated paths of a port's Makefile and
+// everything it includes, relative to portsdir.
+int
+portscan_hash_inputs(int portsdir, const char *inputs, uint64_t *hash)
+{
+	// Hash the path and the contents of every input
+	uint64_t h = HASH_INIT;
+	char *buf = xstrdup(inputs);
+	char *ptr = buf;
+	char *path;
+	while ((path = strsep(&ptr, " ")) != NULL) {
+		if (*path == 0) {
+			continue;
+		}
+		h = hash_bytes(h, path, strlen(path) + 1);
+		int fd = openat(portsdir, path, O_RDONLY);
+		if (fd == -1) {
+			// Missing inputs are part of the hash too so that
+			// the port is rescanned once the file shows up.
+			h = hash_bytes(h, "\xff", 1);
+			continue;
+		}
+		char data[8192];
+		ssize_t n;
+		while ((n = read(fd, data, sizeof(data))) > 0) {
+			h = hash_bytes(h, data, n);
+		}
+		close(fd);
+		if (n < 0) {
+			free(buf);
+			return 0;
+		}
+	}
+	free(buf);
+
+	*hash = h;
+	return 1;
+}
+
+// Stable across runs and machines so that every shard of a scan
+// agrees on which origins it owns.
+uint64_t
+portscan_hash_origin(const char *origin)
+{
+	return hash_str(HASH_INIT, origin);
+}
@@ -46,12 +46,14 @@
 #include <unistd.h>
 
 #include <libias/array.h>
-#include <libias/diff.h>
 #include <libias/set.h>
 #include <libias/util.h>
 
+#include "allocator.h"
 #include "capsicum_helpers.h"
+#include "hashset.h"
 #include "portscan/log.h"
+#include "stats.h"
 
 struct PortscanLogDir {
 	int fd;
@@ -75,8 +77,12 @@ struct PortscanLogEntry {
 
 static void portscan_log_sort(struct PortscanLog *);
 static char *log_entry_tostring(const struct PortscanLogEntry *);
+static const char *log_entry_type_tostring(enum PortscanLogEntryType);
+static const char *log_entry_type_key(enum PortscanLogEntryType);
+static void log_entry_print_change(FILE *, const char *, const struct PortscanLogEntry *);
 static int log_entry_compare(const void *, const void *, void *);
 static struct PortscanLogEntry *log_entry_parse(const char *);
+static struct PortscanLogEntry *log_entry_read(FILE *, char **, size_t *);
 
 static FILE *log_open(struct PortscanLogDir *, const char *);
 static int log_update_latest(struct PortscanLogDir *, const char *);
@@ -99,9 +105,9 @@ portscan_log_free(struct PortscanLog *log)
 	}
 
 	ARRAY_FOREACH(log->entries, struct PortscanLogEntry *, entry) {
-		free(entry->origin);
-		free(entry->value);
-		free(entry);
+		allocator_free(ALLOCATOR_LOG, entry->origin);
+		allocator_free(ALLOCATOR_LOG, entry->value);
+		allocator_free(ALLOCATOR_LOG, entry);
 	}
 	array_free(log->entries);
 	free(log);
@@ -119,78 +125,134 @@ portscan_log_len(struct PortscanLog *log)
 	return array_len(log->entries);
 }
 
-char *
-log_entry_tostring(const struct PortscanLogEntry *entry)
+const char *
+log_entry_type_tostring(enum PortscanLogEntryType type)
+{
+	switch (type) {
+	case PORTSCAN_LOG_ENTRY_UNKNOWN_VAR:
+		return "V";
+	case PORTSCAN_LOG_ENTRY_UNKNOWN_TARGET:
+		return "T";
+	case PORTSCAN_LOG_ENTRY_DUPLICATE_VAR:
+		return "Vc";
+	case PORTSCAN_LOG_ENTRY_OPTION_DEFAULT_DESCRIPTION:
+		return "OD";
+	case PORTSCAN_LOG_ENTRY_OPTION_GROUP:
+		return "OG";
+	case PORTSCAN_LOG_ENTRY_OPTION:
+		return "O";
+	case PORTSCAN_LOG_ENTRY_CATEGORY_NONEXISTENT_PORT:
+		return "Ce";
+	case PORTSCAN_LOG_ENTRY_CATEGORY_UNHOOKED_PORT:
+		return "Cu";
+	case PORTSCAN_LOG_ENTRY_CATEGORY_UNSORTED:
+		return "C";
+	case PORTSCAN_LOG_ENTRY_ERROR:
+		return "E";
+	case PORTSCAN_LOG_ENTRY_VARIABLE_VALUE:
+		return "Vv";
+	case PORTSCAN_LOG_ENTRY_COMMENT:
+		return "#";
+	case PORTSCAN_LOG_ENTRY_EXPANDED_VALUE:
+		return "Ve";
+	}
+
+	abort();
+}
+
+const char *
+log_entry_type_key(enum PortscanLogEntryType type)
 {
-	char *buf;
-	switch (entry->type) {
+	switch (type) {
 	case PORTSCAN_LOG_ENTRY_UNKNOWN_VAR:
-		buf = str_printf("%-7c %-40s %s\n", 'V', entry->origin, entry->value);
-		break;
+		return "unknown_variables";
 	case PORTSCAN_LOG_ENTRY_UNKNOWN_TARGET:
-		buf = str_printf("%-7c %-40s %s\n", 'T', entry->origin, entry->value);
-		break;
+		return "unknown_targets";
 	case PORTSCAN_LOG_ENTRY_DUPLICATE_VAR:
-		buf = str_printf("%-7s %-40s %s\n", "Vc", entry->origin, entry->value);
-		break;
+		return "clones";
 	case PORTSCAN_LOG_ENTRY_OPTION_DEFAULT_DESCRIPTION:
-		buf = str_printf("%-7s %-40s %s\n", "OD", entry->origin, entry->value);
-		break;
+		return "option_default_descriptions";
 	case PORTSCAN_LOG_ENTRY_OPTION_GROUP:
-		buf = str_printf("%-7s %-40s %s\n", "OG", entry->origin, entry->value);
-		break;
+		return "option_groups";
 	case PORTSCAN_LOG_ENTRY_OPTION:
-		buf = str_printf("%-7c %-40s %s\n", 'O', entry->origin, entry->value);
-		break;
+		return "options";
 	case PORTSCAN_LOG_ENTRY_CATEGORY_NONEXISTENT_PORT:
-		buf = str_printf("%-7s %-40s %s\n", "Ce", entry->origin, entry->value);
-		break;
+		return "nonexistent_ports";
 	case PORTSCAN_LOG_ENTRY_CATEGORY_UNHOOKED_PORT:
-		buf = str_printf("%-7s %-40s %s\n", "Cu", entry->origin, entry->value);
-		break;
+		return "unhooked_ports";
 	case PORTSCAN_LOG_ENTRY_CATEGORY_UNSORTED:
-		buf = str_printf("%-7c %-40s %s\n", 'C', entry->origin, entry->value);
-		break;
+		return "unsorted_categories";
 	case PORTSCAN_LOG_ENTRY_ERROR:
-		buf = str_printf("%-7c %-40s %s\n", 'E', entry->origin, entry->value);
-		break;
+		return "errors";
 	case PORTSCAN_LOG_ENTRY_VARIABLE_VALUE:
-		buf = str_printf("%-7s %-40s %s\n", "Vv", entry->origin, entry->value);
-		break;
+		return "variable_values";
 	case PORTSCAN_LOG_ENTRY_COMMENT:
-		buf = str_printf("%-7c %-40s %s\n", '#', entry->origin, entry->value);
-		break;
-	default:
-		abort();
+		return "comments";
+	case PORTSCAN_LOG_ENTRY_EXPANDED_VALUE:
+		return "expanded_values";
 	}
 
-	return buf;
+	abort();
+}
+
+char *
+log_entry_tostring(const struct PortscanLogEntry *entry)
+{
+	return str_printf("%-7s %-40s %s\n", log_entry_type_tostring(entry->type), entry->origin, entry->value);
 }
 
 void
-portscan_log_add_entries(struct PortscanLog *log, enum PortscanLogEntryType type, const char *origin, struct Set *values)
+portscan_log_add_entries(struct PortscanLog *log, enum PortscanLogEntryType type, const char *origin, struct HashSet *values)
 {
 	if (values == NULL) {
 		return;
 	}
 
-	SET_FOREACH (values, const char *, value) {
+	// Entries are sorted before the log is written out
+	HASHSET_FOREACH (values, const char *, value) {
 		portscan_log_add_entry(log, type, origin, value);
 	}
-	set_free(values);
+	hashset_free(values);
 }
 
 void
 portscan_log_add_entry(struct PortscanLog *log, enum PortscanLogEntryType type, const char *origin, const char *value)
 {
-	struct PortscanLogEntry *entry = xmalloc(sizeof(struct PortscanLogEntry));
+	struct PortscanLogEntry *entry = allocator_alloc(ALLOCATOR_LOG, sizeof(struct PortscanLogEntry));
 	entry->type = type;
 	entry->index = array_len(log->entries);
-	entry->origin = xstrdup(origin);
-	entry->value = xstrdup(value);
+	entry->origin = allocator_strdup(ALLOCATOR_LOG, origin);
+	entry->value = allocator_strdup(ALLOCATOR_LOG, value);
 	array_append(log->entries, entry);
 }
 
+struct PortscanLog *
+portscan_log_extract(struct PortscanLog *log, struct Set *origins)
+{
+	struct PortscanLog *retval = portscan_log_new();
+	struct Array *entries = array_new();
+	ARRAY_FOREACH(log->entries, struct PortscanLogEntry *, entry) {
+		if (set_contains(origins, entry->origin)) {
+			entry->index = array_len(retval->entries);
+			array_append(retval->entries, entry);
+		} else {
+			entry->index = array_len(entries);
+			array_append(entries, entry);
+		}
+	}
+	array_free(log->entries);
+	log->entries = entries;
+	return retval;
+}
+
+void
+portscan_log_merge(struct PortscanLog *log, struct PortscanLog *other)
+{
+	ARRAY_FOREACH(other->entries, struct PortscanLogEntry *, entry) {
+		portscan_log_add_entry(log, entry->type, entry->origin, entry->value);
+	}
+}
+
 struct PortscanLogEntry *
 log_entry_parse(const char *s)
 {
@@ -225,6 +287,9 @@ log_entry_parse(const char *s)
 	} else if (str_startswith(s, "E ")) {
 		type = PORTSCAN_LOG_ENTRY_ERROR;
 		s++;
+	} else if (str_startswith(s, "Ve ")) {
+		type = PORTSCAN_LOG_ENTRY_EXPANDED_VALUE;
+		s += 2;
 	} else if (str_startswith(s, "Vv ")) {
 		type = PORTSCAN_LOG_ENTRY_VARIABLE_VALUE;
 		s += 2;
@@ -252,23 +317,35 @@ log_entry_parse(const char *s)
 		value_len--;
 	}
 
-	char *origin = xstrndup(origin_start, s - origin_start);
-	char *entry_value = xstrndup(value, value_len);
+	char *origin = allocator_strndup(ALLOCATOR_LOG, origin_start, s - origin_start);
+	char *entry_value = allocator_strndup(ALLOCATOR_LOG, value, value_len);
 
 	if (strlen(origin) == 0 || strlen(entry_value) == 0) {
 		fprintf(stderr, "unable to parse log entry: %s\n", s);
-		free(origin);
-		free(entry_value);
+		allocator_free(ALLOCATOR_LOG, origin);
+		allocator_free(ALLOCATOR_LOG, entry_value);
 		return NULL;
 	}
 
-	struct PortscanLogEntry *e = xmalloc(sizeof(struct PortscanLogEntry));
+	struct PortscanLogEntry *e = allocator_alloc(ALLOCATOR_LOG, sizeof(struct PortscanLogEntry));
 	e->type = type;
 	e->origin = origin;
 	e->value = entry_value;
 	return e;
 }
 
+struct PortscanLogEntry *
+log_entry_read(FILE *fp, char **line, size_t *linecap)
+{
+	while (getline(line, linecap, fp) > 0) {
+		struct PortscanLogEntry *entry = log_entry_parse(*line);
+		if (entry != NULL) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
 int
 log_entry_compare(const void *ap, const void *bp, void *userdata)
 {
@@ -295,22 +372,18 @@ portscan_log_compare(struct PortscanLog *prev, struct PortscanLog *log)
 	portscan_log_sort(prev);
 	portscan_log_sort(log);
 
-	struct diff p;
-	int rc = array_diff(prev->entries, log->entries, &p, log_entry_compare, NULL);
-	if (rc <= 0) {
-		errx(1, "array_diff failed");
+	if (array_len(prev->entries) != array_len(log->entries)) {
+		return 0;
 	}
-	int equal = 1;
-	for (size_t i = 0; i < p.sessz; i++) {
-		if (p.ses[i].type != DIFF_COMMON) {
-			equal = 0;
-			break;
+	for (size_t i = 0; i < array_len(log->entries); i++) {
+		struct PortscanLogEntry *a = array_get(prev->entries, i);
+		struct PortscanLogEntry *b = array_get(log->entries, i);
+		if (log_entry_compare(&a, &b, NULL) != 0) {
+			return 0;
 		}
 	}
-	free(p.ses);
-	free(p.lcs);
 
-	return equal;
+	return 1;
 }
 
 int
@@ -320,16 +393,180 @@ portscan_log_serialize_to_file(struct PortscanLog *log, FILE *out)
 
 	ARRAY_FOREACH(log->entries, struct PortscanLogEntry *, entry) {
 		char *line = log_entry_tostring(entry);
-		if (write(fileno(out), line, strlen(line)) == -1) {
+		ssize_t written = write(fileno(out), line, strlen(line));
+		if (written == -1) {
 			free(line);
 			return 0;
 		}
+		STATS_ADD(STATS_BYTES_WRITTEN, written);
 		free(line);
 	}
 
 	return 1;
 }
 
+// Also used for the trace written by portscan --trace
+void
+portscan_log_print_json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fprintf(out, "\\%c", *s);
+		} else if ((unsigned char)*s < 0x20) {
+			fprintf(out, "\\u%04x", *s);
+		} else {
+			fputc(*s, out);
+		}
+	}
+	fputc('"', out);
+}
+
+void
+log_entry_print_change(FILE *out, const char *change, const struct PortscanLogEntry *entry)
+{
+	fprintf(out, "{\"change\":\"%s\",\"type\":", change);
+	portscan_log_print_json_string(out, log_entry_type_tostring(entry->type));
+	fprintf(out, ",\"origin\":");
+	portscan_log_print_json_string(out, entry->origin);
+	fprintf(out, ",\"value\":");
+	portscan_log_print_json_string(out, entry->value);
+	fprintf(out, "}\n");
+}
+
+// Writes one JSON object per line for every entry that was added
+// or removed since prev.  Both logs are sorted, so a single merge
+// pass is enough.
+int
+portscan_log_serialize_changes(struct PortscanLog *prev, struct PortscanLog *log, FILE *out)
+{
+	portscan_log_sort(prev);
+	portscan_log_sort(log);
+
+	size_t i = 0;
+	size_t j = 0;
+	while (i < array_len(prev->entries) || j < array_len(log->entries)) {
+		struct PortscanLogEntry *a = array_get(prev->entries, i);
+		struct PortscanLogEntry *b = array_get(log->entries, j);
+		int cmp;
+		if (a == NULL) {
+			cmp = 1;
+		} else if (b == NULL) {
+			cmp = -1;
+		} else {
+			cmp = log_entry_compare(&a, &b, NULL);
+		}
+		if (cmp < 0) {
+			log_entry_print_change(out, "removed", a);
+			i++;
+		} else if (cmp > 0) {
+			log_entry_print_change(out, "added", b);
+			j++;
+		} else {
+			i++;
+			j++;
+		}
+	}
+
+	if (fflush(out) == EOF) {
+		return 0;
+	}
+	return 1;
+}
+
+// Writes one JSON object per origin with an array of values for
+// every kind of entry the origin has, e.g.,
+// {"origin":"devel/foo","unknown_variables":["FOO","BAR"]}
+int
+portscan_log_serialize_to_ndjson(struct PortscanLog *log, FILE *out)
+{
+	portscan_log_sort(log);
+
+	const struct PortscanLogEntry *prev = NULL;
+	ARRAY_FOREACH(log->entries, struct PortscanLogEntry *, entry) {
+		if (prev && strcmp(prev->origin, entry->origin) == 0) {
+			if (prev->type == entry->type) {
+				fputc(',', out);
+			} else {
+				fprintf(out, "],\"%s\":[", log_entry_type_key(entry->type));
+			}
+		} else {
+			if (prev) {
+				fprintf(out, "]}\n");
+			}
+			fprintf(out, "{\"origin\":");
+			portscan_log_print_json_string(out, entry->origin);
+			fprintf(out, ",\"%s\":[", log_entry_type_key(entry->type));
+		}
+		portscan_log_print_json_string(out, entry->value);
+		prev = entry;
+	}
+	if (prev) {
+		fprintf(out, "]}\n");
+	}
+
+	if (fflush(out) == EOF || ferror(out)) {
+		return 0;
+	}
+	return 1;
+}
+
+// K-way merges logs written by portscan_log_serialize_to_file() into
+// log.  Entries that are in several inputs, like errors in
+// Mk/bsd.options.desc.mk that every shard reports, are only added
+// once.  Returns 0 if an input is not sorted.
+int
+portscan_log_merge_files(struct PortscanLog *log, FILE **inputs, size_t len)
+{
+	struct PortscanLogEntry **heads = xrecallocarray(NULL, 0, len, sizeof(struct PortscanLogEntry *));
+	char *line = NULL;
+	size_t linecap = 0;
+	for (size_t i = 0; i < len; i++) {
+		heads[i] = log_entry_read(inputs[i], &line, &linecap);
+	}
+
+	int retval = 1;
+	struct PortscanLogEntry *last = NULL;
+	for (;;) {
+		ssize_t min = -1;
+		for (size_t i = 0; i < len; i++) {
+			if (heads[i] && (min == -1 || log_entry_compare(&heads[i], &heads[min], NULL) < 0)) {
+				min = i;
+			}
+		}
+		if (min == -1) {
+			break;
+		}
+
+		struct PortscanLogEntry *entry = heads[min];
+		heads[min] = log_entry_read(inputs[min], &line, &linecap);
+		if (heads[min] && log_entry_compare(&heads[min], &entry, NULL) < 0) {
+			retval = 0;
+		}
+		if (last && log_entry_compare(&last, &entry, NULL) == 0) {
+			allocator_free(ALLOCATOR_LOG, entry->origin);
+			allocator_free(ALLOCATOR_LOG, entry->value);
+			allocator_free(ALLOCATOR_LOG, entry);
+		} else {
+			entry->index = array_len(log->entries);
+			array_append(log->entries, entry);
+			last = entry;
+		}
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if (heads[i]) {
+			allocator_free(ALLOCATOR_LOG, heads[i]->origin);
+			allocator_free(ALLOCATOR_LOG, heads[i]->value);
+			allocator_free(ALLOCATOR_LOG, heads[i]);
+		}
+	}
+	free(heads);
+	free(line);
+
+	return retval;
+}
+
 FILE *
 log_open(struct PortscanLogDir *logdir, const char *log_path)
 {
@@ -29,6 +29,7 @@
 
 struct PortscanLog;
 struct PortscanLogDir;
+struct HashSet;
 struct Set;
 
 enum PortscanLogEntryType {
@@ -44,6 +45,7 @@ enum PortscanLogEntryType {
 	PORTSCAN_LOG_ENTRY_ERROR,
 	PORTSCAN_LOG_ENTRY_VARIABLE_VALUE,
 	PORTSCAN_LOG_ENTRY_COMMENT,
+	PORTSCAN_LOG_ENTRY_EXPANDED_VALUE,
 };
 
 #define PORTSCAN_LOG_LATEST "portscan-latest.log"
@@ -57,8 +59,15 @@ struct PortscanLog *portscan_log_read_all(struct PortscanLogDir *, const char *)
 void portscan_log_free(struct PortscanLog *);
 
 size_t portscan_log_len(struct PortscanLog *);
-void portscan_log_add_entries(struct PortscanLog *, enum PortscanLogEntryType, const char *, struct Set *);
+void portscan_log_add_entries(struct PortscanLog *, enum PortscanLogEntryType, const char *, struct HashSet *);
 void portscan_log_add_entry(struct PortscanLog *, enum PortscanLogEntryType, const char *, const char *);
 int portscan_log_compare(struct PortscanLog *, struct PortscanLog *);
+struct PortscanLog *portscan_log_extract(struct PortscanLog *, struct Set *);
+void portscan_log_merge(struct PortscanLog *, struct PortscanLog *);
+int portscan_log_merge_files(struct PortscanLog *, FILE **, size_t);
+int portscan_log_serialize_changes(struct PortscanLog *, struct PortscanLog *, FILE *);
 int portscan_log_serialize_to_file(struct PortscanLog *, FILE *);
 int portscan_log_serialize_to_dir(struct PortscanLog *, struct PortscanLogDir *);
+int portscan_log_serialize_to_ndjson(struct PortscanLog *, FILE *);
+
+void portscan_log_print_json_string(FILE *, const char *);
@@ -0,0 +1,166 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libias/util.h>
+
+#include "portscan/mmapfile.h"
+
+static int write_all(int, const void *, size_t);
+
+// Maps path read-only after checking that it is at least header_len
+// bytes long and starts with magic and version.  Everything else is
+// left to the caller.
+int
+portscan_mmapfile_open(struct PortscanMmapFile *file, int dir, const char *path, const char *magic, uint32_t version, size_t header_len)
+{
+	int fd = openat(dir, path, O_RDONLY);
+	if (fd == -1) {
+		return 0;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return 0;
+	}
+	if (st.st_size < 0 || (size_t)st.st_size < header_len || header_len < 8 + sizeof(uint32_t)) {
+		close(fd);
+		errno = EINVAL;
+		return 0;
+	}
+
+	file->len = st.st_size;
+	file->buf = mmap(NULL, file->len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (file->buf == MAP_FAILED) {
+		return 0;
+	}
+
+	uint32_t file_version;
+	memcpy(&file_version, (const char *)file->buf + 8, sizeof(file_version));
+	if (memcmp(file->buf, magic, 8) != 0 || file_version != version) {
+		portscan_mmapfile_close(file);
+		errno = EINVAL;
+		return 0;
+	}
+
+	return 1;
+}
+
+void
+portscan_mmapfile_close(struct PortscanMmapFile *file)
+{
+	munmap(file->buf, file->len);
+	file->buf = NULL;
+	file->len = 0;
+}
+
+int
+write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 0;
+		}
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+// Writes all sections to a temporary file first and then renames it
+// to path so that readers never see a partial file
+int
+portscan_mmapfile_write(int dir, const char *path, const struct PortscanMmapFileSection *sections, size_t len)
+{
+	char *tmp = str_printf(".%s.tmp", path);
+	int retval = 0;
+	int fd = openat(dir, tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd != -1) {
+		retval = 1;
+		for (size_t i = 0; retval && i < len; i++) {
+			retval = write_all(fd, sections[i].buf, sections[i].len);
+		}
+		if (close(fd) == -1) {
+			retval = 0;
+		}
+		if (retval && renameat(dir, tmp, dir, path) == -1) {
+			retval = 0;
+		}
+	}
+	free(tmp);
+	return retval;
+}
+
+const char *
+portscan_mmapfile_string(const char *strings, uint32_t offset)
+{
+	if (offset == PORTSCAN_MMAPFILE_NONE) {
+		return NULL;
+	}
+	return strings + offset;
+}
+
+// Binary search in a table of len entries of size bytes that is
+// sorted by the string whose offset is stored at key_offset in
+// every entry
+ssize_t
+portscan_mmapfile_lookup(const char *strings, const void *table, size_t len, size_t size, size_t key_offset, const char *key)
+{
+	size_t lo = 0;
+	size_t hi = len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint32_t offset;
+		memcpy(&offset, (const char *)table + mid * size + key_offset, sizeof(offset));
+		int cmp = strcmp(key, strings + offset);
+		if (cmp == 0) {
+			return mid;
+		} else if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return -1;
+}
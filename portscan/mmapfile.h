@@ -0,0 +1,51 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#pragma once
+
+// Files written by portscan_mmapfile_write() are in host byte order
+// and only meant to be read back by portscan on the same machine.
+// They start with an 8 byte magic and a uint32_t version.  Strings
+// are referenced by uint32_t offsets into a table of NUL terminated
+// strings with PORTSCAN_MMAPFILE_NONE standing in for NULL.
+#define PORTSCAN_MMAPFILE_NONE UINT32_MAX
+
+struct PortscanMmapFile {
+	void *buf;
+	size_t len;
+};
+
+struct PortscanMmapFileSection {
+	const void *buf;
+	size_t len;
+};
+
+int portscan_mmapfile_open(struct PortscanMmapFile *, int, const char *, const char *, uint32_t, size_t);
+void portscan_mmapfile_close(struct PortscanMmapFile *);
+int portscan_mmapfile_write(int, const char *, const struct PortscanMmapFileSection *, size_t);
+const char *portscan_mmapfile_string(const char *, uint32_t);
+ssize_t portscan_mmapfile_lookup(const char *, const void *, size_t, size_t, size_t, const char *);
@@ -0,0 +1,254 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "portscan/profile.h"
+
+struct PortscanProfilePhaseStats {
+	size_t count;
+	double wall;
+	double cpu;
+};
+
+struct PortscanProfileOrigin {
+	char *origin;
+	double wall;
+	double cpu;
+};
+
+// One profile per worker thread.  Nothing is shared so no locking
+// is needed; the main thread only looks at them after joining.
+struct PortscanProfile {
+	char *name;
+	struct PortscanProfilePhaseStats phases[PORTSCAN_PROFILE__N];
+	struct timespec phase_wall;
+	struct timespec phase_cpu;
+	struct timespec origin_wall;
+	struct timespec origin_cpu;
+	struct PortscanProfileOrigin *slowest;
+	size_t slowest_len;
+	size_t slowest_max;
+};
+
+static int compare_origin(const void *, const void *, void *);
+static double elapsed(struct timespec *, struct timespec *);
+static void now(struct timespec *, struct timespec *);
+
+static const char *phase_names[PORTSCAN_PROFILE__N] = {
+	[PORTSCAN_PROFILE_CATEGORIES] = "categories",
+	[PORTSCAN_PROFILE_OPTIONS_DESC] = "bsd.options.desc.mk",
+	[PORTSCAN_PROFILE_OPEN] = "open",
+	[PORTSCAN_PROFILE_READ] = "read",
+	[PORTSCAN_PROFILE_INCLUDES] = "includes",
+	[PORTSCAN_PROFILE_READ_FINISH] = "read-finish",
+	[PORTSCAN_PROFILE_UNKNOWN_VARIABLES] = "unknown-variables",
+	[PORTSCAN_PROFILE_UNKNOWN_TARGETS] = "unknown-targets",
+	[PORTSCAN_PROFILE_CLONES] = "clones",
+	[PORTSCAN_PROFILE_OPTION_DEFAULT_DESCRIPTIONS] = "option-default-descriptions",
+	[PORTSCAN_PROFILE_OPTIONS] = "options",
+	[PORTSCAN_PROFILE_VARIABLE_VALUES] = "variable-values",
+	[PORTSCAN_PROFILE_EXPANDED_VALUES] = "expanded-values",
+	[PORTSCAN_PROFILE_COMMENTS] = "comments",
+	[PORTSCAN_PROFILE_DEPENDENCIES] = "dependencies",
+	[PORTSCAN_PROFILE_VARIABLES] = "variables",
+	[PORTSCAN_PROFILE_RESULT] = "result",
+};
+
+struct PortscanProfile *
+portscan_profile_new(const char *name, size_t slowest)
+{
+	struct PortscanProfile *profile = xmalloc(sizeof(struct PortscanProfile));
+	profile->name = xstrdup(name);
+	profile->slowest_max = slowest;
+	if (slowest > 0) {
+		profile->slowest = xrecallocarray(NULL, 0, slowest, sizeof(struct PortscanProfileOrigin));
+	}
+	return profile;
+}
+
+void
+portscan_profile_free(struct PortscanProfile *profile)
+{
+	if (profile == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < profile->slowest_len; i++) {
+		free(profile->slowest[i].origin);
+	}
+	free(profile->slowest);
+	free(profile->name);
+	free(profile);
+}
+
+void
+now(struct timespec *wall, struct timespec *cpu)
+{
+	clock_gettime(CLOCK_MONOTONIC, wall);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, cpu);
+}
+
+double
+elapsed(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+void
+portscan_profile_begin(struct PortscanProfile *profile, enum PortscanProfilePhase phase)
+{
+	if (profile == NULL) {
+		return;
+	}
+	now(&profile->phase_wall, &profile->phase_cpu);
+}
+
+void
+portscan_profile_end(struct PortscanProfile *profile, enum PortscanProfilePhase phase)
+{
+	if (profile == NULL) {
+		return;
+	}
+
+	struct timespec wall, cpu;
+	now(&wall, &cpu);
+	profile->phases[phase].count++;
+	profile->phases[phase].wall += elapsed(&profile->phase_wall, &wall);
+	profile->phases[phase].cpu += elapsed(&profile->phase_cpu, &cpu);
+}
+
+void
+portscan_profile_begin_origin(struct PortscanProfile *profile)
+{
+	if (profile == NULL) {
+		return;
+	}
+	now(&profile->origin_wall, &profile->origin_cpu);
+}
+
+void
+portscan_profile_end_origin(struct PortscanProfile *profile, const char *origin)
+{
+	if (profile == NULL || profile->slowest_max == 0) {
+		return;
+	}
+
+	struct timespec wall, cpu;
+	now(&wall, &cpu);
+	double wall_elapsed = elapsed(&profile->origin_wall, &wall);
+
+	// Replace the fastest entry once the list is full.  It is
+	// short so a linear scan is good enough.
+	size_t slot = profile->slowest_len;
+	if (profile->slowest_len == profile->slowest_max) {
+		slot = 0;
+		for (size_t i = 1; i < profile->slowest_len; i++) {
+			if (profile->slowest[i].wall < profile->slowest[slot].wall) {
+				slot = i;
+			}
+		}
+		if (profile->slowest[slot].wall >= wall_elapsed) {
+			return;
+		}
+		free(profile->slowest[slot].origin);
+	} else {
+		profile->slowest_len++;
+	}
+	profile->slowest[slot].origin = xstrdup(origin);
+	profile->slowest[slot].wall = wall_elapsed;
+	profile->slowest[slot].cpu = elapsed(&profile->origin_cpu, &cpu);
+}
+
+int
+compare_origin(const void *ap, const void *bp, void *userdata)
+{
+	const struct PortscanProfileOrigin *a = *(const struct PortscanProfileOrigin **)ap;
+	const struct PortscanProfileOrigin *b = *(const struct PortscanProfileOrigin **)bp;
+	if (a->wall < b->wall) {
+		return 1;
+	} else if (a->wall > b->wall) {
+		return -1;
+	} else {
+		return strcmp(a->origin, b->origin);
+	}
+}
+
+void
+portscan_profile_print(struct Array *profiles, size_t slowest, FILE *fp)
+{
+	struct PortscanProfilePhaseStats total[PORTSCAN_PROFILE__N] = {};
+	struct Array *origins = array_new();
+
+	fprintf(fp, "%-16s %-28s %8s %12s %12s\n", "worker", "phase", "count", "wall ms", "cpu ms");
+	ARRAY_FOREACH(profiles, struct PortscanProfile *, profile) {
+		for (enum PortscanProfilePhase phase = 0; phase < PORTSCAN_PROFILE__N; phase++) {
+			struct PortscanProfilePhaseStats *stats = &profile->phases[phase];
+			if (stats->count == 0) {
+				continue;
+			}
+			fprintf(fp, "%-16s %-28s %8zu %12.3f %12.3f\n", profile->name,
+				phase_names[phase], stats->count, stats->wall * 1000, stats->cpu * 1000);
+			total[phase].count += stats->count;
+			total[phase].wall += stats->wall;
+			total[phase].cpu += stats->cpu;
+		}
+		for (size_t i = 0; i < profile->slowest_len; i++) {
+			array_append(origins, &profile->slowest[i]);
+		}
+	}
+	for (enum PortscanProfilePhase phase = 0; phase < PORTSCAN_PROFILE__N; phase++) {
+		if (total[phase].count > 0) {
+			fprintf(fp, "%-16s %-28s %8zu %12.3f %12.3f\n", "total",
+				phase_names[phase], total[phase].count, total[phase].wall * 1000,
+				total[phase].cpu * 1000);
+		}
+	}
+
+	if (array_len(origins) > 0) {
+		array_sort(origins, compare_origin, NULL);
+		fprintf(fp, "\n%-45s %8s %12s %12s\n", "slowest origins", "", "wall ms", "cpu ms");
+		ARRAY_FOREACH(origins, struct PortscanProfileOrigin *, origin) {
+			if (origin_index >= slowest) {
+				break;
+			}
+			fprintf(fp, "%-45s %8s %12.3f %12.3f\n", origin->origin, "",
+				origin->wall * 1000, origin->cpu * 1000);
+		}
+	}
+
+	array_free(origins);
+}
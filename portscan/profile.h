@@ -0,0 +1,61 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+struct Array;
+struct PortscanProfile;
+
+enum PortscanProfilePhase {
+	PORTSCAN_PROFILE_CATEGORIES,
+	PORTSCAN_PROFILE_OPTIONS_DESC,
+	PORTSCAN_PROFILE_OPEN,
+	PORTSCAN_PROFILE_READ,
+	PORTSCAN_PROFILE_INCLUDES,
+	PORTSCAN_PROFILE_READ_FINISH,
+	PORTSCAN_PROFILE_UNKNOWN_VARIABLES,
+	PORTSCAN_PROFILE_UNKNOWN_TARGETS,
+	PORTSCAN_PROFILE_CLONES,
+	PORTSCAN_PROFILE_OPTION_DEFAULT_DESCRIPTIONS,
+	PORTSCAN_PROFILE_OPTIONS,
+	PORTSCAN_PROFILE_VARIABLE_VALUES,
+	PORTSCAN_PROFILE_EXPANDED_VALUES,
+	PORTSCAN_PROFILE_COMMENTS,
+	PORTSCAN_PROFILE_DEPENDENCIES,
+	PORTSCAN_PROFILE_VARIABLES,
+	PORTSCAN_PROFILE_RESULT,
+	PORTSCAN_PROFILE__N,
+};
+
+struct PortscanProfile *portscan_profile_new(const char *, size_t);
+void portscan_profile_free(struct PortscanProfile *);
+void portscan_profile_begin(struct PortscanProfile *, enum PortscanProfilePhase);
+void portscan_profile_end(struct PortscanProfile *, enum PortscanProfilePhase);
+void portscan_profile_begin_origin(struct PortscanProfile *);
+void portscan_profile_end_origin(struct PortscanProfile *, const char *);
+void portscan_profile_print(struct Array *, size_t, FILE *);
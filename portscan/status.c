@@ -31,29 +31,99 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <fcntl.h>
+#include <libgen.h>
 #include <signal.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <libias/util.h>
+
+#include "capsicum_helpers.h"
+#include "portscan/log.h"
 #include "portscan/status.h"
 
+// Weight of the newest sample in the moving average of the scan rate
+#define RATE_SMOOTHING 0.3
+
+struct PortscanStatusWorker {
+	atomic_size_t scanned;
+	_Atomic(const char *) origin;
+	_Atomic(long long) since;
+};
+
+static double elapsed(struct timespec *, struct timespec *);
+static long long monotonic_ns(void);
 static void portscan_status_signal_handler(int);
+static void portscan_status_write_file(size_t, int, double);
 
 static enum PortscanState state = PORTSCAN_STATUS_START;
 static struct timespec tic;
 static unsigned int interval;
+static int progress;
 static atomic_int siginfo_requested = ATOMIC_VAR_INIT(0);
+static atomic_int tick_requested = ATOMIC_VAR_INIT(0);
+static atomic_flag printing = ATOMIC_FLAG_INIT;
 static atomic_size_t scanned = ATOMIC_VAR_INIT(0);
 static size_t max_scanned;
+static struct PortscanStatusWorker *workers;
+static size_t workers_len;
+static _Thread_local struct PortscanStatusWorker *worker = NULL;
+static struct timespec rate_tic;
+static size_t rate_scanned;
+static double rate;
+static int statusdir = -1;
+static char *statusfile;
+static char *statusfile_tmp;
+
+static const char *state_names[] = {
+	[PORTSCAN_STATUS_START] = "start",
+	[PORTSCAN_STATUS_CATEGORIES] = "categories",
+	[PORTSCAN_STATUS_PORTS] = "ports",
+	[PORTSCAN_STATUS_RESULT] = "result",
+	[PORTSCAN_STATUS_FINISHED] = "finished",
+};
+
+int
+portscan_status_open_file(const char *path)
+{
+	char *buf = xstrdup(path);
+	statusdir = open(dirname(buf), O_DIRECTORY);
+	free(buf);
+	if (statusdir == -1) {
+		return 0;
+	}
+
+	buf = xstrdup(path);
+	statusfile = xstrdup(basename(buf));
+	free(buf);
+	statusfile_tmp = str_printf(".%s.tmp", statusfile);
+
+#if HAVE_CAPSICUM
+	if (caph_limit_stream(statusdir, CAPH_CREATE | CAPH_FTRUNCATE | CAPH_RENAME) < 0) {
+		err(1, "caph_limit_stream: %s", path);
+	}
+#endif
+
+	return 1;
+}
 
 void
 portscan_status_init(unsigned int progress_interval)
 {
+	// Without --progress only the status file is updated on
+	// every tick.
+	progress = progress_interval > 0;
 	interval = progress_interval;
+	if (interval == 0 && statusdir != -1) {
+		interval = 5;
+	}
 	clock_gettime(CLOCK_MONOTONIC, &tic);
+	rate_tic = tic;
 
 #ifdef SIGINFO
 	if (signal(SIGINFO, portscan_status_signal_handler)) {
@@ -71,47 +141,154 @@ portscan_status_init(unsigned int progress_interval)
 	}
 }
 
+long long
+monotonic_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+double
+elapsed(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_nsec - start->tv_nsec) / 1000000000.0 + (end->tv_sec - start->tv_sec);
+}
+
+void
+portscan_status_attach(size_t i)
+{
+	if (i < workers_len) {
+		worker = &workers[i];
+	} else {
+		worker = NULL;
+	}
+}
+
 void
 portscan_status_inc()
 {
-	scanned++;
+	if (worker) {
+		atomic_fetch_add_explicit(&worker->scanned, 1, memory_order_relaxed);
+	} else {
+		scanned++;
+	}
+}
+
+void
+portscan_status_set_origin(const char *origin)
+{
+	if (worker) {
+		atomic_store_explicit(&worker->since, monotonic_ns(), memory_order_relaxed);
+		atomic_store_explicit(&worker->origin, origin, memory_order_relaxed);
+	}
 }
 
 void
-portscan_status_reset(enum PortscanState new_state, size_t max)
+portscan_status_reset(enum PortscanState new_state, size_t max, size_t n_workers)
 {
+	// Only called while no worker is running
 	state = new_state;
 	scanned = 0;
 	max_scanned = max;
+	free(workers);
+	workers = NULL;
+	workers_len = n_workers;
+	if (n_workers > 0) {
+		workers = xrecallocarray(NULL, 0, n_workers, sizeof(struct PortscanStatusWorker));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &rate_tic);
+	rate_scanned = 0;
+	rate = 0;
 	if (interval) {
-		siginfo_requested = 1;
+		tick_requested = 1;
+	}
+}
+
+// Switches to the finished state but keeps the totals of the last
+// phase so that the final status file still has them
+void
+portscan_status_finish()
+{
+	for (size_t i = 0; i < workers_len; i++) {
+		scanned += atomic_load_explicit(&workers[i].scanned, memory_order_relaxed);
+	}
+	free(workers);
+	workers = NULL;
+	workers_len = 0;
+	state = PORTSCAN_STATUS_FINISHED;
+	if (interval) {
+		tick_requested = 1;
 	}
 }
 
 void
 portscan_status_print()
 {
+	if (atomic_flag_test_and_set(&printing)) {
+		return;
+	}
+
 	int expected = 1;
-	if (atomic_compare_exchange_strong(&siginfo_requested, &expected, 0)) {
+	int siginfo = atomic_compare_exchange_strong(&siginfo_requested, &expected, 0);
+	expected = 1;
+	int tick = atomic_compare_exchange_strong(&tick_requested, &expected, 0);
+	if (!siginfo && !tick) {
+		atomic_flag_clear(&printing);
+		return;
+	}
+
+	size_t total = scanned;
+	for (size_t i = 0; i < workers_len; i++) {
+		total += atomic_load_explicit(&workers[i].scanned, memory_order_relaxed);
+	}
+
+	struct timespec toc;
+	clock_gettime(CLOCK_MONOTONIC, &toc);
+	int seconds = elapsed(&tic, &toc);
+	double dt = elapsed(&rate_tic, &toc);
+	if (dt > 0 && total >= rate_scanned) {
+		double current = (total - rate_scanned) / dt;
+		if (rate == 0) {
+			rate = current;
+		} else {
+			rate = RATE_SMOOTHING * current + (1 - RATE_SMOOTHING) * rate;
+		}
+		rate_tic = toc;
+		rate_scanned = total;
+	}
+	double eta = -1;
+	if (rate > 0 && max_scanned >= total) {
+		eta = (max_scanned - total) / rate;
+	}
+
+	if (statusdir != -1) {
+		portscan_status_write_file(total, seconds, eta);
+	}
+
+	if (siginfo || progress) {
 		int percent = 0;
 		if (max_scanned > 0) {
-			percent = scanned * 100 / max_scanned;
+			percent = total * 100 / max_scanned;
+		}
+		char *throughput;
+		if (eta < 0) {
+			throughput = str_printf("%ds", seconds);
+		} else {
+			throughput = str_printf("%ds, %.1f/s, ETA %.0fs", seconds, rate, eta);
 		}
-		struct timespec toc;
-		clock_gettime(CLOCK_MONOTONIC, &toc);
-		int seconds = (toc.tv_nsec - tic.tv_nsec) / 1000000000.0 + (toc.tv_sec  - tic.tv_sec);
 		switch (state) {
 		case PORTSCAN_STATUS_START:
 			fprintf(stderr, "[  0%%] starting (%ds)\n", seconds);
 			break;
 		case PORTSCAN_STATUS_CATEGORIES:
-			fprintf(stderr, "[%3d%%] scanning categories %zu/%zu (%ds)\n", percent, scanned, max_scanned, seconds);
+			fprintf(stderr, "[%3d%%] scanning categories %zu/%zu (%s)\n", percent, total, max_scanned, throughput);
 			break;
 		case PORTSCAN_STATUS_PORTS:
-			fprintf(stderr, "[%3d%%] scanning ports %zu/%zu (%ds)\n", percent, scanned, max_scanned, seconds);
+			fprintf(stderr, "[%3d%%] scanning ports %zu/%zu (%s)\n", percent, total, max_scanned, throughput);
 			break;
 		case PORTSCAN_STATUS_RESULT:
-			fprintf(stderr, "[%3d%%] compiling result %zu/%zu (%ds)\n", percent, scanned, max_scanned, seconds);
+			fprintf(stderr, "[%3d%%] compiling result %zu/%zu (%s)\n", percent, total, max_scanned, throughput);
 			break;
 		case PORTSCAN_STATUS_FINISHED:
 			fprintf(stderr, "[100%%] finished in %ds\n", seconds);
@@ -119,14 +296,78 @@ portscan_status_print()
 		default:
 			abort();
 		}
-		if (interval) {
-			alarm(interval);
+		free(throughput);
+
+		long long now = monotonic_ns();
+		for (size_t i = 0; i < workers_len; i++) {
+			const char *origin = atomic_load_explicit(&workers[i].origin, memory_order_relaxed);
+			if (origin) {
+				long long since = atomic_load_explicit(&workers[i].since, memory_order_relaxed);
+				fprintf(stderr, "       worker %zu: %s (%.1fs)\n", i, origin, (now - since) / 1000000000.0);
+			}
+		}
+	}
+
+	if (interval && tick) {
+		alarm(interval);
+	}
+
+	atomic_flag_clear(&printing);
+}
+
+void
+portscan_status_write_file(size_t total, int seconds, double eta)
+{
+	int fd = openat(statusdir, statusfile_tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd == -1) {
+		warn("openat: %s", statusfile_tmp);
+		return;
+	}
+	FILE *fp = fdopen(fd, "w");
+	if (fp == NULL) {
+		warn("fdopen: %s", statusfile_tmp);
+		close(fd);
+		return;
+	}
+
+	fprintf(fp, "{\"state\":\"%s\",\"scanned\":%zu,\"total\":%zu,\"seconds\":%d,\"rate\":%.3f,\"eta\":",
+		state_names[state], total, max_scanned, seconds, rate);
+	if (eta < 0) {
+		fprintf(fp, "null");
+	} else {
+		fprintf(fp, "%.0f", eta);
+	}
+	fprintf(fp, ",\"workers\":[");
+	long long now = monotonic_ns();
+	for (size_t i = 0; i < workers_len; i++) {
+		const char *origin = atomic_load_explicit(&workers[i].origin, memory_order_relaxed);
+		fprintf(fp, "%s{\"scanned\":%zu,\"origin\":", i == 0 ? "" : ",",
+			atomic_load_explicit(&workers[i].scanned, memory_order_relaxed));
+		if (origin) {
+			long long since = atomic_load_explicit(&workers[i].since, memory_order_relaxed);
+			portscan_log_print_json_string(fp, origin);
+			fprintf(fp, ",\"seconds\":%.3f}", (now - since) / 1000000000.0);
+		} else {
+			fprintf(fp, "null,\"seconds\":null}");
 		}
 	}
+	fprintf(fp, "]}\n");
+
+	if (fclose(fp) != 0) {
+		warn("fclose: %s", statusfile_tmp);
+		return;
+	}
+	if (renameat(statusdir, statusfile_tmp, statusdir, statusfile) == -1) {
+		warn("renameat: %s", statusfile);
+	}
 }
 
 void
 portscan_status_signal_handler(int si)
 {
-	siginfo_requested = 1;
+	if (si == SIGALRM) {
+		tick_requested = 1;
+	} else {
+		siginfo_requested = 1;
+	}
 }
@@ -36,7 +36,11 @@ enum PortscanState {
 	PORTSCAN_STATUS_FINISHED,
 };
 
+int portscan_status_open_file(const char *);
 void portscan_status_init(unsigned int);
+void portscan_status_attach(size_t);
 void portscan_status_inc(void);
-void portscan_status_reset(enum PortscanState, size_t);
+void portscan_status_set_origin(const char *);
+void portscan_status_reset(enum PortscanState, size_t, size_t);
+void portscan_status_finish(void);
 void portscan_status_print(void);
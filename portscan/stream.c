@@ -0,0 +1,149 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "portscan/log.h"
+#include "portscan/stream.h"
+#include "stats.h"
+
+// Workers claim origins in order so that in ordered mode only the
+// results of the ports that are still being scanned by other workers
+// have to be held back.
+struct PortscanStream {
+	pthread_mutex_t mutex;
+	FILE *out;
+	int ordered;
+	size_t claimed;
+	size_t written;
+	struct Array *pending;
+};
+
+static void stream_flush(struct PortscanStream *, const char *);
+
+struct PortscanStream *
+portscan_stream_new(FILE *out, size_t len, int ordered)
+{
+	struct PortscanStream *stream = xmalloc(sizeof(struct PortscanStream));
+	if (pthread_mutex_init(&stream->mutex, NULL) != 0) {
+		err(1, "pthread_mutex_init");
+	}
+	stream->out = out;
+	stream->ordered = ordered;
+	if (ordered) {
+		stream->pending = array_new();
+		for (size_t i = 0; i < len; i++) {
+			array_append(stream->pending, NULL);
+		}
+	}
+	return stream;
+}
+
+void
+portscan_stream_free(struct PortscanStream *stream)
+{
+	if (stream == NULL) {
+		return;
+	}
+
+	if (stream->pending) {
+		ARRAY_FOREACH(stream->pending, char *, line) {
+			free(line);
+		}
+		array_free(stream->pending);
+	}
+	pthread_mutex_destroy(&stream->mutex);
+	free(stream);
+}
+
+size_t
+portscan_stream_claim(struct PortscanStream *stream)
+{
+	pthread_mutex_lock(&stream->mutex);
+	size_t index = stream->claimed++;
+	pthread_mutex_unlock(&stream->mutex);
+	return index;
+}
+
+void
+stream_flush(struct PortscanStream *stream, const char *buf)
+{
+	size_t len = strlen(buf);
+	if (len == 0) {
+		return;
+	}
+	if (fwrite(buf, 1, len, stream->out) != len || fflush(stream->out) == EOF) {
+		err(1, "fwrite");
+	}
+	STATS_ADD(STATS_BYTES_WRITTEN, len);
+}
+
+// Writes the results of the index-th claimed origin.  In ordered mode
+// they are held back until the results of all earlier origins were
+// written.
+void
+portscan_stream_write(struct PortscanStream *stream, size_t index, struct PortscanLog *log)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fp = open_memstream(&buf, &len);
+	if (fp == NULL) {
+		err(1, "open_memstream");
+	}
+	if (!portscan_log_serialize_to_ndjson(log, fp)) {
+		err(1, "portscan_log_serialize_to_ndjson");
+	}
+	fclose(fp);
+
+	pthread_mutex_lock(&stream->mutex);
+	if (stream->ordered) {
+		array_set(stream->pending, index, buf);
+		char *line;
+		while ((line = array_get(stream->pending, stream->written)) != NULL) {
+			stream_flush(stream, line);
+			free(line);
+			array_set(stream->pending, stream->written, NULL);
+			stream->written++;
+		}
+	} else {
+		stream_flush(stream, buf);
+		free(buf);
+	}
+	pthread_mutex_unlock(&stream->mutex);
+}
@@ -0,0 +1,188 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "portscan/log.h"
+#include "portscan/trace.h"
+
+struct PortscanTraceEvent {
+	const char *name;
+	char *origin;
+	double ts;
+	double dur;
+};
+
+// Events are only ever appended by the thread the buffer is attached
+// to.  Everything is written out in one go by portscan_trace_write()
+// after all workers were joined.
+struct PortscanTraceThread {
+	struct PortscanTrace *trace;
+	char *name;
+	size_t tid;
+	struct Array *events;
+	struct Array *stack;
+};
+
+struct PortscanTrace {
+	struct timespec start;
+	struct Array *threads;
+};
+
+static double timestamp(struct PortscanTrace *);
+
+static _Thread_local struct PortscanTraceThread *current = NULL;
+
+struct PortscanTrace *
+portscan_trace_new()
+{
+	struct PortscanTrace *trace = xmalloc(sizeof(struct PortscanTrace));
+	clock_gettime(CLOCK_MONOTONIC, &trace->start);
+	trace->threads = array_new();
+	return trace;
+}
+
+void
+portscan_trace_free(struct PortscanTrace *trace)
+{
+	if (trace == NULL) {
+		return;
+	}
+
+	ARRAY_FOREACH(trace->threads, struct PortscanTraceThread *, thread) {
+		ARRAY_FOREACH(thread->events, struct PortscanTraceEvent *, event) {
+			free(event->origin);
+			free(event);
+		}
+		array_free(thread->events);
+		array_free(thread->stack);
+		free(thread->name);
+		free(thread);
+	}
+	array_free(trace->threads);
+	free(trace);
+}
+
+double
+timestamp(struct PortscanTrace *trace)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - trace->start.tv_sec) * 1000000.0 + (now.tv_nsec - trace->start.tv_nsec) / 1000.0;
+}
+
+struct PortscanTraceThread *
+portscan_trace_thread(struct PortscanTrace *trace, const char *name)
+{
+	if (trace == NULL) {
+		return NULL;
+	}
+
+	struct PortscanTraceThread *thread = xmalloc(sizeof(struct PortscanTraceThread));
+	thread->trace = trace;
+	thread->name = xstrdup(name);
+	thread->tid = array_len(trace->threads);
+	thread->events = array_new();
+	thread->stack = array_new();
+	array_append(trace->threads, thread);
+	return thread;
+}
+
+void
+portscan_trace_attach(struct PortscanTraceThread *thread)
+{
+	current = thread;
+}
+
+void
+portscan_trace_begin(const char *name, const char *origin)
+{
+	struct PortscanTraceThread *thread = current;
+	if (thread == NULL) {
+		return;
+	}
+
+	struct PortscanTraceEvent *event = xmalloc(sizeof(struct PortscanTraceEvent));
+	event->name = name;
+	if (origin) {
+		event->origin = xstrdup(origin);
+	}
+	event->ts = timestamp(thread->trace);
+	array_append(thread->events, event);
+	array_append(thread->stack, event);
+}
+
+void
+portscan_trace_end()
+{
+	struct PortscanTraceThread *thread = current;
+	if (thread == NULL) {
+		return;
+	}
+
+	struct PortscanTraceEvent *event = array_pop(thread->stack);
+	if (event) {
+		event->dur = timestamp(thread->trace) - event->ts;
+	}
+}
+
+int
+portscan_trace_write(struct PortscanTrace *trace, FILE *fp)
+{
+	fprintf(fp, "{\"traceEvents\":[\n");
+	int first = 1;
+	ARRAY_FOREACH(trace->threads, struct PortscanTraceThread *, thread) {
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":",
+			first ? "" : ",\n", thread->tid);
+		portscan_log_print_json_string(fp, thread->name);
+		fprintf(fp, "}}");
+		first = 0;
+		ARRAY_FOREACH(thread->events, struct PortscanTraceEvent *, event) {
+			fprintf(fp, ",\n{\"name\":");
+			portscan_log_print_json_string(fp, event->name);
+			fprintf(fp, ",\"cat\":\"portscan\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f",
+				thread->tid, event->ts, event->dur);
+			if (event->origin) {
+				fprintf(fp, ",\"args\":{\"origin\":");
+				portscan_log_print_json_string(fp, event->origin);
+				fprintf(fp, "}");
+			}
+			fprintf(fp, "}");
+		}
+	}
+	fprintf(fp, "\n]}\n");
+
+	return fflush(fp) == 0 && !ferror(fp);
+}
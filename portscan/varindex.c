@@ -0,0 +1,578 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <regex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libias/array.h>
+#include <libias/map.h>
+#include <libias/util.h>
+
+#include "portscan/varindex.h"
+#include "portscan/mmapfile.h"
+#include "regexp.h"
+
+// Layout of the index, see portscan/mmapfile.h
+//
+// header
+// ports[ports]		sorted by origin
+// names[names]		interned variable names, sorted
+// postings[postings]	grouped by name, then sorted by port
+// by_port[postings]	posting indexes grouped by port
+// strings[strings_len]	NUL terminated, deduplicated strings
+#define VARINDEX_MAGIC "PORTVIDX"
+#define VARINDEX_VERSION 1
+#define VARINDEX_NONE PORTSCAN_MMAPFILE_NONE
+
+struct PortscanVarindexHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t ports;
+	uint32_t names;
+	uint32_t postings;
+	uint32_t strings_len;
+	uint32_t pad;
+};
+
+struct PortscanVarindexPort {
+	uint64_t hash;
+	uint32_t origin;
+	uint32_t inputs;
+	uint32_t first;
+	uint32_t count;
+};
+
+struct PortscanVarindexName {
+	uint32_t name;
+	uint32_t first;
+	uint32_t count;
+};
+
+struct PortscanVarindexPosting {
+	uint32_t port;
+	uint32_t name;
+	uint32_t value;
+	uint32_t start;
+	uint32_t end;
+};
+
+struct PortscanVarindex {
+	struct PortscanMmapFile file;
+	const struct PortscanVarindexHeader *header;
+	const struct PortscanVarindexPort *ports;
+	const struct PortscanVarindexName *names;
+	const struct PortscanVarindexPosting *postings;
+	const uint32_t *by_port;
+	const char *strings;
+};
+
+struct PortscanVarindexBuilder {
+	struct Map *ports;
+};
+
+struct PortscanVarindexBuilderPort {
+	char *origin;
+	uint64_t hash;
+	char *inputs;
+	int scanned;
+	uint32_t index;
+	struct Array *entries;
+};
+
+struct PortscanVarindexBuilderPosting {
+	struct PortscanVarindexBuilderPort *port;
+	struct PortscanVarindexEntry *entry;
+	size_t seq;
+};
+
+struct PortscanVarindexStrings {
+	struct Array *values;
+	uint32_t *offsets;
+	size_t len;
+};
+
+static struct PortscanVarindexBuilderPort *builder_port(struct PortscanVarindexBuilder *, const char *);
+static void builder_port_free(struct PortscanVarindexBuilderPort *);
+static struct PortscanVarindexEntry *entry_new(struct PortscanVarindex *, const struct PortscanVarindexPosting *);
+static ssize_t lookup(struct PortscanVarindex *, const char *);
+static int posting_compare(const void *, const void *, void *);
+static uint32_t strings_offset(struct PortscanVarindexStrings *, const char *);
+static int validate(struct PortscanVarindex *);
+
+struct PortscanVarindexBuilder *
+portscan_varindex_builder_new()
+{
+	struct PortscanVarindexBuilder *builder = xmalloc(sizeof(struct PortscanVarindexBuilder));
+	builder->ports = map_new(str_compare, NULL, NULL, builder_port_free);
+	return builder;
+}
+
+void
+portscan_varindex_builder_free(struct PortscanVarindexBuilder *builder)
+{
+	if (builder == NULL) {
+		return;
+	}
+	map_free(builder->ports);
+	free(builder);
+}
+
+void
+builder_port_free(struct PortscanVarindexBuilderPort *port)
+{
+	if (port == NULL) {
+		return;
+	}
+	portscan_varindex_entries_free(port->entries);
+	free(port->origin);
+	free(port->inputs);
+	free(port);
+}
+
+struct PortscanVarindexBuilderPort *
+builder_port(struct PortscanVarindexBuilder *builder, const char *origin)
+{
+	struct PortscanVarindexBuilderPort *port = map_get(builder->ports, origin);
+	if (port == NULL) {
+		port = xmalloc(sizeof(struct PortscanVarindexBuilderPort));
+		port->origin = xstrdup(origin);
+		port->entries = array_new();
+		map_add(builder->ports, port->origin, port);
+	}
+	return port;
+}
+
+void
+portscan_varindex_builder_add_port(struct PortscanVarindexBuilder *builder, const char *origin, uint64_t hash, const char *inputs)
+{
+	struct PortscanVarindexBuilderPort *port = builder_port(builder, origin);
+	port->scanned = 1;
+	port->hash = hash;
+	free(port->inputs);
+	port->inputs = xstrdup(inputs ? inputs : "");
+}
+
+void
+portscan_varindex_builder_add_entry(struct PortscanVarindexBuilder *builder, const char *origin, const char *name, const char *value, size_t start, size_t end)
+{
+	struct PortscanVarindexBuilderPort *port = builder_port(builder, origin);
+	struct PortscanVarindexEntry *entry = xmalloc(sizeof(struct PortscanVarindexEntry));
+	entry->name = xstrdup(name);
+	entry->value = xstrdup(value);
+	entry->start = start;
+	entry->end = end;
+	array_append(port->entries, entry);
+}
+
+void
+portscan_varindex_builder_copy_port(struct PortscanVarindexBuilder *builder, struct PortscanVarindex *index, const char *origin)
+{
+	uint64_t hash;
+	const char *inputs;
+	if (!portscan_varindex_port(index, origin, &hash, &inputs)) {
+		return;
+	}
+	portscan_varindex_builder_add_port(builder, origin, hash, inputs);
+	struct Array *entries = portscan_varindex_port_entries(index, origin);
+	ARRAY_FOREACH(entries, struct PortscanVarindexEntry *, entry) {
+		portscan_varindex_builder_add_entry(builder, origin, entry->name, entry->value, entry->start, entry->end);
+	}
+	portscan_varindex_entries_free(entries);
+}
+
+int
+portscan_varindex_builder_has_port(struct PortscanVarindexBuilder *builder, const char *origin)
+{
+	struct PortscanVarindexBuilderPort *port = map_get(builder->ports, origin);
+	return port && port->scanned;
+}
+
+int
+posting_compare(const void *ap, const void *bp, void *userdata)
+{
+	const struct PortscanVarindexBuilderPosting *a = *(const struct PortscanVarindexBuilderPosting **)ap;
+	const struct PortscanVarindexBuilderPosting *b = *(const struct PortscanVarindexBuilderPosting **)bp;
+	int retval = strcmp(a->entry->name, b->entry->name);
+	if (retval != 0) {
+		return retval;
+	} else if (a->port->index != b->port->index) {
+		return a->port->index < b->port->index ? -1 : 1;
+	} else if (a->seq != b->seq) {
+		return a->seq < b->seq ? -1 : 1;
+	} else {
+		return 0;
+	}
+}
+
+uint32_t
+strings_offset(struct PortscanVarindexStrings *strings, const char *s)
+{
+	size_t lo = 0;
+	size_t hi = array_len(strings->values);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(s, array_get(strings->values, mid));
+		if (cmp == 0) {
+			return strings->offsets[mid];
+		} else if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return VARINDEX_NONE;
+}
+
+int
+portscan_varindex_builder_write(struct PortscanVarindexBuilder *builder, int dir, const char *path)
+{
+	// Intern all strings.  Values repeat a lot across ports, e.g.,
+	// every port has USES=gmake or LICENSE=BSD2CLAUSE.
+	struct Array *ports = map_values(builder->ports);
+	struct Array *postings = array_new();
+	struct Array *all = array_new();
+	size_t seq = 0;
+	ARRAY_FOREACH(ports, struct PortscanVarindexBuilderPort *, port) {
+		port->index = port_index;
+		array_append(all, port->origin);
+		if (port->scanned) {
+			array_append(all, port->inputs);
+		}
+		ARRAY_FOREACH(port->entries, struct PortscanVarindexEntry *, entry) {
+			struct PortscanVarindexBuilderPosting *posting = xmalloc(sizeof(struct PortscanVarindexBuilderPosting));
+			posting->port = port;
+			posting->entry = entry;
+			posting->seq = seq++;
+			array_append(postings, posting);
+			array_append(all, entry->name);
+			array_append(all, entry->value);
+		}
+	}
+	array_sort(all, str_compare, NULL);
+	array_sort(postings, posting_compare, NULL);
+
+	struct PortscanVarindexStrings strings = { array_new(), NULL, 0 };
+	strings.offsets = xrecallocarray(NULL, 0, array_len(all) + 1, sizeof(uint32_t));
+	const char *last = NULL;
+	ARRAY_FOREACH(all, const char *, s) {
+		if (last == NULL || strcmp(last, s) != 0) {
+			strings.offsets[array_len(strings.values)] = strings.len;
+			array_append(strings.values, s);
+			strings.len += strlen(s) + 1;
+			last = s;
+		}
+	}
+	array_free(all);
+
+	size_t ports_len = array_len(ports);
+	size_t postings_len = array_len(postings);
+	if (ports_len >= UINT32_MAX || postings_len >= UINT32_MAX || strings.len >= UINT32_MAX) {
+		ARRAY_FOREACH(postings, struct PortscanVarindexBuilderPosting *, posting) {
+			free(posting);
+		}
+		array_free(postings);
+		array_free(ports);
+		array_free(strings.values);
+		free(strings.offsets);
+		errno = EFBIG;
+		return 0;
+	}
+
+	struct PortscanVarindexPort *port_table = xrecallocarray(NULL, 0, ports_len + 1, sizeof(struct PortscanVarindexPort));
+	struct PortscanVarindexName *name_table = xrecallocarray(NULL, 0, postings_len + 1, sizeof(struct PortscanVarindexName));
+	struct PortscanVarindexPosting *posting_table = xrecallocarray(NULL, 0, postings_len + 1, sizeof(struct PortscanVarindexPosting));
+	uint32_t *by_port = xrecallocarray(NULL, 0, postings_len + 1, sizeof(uint32_t));
+	uint32_t *fill = xrecallocarray(NULL, 0, ports_len + 1, sizeof(uint32_t));
+
+	size_t names_len = 0;
+	last = NULL;
+	ARRAY_FOREACH(postings, struct PortscanVarindexBuilderPosting *, posting) {
+		if (last == NULL || strcmp(last, posting->entry->name) != 0) {
+			last = posting->entry->name;
+			name_table[names_len].name = strings_offset(&strings, last);
+			name_table[names_len].first = posting_index;
+			names_len++;
+		}
+		name_table[names_len - 1].count++;
+		struct PortscanVarindexPosting *p = &posting_table[posting_index];
+		p->port = posting->port->index;
+		p->name = name_table[names_len - 1].name;
+		p->value = strings_offset(&strings, posting->entry->value);
+		p->start = posting->entry->start;
+		p->end = posting->entry->end;
+		port_table[p->port].count++;
+	}
+
+	// Counting sort of the postings by port.  Postings of a port
+	// stay ordered by name since the sort is stable.
+	size_t offset = 0;
+	ARRAY_FOREACH(ports, struct PortscanVarindexBuilderPort *, port) {
+		struct PortscanVarindexPort *p = &port_table[port_index];
+		p->hash = port->hash;
+		p->origin = strings_offset(&strings, port->origin);
+		p->inputs = port->scanned ? strings_offset(&strings, port->inputs) : VARINDEX_NONE;
+		p->first = offset;
+		fill[port_index] = offset;
+		offset += p->count;
+	}
+	for (size_t i = 0; i < postings_len; i++) {
+		by_port[fill[posting_table[i].port]++] = i;
+	}
+	free(fill);
+
+	char *string_table = xmalloc(strings.len + 1);
+	ARRAY_FOREACH(strings.values, const char *, s) {
+		memcpy(string_table + strings.offsets[s_index], s, strlen(s) + 1);
+	}
+
+	struct PortscanVarindexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VARINDEX_MAGIC, sizeof(header.magic));
+	header.version = VARINDEX_VERSION;
+	header.ports = ports_len;
+	header.names = names_len;
+	header.postings = postings_len;
+	header.strings_len = strings.len;
+
+	struct PortscanMmapFileSection sections[] = {
+		{ &header, sizeof(header) },
+		{ port_table, ports_len * sizeof(*port_table) },
+		{ name_table, names_len * sizeof(*name_table) },
+		{ posting_table, postings_len * sizeof(*posting_table) },
+		{ by_port, postings_len * sizeof(*by_port) },
+		{ string_table, strings.len },
+	};
+	int retval = portscan_mmapfile_write(dir, path, sections, nitems(sections));
+
+	free(string_table);
+	free(by_port);
+	free(posting_table);
+	free(name_table);
+	free(port_table);
+	ARRAY_FOREACH(postings, struct PortscanVarindexBuilderPosting *, posting) {
+		free(posting);
+	}
+	array_free(postings);
+	array_free(ports);
+	array_free(strings.values);
+	free(strings.offsets);
+
+	return retval;
+}
+
+int
+validate(struct PortscanVarindex *index)
+{
+	const struct PortscanVarindexHeader *header = index->file.buf;
+
+	size_t len = sizeof(*header) +
+		header->ports * sizeof(struct PortscanVarindexPort) +
+		header->names * sizeof(struct PortscanVarindexName) +
+		header->postings * sizeof(struct PortscanVarindexPosting) +
+		header->postings * sizeof(uint32_t) +
+		header->strings_len;
+	if (len != index->file.len) {
+		return 0;
+	}
+
+	const char *p = index->file.buf;
+	p += sizeof(*header);
+	index->header = header;
+	index->ports = (const struct PortscanVarindexPort *)p;
+	p += header->ports * sizeof(struct PortscanVarindexPort);
+	index->names = (const struct PortscanVarindexName *)p;
+	p += header->names * sizeof(struct PortscanVarindexName);
+	index->postings = (const struct PortscanVarindexPosting *)p;
+	p += header->postings * sizeof(struct PortscanVarindexPosting);
+	index->by_port = (const uint32_t *)p;
+	p += header->postings * sizeof(uint32_t);
+	index->strings = p;
+
+	if (header->strings_len > 0 && index->strings[header->strings_len - 1] != 0) {
+		return 0;
+	}
+	for (size_t i = 0; i < header->ports; i++) {
+		const struct PortscanVarindexPort *port = &index->ports[i];
+		if (port->origin >= header->strings_len ||
+		    (port->inputs != VARINDEX_NONE && port->inputs >= header->strings_len) ||
+		    port->first > header->postings ||
+		    port->count > header->postings - port->first) {
+			return 0;
+		}
+	}
+	for (size_t i = 0; i < header->names; i++) {
+		const struct PortscanVarindexName *name = &index->names[i];
+		if (name->name >= header->strings_len ||
+		    name->first > header->postings ||
+		    name->count > header->postings - name->first) {
+			return 0;
+		}
+	}
+	for (size_t i = 0; i < header->postings; i++) {
+		const struct PortscanVarindexPosting *posting = &index->postings[i];
+		if (posting->port >= header->ports ||
+		    posting->name >= header->strings_len ||
+		    posting->value >= header->strings_len ||
+		    index->by_port[i] >= header->postings) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+struct PortscanVarindex *
+portscan_varindex_open(int dir, const char *path)
+{
+	struct PortscanVarindex *index = xmalloc(sizeof(struct PortscanVarindex));
+	if (!portscan_mmapfile_open(&index->file, dir, path, VARINDEX_MAGIC, VARINDEX_VERSION, sizeof(struct PortscanVarindexHeader))) {
+		free(index);
+		return NULL;
+	}
+	if (!validate(index)) {
+		portscan_mmapfile_close(&index->file);
+		free(index);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return index;
+}
+
+void
+portscan_varindex_close(struct PortscanVarindex *index)
+{
+	if (index == NULL) {
+		return;
+	}
+	portscan_mmapfile_close(&index->file);
+	free(index);
+}
+
+ssize_t
+lookup(struct PortscanVarindex *index, const char *origin)
+{
+	return portscan_mmapfile_lookup(index->strings, index->ports, index->header->ports,
+		sizeof(struct PortscanVarindexPort), offsetof(struct PortscanVarindexPort, origin), origin);
+}
+
+struct Array *
+portscan_varindex_ports(struct PortscanVarindex *index)
+{
+	struct Array *ports = array_new();
+	for (size_t i = 0; i < index->header->ports; i++) {
+		if (index->ports[i].inputs != VARINDEX_NONE) {
+			array_append(ports, portscan_mmapfile_string(index->strings, index->ports[i].origin));
+		}
+	}
+	return ports;
+}
+
+int
+portscan_varindex_port(struct PortscanVarindex *index, const char *origin, uint64_t *hash, const char **inputs)
+{
+	ssize_t i = lookup(index, origin);
+	if (i < 0 || index->ports[i].inputs == VARINDEX_NONE) {
+		return 0;
+	}
+	if (hash) {
+		*hash = index->ports[i].hash;
+	}
+	if (inputs) {
+		*inputs = portscan_mmapfile_string(index->strings, index->ports[i].inputs);
+	}
+	return 1;
+}
+
+struct PortscanVarindexEntry *
+entry_new(struct PortscanVarindex *index, const struct PortscanVarindexPosting *posting)
+{
+	struct PortscanVarindexEntry *entry = xmalloc(sizeof(struct PortscanVarindexEntry));
+	entry->origin = xstrdup(portscan_mmapfile_string(index->strings, index->ports[posting->port].origin));
+	entry->name = xstrdup(portscan_mmapfile_string(index->strings, posting->name));
+	entry->value = xstrdup(portscan_mmapfile_string(index->strings, posting->value));
+	entry->start = posting->start;
+	entry->end = posting->end;
+	return entry;
+}
+
+struct Array *
+portscan_varindex_port_entries(struct PortscanVarindex *index, const char *origin)
+{
+	ssize_t i = lookup(index, origin);
+	if (i < 0) {
+		return NULL;
+	}
+	struct Array *entries = array_new();
+	const struct PortscanVarindexPort *port = &index->ports[i];
+	for (size_t j = port->first; j < port->first + port->count; j++) {
+		array_append(entries, entry_new(index, &index->postings[index->by_port[j]]));
+	}
+	return entries;
+}
+
+struct Array *
+portscan_varindex_query(struct PortscanVarindex *index, struct Regexp *name_query, struct Regexp *value_query)
+{
+	struct Array *entries = array_new();
+	for (size_t i = 0; i < index->header->names; i++) {
+		const struct PortscanVarindexName *name = &index->names[i];
+		if (name_query && regexp_exec(name_query, portscan_mmapfile_string(index->strings, name->name)) != 0) {
+			continue;
+		}
+		for (size_t j = name->first; j < name->first + name->count; j++) {
+			const struct PortscanVarindexPosting *posting = &index->postings[j];
+			if (value_query == NULL || regexp_exec(value_query, portscan_mmapfile_string(index->strings, posting->value)) == 0) {
+				array_append(entries, entry_new(index, posting));
+			}
+		}
+	}
+	return entries;
+}
+
+void
+portscan_varindex_entries_free(struct Array *entries)
+{
+	if (entries == NULL) {
+		return;
+	}
+	ARRAY_FOREACH(entries, struct PortscanVarindexEntry *, entry) {
+		free(entry->origin);
+		free(entry->name);
+		free(entry->value);
+		free(entry);
+	}
+	array_free(entries);
+}
@@ -0,0 +1,59 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+struct Array;
+struct PortscanVarindex;
+struct PortscanVarindexBuilder;
+struct Regexp;
+
+struct PortscanVarindexEntry {
+	char *origin;
+	char *name;
+	char *value;
+	size_t start;
+	size_t end;
+};
+
+struct PortscanVarindexBuilder *portscan_varindex_builder_new(void);
+void portscan_varindex_builder_free(struct PortscanVarindexBuilder *);
+void portscan_varindex_builder_add_port(struct PortscanVarindexBuilder *, const char *, uint64_t, const char *);
+void portscan_varindex_builder_add_entry(struct PortscanVarindexBuilder *, const char *, const char *, const char *, size_t, size_t);
+void portscan_varindex_builder_copy_port(struct PortscanVarindexBuilder *, struct PortscanVarindex *, const char *);
+int portscan_varindex_builder_has_port(struct PortscanVarindexBuilder *, const char *);
+int portscan_varindex_builder_write(struct PortscanVarindexBuilder *, int, const char *);
+
+struct PortscanVarindex *portscan_varindex_open(int, const char *);
+void portscan_varindex_close(struct PortscanVarindex *);
+struct Array *portscan_varindex_ports(struct PortscanVarindex *);
+int portscan_varindex_port(struct PortscanVarindex *, const char *, uint64_t *, const char **);
+struct Array *portscan_varindex_port_entries(struct PortscanVarindex *, const char *);
+struct Array *portscan_varindex_query(struct PortscanVarindex *, struct Regexp *, struct Regexp *);
+
+void portscan_varindex_entries_free(struct Array *);
@@ -0,0 +1,415 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#if defined(__has_include)
+# if __has_include(<sys/inotify.h>)
+#  define HAVE_INOTIFY 1
+# endif
+#endif
+
+#if HAVE_INOTIFY
+# include <sys/inotify.h>
+#endif
+#include <sys/stat.h>
+#include <dirent.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libias/array.h>
+#include <libias/map.h>
+#include <libias/set.h>
+#include <libias/util.h>
+
+#include "portscan/watch.h"
+
+#if HAVE_INOTIFY
+# define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#endif
+
+struct PortscanWatch {
+	int fd;
+	char *portsdir;
+	// Watched directories relative to the ports tree indexed by
+	// watch descriptor
+	struct Array *dirs;
+	struct Set *watched;
+	// origin -> space separated inputs of its last scan
+	struct Map *ports;
+	// input -> origins that include it
+	struct Map *inputs;
+};
+
+static int path_depth(const char *);
+static char *path_normalize(const char *);
+static int watch_classify(struct PortscanWatch *, const char *, uint32_t, struct Set *);
+static void watch_dir(struct PortscanWatch *, const char *, int);
+
+int
+path_depth(const char *path)
+{
+	int depth = 1;
+	for (const char *p = path; *p; p++) {
+		if (*p == '/') {
+			depth++;
+		}
+	}
+	return depth;
+}
+
+// Resolves . and .. components so that include paths like
+// devel/foo/../../Mk/Uses/bar.mk match the path of the event.
+char *
+path_normalize(const char *path)
+{
+	struct Array *components = array_new();
+	char *buf = xstrdup(path);
+	char *s = buf;
+	char *component;
+	while ((component = strsep(&s, "/")) != NULL) {
+		if (*component == 0 || strcmp(component, ".") == 0) {
+			continue;
+		} else if (strcmp(component, "..") == 0) {
+			array_pop(components);
+		} else {
+			array_append(components, component);
+		}
+	}
+	char *retval = str_join(components, "/");
+	array_free(components);
+	free(buf);
+	return retval;
+}
+
+struct PortscanWatch *
+portscan_watch_new(const char *portsdir)
+{
+#if HAVE_INOTIFY
+	int fd = inotify_init1(IN_CLOEXEC);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	struct PortscanWatch *watch = xmalloc(sizeof(struct PortscanWatch));
+	watch->fd = fd;
+	watch->portsdir = xstrdup(portsdir);
+	watch->dirs = array_new();
+	watch->watched = set_new(str_compare, NULL, free);
+	watch->ports = map_new(str_compare, NULL, free, free);
+	watch->inputs = map_new(str_compare, NULL, free, set_free);
+
+	// Mk/ is watched completely, everything else only down to
+	// the port directories.  Other directories are added once a
+	// port includes files from them.
+	watch_dir(watch, "Mk", -1);
+	watch_dir(watch, "", 2);
+
+	return watch;
+#else
+	errno = EOPNOTSUPP;
+	return NULL;
+#endif
+}
+
+void
+portscan_watch_free(struct PortscanWatch *watch)
+{
+	if (watch == NULL) {
+		return;
+	}
+
+	close(watch->fd);
+	free(watch->portsdir);
+	ARRAY_FOREACH(watch->dirs, char *, dir) {
+		free(dir);
+	}
+	array_free(watch->dirs);
+	set_free(watch->watched);
+	map_free(watch->ports);
+	map_free(watch->inputs);
+	free(watch);
+}
+
+void
+watch_dir(struct PortscanWatch *watch, const char *dir, int depth)
+{
+#if HAVE_INOTIFY
+	if (set_contains(watch->watched, dir)) {
+		return;
+	}
+
+	char *path;
+	if (*dir) {
+		path = str_printf("%s/%s", watch->portsdir, dir);
+	} else {
+		path = xstrdup(watch->portsdir);
+	}
+	int wd = inotify_add_watch(watch->fd, path, WATCH_EVENTS | IN_ONLYDIR);
+	if (wd == -1) {
+		if (errno != ENOENT && errno != ENOTDIR) {
+			warn("inotify_add_watch: %s", path);
+		}
+		free(path);
+		return;
+	}
+	while (array_len(watch->dirs) <= (size_t)wd) {
+		array_append(watch->dirs, NULL);
+	}
+	free(array_get(watch->dirs, wd));
+	array_set(watch->dirs, wd, xstrdup(dir));
+	set_add(watch->watched, xstrdup(dir));
+
+	if (depth != 0) {
+		DIR *d = opendir(path);
+		if (d) {
+			struct dirent *dp;
+			while ((dp = readdir(d)) != NULL) {
+				if (dp->d_name[0] == '.') {
+					continue;
+				}
+				struct stat sb;
+				if (fstatat(dirfd(d), dp->d_name, &sb, 0) == -1 ||
+				    !S_ISDIR(sb.st_mode)) {
+					continue;
+				}
+				char *subdir;
+				if (*dir) {
+					subdir = str_printf("%s/%s", dir, dp->d_name);
+				} else {
+					subdir = xstrdup(dp->d_name);
+				}
+				watch_dir(watch, subdir, depth - 1);
+				free(subdir);
+			}
+			closedir(d);
+		}
+	}
+	free(path);
+#endif
+}
+
+void
+portscan_watch_add_port(struct PortscanWatch *watch, const char *origin, const char *inputs)
+{
+	portscan_watch_remove_port(watch, origin);
+
+	struct Array *paths = array_new();
+	char *buf = xstrdup(inputs);
+	char *s = buf;
+	char *input;
+	while ((input = strsep(&s, " ")) != NULL) {
+		if (*input == 0) {
+			continue;
+		}
+		char *path = path_normalize(input);
+		struct Set *origins = map_get(watch->inputs, path);
+		if (origins == NULL) {
+			origins = set_new(str_compare, NULL, free);
+			map_add(watch->inputs, xstrdup(path), origins);
+		}
+		if (!set_contains(origins, origin)) {
+			set_add(origins, xstrdup(origin));
+		}
+		char *dir = xstrdup(path);
+		char *sep = strrchr(dir, '/');
+		if (sep) {
+			*sep = 0;
+			watch_dir(watch, dir, 0);
+		}
+		free(dir);
+		array_append(paths, path);
+	}
+	free(buf);
+
+	map_add(watch->ports, xstrdup(origin), str_join(paths, " "));
+	ARRAY_FOREACH(paths, char *, path) {
+		free(path);
+	}
+	array_free(paths);
+}
+
+void
+portscan_watch_remove_port(struct PortscanWatch *watch, const char *origin)
+{
+	const char *inputs = map_get(watch->ports, origin);
+	if (inputs == NULL) {
+		return;
+	}
+
+	char *buf = xstrdup(inputs);
+	char *s = buf;
+	char *path;
+	while ((path = strsep(&s, " ")) != NULL) {
+		struct Set *origins = map_get(watch->inputs, path);
+		if (origins) {
+			set_remove(origins, origin);
+			if (set_len(origins) == 0) {
+				map_remove(watch->inputs, path);
+			}
+		}
+	}
+	free(buf);
+	map_remove(watch->ports, origin);
+}
+
+int
+watch_classify(struct PortscanWatch *watch, const char *path, uint32_t mask, struct Set *origins)
+{
+#if HAVE_INOTIFY
+	int retval = PORTSCAN_WATCH_NOTHING;
+	int mk = strcmp(path, "Mk") == 0 || str_startswith(path, "Mk/");
+	int depth = path_depth(path);
+
+	if (mask & IN_ISDIR) {
+		if (mask & (IN_CREATE | IN_MOVED_TO)) {
+			if (mk) {
+				watch_dir(watch, path, -1);
+			} else if (depth <= 2) {
+				watch_dir(watch, path, 2 - depth);
+			}
+		}
+		// New or removed category or port directories
+		if (!mk && depth <= 2) {
+			retval |= PORTSCAN_WATCH_CATEGORIES;
+		}
+	}
+
+	if (strcmp(path, "Mk/bsd.options.desc.mk") == 0) {
+		retval |= PORTSCAN_WATCH_ALL;
+	} else if (strcmp(path, "Makefile") == 0 ||
+		   (depth == 2 && !mk && str_endswith(path, "/Makefile"))) {
+		retval |= PORTSCAN_WATCH_CATEGORIES;
+	}
+
+	if (!mk && depth >= 2) {
+		const char *sep = strchr(path, '/');
+		sep = strchr(sep + 1, '/');
+		char *origin;
+		if (sep) {
+			origin = xstrndup(path, sep - path);
+		} else {
+			origin = xstrdup(path);
+		}
+		if (map_contains(watch->ports, origin) && !set_contains(origins, origin)) {
+			set_add(origins, origin);
+			retval |= PORTSCAN_WATCH_PORTS;
+		} else {
+			free(origin);
+		}
+	}
+
+	struct Set *dependents = map_get(watch->inputs, path);
+	if (dependents) {
+		SET_FOREACH(dependents, const char *, origin) {
+			if (!set_contains(origins, origin)) {
+				set_add(origins, xstrdup(origin));
+			}
+			retval |= PORTSCAN_WATCH_PORTS;
+		}
+	}
+
+	return retval;
+#else
+	return PORTSCAN_WATCH_NOTHING;
+#endif
+}
+
+// Blocks until something changed in the ports tree and then collects
+// events until none arrived for debounce milliseconds.  The origins
+// to rescan are added to origins.
+int
+portscan_watch_wait(struct PortscanWatch *watch, int debounce, struct Set *origins)
+{
+#if HAVE_INOTIFY
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	int retval = PORTSCAN_WATCH_NOTHING;
+	for (;;) {
+		struct pollfd pfd = { .fd = watch->fd, .events = POLLIN };
+		int n = poll(&pfd, 1, retval == PORTSCAN_WATCH_NOTHING ? -1 : debounce);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		} else if (n == 0) {
+			return retval;
+		}
+
+		ssize_t len = read(watch->fd, buf, sizeof(buf));
+		if (len == -1) {
+			if (errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
+			return -1;
+		}
+		for (char *p = buf; p < buf + len;) {
+			const struct inotify_event *event = (const struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW) {
+				// Events were lost so we do not know what changed
+				retval |= PORTSCAN_WATCH_ALL | PORTSCAN_WATCH_CATEGORIES;
+				continue;
+			}
+			const char *dir = array_get(watch->dirs, event->wd);
+			if (dir == NULL) {
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				set_remove(watch->watched, dir);
+				free(array_get(watch->dirs, event->wd));
+				array_set(watch->dirs, event->wd, NULL);
+				continue;
+			}
+			if (event->len == 0 || event->name[0] == '.') {
+				continue;
+			}
+			char *path;
+			if (*dir) {
+				path = str_printf("%s/%s", dir, event->name);
+			} else {
+				path = xstrdup(event->name);
+			}
+			retval |= watch_classify(watch, path, event->mask, origins);
+			free(path);
+		}
+	}
+#else
+	errno = EOPNOTSUPP;
+	return -1;
+#endif
+}
@@ -33,11 +33,13 @@
 # include <err.h>
 #endif
 #include <regex.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include <libias/util.h>
 
 #include "regexp.h"
+#include "stats.h"
 
 struct Regexp {
 	int exec;
@@ -144,5 +146,6 @@ regexp_exec(struct Regexp *regexp, const char *buf)
 {
 	regexp->buf = buf;
 	regexp->exec++;
+	STATS_INC(STATS_REGEXEC_CALLS);
 	return regexec(regexp->regex, regexp->buf, regexp->nmatch, regexp->match, 0);
 }
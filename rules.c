@@ -36,18 +36,23 @@
 #endif
 #include <math.h>
 #include <regex.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <libias/array.h>
+#include <libias/map.h>
 #include <libias/set.h>
 #include <libias/util.h>
 
+#include "cache.h"
 #include "conditional.h"
+#include "hashfn.h"
 #include "regexp.h"
 #include "rules.h"
 #include "parser.h"
+#include "stats.h"
 #include "token.h"
 #include "variable.h"
 
@@ -66,9 +71,13 @@ static int is_shebang_lang(struct Parser *, const char *, char **, char **);
 static int is_valid_license(struct Parser *, const char *);
 static int matches_license_name(struct Parser *, const char *);
 static int matches_options_group(struct Parser *, const char *, char **);
+static uint64_t metadata_fingerprint(struct Parser *, unsigned int);
+static const char *options_helper_suffix(struct Parser *, const char *);
+static void *read_metadata(struct Parser *, enum ParserMetadata);
 static char *remove_plist_keyword(const char *);
 static void target_extract_opt(struct Parser *, const char *, char **, char **, int *);
 static int variable_has_flag(struct Parser *, const char *, int);
+static enum BlockType variable_order_block_compute(struct Parser *, const char *, struct Set **);
 
 static struct {
 	const char *pattern;
@@ -1167,6 +1176,12 @@ static struct VariableOrderEntry special_variables_[] = {
 
 static volatile int rules_initialized = 0;
 
+// USES that variable_order_block() checks for
+static struct Set *relevant_uses_ = NULL;
+
+// The metadata the calling thread looked at via read_metadata()
+static _Thread_local unsigned int metadata_reads = 0;
+
 int
 variable_has_flag(struct Parser *parser, const char *var, int flag)
 {
@@ -1279,7 +1294,7 @@ is_valid_license(struct Parser *parser, const char *license)
 		}
 		return i > 0;
 	} else {
-		return set_contains(parser_metadata(parser, PARSER_METADATA_LICENSES), license);
+		return set_contains(read_metadata(parser, PARSER_METADATA_LICENSES), license);
 	}
 }
 
@@ -1689,7 +1704,7 @@ is_flavors_helper(struct Parser *parser, const char *var, char **prefix_ret, cha
 
 	char *prefix = xstrndup(var, len - 1);
 	int found = 0;
-	SET_FOREACH(parser_metadata(parser, PARSER_METADATA_FLAVORS), const char *, flavor) {
+	SET_FOREACH(read_metadata(parser, PARSER_METADATA_FLAVORS), const char *, flavor) {
 		if (strcmp(prefix, flavor) == 0) {
 			found = 1;
 			break;
@@ -1738,7 +1753,7 @@ extract_subpkg(struct Parser *parser, const char *var_, char **subpkg_ret)
 	if (subpkg && !(parser_settings(parser).behavior & PARSER_ALLOW_FUZZY_MATCHING)) {
 		int found = 0;
 #if PORTFMT_SUBPACKAGES
-		struct Set *subpkgs = parser_metadata(parser, PARSER_METADATA_SUBPACKAGES);
+		struct Set *subpkgs = read_metadata(parser, PARSER_METADATA_SUBPACKAGES);
 		SET_FOREACH (subpkgs, const char *, pkg) {
 			if (strcmp(subpkg, pkg) == 0) {
 				found = 1;
@@ -1766,6 +1781,45 @@ extract_subpkg(struct Parser *parser, const char *var_, char **subpkg_ret)
 	return var;
 }
 
+// Looking for the helper a variable name ends with is the most
+// expensive part of is_options_helper().  It only depends on the name
+// so the result is shared between parsers when they have a cache.
+const char *
+options_helper_suffix(struct Parser *parser, const char *var)
+{
+	struct Cache *cache = parser_settings(parser).cache;
+	char *key = NULL;
+	int index;
+	if (cache) {
+		key = str_printf("helper %s", var);
+		if (cache_get(cache, key, &index)) {
+			free(key);
+			return index < 0 ? NULL : variable_order_[index].var;
+		}
+	}
+
+	index = -1;
+	for (size_t i = 0; i < nitems(variable_order_); i++) {
+		if (variable_order_[i].block != BLOCK_OPTHELPER) {
+			continue;
+		}
+		const char *helper = variable_order_[i].var;
+		if (str_endswith(var, helper) &&
+		    strlen(var) > strlen(helper) &&
+		    var[strlen(var) - strlen(helper) - 1] == '_') {
+			index = i;
+			break;
+		}
+	}
+
+	if (key) {
+		cache_put(cache, key, index);
+		free(key);
+	}
+
+	return index < 0 ? NULL : variable_order_[index].var;
+}
+
 int
 is_options_helper(struct Parser *parser, const char *var_, char **prefix_ret, char **helper_ret, char **subpkg_ret)
 {
@@ -1779,18 +1833,7 @@ is_options_helper(struct Parser *parser, const char *var_, char **prefix_ret, ch
 	if (str_endswith(var, "DESC")) {
 		suffix = "DESC";
 	} else {
-		for (size_t i = 0; i < nitems(variable_order_); i++) {
-			if (variable_order_[i].block != BLOCK_OPTHELPER) {
-				continue;
-			}
-			const char *helper = variable_order_[i].var;
-			if (str_endswith(var, helper) &&
-			    strlen(var) > strlen(helper) &&
-			    var[strlen(var) - strlen(helper) - 1] == '_') {
-				suffix = helper;
-				break;
-			}
-		}
+		suffix = options_helper_suffix(parser, var);
 	}
 	if (suffix == NULL) {
 		free(subpkg);
@@ -1845,8 +1888,8 @@ is_options_helper(struct Parser *parser, const char *var_, char **prefix_ret, ch
 	}
 
 	char *prefix = xstrndup(var, len - 1);
-	struct Set *groups = parser_metadata(parser, PARSER_METADATA_OPTION_GROUPS);
-	struct Set *options = parser_metadata(parser, PARSER_METADATA_OPTIONS);
+	struct Set *groups = read_metadata(parser, PARSER_METADATA_OPTION_GROUPS);
+	struct Set *options = read_metadata(parser, PARSER_METADATA_OPTIONS);
 	if (strcmp(suffix, "DESC") == 0) {
 		SET_FOREACH (groups, const char *, group) {
 			if (strcmp(prefix, group) == 0) {
@@ -1935,7 +1978,7 @@ matches_options_group(struct Parser *parser, const char *s, char **prefix)
 		}
 		return 1;
 	} else {
-		struct Set *groups = parser_metadata(parser, PARSER_METADATA_OPTION_GROUPS);
+		struct Set *groups = read_metadata(parser, PARSER_METADATA_OPTION_GROUPS);
 		// XXX: This could be stricter by checking the group type too
 		SET_FOREACH (groups, const char *, group) {
 			if (strcmp(s + i, group) == 0) {
@@ -1985,11 +2028,11 @@ is_cabal_datadir_vars(struct Parser *parser, const char *var, char **prefix, cha
 	}
 
 	// Do we have USES=cabal?
-	if (!set_contains(parser_metadata(parser, PARSER_METADATA_USES), "cabal")) {
+	if (!set_contains(read_metadata(parser, PARSER_METADATA_USES), "cabal")) {
 		return 0;
 	}
 
-	SET_FOREACH (parser_metadata(parser, PARSER_METADATA_CABAL_EXECUTABLES), const char *, exe) {
+	SET_FOREACH (read_metadata(parser, PARSER_METADATA_CABAL_EXECUTABLES), const char *, exe) {
 		if (is_cabal_datadir_vars_helper(var, exe, prefix, suffix)) {
 			return 1;
 		}
@@ -2055,7 +2098,7 @@ is_shebang_lang(struct Parser *parser, const char *var, char **prefix, char **su
 	}
 
 	// Do we have USES=shebangfix?
-	if (!set_contains(parser_metadata(parser, PARSER_METADATA_USES), "shebangfix")) {
+	if (!set_contains(read_metadata(parser, PARSER_METADATA_USES), "shebangfix")) {
 		return 0;
 	}
 
@@ -2067,7 +2110,7 @@ is_shebang_lang(struct Parser *parser, const char *var, char **prefix, char **su
 	}
 
 	int ok = 0;
-	SET_FOREACH (parser_metadata(parser, PARSER_METADATA_SHEBANG_LANGS), const char *, lang) {
+	SET_FOREACH (read_metadata(parser, PARSER_METADATA_SHEBANG_LANGS), const char *, lang) {
 		if (is_shebang_lang_helper(var, lang, prefix, suffix)) {
 			ok = 1;
 			break;
@@ -2077,13 +2120,102 @@ is_shebang_lang(struct Parser *parser, const char *var, char **prefix, char **su
 	return ok;
 }
 
+void *
+read_metadata(struct Parser *parser, enum ParserMetadata meta)
+{
+	metadata_reads |= 1U << meta;
+	return parser_metadata(parser, meta);
+}
+
+// Identifies the metadata in READS.  Of MASTERDIR only its presence
+// and of USES only what variable_order_block() checks for matters.
+uint64_t
+metadata_fingerprint(struct Parser *parser, unsigned int reads)
+{
+	uint64_t h = HASH_INIT;
+	int fuzzy = !!(parser_settings(parser).behavior & PARSER_ALLOW_FUZZY_MATCHING);
+	h = hash_bytes(h, &fuzzy, sizeof(fuzzy));
+	h = hash_bytes(h, &reads, sizeof(reads));
+	for (enum ParserMetadata meta = 0; meta <= PARSER_METADATA_USES; meta++) {
+		if (!(reads & (1U << meta))) {
+			continue;
+		}
+		switch (meta) {
+		case PARSER_METADATA_MASTERDIR: {
+			int masterdir = parser_metadata(parser, meta) != NULL;
+			h = hash_bytes(h, &masterdir, sizeof(masterdir));
+			break;
+		} case PARSER_METADATA_OPTION_DESCRIPTIONS:
+			MAP_FOREACH(parser_metadata(parser, meta), const char *, key, const char *, value) {
+				h = hash_bytes(h, key, strlen(key) + 1);
+				h = hash_bytes(h, value, strlen(value) + 1);
+			}
+			break;
+		case PARSER_METADATA_USES:
+			SET_FOREACH(parser_metadata(parser, meta), const char *, uses) {
+				if (set_contains(relevant_uses_, uses)) {
+					h = hash_bytes(h, uses, strlen(uses) + 1);
+				}
+			}
+			break;
+		default:
+			SET_FOREACH(parser_metadata(parser, meta), const char *, value) {
+				h = hash_bytes(h, value, strlen(value) + 1);
+			}
+			break;
+		}
+		// Keep the same values in different sets apart
+		h = hash_bytes(h, &meta, sizeof(meta));
+	}
+	return h;
+}
+
 enum BlockType
 variable_order_block(struct Parser *parser, const char *var, struct Set **uses_candidates)
 {
+	STATS_INC(STATS_VARIABLE_ORDER_BLOCK_CALLS);
 	if (uses_candidates) {
 		*uses_candidates = NULL;
 	}
 
+	// The USES candidates are not cached, so only look up plain
+	// calls.
+	struct Cache *cache = parser_settings(parser).cache;
+	if (cache == NULL || uses_candidates) {
+		return variable_order_block_compute(parser, var, uses_candidates);
+	}
+
+	// Besides the name the result only depends on the metadata that
+	// was looked at to get it.  Remember which metadata that was for
+	// every name and share results between all ports that agree on it.
+	char *readskey = str_printf("reads %s", var);
+	int reads = 0;
+	int block;
+	if (cache_get(cache, readskey, &reads)) {
+		char *key = str_printf("block %016llx %s", (unsigned long long)metadata_fingerprint(parser, reads), var);
+		int found = cache_get(cache, key, &block);
+		free(key);
+		if (found) {
+			free(readskey);
+			return block;
+		}
+	}
+
+	metadata_reads = 0;
+	block = variable_order_block_compute(parser, var, NULL);
+	reads |= metadata_reads;
+	cache_put(cache, readskey, reads);
+	free(readskey);
+	char *key = str_printf("block %016llx %s", (unsigned long long)metadata_fingerprint(parser, reads), var);
+	cache_put(cache, key, block);
+	free(key);
+
+	return block;
+}
+
+enum BlockType
+variable_order_block_compute(struct Parser *parser, const char *var, struct Set **uses_candidates)
+{
 	if (strcmp(var, "LICENSE") == 0) {
 		return BLOCK_LICENSE;
 	}
@@ -2154,8 +2286,8 @@ variable_order_block(struct Parser *parser, const char *var, struct Set **uses_c
 			// down in the master Makefile we would
 			// get many false positives otherwise.
 			if (!(parser_settings(parser).behavior & PARSER_ALLOW_FUZZY_MATCHING) &&
-			    !parser_metadata(parser, PARSER_METADATA_MASTERDIR)) {
-				struct Set *uses = parser_metadata(parser, PARSER_METADATA_USES);
+			    !read_metadata(parser, PARSER_METADATA_MASTERDIR)) {
+				struct Set *uses = read_metadata(parser, PARSER_METADATA_USES);
 				for (; variable_order_[i].uses[count] && count < nitems(variable_order_[i].uses); count++);
 				if (count > 0) {
 					satisfies_uses = 0;
@@ -2300,7 +2432,7 @@ compare_order(const void *ap, const void *bp, void *userdata)
 				}
 			}
 			size_t i = 0;
-			SET_FOREACH (parser_metadata(parser, PARSER_METADATA_SHEBANG_LANGS), const char *, lang) {
+			SET_FOREACH (read_metadata(parser, PARSER_METADATA_SHEBANG_LANGS), const char *, lang) {
 				if (strcmp(alang, lang) == 0) {
 					ascore = i;
 				}
@@ -2355,7 +2487,7 @@ compare_order(const void *ap, const void *bp, void *userdata)
 			ssize_t ascore = -1;
 			ssize_t bscore = -1;
 			size_t i = 0;
-			SET_FOREACH (parser_metadata(parser, PARSER_METADATA_CABAL_EXECUTABLES), const char *, exe) {
+			SET_FOREACH (read_metadata(parser, PARSER_METADATA_CABAL_EXECUTABLES), const char *, exe) {
 				if (strcmp(aexe, exe) == 0) {
 					ascore = i;
 				}
@@ -2802,6 +2934,7 @@ regex(enum RegularExpression re)
 int
 matches(enum RegularExpression re, const char *s)
 {
+	STATS_INC(STATS_REGEXEC_CALLS);
 	return regexec(&regular_expressions[re].re, s, 0, NULL, 0) == 0;
 }
 
@@ -2816,6 +2949,7 @@ sub(enum RegularExpression re, const char *replacement, const char *s)
 	buf[0] = 0;
 
 	regmatch_t pmatch[1];
+	STATS_INC(STATS_REGEXEC_CALLS);
 	if (regexec(&regular_expressions[re].re, s, 1, pmatch, 0) == 0) {
 		strncpy(buf, s, pmatch[0].rm_so);
 		xstrlcat(buf, replacement, len);
@@ -2848,5 +2982,14 @@ rules_init()
 		}
 	}
 
+	relevant_uses_ = set_new(str_compare, NULL, NULL);
+	set_add(relevant_uses_, "cabal");
+	set_add(relevant_uses_, "shebangfix");
+	for (size_t i = 0; i < nitems(variable_order_); i++) {
+		for (size_t j = 0; j < nitems(variable_order_[i].uses) && variable_order_[i].uses[j]; j++) {
+			set_add(relevant_uses_, variable_order_[i].uses[j]);
+		}
+	}
+
 	rules_initialized = 1;
 }
@@ -0,0 +1,162 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libias/util.h>
+
+#include "allocator.h"
+#include "stats.h"
+
+// Every thread gets its own set of counters so that portscan workers
+// do not fight over the same cache lines.  They are registered in a
+// global list once and summed up by stats_print().
+struct StatsThread {
+	atomic_size_t counters[STATS__N];
+	struct StatsThread *next;
+};
+
+static const char *counter_names[STATS__N] = {
+	[STATS_TOKENS_COMMENT] = "comment",
+	[STATS_TOKENS_CONDITIONAL_END] = "conditional_end",
+	[STATS_TOKENS_CONDITIONAL_TOKEN] = "conditional_token",
+	[STATS_TOKENS_CONDITIONAL_START] = "conditional_start",
+	[STATS_TOKENS_TARGET_COMMAND_END] = "target_command_end",
+	[STATS_TOKENS_TARGET_COMMAND_START] = "target_command_start",
+	[STATS_TOKENS_TARGET_COMMAND_TOKEN] = "target_command_token",
+	[STATS_TOKENS_TARGET_END] = "target_end",
+	[STATS_TOKENS_TARGET_START] = "target_start",
+	[STATS_TOKENS_VARIABLE_END] = "variable_end",
+	[STATS_TOKENS_VARIABLE_START] = "variable_start",
+	[STATS_TOKENS_VARIABLE_TOKEN] = "variable_token",
+	[STATS_BYTES_READ] = "bytes_read",
+	[STATS_BYTES_WRITTEN] = "bytes_written",
+	[STATS_CACHE_HITS] = "cache_hits",
+	[STATS_CACHE_MISSES] = "cache_misses",
+	[STATS_EDIT_PASSES] = "edit_passes",
+	[STATS_FORMAT_CACHE_HITS] = "format_cache_hits",
+	[STATS_FORMAT_CACHE_MISSES] = "format_cache_misses",
+	[STATS_LOOKUP_VARIABLE_CALLS] = "lookup_variable_calls",
+	[STATS_LOOKUP_VARIABLE_TOKENS_SCANNED] = "lookup_variable_tokens_scanned",
+	[STATS_METADATA_INVALIDATIONS] = "metadata_invalidations",
+	[STATS_OUTPUT_FRAGMENTS] = "output_fragments",
+	[STATS_REGEXEC_CALLS] = "regexec_calls",
+	[STATS_TOKEN_CACHE_HITS] = "token_cache_hits",
+	[STATS_TOKEN_CACHE_MISSES] = "token_cache_misses",
+	[STATS_VARIABLE_ORDER_BLOCK_CALLS] = "variable_order_block_calls",
+};
+
+int stats_enabled = 0;
+static int allocations_enabled = 0;
+static _Thread_local struct StatsThread *thread_stats = NULL;
+static _Atomic(struct StatsThread *) threads = NULL;
+
+void
+stats_add(enum StatsCounter counter, size_t n)
+{
+	struct StatsThread *stats = thread_stats;
+	if (stats == NULL) {
+		stats = xmalloc(sizeof(struct StatsThread));
+		stats->next = atomic_load(&threads);
+		while (!atomic_compare_exchange_weak(&threads, &stats->next, stats));
+		thread_stats = stats;
+	}
+	atomic_fetch_add_explicit(&stats->counters[counter], n, memory_order_relaxed);
+}
+
+void
+stats_enable()
+{
+	stats_enabled = 1;
+}
+
+// The counting allocator puts a header in front of every allocation,
+// so it is only installed on request instead of with every
+// stats_enable().  Like any allocator it has to be set up before the
+// first allocation.
+void
+stats_enable_allocations()
+{
+	stats_enable();
+	allocations_enabled = 1;
+	allocator_set(allocator_counting());
+}
+
+// Releases the counters of all threads.  Workers keep theirs
+// registered after they exit so that stats_print() can still sum
+// them up, so this must only be called once they are all done.
+void
+stats_free()
+{
+	struct StatsThread *stats = atomic_exchange(&threads, NULL);
+	while (stats) {
+		struct StatsThread *next = stats->next;
+		free(stats);
+		stats = next;
+	}
+	thread_stats = NULL;
+}
+
+void
+stats_print(FILE *fp)
+{
+	size_t counters[STATS__N] = {};
+	size_t nthreads = 0;
+	for (struct StatsThread *stats = atomic_load(&threads); stats; stats = stats->next) {
+		for (size_t i = 0; i < STATS__N; i++) {
+			counters[i] += atomic_load_explicit(&stats->counters[i], memory_order_relaxed);
+		}
+		nthreads++;
+	}
+
+	fprintf(fp, "{\n  \"threads\": %zu,\n  \"tokens_created\": {", nthreads);
+	for (size_t i = STATS_TOKENS_COMMENT; i <= STATS_TOKENS_VARIABLE_TOKEN; i++) {
+		fprintf(fp, "%s\n    \"%s\": %zu", i == STATS_TOKENS_COMMENT ? "" : ",",
+			counter_names[i], counters[i]);
+	}
+	fprintf(fp, "\n  }");
+	for (size_t i = STATS_TOKENS_VARIABLE_TOKEN + 1; i < STATS__N; i++) {
+		fprintf(fp, ",\n  \"%s\": %zu", counter_names[i], counters[i]);
+	}
+	if (allocations_enabled) {
+		fprintf(fp, ",\n  \"allocations\": {");
+		for (enum AllocatorSubsystem i = ALLOCATOR_TOKENS; i < ALLOCATOR__N; i++) {
+			struct AllocatorStats alloc;
+			allocator_stats(i, &alloc);
+			fprintf(fp, "%s\n    \"%s\": { \"allocations\": %zu, \"bytes\": %zu, \"peak_bytes\": %zu }",
+				i == ALLOCATOR_TOKENS ? "" : ",", allocator_subsystem_tostring(i),
+				alloc.allocations, alloc.bytes, alloc.peak_bytes);
+		}
+		fprintf(fp, "\n  }");
+	}
+	fprintf(fp, "\n}\n");
+}
@@ -0,0 +1,79 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+enum StatsCounter {
+	// Tokens created, in the same order as enum TokenType
+	STATS_TOKENS_COMMENT,
+	STATS_TOKENS_CONDITIONAL_END,
+	STATS_TOKENS_CONDITIONAL_TOKEN,
+	STATS_TOKENS_CONDITIONAL_START,
+	STATS_TOKENS_TARGET_COMMAND_END,
+	STATS_TOKENS_TARGET_COMMAND_START,
+	STATS_TOKENS_TARGET_COMMAND_TOKEN,
+	STATS_TOKENS_TARGET_END,
+	STATS_TOKENS_TARGET_START,
+	STATS_TOKENS_VARIABLE_END,
+	STATS_TOKENS_VARIABLE_START,
+	STATS_TOKENS_VARIABLE_TOKEN,
+	STATS_BYTES_READ,
+	STATS_BYTES_WRITTEN,
+	STATS_CACHE_HITS,
+	STATS_CACHE_MISSES,
+	STATS_EDIT_PASSES,
+	STATS_FORMAT_CACHE_HITS,
+	STATS_FORMAT_CACHE_MISSES,
+	STATS_LOOKUP_VARIABLE_CALLS,
+	STATS_LOOKUP_VARIABLE_TOKENS_SCANNED,
+	STATS_METADATA_INVALIDATIONS,
+	STATS_OUTPUT_FRAGMENTS,
+	STATS_REGEXEC_CALLS,
+	STATS_TOKEN_CACHE_HITS,
+	STATS_TOKEN_CACHE_MISSES,
+	STATS_VARIABLE_ORDER_BLOCK_CALLS,
+	STATS__N,
+};
+
+// Counting is off unless stats_enable() was called.  Check the flag
+// inline so that disabled counters cost no more than a branch.
+#define STATS_ADD(counter, n) do { \
+	if (stats_enabled) { \
+		stats_add((counter), (n)); \
+	} \
+} while (0)
+#define STATS_INC(counter) STATS_ADD(counter, 1)
+#define STATS_TOKEN(type) STATS_INC(STATS_TOKENS_COMMENT + (type))
+
+extern int stats_enabled;
+
+void stats_add(enum StatsCounter, size_t);
+void stats_enable(void);
+void stats_enable_allocations(void);
+void stats_free(void);
+void stats_print(FILE *);
@@ -205,6 +205,22 @@ target_free(struct Target *target)
 	free(target);
 }
 
+size_t
+target_memory_usage(struct Target *target)
+{
+	size_t bytes = sizeof(struct Target);
+	struct Array *arrays[] = { target->names, target->deps };
+	for (size_t i = 0; i < nitems(arrays); i++) {
+		ARRAY_FOREACH(arrays[i], const char *, s) {
+			bytes += sizeof(char *) + strlen(s) + 1;
+		}
+	}
+	if (target->comment) {
+		bytes += strlen(target->comment) + 1;
+	}
+	return bytes;
+}
+
 const char *
 target_comment(struct Target *target)
 {
@@ -33,6 +33,7 @@ struct Target;
 struct Target *target_new(char *);
 struct Target *target_clone(struct Target *);
 void target_free(struct Target *);
+size_t target_memory_usage(struct Target *);
 const char *target_comment(struct Target *);
 struct Array *target_dependencies(struct Target *);
 struct Array *target_names(struct Target *);
@@ -0,0 +1 @@
+${PORTEDIT} get -x '^(DEFAULT|PKGNAMESUFFIX|PLIST_SUB|WRKSRC)$' 4.in | diff -L 4.expected -L 4.actual -u 4.expected -
@@ -0,0 +1,8 @@
+# Values that depend on the framework cannot be expanded.  Exit
+# status should be non-zero.
+if printf 'WRKSRC=\t${WRKDIR}/foo\n' | ${PORTEDIT} get -x '^WRKSRC$'; then
+	echo "status: $? expected: 1"
+	exit 1
+else
+	echo "error ok"
+fi
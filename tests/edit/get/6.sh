@@ -0,0 +1,8 @@
+# Branches that cannot be decided for the configuration are kept
+{
+	${PORTEDIT} get -c ARCH=armv7 -o DOCS '(DEPENDS|CFLAGS)$' 6.in
+	echo --
+	${PORTEDIT} get -c ARCH=i386 -c OSVERSION=1203000 '(DEPENDS|CFLAGS)$' 6.in
+	echo --
+	${PORTEDIT} get -c ARCH=amd64 -c WITH_DEBUG= -o DOCS -o X11 'DEPENDS$' 6.in
+} | diff -L 6.expected -L 6.actual -u 6.expected -
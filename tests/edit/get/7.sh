@@ -0,0 +1,11 @@
+# The empty variable is never defined so ${:U...} expands to a
+# literal.  A variable that is appended to, conditionally assigned,
+# or references itself before the Makefile assigns it might be set
+# outside of it and cannot be expanded.
+${PORTEDIT} get -x '^(LITERAL|UNDEFINED)$' 7.in | diff -L 7.expected -L 7.actual -u 7.expected -
+for var in CFLAGS PLIST_SUB SELF; do
+	if ${PORTEDIT} get -x "^${var}\$" 7.in 2>/dev/null; then
+		echo "${var}: status: 0 expected: 1"
+		exit 1
+	fi
+done
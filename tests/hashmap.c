@@ -0,0 +1,176 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+
+#include <libias/array.h>
+#include <libias/map.h>
+#include <libias/util.h>
+
+#include "hashmap.h"
+#include "hashset.h"
+
+#define CHECK(x) \
+	do { \
+		if (!(x)) { \
+			errx(1, "%s:%d: %s", __FILE__, __LINE__, #x); \
+		} \
+	} while (0)
+
+static void check_keys(struct HashMap *, const char *);
+static size_t key_hash(const void *, void *);
+
+// Keys are named after the hash they get so that tests can place them
+// in the table: "k15" lands in slot 15 of a 16 slot table.
+size_t
+key_hash(const void *key, void *userdata)
+{
+	return strtoul((const char *)key + 1, NULL, 10);
+}
+
+// Compares the keys in table order to the space separated list
+void
+check_keys(struct HashMap *map, const char *expected)
+{
+	struct Array *keys = hashmap_keys(map);
+	char *s = str_join(keys, " ");
+	if (strcmp(s, expected) != 0) {
+		errx(1, "keys: expected '%s' got '%s'", expected, s);
+	}
+	free(s);
+	array_free(keys);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct HashMap *map = hashmap_new(key_hash, str_compare, NULL, NULL, NULL);
+
+	// Removing an entry shifts back the rest of its probe sequence
+	// even when it wraps around the end of the table.
+	hashmap_add(map, "k15", "a");
+	hashmap_add(map, "k31", "b");
+	hashmap_add(map, "k47", "c");
+	hashmap_add(map, "k16", "d");
+	hashmap_add(map, "k2", "e");
+	check_keys(map, "k31 k47 k16 k2 k15");
+	hashmap_remove(map, "k15");
+	check_keys(map, "k47 k16 k2 k31");
+	CHECK(hashmap_len(map) == 4);
+	CHECK(!hashmap_contains(map, "k15"));
+	CHECK(strcmp(hashmap_get(map, "k31"), "b") == 0);
+	CHECK(strcmp(hashmap_get(map, "k47"), "c") == 0);
+	CHECK(strcmp(hashmap_get(map, "k16"), "d") == 0);
+	CHECK(strcmp(hashmap_get(map, "k2"), "e") == 0);
+	hashmap_remove(map, "k31");
+	check_keys(map, "k16 k2 k47");
+	hashmap_remove(map, "k16");
+	check_keys(map, "k2 k47");
+	hashmap_remove(map, "k47");
+	hashmap_remove(map, "k2");
+	CHECK(hashmap_len(map) == 0);
+	check_keys(map, "");
+
+	// The table doubles once it would be more than 3/4 full.  k16
+	// shares slot 0 with k0 in 16 slots but not in 32.
+	const char *keys[] = { "k16", "k1", "k2", "k3", "k4", "k5", "k6", "k7", "k8", "k9", "k10", "k11", "k12" };
+	for (size_t i = 0; i < 12; i++) {
+		hashmap_add(map, keys[i], keys[i]);
+	}
+	check_keys(map, "k16 k1 k2 k3 k4 k5 k6 k7 k8 k9 k10 k11");
+	hashmap_add(map, keys[12], keys[12]);
+	check_keys(map, "k1 k2 k3 k4 k5 k6 k7 k8 k9 k10 k11 k12 k16");
+	CHECK(hashmap_len(map) == 13);
+	for (size_t i = 0; i < nitems(keys); i++) {
+		CHECK(hashmap_get(map, keys[i]) == keys[i]);
+	}
+
+	// Adding an existing key keeps the old entry
+	hashmap_add(map, "k1", "other");
+	CHECK(hashmap_len(map) == 13);
+	CHECK(hashmap_get(map, "k1") == keys[1]);
+
+	// Truncating releases the large table, so the map starts over
+	// with 16 slots where k16 and k0 collide again.
+	hashmap_truncate(map);
+	CHECK(hashmap_len(map) == 0);
+	check_keys(map, "");
+	CHECK(!hashmap_contains(map, "k16"));
+	hashmap_add(map, "k16", "a");
+	hashmap_add(map, "k0", "b");
+	check_keys(map, "k16 k0");
+	hashmap_truncate(map);
+	hashmap_add(map, "k0", "b");
+	check_keys(map, "k0");
+	hashmap_free(map);
+
+	// Sorted keys are in the same order as the ones of a struct Map
+	map = hashmap_new(hashmap_str_hash, str_compare, NULL, free, NULL);
+	struct Map *sorted = map_new(str_compare, NULL, free, NULL);
+	struct HashSet *set = hashset_new(hashmap_str_hash, str_compare, NULL, free);
+	for (size_t i = 0; i < 1000; i++) {
+		char *key = str_printf("%zu", (i * 7919) % 1000);
+		hashmap_add(map, key, NULL);
+		map_add(sorted, xstrdup(key), NULL);
+		hashset_add(set, xstrdup(key));
+		if (i % 3 == 0) {
+			char *removed = str_printf("%zu", (i * 7) % 1000);
+			hashmap_remove(map, removed);
+			map_remove(sorted, removed);
+			hashset_remove(set, removed);
+			free(removed);
+		}
+	}
+	struct Array *hashkeys = hashmap_sorted_keys(map);
+	struct Array *setvalues = hashset_sorted_values(set);
+	struct Array *mapkeys = map_keys(sorted);
+	CHECK(array_len(hashkeys) == array_len(mapkeys));
+	CHECK(array_len(setvalues) == array_len(mapkeys));
+	ARRAY_FOREACH(mapkeys, const char *, key) {
+		CHECK(strcmp(array_get(hashkeys, key_index), key) == 0);
+		CHECK(strcmp(array_get(setvalues, key_index), key) == 0);
+		CHECK(hashmap_contains(map, key));
+		CHECK(hashset_contains(set, key));
+	}
+	array_free(hashkeys);
+	array_free(setvalues);
+	array_free(mapkeys);
+	hashmap_free(map);
+	hashset_free(set);
+	map_free(sorted);
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_ERR
+# include <err.h>
+#endif
+
+#include <libias/array.h>
+#include <libias/util.h>
+
+#include "parser.h"
+
+#define CHECK(x) \
+	do { \
+		if (!(x)) { \
+			errx(1, "%s:%d: %s", __FILE__, __LINE__, #x); \
+		} \
+	} while (0)
+
+struct Collected {
+	struct Array *values;
+	struct Array *comments;
+};
+
+static void check(struct Parser *, const char *, enum ParserLookupVariableBehavior, const char *, const char *);
+static void collect(struct Parser *, const char *, int, void *);
+static void compare(struct Array *, const char *);
+
+static const char *makefile =
+	"FOO=	a b # first\n"
+	"BAR=	x\n"
+	".if ${OPSYS} == FreeBSD\n"
+	"FOO+=	c\n"
+	".endif\n"
+	"FOO+=	d e # second\n";
+
+void
+collect(struct Parser *parser, const char *data, int comment, void *userdata)
+{
+	struct Collected *collected = userdata;
+	array_append(comment ? collected->comments : collected->values, (char *)data);
+}
+
+void
+compare(struct Array *tokens, const char *expected)
+{
+	char *s = str_join(tokens, "|");
+	if (strcmp(s, expected) != 0) {
+		errx(1, "expected '%s' got '%s'", expected, s);
+	}
+	free(s);
+}
+
+// parser_variable_foreach() has to visit the tokens in the same order
+// parser_lookup_variable() returns them in
+void
+check(struct Parser *parser, const char *name, enum ParserLookupVariableBehavior behavior, const char *values, const char *comments)
+{
+	struct Collected collected = { array_new(), array_new() };
+	struct Variable *var = parser_variable_foreach(parser, name, behavior, collect, &collected);
+	compare(collected.values, values);
+	compare(collected.comments, comments);
+
+	struct Array *lookup_values = NULL;
+	struct Array *lookup_comments = NULL;
+	CHECK(parser_lookup_variable(parser, name, behavior, &lookup_values, &lookup_comments) == var);
+	CHECK(parser_variable_exists(parser, name, behavior) == var);
+	if (var) {
+		compare(lookup_values, values);
+		compare(lookup_comments, comments);
+	} else {
+		CHECK(lookup_values == NULL && lookup_comments == NULL);
+	}
+
+	array_free(lookup_values);
+	array_free(lookup_comments);
+	array_free(collected.values);
+	array_free(collected.comments);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct ParserSettings settings;
+	parser_init_settings(&settings);
+	struct Parser *parser = parser_new(&settings);
+	CHECK(parser_read_from_buffer(parser, makefile, strlen(makefile)) == PARSER_ERROR_OK);
+	CHECK(parser_read_finish(parser) == PARSER_ERROR_OK);
+
+	check(parser, "FOO", PARSER_LOOKUP_DEFAULT, "a|b|c|d|e", "# first|# second");
+	check(parser, "FOO", PARSER_LOOKUP_FIRST, "a|b", "# first");
+	check(parser, "FOO", PARSER_LOOKUP_IGNORE_VARIABLES_IN_CONDITIIONALS, "a|b|d|e", "# first|# second");
+	check(parser, "FOO", PARSER_LOOKUP_FIRST | PARSER_LOOKUP_IGNORE_VARIABLES_IN_CONDITIIONALS, "a|b", "# first");
+	check(parser, "BAR", PARSER_LOOKUP_DEFAULT, "x", "");
+	check(parser, "BAZ", PARSER_LOOKUP_DEFAULT, "", "");
+
+	parser_free(parser);
+
+	return 0;
+}
@@ -0,0 +1,11 @@
+# Token streams loaded from the cache are the same as freshly tokenized ones
+cachedir="$(mktemp -dt portfmt-test.XXXXXXX)"
+for t in 0006 0007; do
+	PORTFMT_CACHE_DIR="${cachedir}" ${PORTFMT} -d ${t}.in | diff -L "${t}.expected" -L "${t}.actual" -u ${t}.expected -
+	PORTFMT_CACHE_DIR="${cachedir}" ${PORTFMT} -d ${t}.in | diff -L "${t}.expected" -L "${t}.actual" -u ${t}.expected -
+	PORTFMT_CACHE_DIR="${cachedir}" ${PORTFMT} --stats -d ${t}.in 2>&1 >/dev/null | grep -q '"token_cache_hits": 1'
+done
+printf 'post-patch:\n\t@true\n' | PORTFMT_CACHE_DIR="${cachedir}" ${PORTFMT} > "${cachedir}/fresh"
+printf 'post-patch:\n\t@true\n' | PORTFMT_CACHE_DIR="${cachedir}" ${PORTFMT} | diff -u "${cachedir}/fresh" -
+printf 'post-patch:\n\t@true\n' | PORTFMT_CACHE_DIR="${cachedir}" ${PORTFMT} --stats 2>&1 >/dev/null | grep -q '"token_cache_hits": 1'
+rm -r "${cachedir}"
@@ -0,0 +1,20 @@
+# Files that are known to be formatted are skipped in check and
+# in-place mode
+cachedir="$(mktemp -dt portfmt-test.XXXXXXX)"
+export PORTFMT_CACHE_DIR="${cachedir}"
+cp ../format/0001.in "${cachedir}/Makefile"
+for i in 1 2; do
+	if ${PORTFMT} -D "${cachedir}/Makefile" >/dev/null; then
+		echo "expected differences" >&2
+		exit 1
+	fi
+done
+${PORTFMT} -i "${cachedir}/Makefile"
+diff -u ../format/0001.expected "${cachedir}/Makefile"
+${PORTFMT} -i "${cachedir}/Makefile"
+${PORTFMT} --stats -D "${cachedir}/Makefile" 2>&1 | grep -q '"format_cache_hits": 1'
+${PORTFMT} --stats -i "${cachedir}/Makefile" 2>&1 | grep -q '"format_cache_hits": 1'
+diff -u ../format/0001.expected "${cachedir}/Makefile"
+# Other settings do not share entries
+${PORTFMT} --stats -D -w 20 "${cachedir}/Makefile" 2>&1 | grep -q '"format_cache_hits": 0'
+rm -r "${cachedir}"
@@ -0,0 +1,46 @@
+# Metadata follows edits that change its dependencies and is only
+# recomputed for the affected keys
+tmpdir="$(mktemp -dt portfmt-test.XXXXXXX)"
+cat >"${tmpdir}/Makefile" <<'MAKEFILE'
+PORTNAME=	foo
+CATEGORIES=	devel
+
+MAINTAINER=	x@y.z
+COMMENT=	Foo
+
+USES=	gmake
+
+OPTIONS_DEFINE=	FOO
+FOO_DESC=	Foo
+
+FOO_CONFIGURE_ON=	--foo
+
+.include <bsd.port.mk>
+MAKEFILE
+cat >"${tmpdir}/expected" <<'MAKEFILE'
+PORTNAME=	foo
+CATEGORIES=	devel
+
+MAINTAINER=	x@y.z
+COMMENT=	Foo
+
+USES=	gmake
+
+OPTIONS_DEFINE=	BAR FOO
+FOO_DESC=	Foo
+
+BAR_VARS=		A=2 \
+			B=1
+FOO_CONFIGURE_ON=	--foo
+
+.include <bsd.port.mk>
+MAKEFILE
+printf 'OPTIONS_DEFINE+=BAR\nBAR_VARS=b=1 a=2\n' | \
+	${PORTEDIT} merge "${tmpdir}/Makefile" | diff -u "${tmpdir}/expected" -
+echo 'COMMENT=Bar' | ${PORTEDIT} --stats merge "${tmpdir}/Makefile" 2>&1 >/dev/null | \
+	grep -q '"metadata_invalidations": 0,'
+echo 'LICENSE=MIT' | ${PORTEDIT} --stats merge "${tmpdir}/Makefile" 2>&1 >/dev/null | \
+	grep -q '"metadata_invalidations": 1,'
+echo 'USES+=python' | ${PORTEDIT} --stats merge "${tmpdir}/Makefile" 2>&1 >/dev/null | \
+	grep -q '"metadata_invalidations": 3,'
+rm -r "${tmpdir}"
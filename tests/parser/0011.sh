@@ -0,0 +1,16 @@
+# Truncated or corrupt token cache entries are misses
+cachedir="$(mktemp -dt portfmt-test.XXXXXXX)"
+export PORTFMT_CACHE_DIR="${cachedir}"
+${PORTFMT} -d 0006.in >/dev/null
+entry="$(ls "${cachedir}")"
+cp "${cachedir}/${entry}" "${cachedir}/full"
+for size in 8 44 48 52 100; do
+	head -c "${size}" "${cachedir}/full" >"${cachedir}/${entry}"
+	${PORTFMT} --stats -d 0006.in 2>"${cachedir}/stats" | diff -L "0006.expected" -L "0006.actual" -u 0006.expected -
+	grep -q '"token_cache_misses": 1' "${cachedir}/stats"
+done
+head -c 36 "${cachedir}/full" >"${cachedir}/${entry}"
+printf '\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377' >>"${cachedir}/${entry}"
+${PORTFMT} --stats -d 0006.in 2>"${cachedir}/stats" | diff -L "0006.expected" -L "0006.actual" -u 0006.expected -
+grep -q '"token_cache_misses": 1' "${cachedir}/stats"
+rm -r "${cachedir}"
@@ -0,0 +1,25 @@
+# -M reports the same keys in the same order for every input and the
+# total is the sum of all bytes
+tmpdir="$(mktemp -dt portfmt-test.XXXXXXX)"
+cat >"${tmpdir}/keys" <<'EOF'
+tokens
+token_data
+variables
+targets
+conditionals
+rawlines
+result
+metadata
+edited
+tokengc
+total
+EOF
+for input in 0006.in 0007.in /dev/null; do
+	${PORTFMT} -M "${input}" 2>"${tmpdir}/usage" >/dev/null
+	sed -n 's/^  "\([a-z_]*\)": .*/\1/p' "${tmpdir}/usage" | diff -u "${tmpdir}/keys" -
+	sed '1d;$d;/"total"/d' "${tmpdir}/usage" | \
+		grep -Evq '^  "[a-z_]+": \{ "count": [0-9]+, "bytes": [0-9]+ \},$' && exit 1
+	sum="$(sed -n 's/.*"bytes": \([0-9]*\).*/\1/p' "${tmpdir}/usage" | awk '{ n += $1 } END { print n }')"
+	grep -q "^  \"total\": ${sum}\$" "${tmpdir}/usage"
+done
+rm -r "${tmpdir}"
@@ -0,0 +1,21 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+${PORTSCAN} -p 0007 --depgraph="${logdir}/depgraph"
+${PORTSCAN} --depgraph="${logdir}/depgraph" --deps=devel/foo-slave > "${logdir}/deps"
+cat <<EOF | diff -u - "${logdir}/deps"
+converters/libiconv	lib
+devel/gmake	uses
+devel/kyua	test
+devel/py-six	build
+textproc/py-sphinx	build
+EOF
+${PORTSCAN} --depgraph="${logdir}/depgraph" --rdeps=devel/foo > "${logdir}/rdeps"
+cat <<EOF | diff -u - "${logdir}/rdeps"
+devel/bar	run
+EOF
+# Unchanged ports are taken from the previous index
+${PORTSCAN} -p 0007 --depgraph="${logdir}/depgraph"
+${PORTSCAN} --depgraph="${logdir}/depgraph" --rdeps=devel/gmake > "${logdir}/rdeps"
+cat <<EOF | diff -u - "${logdir}/rdeps"
+devel/foo	uses
+devel/foo-slave	uses
+EOF
@@ -0,0 +1,23 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+${PORTSCAN} -p 0007 --varindex="${logdir}/varindex"
+${PORTSCAN} --varindex="${logdir}/varindex" --lookup='^(PORTNAME|MASTERDIR)$' > "${logdir}/lookup"
+cat <<EOF | diff -u - "${logdir}/lookup"
+devel/foo-slave:5	MASTERDIR	\${.CURDIR}/../foo
+devel/bar:1	PORTNAME	bar
+devel/foo:1	PORTNAME	foo
+EOF
+${PORTSCAN} --varindex="${logdir}/varindex" --lookup='DEPENDS$' -q 'py-' > "${logdir}/lookup"
+cat <<EOF | diff -u - "${logdir}/lookup"
+devel/foo:15	DOCS_BUILD_DEPENDS	sphinx-build:textproc/py-sphinx
+devel/foo:10	PY_DEPENDS	\${PYTHON_PKGNAMEPREFIX}six>0:devel/py-six@\${PY_FLAVOR}
+EOF
+# Unchanged ports are taken from the previous index
+${PORTSCAN} -p 0007 --varindex="${logdir}/varindex" devel/bar
+${PORTSCAN} --varindex="${logdir}/varindex" --lookup='^PORTNAME$' > "${logdir}/lookup"
+cat <<EOF | diff -u - "${logdir}/lookup"
+devel/bar:1	PORTNAME	bar
+devel/foo:1	PORTNAME	foo
+EOF
+if ${PORTSCAN} --varindex="${logdir}/varindex" --lookup='^NOPE$'; then
+	exit 1
+fi
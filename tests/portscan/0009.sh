@@ -0,0 +1,11 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+${PORTSCAN} -p 0005 --format=ndjson-ordered > "${logdir}/out"
+cat <<EOF | diff -u - "${logdir}/out"
+{"origin":"archivers","unsorted_categories":["unsorted category or other formatting issues"]}
+{"origin":"archivers/foo","nonexistent_ports":["entry without existing directory"]}
+{"origin":"archivers/foo","errors":["fileopenat: No such file or directory"]}
+EOF
+${PORTSCAN} -p 0007 --unknown-variables --options --format=ndjson > "${logdir}/out"
+cat <<EOF | diff -u - "${logdir}/out"
+{"origin":"devel/foo","unknown_variables":["PY_DEPENDS"],"options":["DOCS"]}
+EOF
@@ -0,0 +1,10 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+${PORTSCAN} -p 0007 --all > "${logdir}/expected"
+${PORTSCAN} -p 0007 --all --shard=1/2 > "${logdir}/shard1"
+${PORTSCAN} -p 0007 --all --shard=2/2 > "${logdir}/shard2"
+# Category results are only in the first shard
+grep -q '^C ' "${logdir}/shard1"
+if grep -q '^C ' "${logdir}/shard2"; then
+	exit 1
+fi
+${PORTSCAN} merge "${logdir}/shard2" "${logdir}/shard1" | diff -u "${logdir}/expected" -
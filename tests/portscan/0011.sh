@@ -0,0 +1,4 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+${PORTSCAN} -p 0007 --status-file="${logdir}/status.json" >/dev/null
+# The final status keeps the totals of the last phase
+grep -q '^{"state":"finished","scanned":3,"total":3,.*"workers":\[\]}$' "${logdir}/status.json"
@@ -0,0 +1,10 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+# devel/a and devel/b only differ in their USES and options, so
+# cached variable blocks must not be shared between them
+${PORTSCAN} -p 0012 --unknown-variables > "${logdir}/out"
+cat <<EOF | diff -u - "${logdir}/out"
+V       devel/a                                  BAR_CONFIGURE_ON
+V       devel/b                                  CARGO_CRATES
+V       devel/b                                  FOO_CONFIGURE_ON
+EOF
+${PORTSCAN} -p 0012 --unknown-variables devel/b devel/a | diff -u "${logdir}/out" -
@@ -0,0 +1,14 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+${PORTSCAN} -p 0007 --profile=2 2>"${logdir}/profile" >/dev/null
+head -1 "${logdir}/profile" | grep -Eq '^worker +phase +count +wall ms +cpu ms$'
+for phase in categories bsd.options.desc.mk result; do
+	grep -Eq "^total +${phase} +1 " "${logdir}/profile"
+done
+# Every port goes through the same phases once
+for phase in open read includes read-finish unknown-variables clones; do
+	grep -Eq "^total +${phase} +3 " "${logdir}/profile"
+done
+# Only the two slowest origins are listed
+sed -n '/^slowest origins/,$p' "${logdir}/profile" > "${logdir}/slowest"
+[ "$(wc -l < "${logdir}/slowest")" -eq 3 ]
+grep -Eq '^devel/(foo|bar|foo-slave) ' "${logdir}/slowest"
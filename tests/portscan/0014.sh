@@ -0,0 +1,24 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+${PORTSCAN} -p 0007 --trace="${logdir}/trace.json" >/dev/null
+trace="${logdir}/trace.json"
+# One event per line, so check the JSON structure line by line
+[ "$(head -1 "${trace}")" = '{"traceEvents":[' ]
+[ "$(tail -1 "${trace}")" = ']}' ]
+sed '1d;$d' "${trace}" > "${logdir}/events"
+sed '$d' "${logdir}/events" > "${logdir}/head"
+grep -Evq ',$' "${logdir}/head" && exit 1
+case "$(tail -1 "${logdir}/events")" in
+*,) exit 1 ;;
+esac
+meta='\{"name":"thread_name","ph":"M","pid":1,"tid":[0-9]+,"args":\{"name":"[^"\\]*"\}\}'
+event='\{"name":"[^"\\]*","cat":"portscan","ph":"X","pid":1,"tid":[0-9]+,"ts":[0-9]+\.[0-9]{3},"dur":[0-9]+\.[0-9]{3}(,"args":\{"origin":"[^"\\]*"\})?\}'
+grep -Evq "^(${meta}|${event}),?\$" "${logdir}/events" && exit 1
+# Every worker thread is named exactly once
+grep -Eo '"tid":[0-9]+,"args":\{"name":"[^"]*"' "${logdir}/events" | sed 's/,"args":{"name":/ /' > "${logdir}/threads"
+[ -z "$(cut -d' ' -f1 "${logdir}/threads" | sort | uniq -d)" ]
+[ -z "$(cut -d' ' -f2 "${logdir}/threads" | sort | uniq -d)" ]
+workers="$(getconf _NPROCESSORS_ONLN)"
+[ "$(grep -c '"main"$' "${logdir}/threads")" -eq 1 ]
+[ "$(grep -c '"categories\[[0-9]*\]"$' "${logdir}/threads")" -eq "${workers}" ]
+[ "$(grep -c '"ports\[[0-9]*\]"$' "${logdir}/threads")" -eq "${workers}" ]
+[ "$(wc -l < "${logdir}/threads")" -eq $((2 * workers + 1)) ]
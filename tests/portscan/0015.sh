@@ -0,0 +1,11 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+${PORTSCAN} -p 0007 --stats=allocations 2>"${logdir}/stats" >/dev/null
+grep -q '^  "allocations": {$' "${logdir}/stats"
+grep -Eq '^    "tokens": \{ "allocations": [1-9][0-9]*, "bytes": [1-9][0-9]*, "peak_bytes": [1-9][0-9]* \},$' "${logdir}/stats"
+# The counting allocator is only installed on request
+${PORTSCAN} -p 0007 --stats 2>"${logdir}/stats" >/dev/null
+grep -q '"tokens_created"' "${logdir}/stats"
+grep -q '"allocations"' "${logdir}/stats" && exit 1
+if ${PORTSCAN} -p 0007 --stats=foo 2>/dev/null; then
+	exit 1
+fi
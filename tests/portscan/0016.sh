@@ -0,0 +1,34 @@
+logdir="$(mktemp -dt portscan-test.XXXXXXX)"
+# Conflicting options are rejected before anything is watched
+if ${PORTSCAN} -p 0007 --watch --shard=1/2 2>"${logdir}/err"; then
+	exit 1
+fi
+grep -q -- '--shard cannot be used with --watch' "${logdir}/err"
+if ${PORTSCAN} -p 0007 --watch --format=ndjson 2>"${logdir}/err"; then
+	exit 1
+fi
+grep -q -- '--format=ndjson cannot be used with -l or --watch' "${logdir}/err"
+
+# Without inotify --watch fails right away.  Otherwise the initial
+# scan is reported as changes and it keeps running until killed.
+${PORTSCAN} -p 0007 --watch >"${logdir}/out" 2>"${logdir}/err" &
+pid=$!
+i=0
+while [ ${i} -lt 100 ] && kill -0 ${pid} 2>/dev/null && [ "$(wc -l < "${logdir}/out")" -lt 2 ]; do
+	sleep 0.1
+	i=$((i + 1))
+done
+if kill -0 ${pid} 2>/dev/null; then
+	kill ${pid}
+	wait ${pid} || true
+	cat <<EOF | diff -u - "${logdir}/out"
+{"change":"added","type":"C","origin":"devel","value":"unsorted category or other formatting issues"}
+{"change":"added","type":"V","origin":"devel/foo","value":"PY_DEPENDS"}
+EOF
+else
+	status=0
+	wait ${pid} || status=$?
+	[ ${status} -eq 1 ]
+	[ ! -s "${logdir}/out" ]
+	grep -q '^portscan: portscan_watch_new: 0007: ' "${logdir}/err"
+fi
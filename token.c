@@ -28,18 +28,23 @@
 
 #include "config.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <libias/util.h>
 
+#include "allocator.h"
 #include "conditional.h"
+#include "stats.h"
 #include "target.h"
 #include "token.h"
 #include "variable.h"
 
 struct Token {
 	enum TokenType type;
+	// Flags are not copied by token_clone()
+	unsigned char flags;
 	char *data;
 	struct Conditional *cond;
 	struct Variable *var;
@@ -80,12 +85,13 @@ token_new(enum TokenType type, struct Range *lines, const char *data,
 		return NULL;
 	}
 
-	struct Token *t = xmalloc(sizeof(struct Token));
+	struct Token *t = allocator_alloc(ALLOCATOR_TOKENS, sizeof(struct Token));
 	t->type = type;
+	STATS_TOKEN(t->type);
 	t->lines = *lines;
 
 	if (data) {
-		t->data = xstrdup(data);
+		t->data = allocator_strdup(ALLOCATOR_TOKENS, data);
 	}
 	t->cond = cond;
 	t->target = target;
@@ -101,13 +107,14 @@ token_new_comment(struct Range *lines, const char *data, struct Conditional *con
 		return NULL;
 	}
 
-	struct Token *t = xmalloc(sizeof(struct Token));
+	struct Token *t = allocator_alloc(ALLOCATOR_TOKENS, sizeof(struct Token));
 	t->type = COMMENT;
+	STATS_TOKEN(t->type);
 	t->lines = *lines;
 	if (cond) {
 		t->cond = conditional_clone(cond);
 	}
-	t->data = xstrdup(data);
+	t->data = allocator_strdup(ALLOCATOR_TOKENS, data);
 	return t;
 }
 
@@ -118,8 +125,9 @@ token_new_variable_end(struct Range *lines, struct Variable *var)
 		return NULL;
 	}
 
-	struct Token *t = xmalloc(sizeof(struct Token));
+	struct Token *t = allocator_alloc(ALLOCATOR_TOKENS, sizeof(struct Token));
 	t->type = VARIABLE_END;
+	STATS_TOKEN(t->type);
 	t->lines = *lines;
 	t->var = variable_clone(var);
 
@@ -133,8 +141,9 @@ token_new_variable_start(struct Range *lines, struct Variable *var)
 		return NULL;
 	}
 
-	struct Token *t = xmalloc(sizeof(struct Token));
+	struct Token *t = allocator_alloc(ALLOCATOR_TOKENS, sizeof(struct Token));
 	t->type = VARIABLE_START;
+	STATS_TOKEN(t->type);
 	t->lines = *lines;
 	t->var = variable_clone(var);
 
@@ -148,11 +157,12 @@ token_new_variable_token(struct Range *lines, struct Variable *var, const char *
 		return NULL;
 	}
 
-	struct Token *t = xmalloc(sizeof(struct Token));
+	struct Token *t = allocator_alloc(ALLOCATOR_TOKENS, sizeof(struct Token));
 	t->type = VARIABLE_TOKEN;
+	STATS_TOKEN(t->type);
 	t->lines = *lines;
 	t->var = variable_clone(var);
-	t->data = xstrdup(data);
+	t->data = allocator_strdup(ALLOCATOR_TOKENS, data);
 
 	return t;
 }
@@ -163,11 +173,19 @@ token_free(struct Token *token)
 	if (token == NULL) {
 		return;
 	}
-	free(token->data);
+	allocator_free(ALLOCATOR_TOKENS, token->data);
 	conditional_free(token->cond);
 	variable_free(token->var);
 	target_free(token->target);
-	free(token);
+	allocator_free(ALLOCATOR_TOKENS, token);
+}
+
+size_t
+token_memory_usage(struct Token *token)
+{
+	// The data string and the objects a token points to are
+	// accounted for separately.
+	return sizeof(struct Token);
 }
 
 struct Token *
@@ -179,13 +197,14 @@ token_as_comment(struct Token *token)
 struct Token *
 token_clone(struct Token *token, const char *newdata)
 {
-	struct Token *t = xmalloc(sizeof(struct Token));
+	struct Token *t = allocator_alloc(ALLOCATOR_TOKENS, sizeof(struct Token));
 
 	t->type = token->type;
+	STATS_TOKEN(t->type);
 	if (newdata) {
-		t->data = xstrdup(newdata);
+		t->data = allocator_strdup(ALLOCATOR_TOKENS, newdata);
 	} else if (token->data) {
-		t->data = xstrdup(token->data);
+		t->data = allocator_strdup(ALLOCATOR_TOKENS, token->data);
 	}
 	if (token->cond) {
 		t->cond = conditional_clone(token->cond);
@@ -214,6 +233,12 @@ token_data(struct Token *token)
 	return token->data;
 }
 
+enum TokenFlags
+token_flags(struct Token *token)
+{
+	return token->flags;
+}
+
 int
 token_goalcol(struct Token *token)
 {
@@ -278,6 +303,12 @@ token_variable(struct Token *token)
 	return token->var;
 }
 
+void
+token_set_flags(struct Token *token, enum TokenFlags flags)
+{
+	token->flags = flags;
+}
+
 void
 token_set_goalcol(struct Token *token, int goalcol)
 {
@@ -42,6 +42,13 @@ enum TokenType {
 	VARIABLE_TOKEN,
 };
 
+enum TokenFlags {
+	TOKEN_EDITED = 1 << 0,
+	// Scratch bit for passes over the token array, always cleared
+	// again after use
+	TOKEN_VISITED = 1 << 1,
+};
+
 struct Range {
 	size_t start;
 	size_t end;
@@ -58,14 +65,17 @@ struct Token *token_new_variable_end(struct Range *, struct Variable *);
 struct Token *token_new_variable_start(struct Range *, struct Variable *);
 struct Token *token_new_variable_token(struct Range *, struct Variable *, const char *);
 void token_free(struct Token *);
+size_t token_memory_usage(struct Token *);
 struct Token *token_as_comment(struct Token *);
 struct Token *token_clone(struct Token *, const char *);
 struct Conditional *token_conditional(struct Token *);
 char *token_data(struct Token *);
+enum TokenFlags token_flags(struct Token *);
 int token_goalcol(struct Token *);
 struct Range *token_lines(struct Token *);
 struct Target *token_target(struct Token *);
 enum TokenType token_type(struct Token *);
 const char *token_type_tostring(enum TokenType);
 struct Variable *token_variable(struct Token *);
+void token_set_flags(struct Token *, enum TokenFlags);
 void token_set_goalcol(struct Token *, int);
@@ -0,0 +1,424 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libias/array.h>
+#include <libias/map.h>
+#include <libias/util.h>
+
+#include "hashfn.h"
+#include "stats.h"
+#include "token.h"
+#include "tokencache.h"
+
+// Bump this whenever the tokenizer in parser.c or enum TokenType
+// changes so that stale entries are ignored.
+#define TOKEN_CACHE_VERSION 1
+#define TOKEN_CACHE_MAGIC "PFTC"
+
+// Entries are written in host byte order.  A header
+//	magic[4] version:u32 len:u64 check:u64 nstrings:u32 nentries:u32
+//	lines.start:u32 lines.end:u32 in_target:u32 condname:u32 targetname:u32
+// is followed by the string table (len:u32 and the bytes of every
+// string) and then by the entries
+//	type:u32 lines.start:u32 lines.end:u32 data:u32 varname:u32 condname:u32 targetname:u32
+// Strings are referenced by their 1-based index and 0 means NULL.
+struct TokenCache {
+	int dirfd;
+	pthread_mutex_t mutex;
+	unsigned long tmpfiles;
+};
+
+struct TokenCacheReader {
+	const unsigned char *buf;
+	size_t len;
+	size_t pos;
+};
+
+static int read_string(struct TokenCacheReader *, struct TokenStream *, char **);
+static int read_u32(struct TokenCacheReader *, uint32_t *);
+static int read_u64(struct TokenCacheReader *, uint64_t *);
+static struct TokenStream *token_cache_parse(const unsigned char *, size_t, const char *, size_t);
+static void write_string(FILE *, struct TokenStream *, const char *);
+static void write_u32(FILE *, uint32_t);
+static void write_u64(FILE *, uint64_t);
+
+int
+read_u32(struct TokenCacheReader *r, uint32_t *value)
+{
+	if (r->pos > r->len || r->len - r->pos < sizeof(*value)) {
+		return 0;
+	}
+	memcpy(value, r->buf + r->pos, sizeof(*value));
+	r->pos += sizeof(*value);
+	return 1;
+}
+
+int
+read_u64(struct TokenCacheReader *r, uint64_t *value)
+{
+	if (r->pos > r->len || r->len - r->pos < sizeof(*value)) {
+		return 0;
+	}
+	memcpy(value, r->buf + r->pos, sizeof(*value));
+	r->pos += sizeof(*value);
+	return 1;
+}
+
+int
+read_string(struct TokenCacheReader *r, struct TokenStream *stream, char **s)
+{
+	uint32_t index;
+	if (!read_u32(r, &index) || index > array_len(stream->strings)) {
+		return 0;
+	}
+	if (index == 0) {
+		*s = NULL;
+	} else {
+		*s = array_get(stream->strings, index - 1);
+	}
+	return 1;
+}
+
+void
+write_u32(FILE *fp, uint32_t value)
+{
+	fwrite(&value, sizeof(value), 1, fp);
+}
+
+void
+write_u64(FILE *fp, uint64_t value)
+{
+	fwrite(&value, sizeof(value), 1, fp);
+}
+
+void
+write_string(FILE *fp, struct TokenStream *stream, const char *s)
+{
+	if (s == NULL) {
+		write_u32(fp, 0);
+	} else {
+		write_u32(fp, (uintptr_t)map_get(stream->index, s));
+	}
+}
+
+struct TokenCache *
+token_cache_open(const char *path)
+{
+	if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+		return NULL;
+	}
+	int dirfd = open(path, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+	if (dirfd == -1) {
+		return NULL;
+	}
+
+	struct TokenCache *cache = xmalloc(sizeof(struct TokenCache));
+	cache->dirfd = dirfd;
+	pthread_mutex_init(&cache->mutex, NULL);
+	return cache;
+}
+
+void
+token_cache_close(struct TokenCache *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+	close(cache->dirfd);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+}
+
+struct TokenStream *
+token_cache_parse(const unsigned char *buf, size_t buflen, const char *content, size_t len)
+{
+	struct TokenCacheReader r = { buf, buflen, 0 };
+	if (buflen < strlen(TOKEN_CACHE_MAGIC) ||
+	    memcmp(buf, TOKEN_CACHE_MAGIC, strlen(TOKEN_CACHE_MAGIC)) != 0) {
+		return NULL;
+	}
+	r.pos += strlen(TOKEN_CACHE_MAGIC);
+
+	uint32_t version, nstrings, nentries, start, end, in_target;
+	uint64_t cached_len, check;
+	if (!read_u32(&r, &version) || version != TOKEN_CACHE_VERSION ||
+	    !read_u64(&r, &cached_len) || cached_len != len ||
+	    !read_u64(&r, &check) || check != hash_check(content, len) ||
+	    !read_u32(&r, &nstrings) || !read_u32(&r, &nentries) ||
+	    !read_u32(&r, &start) || !read_u32(&r, &end) ||
+	    !read_u32(&r, &in_target)) {
+		return NULL;
+	}
+	// condname and targetname follow but need the string table
+	size_t state = r.pos;
+	if (r.len - r.pos < 2 * sizeof(uint32_t)) {
+		return NULL;
+	}
+	r.pos += 2 * sizeof(uint32_t);
+
+	struct TokenStream *stream = token_stream_new();
+	stream->lines.start = start;
+	stream->lines.end = end;
+	stream->in_target = in_target;
+	for (uint32_t i = 0; i < nstrings; i++) {
+		uint32_t slen;
+		if (!read_u32(&r, &slen) || r.pos > r.len || r.len - r.pos < slen) {
+			goto fail;
+		}
+		char *s = xstrndup((const char *)r.buf + r.pos, slen);
+		r.pos += slen;
+		if (strlen(s) != slen || map_contains(stream->index, s)) {
+			free(s);
+			goto fail;
+		}
+		array_append(stream->strings, s);
+		map_add(stream->index, s, (void *)(uintptr_t)array_len(stream->strings));
+	}
+
+	size_t entries = r.pos;
+	r.pos = state;
+	if (!read_string(&r, stream, &stream->condname) ||
+	    !read_string(&r, stream, &stream->targetname)) {
+		goto fail;
+	}
+	r.pos = entries;
+
+	for (uint32_t i = 0; i < nentries; i++) {
+		uint32_t type;
+		struct TokenStreamEntry *e = xmalloc(sizeof(struct TokenStreamEntry));
+		array_append(stream->entries, e);
+		if (!read_u32(&r, &type) || type > VARIABLE_TOKEN ||
+		    !read_u32(&r, &start) || !read_u32(&r, &end) ||
+		    !read_string(&r, stream, &e->data) ||
+		    !read_string(&r, stream, &e->varname) ||
+		    !read_string(&r, stream, &e->condname) ||
+		    !read_string(&r, stream, &e->targetname)) {
+			goto fail;
+		}
+		e->type = type;
+		e->lines.start = start;
+		e->lines.end = end;
+	}
+	if (r.pos != r.len) {
+		goto fail;
+	}
+
+	return stream;
+
+fail:
+	token_stream_free(stream);
+	return NULL;
+}
+
+// Returns the token stream of the file with the given content or NULL
+// if it is not in the cache.
+struct TokenStream *
+token_cache_get(struct TokenCache *cache, const char *content, size_t len)
+{
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash_bytes(HASH_INIT, content, len));
+
+	struct TokenStream *stream = NULL;
+	unsigned char *buf = NULL;
+	int fd = openat(cache->dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		goto done;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		goto done;
+	}
+	size_t buflen = st.st_size;
+	buf = xmalloc(buflen + 1);
+	size_t pos = 0;
+	while (pos < buflen) {
+		ssize_t n = read(fd, buf + pos, buflen - pos);
+		if (n <= 0) {
+			goto done;
+		}
+		pos += n;
+	}
+	stream = token_cache_parse(buf, buflen, content, len);
+
+done:
+	if (fd != -1) {
+		close(fd);
+	}
+	free(buf);
+	if (stream) {
+		STATS_INC(STATS_TOKEN_CACHE_HITS);
+	} else {
+		STATS_INC(STATS_TOKEN_CACHE_MISSES);
+	}
+	return stream;
+}
+
+// Stores the token stream of the file with the given content.  The
+// cache is only an optimization, so errors are ignored and at worst
+// the file is tokenized again next time.
+void
+token_cache_put(struct TokenCache *cache, const char *content, size_t len, struct TokenStream *stream)
+{
+	char *buf = NULL;
+	size_t buflen = 0;
+	FILE *fp = open_memstream(&buf, &buflen);
+	if (fp == NULL) {
+		return;
+	}
+	fwrite(TOKEN_CACHE_MAGIC, strlen(TOKEN_CACHE_MAGIC), 1, fp);
+	write_u32(fp, TOKEN_CACHE_VERSION);
+	write_u64(fp, len);
+	write_u64(fp, hash_check(content, len));
+	write_u32(fp, array_len(stream->strings));
+	write_u32(fp, array_len(stream->entries));
+	write_u32(fp, stream->lines.start);
+	write_u32(fp, stream->lines.end);
+	write_u32(fp, stream->in_target);
+	write_string(fp, stream, stream->condname);
+	write_string(fp, stream, stream->targetname);
+	ARRAY_FOREACH(stream->strings, const char *, s) {
+		size_t slen = strlen(s);
+		write_u32(fp, slen);
+		fwrite(s, 1, slen, fp);
+	}
+	ARRAY_FOREACH(stream->entries, struct TokenStreamEntry *, e) {
+		write_u32(fp, e->type);
+		write_u32(fp, e->lines.start);
+		write_u32(fp, e->lines.end);
+		write_string(fp, stream, e->data);
+		write_string(fp, stream, e->varname);
+		write_string(fp, stream, e->condname);
+		write_string(fp, stream, e->targetname);
+	}
+	if (fclose(fp) != 0) {
+		free(buf);
+		return;
+	}
+
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash_bytes(HASH_INIT, content, len));
+	pthread_mutex_lock(&cache->mutex);
+	char *tmpname = str_printf(".%s.%ld.%lu", name, (long)getpid(), cache->tmpfiles++);
+	pthread_mutex_unlock(&cache->mutex);
+
+	// Write to a temporary file first so that concurrent readers
+	// never see partial entries.
+	int fd = openat(cache->dirfd, tmpname, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd != -1) {
+		size_t pos = 0;
+		while (pos < buflen) {
+			ssize_t n = write(fd, buf + pos, buflen - pos);
+			if (n <= 0) {
+				break;
+			}
+			pos += n;
+		}
+		if (close(fd) == -1 || pos < buflen ||
+		    renameat(cache->dirfd, tmpname, cache->dirfd, name) == -1) {
+			unlinkat(cache->dirfd, tmpname, 0);
+		}
+	}
+
+	free(tmpname);
+	free(buf);
+}
+
+struct TokenStream *
+token_stream_new()
+{
+	struct TokenStream *stream = xmalloc(sizeof(struct TokenStream));
+	stream->entries = array_new();
+	stream->strings = array_new();
+	stream->index = map_new(str_compare, NULL, NULL, NULL);
+	stream->lines.start = 1;
+	stream->lines.end = 1;
+	return stream;
+}
+
+void
+token_stream_free(struct TokenStream *stream)
+{
+	if (stream == NULL) {
+		return;
+	}
+
+	ARRAY_FOREACH(stream->entries, struct TokenStreamEntry *, e) {
+		free(e);
+	}
+	array_free(stream->entries);
+	map_free(stream->index);
+	ARRAY_FOREACH(stream->strings, char *, s) {
+		free(s);
+	}
+	array_free(stream->strings);
+	free(stream);
+}
+
+void
+token_stream_append(struct TokenStream *stream, enum TokenType type, struct Range *lines, const char *data, const char *varname, const char *condname, const char *targetname)
+{
+	struct TokenStreamEntry *e = xmalloc(sizeof(struct TokenStreamEntry));
+	e->type = type;
+	e->lines = *lines;
+	e->data = token_stream_intern(stream, data);
+	e->varname = token_stream_intern(stream, varname);
+	e->condname = token_stream_intern(stream, condname);
+	e->targetname = token_stream_intern(stream, targetname);
+	array_append(stream->entries, e);
+}
+
+char *
+token_stream_intern(struct TokenStream *stream, const char *s)
+{
+	if (s == NULL) {
+		return NULL;
+	}
+
+	uintptr_t index = (uintptr_t)map_get(stream->index, s);
+	if (index > 0) {
+		return array_get(stream->strings, index - 1);
+	}
+
+	char *copy = xstrdup(s);
+	array_append(stream->strings, copy);
+	map_add(stream->index, copy, (void *)(uintptr_t)array_len(stream->strings));
+	return copy;
+}
@@ -0,0 +1,68 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Copyright (c) 2021 Tobias Kortkamp <tobik@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#pragma once
+
+// An on-disk cache of tokenized Makefiles.  Entries are keyed by a
+// hash of the file content, so that portclippy, portedit, portfmt,
+// and portscan can all reuse the token stream of an unchanged file
+// no matter which flags they run with.
+struct Array;
+struct Map;
+struct TokenCache;
+
+// The arguments of every token_new() call the tokenizer made and the
+// tokenizer state after the last line.  Strings are interned and
+// owned by the stream.
+struct TokenStreamEntry {
+	enum TokenType type;
+	struct Range lines;
+	char *data;
+	char *varname;
+	char *condname;
+	char *targetname;
+};
+
+struct TokenStream {
+	struct Array *entries;
+	struct Range lines;
+	int in_target;
+	char *condname;
+	char *targetname;
+	struct Array *strings;
+	struct Map *index;
+};
+
+struct TokenCache *token_cache_open(const char *);
+void token_cache_close(struct TokenCache *);
+struct TokenStream *token_cache_get(struct TokenCache *, const char *, size_t);
+void token_cache_put(struct TokenCache *, const char *, size_t, struct TokenStream *);
+
+struct TokenStream *token_stream_new(void);
+void token_stream_free(struct TokenStream *);
+void token_stream_append(struct TokenStream *, enum TokenType, struct Range *, const char *, const char *, const char *, const char *);
+char *token_stream_intern(struct TokenStream *, const char *);
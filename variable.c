@@ -113,6 +113,12 @@ variable_free(struct Variable *var)
 	free(var);
 }
 
+size_t
+variable_memory_usage(struct Variable *var)
+{
+	return sizeof(struct Variable) + strlen(var->name) + 1;
+}
+
 int
 variable_cmp(struct Variable *a, struct Variable *b)
 {
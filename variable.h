@@ -42,6 +42,7 @@ struct Variable *variable_clone(struct Variable *);
 int variable_cmp(struct Variable *, struct Variable *);
 int variable_compare(const void *, const void *, void *);
 void variable_free(struct Variable *);
+size_t variable_memory_usage(struct Variable *);
 enum VariableModifier variable_modifier(struct Variable *);
 void variable_set_modifier(struct Variable *, enum VariableModifier);
 char *variable_name(struct Variable *);